@@ -43,6 +43,7 @@ ExternalProject_Add(binaryen
     BINARY_DIR ${binary_dir}
     URL https://github.com/WebAssembly/binaryen/archive/1.37.35.tar.gz
     URL_HASH SHA256=19439e41dc576446eaae0c4a8e07d4cd4c40aea7dfb0a6475b925686852f8006
+    PATCH_COMMAND patch -p1 -l -i ${CMAKE_CURRENT_LIST_DIR}/binaryen.patch
     CMAKE_ARGS
     -DCMAKE_INSTALL_PREFIX=<INSTALL_DIR>
     -DCMAKE_INSTALL_LIBDIR=lib
@@ -26,6 +26,145 @@ extern "C" {
 
 EVMC_EXPORT struct evmc_instance* evmc_create_hera(void) EVMC_NOEXCEPT;
 
+/// A single message of a batch, with the code to execute it against.
+struct hera_batch_item {
+  struct evmc_context* context;
+  enum evmc_revision rev;
+  const struct evmc_message* msg;
+  const uint8_t* code;
+  size_t code_size;
+};
+
+/// The output buffers of a batch. They are placed into a few large blocks as
+/// the messages complete and owned by Hera until hera_release_batch() is
+/// called.
+struct hera_batch_arena;
+
+/// Executes @count independent messages on @instance and stores their
+/// results in @results, which must have room for @count entries. Each one
+/// is executed, recorded and traced as if passed to execute().
+///
+/// Up to @num_threads threads are used (0 or 1 executes on the calling
+/// thread): the calling thread and threads Hera keeps across batches. With
+/// more than one thread the items may run concurrently, so
+/// their contexts must tolerate that. Engines which cannot run concurrently
+/// always execute the batch on the calling thread.
+///
+/// The release functions of the results do nothing: their output data points
+/// into the returned arena, which must be released with hera_release_batch().
+/// Returns NULL if the arena could not be allocated, in which case every
+/// result has the status EVMC_INTERNAL_ERROR. So does a single result whose
+/// output found no room.
+EVMC_EXPORT struct hera_batch_arena* hera_execute_batch(
+  struct evmc_instance* instance,
+  const struct hera_batch_item* items,
+  struct evmc_result* results,
+  size_t count,
+  unsigned num_threads
+) EVMC_NOEXCEPT;
+
+/// Lets the state lookups of a batch complete asynchronously, so that
+/// executions waiting for state do not block the others.
+///
+/// Before Hera asks the host of an execution for a storage value, a balance
+/// or code (size or contents) it asks the matching function here whether
+/// the state is ready. If not, the execution is suspended and others are run
+/// meanwhile; the function is asked again after wait() returned. A function
+/// returning false should start loading the state, if it has not yet.
+///
+/// Like evmc_context, it is meant to be embedded into the structure of the
+/// implementation.
+struct hera_async_host {
+  bool (*storage_ready)(struct hera_async_host* host, const evmc_address* address, const evmc_bytes32* key);
+  bool (*balance_ready)(struct hera_async_host* host, const evmc_address* address);
+  bool (*code_ready)(struct hera_async_host* host, const evmc_address* address);
+  /// Blocks until some state a ready function returned false for was loaded.
+  void (*wait)(struct hera_async_host* host);
+};
+
+/// Executes @count independent messages on @instance like
+/// hera_execute_batch(), interleaving them on the calling thread: whenever
+/// one waits for state from @async_host, another runs.
+///
+/// The items may run concurrently in this sense, so their contexts must
+/// tolerate that. Engines which cannot run concurrently execute the items
+/// one after the other without suspending them.
+EVMC_EXPORT struct hera_batch_arena* hera_execute_async_batch(
+  struct evmc_instance* instance,
+  struct hera_async_host* async_host,
+  const struct hera_batch_item* items,
+  struct evmc_result* results,
+  size_t count
+) EVMC_NOEXCEPT;
+
+/// Releases the output buffers of a batch. Accepts NULL.
+EVMC_EXPORT void hera_release_batch(struct hera_batch_arena* arena) EVMC_NOEXCEPT;
+
+/// The memory held by an instance, in bytes. Caches are evicted to keep the
+/// total within the "memory-budget" option, if set.
+struct hera_memory_usage {
+  /// The "memory-budget" option, 0 if unlimited.
+  size_t budget;
+  size_t total;
+  size_t module_cache;
+  size_t static_call_cache;
+  /// Stacks in use and free ones kept for reuse, at the part which stays
+  /// committed between executions.
+  size_t fiber_stacks;
+  /// The linear memories and code of the executing contracts.
+  size_t instances;
+  /// The number of cache entries evicted to stay within the budget.
+  uint64_t evictions;
+};
+
+/// Reports the memory held by @instance.
+EVMC_EXPORT void hera_get_memory_usage(struct evmc_instance* instance, struct hera_memory_usage* usage) EVMC_NOEXCEPT;
+
+/// How often executions of an instance reached for memory of another NUMA
+/// node than the one they ran on.
+struct hera_numa_stats {
+  /// The number of NUMA nodes, 1 where Linux does not report them.
+  unsigned nodes;
+  /// Module cache hits which found the module only on another node, which
+  /// the execution then built again for its own.
+  uint64_t module_cache_remote_hits;
+  /// Fiber stacks taken from another node for want of a free local one.
+  uint64_t fiber_stack_remote_reuses;
+};
+
+/// Reports the NUMA counters of @instance.
+EVMC_EXPORT void hera_get_numa_stats(struct evmc_instance* instance, struct hera_numa_stats* stats) EVMC_NOEXCEPT;
+
+/// The time executions of an instance spent in each phase, collected while
+/// the "phase-times" option is "true". Each phase runs until the next one
+/// starts. A phase an execution skips, such as validation on a module cache
+/// hit, counts towards the next one it reaches. Nested executions are timed
+/// on their own and, where they share a fiber, not in their caller's run.
+struct hera_phase_times {
+  uint64_t executions;
+  /// Decoding the code, including compiling it for the baseline engine.
+  uint64_t parse_ns;
+  uint64_t validate_ns;
+  /// Resolving imports and setting up the instance and its memory.
+  uint64_t instantiate_ns;
+  /// Running the code until the execution returns.
+  uint64_t run_ns;
+};
+
+/// Reports the phase times of @instance, zeros without "phase-times".
+EVMC_EXPORT void hera_get_phase_times(struct evmc_instance* instance, struct hera_phase_times* times) EVMC_NOEXCEPT;
+
+/// Returns the smallest starting gas with which the execution behind @result
+/// would have ended the same way, so gas can be estimated in a single run.
+///
+/// Only available when the "gas-estimation" option is set to "true", and only
+/// for successful or reverted executions; returns 0 otherwise. Sub-calls are
+/// accounted for with the gas they used, so a callee which itself depends on
+/// the 63/64 forwarding rule may need a larger figure. The figure is kept in
+/// the optional storage of @result, which must be a result of Hera or a copy
+/// of one.
+EVMC_EXPORT int64_t hera_get_required_gas(const struct evmc_result* result) EVMC_NOEXCEPT;
+
 #if __cplusplus
 }
 #endif
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+
+# Executes every byte which is not a Byzantium instruction, on an empty stack,
+# with the EVM1 interpreter. Each must fail without touching the stack.
+#
+# Usage: evm1-opcode-tests.sh [path to hera-run]
+
+set -e
+
+HERA_RUN=${1:-hera-run}
+CONTRACT=$(mktemp)
+trap 'rm -f "$CONTRACT"' EXIT
+
+undefined() {
+  local op=$1
+  (( (op >= 0x0c && op <= 0x0f) || (op >= 0x1b && op <= 0x1f) || (op >= 0x21 && op <= 0x2f) ||
+     op == 0x3f || (op >= 0x46 && op <= 0x4f) || (op >= 0x5c && op <= 0x5f) ||
+     (op >= 0xa5 && op <= 0xef) || (op >= 0xf5 && op <= 0xf9) || op == 0xfb || op == 0xfc || op == 0xfe ))
+}
+
+failed=0
+for op in $(seq 0 255); do
+  undefined $op || continue
+  printf "\\x$(printf %02x $op)" > "$CONTRACT"
+  status=$("$HERA_RUN" --gas 100000 evm1mode=interpret "$CONTRACT" | sed -n 's/^status: \(.*\) (.*/\1/p' || true)
+  if [ "$status" != "failure" ]; then
+    echo "0x$(printf %02x $op): $status"
+    failed=1
+  fi
+done
+
+if [ $failed -ne 0 ]; then
+  echo "undefined instructions did not fail."
+  exit 1
+fi
+echo "all undefined instructions failed."
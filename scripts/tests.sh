@@ -32,3 +32,12 @@ git clone https://github.com/ewasm/tests -b wasm-tests --single-branch
 
 echo "run ewasm tests."
 ${TESTETH} -t GeneralStateTests/stEWASMTests -- --testpath ./tests --vm hera --singlenet "Byzantium"
+
+echo "fetch ethereum tests."
+git clone https://github.com/ethereum/tests ethereum-tests
+
+echo "run state tests with the EVM1 interpreter."
+${TESTETH} -t GeneralStateTests -- --testpath ./ethereum-tests --vm hera --evmc evm1mode=interpret --singlenet "Byzantium"
+
+echo "run ewasm tests with the baseline compiler."
+${TESTETH} -t GeneralStateTests/stEWASMTests -- --testpath ./tests --vm hera --evmc engine=baseline --singlenet "Byzantium"
@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+
+# Counts the TLB misses of contracts executed by hera-run without and with
+# huge pages, for each engine, with perf stat. The figures depend on the
+# CPU, the kernel and its transparent huge page setting, so they are to be
+# measured on the machine Hera runs on.
+#
+# Usage: tlb-bench.sh <contract.wasm>...
+#
+# HERA_RUN (default hera-run), REPEAT (default 1000) and ENGINES (default
+# "baseline binaryen") can be set in the environment.
+
+set -e
+
+HERA_RUN=${HERA_RUN:-hera-run}
+REPEAT=${REPEAT:-1000}
+ENGINES=${ENGINES:-"baseline binaryen"}
+EVENTS=dTLB-load-misses,iTLB-load-misses
+
+if [ $# -eq 0 ]
+then
+  echo "Usage: $0 <contract.wasm>..." >&2
+  exit 1
+fi
+
+echo "transparent huge pages: $(cat /sys/kernel/mm/transparent_hugepage/enabled)"
+echo "reserved huge pages: $(cat /proc/sys/vm/nr_hugepages)"
+
+STATS=$(mktemp)
+trap 'rm -f $STATS' EXIT
+
+# Prints the dTLB and iTLB load misses of hera-run with the given options.
+count() {
+  perf stat -x, -e $EVENTS -o $STATS -- $HERA_RUN --repeat $REPEAT "$@" > /dev/null
+  awk -F, '$3 == "dTLB-load-misses" { d = $1 } $3 == "iTLB-load-misses" { i = $1 } END { print d, i }' $STATS
+}
+
+# Prints the reduction from $1 to $2 in percent.
+reduction() {
+  awk -v before=$1 -v after=$2 'BEGIN { if (before + 0 > 0) printf "%.1f%%", (before - after) * 100 / before; else print "-" }'
+}
+
+printf "%-32s %-10s %16s %16s %8s %16s %16s %8s\n" contract engine \
+  "dTLB off" "dTLB on" "" "iTLB off" "iTLB on" ""
+for contract in "$@"
+do
+  for engine in $ENGINES
+  do
+    read dOff iOff < <(count engine=$engine huge-pages=false $contract)
+    read dOn iOn < <(count engine=$engine huge-pages=true $contract)
+    printf "%-32s %-10s %16s %16s %8s %16s %16s %8s\n" $(basename $contract) $engine \
+      $dOff $dOn $(reduction $dOff $dOn) $iOff $iOn $(reduction $iOff $iOn)
+  done
+done
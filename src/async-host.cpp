@@ -0,0 +1,116 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "async-host.h"
+
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+namespace hera {
+
+constexpr size_t AsyncScheduler::maxSuspended;
+
+thread_local AsyncScheduler* AsyncScheduler::s_current = nullptr;
+
+AsyncScheduler* AsyncScheduler::current()
+{
+  // Only tasks can be suspended, not the scheduler itself.
+  return Fiber::current() ? s_current : nullptr;
+}
+
+void AsyncScheduler::awaitStorage(evmc_address const& address, evmc_bytes32 const& key)
+{
+  AsyncScheduler* scheduler = current();
+  if (!scheduler)
+    return;
+  hera_async_host* host = scheduler->m_host;
+  while (!host->storage_ready(host, &address, &key))
+    Fiber::suspend();
+}
+
+void AsyncScheduler::awaitBalance(evmc_address const& address)
+{
+  AsyncScheduler* scheduler = current();
+  if (!scheduler)
+    return;
+  hera_async_host* host = scheduler->m_host;
+  while (!host->balance_ready(host, &address))
+    Fiber::suspend();
+}
+
+void AsyncScheduler::awaitCode(evmc_address const& address)
+{
+  AsyncScheduler* scheduler = current();
+  if (!scheduler)
+    return;
+  hera_async_host* host = scheduler->m_host;
+  while (!host->code_ready(host, &address))
+    Fiber::suspend();
+}
+
+void AsyncScheduler::run(vector<function<void()>> const& tasks)
+{
+  vector<unique_ptr<Fiber>> fibers(tasks.size());
+
+  // Neither outgrows this, so nothing throws while tasks are suspended.
+  size_t capacity = min(tasks.size(), maxSuspended);
+  vector<size_t> ready;
+  ready.reserve(capacity);
+  vector<size_t> suspended;
+  suspended.reserve(capacity);
+
+  AsyncScheduler* previous = s_current;
+  s_current = this;
+
+  // Suspended tasks are resumed before new ones are started. Nothing tells
+  // which loads completed, so all of them are retried after a wait.
+  size_t started = 0;
+  size_t nextReady = 0;
+  while (started < tasks.size() || nextReady < ready.size() || !suspended.empty()) {
+    size_t i;
+    if (nextReady < ready.size()) {
+      i = ready[nextReady++];
+    } else if (started < tasks.size() && suspended.size() < maxSuspended) {
+      i = started++;
+      try {
+        fibers[i].reset(new Fiber(m_pool, tasks[i]));
+      } catch (...) {
+        tasks[i]();
+        continue;
+      }
+    } else {
+      m_host->wait(m_host);
+      ready.swap(suspended);
+      suspended.clear();
+      nextReady = 0;
+      continue;
+    }
+
+    if (!fibers[i]->resume())
+      tasks[i]();
+    else if (!fibers[i]->finished()) {
+      suspended.push_back(i);
+      continue;
+    }
+    fibers[i].reset();
+  }
+
+  s_current = previous;
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <evmc/evmc.h>
+#include <hera/hera.h>
+
+#include "fiber.h"
+
+namespace hera {
+
+// Runs independent tasks interleaved on the calling thread, each on a fiber
+// of its own. A task which needs state the async host has not loaded yet
+// suspends, and the others run until the host has loaded some.
+class AsyncScheduler {
+public:
+  // Every suspended task holds a stack, so no more tasks are started while
+  // this many are suspended.
+  static constexpr size_t maxSuspended = 1024;
+
+  AsyncScheduler(hera_async_host* host, FiberPool& pool): m_host(host), m_pool(pool) {}
+
+  AsyncScheduler(AsyncScheduler const&) = delete;
+  AsyncScheduler& operator=(AsyncScheduler const&) = delete;
+
+  // Runs every task to completion. Tasks must not throw. A task for which no
+  // fiber is available runs directly, blocking the others.
+  void run(std::vector<std::function<void()>> const& tasks);
+
+  // To be called before the host is asked for the given state. Suspends the
+  // calling task until the async host has loaded it. Does nothing outside
+  // of a task.
+  static void awaitStorage(evmc_address const& address, evmc_bytes32 const& key);
+  static void awaitBalance(evmc_address const& address);
+  static void awaitCode(evmc_address const& address);
+
+private:
+  // The scheduler of the current thread, while it runs tasks.
+  static AsyncScheduler* current();
+
+  hera_async_host* m_host;
+  FiberPool& m_pool;
+
+  static thread_local AsyncScheduler* s_current;
+};
+
+}
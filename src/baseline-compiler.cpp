@@ -0,0 +1,1864 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "baseline-compiler.h"
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <set>
+
+#include "exceptions.h"
+#include "fiber.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+/*
+ * Module structure
+ */
+
+enum ValType : uint8_t {
+  // Any type, popped from the stack of unreachable code.
+  AnyType = 0,
+  I32 = 0x7f,
+  I64 = 0x7e,
+  F32 = 0x7d,
+  F64 = 0x7c
+};
+
+struct Signature {
+  vector<ValType> params;
+  vector<ValType> results;
+};
+
+bool operator==(Signature const& a, Signature const& b)
+{
+  return a.params == b.params && a.results == b.results;
+}
+
+enum class Trap : uint32_t {
+  Unreachable,
+  DivideByZero,
+  IntegerOverflow,
+  OutOfBounds,
+  StackExhausted,
+  IndirectCallMismatch,
+  UndefinedElement,
+  Count
+};
+
+char const* trapMessage(uint32_t kind)
+{
+  static char const* const messages[] = {
+    "unreachable executed",
+    "integer divide by zero",
+    "integer overflow",
+    "memory access out of bounds",
+    "call stack exhausted",
+    "indirect call signature mismatch",
+    "undefined table element"
+  };
+  return kind < static_cast<uint32_t>(Trap::Count) ? messages[kind] : "unknown trap";
+}
+
+const uint32_t pageSize = 65536;
+const uint32_t maxPages = 65536;
+const uint32_t maxLocals = 50000;
+const uint32_t maxTableSize = 10000000;
+
+// The signatures the EEI functions must be imported with.
+Signature eeiSignature(EEIFunction function)
+{
+  switch (function) {
+  case EEIFunction::useGas: return { { I64 }, {} };
+  case EEIFunction::getGasLeft: return { {}, { I64 } };
+  case EEIFunction::getAddress: return { { I32 }, {} };
+  case EEIFunction::getExternalBalance: return { { I32, I32 }, {} };
+  case EEIFunction::getBlockHash: return { { I64, I32 }, { I32 } };
+  case EEIFunction::getCallDataSize: return { {}, { I32 } };
+  case EEIFunction::callDataCopy: return { { I32, I32, I32 }, {} };
+  case EEIFunction::getCaller: return { { I32 }, {} };
+  case EEIFunction::getCallValue: return { { I32 }, {} };
+  case EEIFunction::codeCopy: return { { I32, I32, I32 }, {} };
+  case EEIFunction::getCodeSize: return { {}, { I32 } };
+  case EEIFunction::externalCodeCopy: return { { I32, I32, I32, I32 }, {} };
+  case EEIFunction::getExternalCodeSize: return { { I32 }, { I32 } };
+  case EEIFunction::getBlockCoinbase: return { { I32 }, {} };
+  case EEIFunction::getBlockDifficulty: return { { I32 }, {} };
+  case EEIFunction::getBlockGasLimit: return { {}, { I64 } };
+  case EEIFunction::getTxGasPrice: return { { I32 }, {} };
+  case EEIFunction::log: return { { I32, I32, I32, I32, I32, I32, I32 }, {} };
+  case EEIFunction::getBlockNumber: return { {}, { I64 } };
+  case EEIFunction::getBlockTimestamp: return { {}, { I64 } };
+  case EEIFunction::getTxOrigin: return { { I32 }, {} };
+  case EEIFunction::storageStore: return { { I32, I32 }, {} };
+  case EEIFunction::storageLoad: return { { I32, I32 }, {} };
+  case EEIFunction::finish: return { { I32, I32 }, {} };
+  case EEIFunction::revert: return { { I32, I32 }, {} };
+  case EEIFunction::getReturnDataSize: return { {}, { I32 } };
+  case EEIFunction::returnDataCopy: return { { I32, I32, I32 }, {} };
+  case EEIFunction::call: return { { I64, I32, I32, I32, I32 }, { I32 } };
+  case EEIFunction::callCode: return { { I64, I32, I32, I32, I32 }, { I32 } };
+  case EEIFunction::callDelegate: return { { I64, I32, I32, I32 }, { I32 } };
+  case EEIFunction::callStatic: return { { I64, I32, I32, I32 }, { I32 } };
+  case EEIFunction::create: return { { I32, I32, I32, I32 }, { I32 } };
+  case EEIFunction::selfDestruct: return { { I32 }, {} };
+  case EEIFunction::Unresolved: break;
+  }
+  heraAssert(false, "Unknown EEI function.");
+}
+
+// The signatures of the functions of the "debug" namespace, which are only
+// available in debugging builds.
+bool debugSignature(string const& base, Signature& signature)
+{
+#if HERA_DEBUGGING
+  if (base == "evmTrace") {
+    signature = { { I32, I32, I32, I32 }, {} };
+    return true;
+  }
+  if (base == "print32") {
+    signature = { { I32 }, {} };
+    return true;
+  }
+  if (base == "print64") {
+    signature = { { I64 }, {} };
+    return true;
+  }
+  if (base == "printMem" || base == "printMemHex") {
+    signature = { { I32, I32 }, {} };
+    return true;
+  }
+  if (base == "printStorage" || base == "printStorageHex") {
+    signature = { { I32 }, {} };
+    return true;
+  }
+#else
+  (void)base;
+  (void)signature;
+#endif
+  return false;
+}
+
+/*
+ * Binary reading
+ */
+
+class Reader {
+public:
+  Reader(uint8_t const* data, size_t size): m_pos(data), m_end(data + size) {}
+
+  bool done() const { return m_pos == m_end; }
+  size_t remaining() const { return static_cast<size_t>(m_end - m_pos); }
+
+  uint8_t byte()
+  {
+    ensureCondition(m_pos < m_end, ContractValidationFailure, "Unexpected end of contract.");
+    return *m_pos++;
+  }
+
+  uint32_t u32()
+  {
+    uint32_t result = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+      uint8_t b = byte();
+      if (shift == 28)
+        ensureCondition((b & 0xf0) == 0, ContractValidationFailure, "Integer representation too long.");
+      result |= static_cast<uint32_t>(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return result;
+    }
+  }
+
+  int32_t s32() { return static_cast<int32_t>(readSigned(32)); }
+  int64_t s64() { return readSigned(64); }
+
+  Reader sub(size_t size)
+  {
+    ensureCondition(size <= remaining(), ContractValidationFailure, "Section or body exceeds the contract.");
+    Reader result(m_pos, size);
+    m_pos += size;
+    return result;
+  }
+
+  string name()
+  {
+    Reader bytes = sub(u32());
+    return string(reinterpret_cast<char const*>(bytes.m_pos), bytes.remaining());
+  }
+
+  vector<uint8_t> bytes(size_t size)
+  {
+    Reader bytes = sub(size);
+    return vector<uint8_t>(bytes.m_pos, bytes.m_end);
+  }
+
+private:
+  int64_t readSigned(unsigned bits)
+  {
+    uint64_t result = 0;
+    unsigned shift = 0;
+    uint8_t b;
+    do {
+      b = byte();
+      result |= static_cast<uint64_t>(b & 0x7f) << shift;
+      shift += 7;
+      if (shift >= bits) {
+        // The unused bits of the last byte must extend the sign.
+        unsigned used = bits - (shift - 7);
+        uint8_t rest = static_cast<uint8_t>((b & 0x7f) >> (used - 1));
+        ensureCondition(
+          !(b & 0x80) && (rest == 0 || rest == (0x7f >> (used - 1))),
+          ContractValidationFailure,
+          "Integer representation too long."
+        );
+        break;
+      }
+    } while (b & 0x80);
+    if (shift < 64 && (b & 0x40))
+      result |= ~uint64_t(0) << shift;
+    return static_cast<int64_t>(result);
+  }
+
+  uint8_t const* m_pos;
+  uint8_t const* m_end;
+};
+
+/*
+ * x86-64 encoding
+ */
+
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+enum Cond : uint8_t {
+  CondB = 0x2, CondAE = 0x3, CondE = 0x4, CondNE = 0x5, CondBE = 0x6, CondA = 0x7,
+  CondL = 0xc, CondGE = 0xd, CondLE = 0xe, CondG = 0xf
+};
+
+// A memory operand: [base + index * scale + disp].
+struct Mem {
+  Reg base;
+  int32_t disp;
+  bool hasIndex;
+  Reg index;
+  uint8_t scale;
+};
+
+Mem at(Reg base, int32_t disp = 0) { return Mem{base, disp, false, RAX, 1}; }
+Mem at(Reg base, Reg index, uint8_t scale, int32_t disp = 0) { return Mem{base, disp, true, index, scale}; }
+
+// Instruction encoding, for the few forms the compiler uses. Register
+// operands are plain register numbers, w selects the 64 bit form.
+class Assembler {
+public:
+  vector<uint8_t>& code() { return m_code; }
+  size_t position() const { return m_code.size(); }
+
+  void byte(uint8_t b) { m_code.push_back(b); }
+  void u32(uint32_t value) { for (unsigned i = 0; i < 4; ++i) byte(static_cast<uint8_t>(value >> (8 * i))); }
+  void u64(uint64_t value) { for (unsigned i = 0; i < 8; ++i) byte(static_cast<uint8_t>(value >> (8 * i))); }
+
+  void patch32(size_t at, uint32_t value) { for (unsigned i = 0; i < 4; ++i) m_code[at + i] = static_cast<uint8_t>(value >> (8 * i)); }
+  // Points the rel32 at @at to @target.
+  void link(size_t at, size_t target) { patch32(at, static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4))); }
+
+  // opcode reg, [mem]
+  void rm(bool w, initializer_list<uint8_t> opcode, unsigned reg, Mem const& m)
+  {
+    rex(w, reg, m.hasIndex ? m.index : 0, m.base);
+    for (uint8_t b: opcode)
+      byte(b);
+    unsigned base = m.base & 7;
+    bool sib = m.hasIndex || base == RSP;
+    uint8_t mod = (m.disp == 0 && base != RBP) ? 0 : (m.disp >= -128 && m.disp <= 127) ? 1 : 2;
+    byte(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (sib ? 4 : base)));
+    if (sib) {
+      uint8_t scale = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+      byte(static_cast<uint8_t>(scale << 6 | (m.hasIndex ? (m.index & 7) : 4) << 3 | base));
+    }
+    if (mod == 1)
+      byte(static_cast<uint8_t>(m.disp));
+    else if (mod == 2)
+      u32(static_cast<uint32_t>(m.disp));
+  }
+
+  // opcode reg, rm (register direct)
+  void rr(bool w, initializer_list<uint8_t> opcode, unsigned reg, unsigned rmReg)
+  {
+    rex(w, reg, 0, rmReg);
+    for (uint8_t b: opcode)
+      byte(b);
+    byte(static_cast<uint8_t>(0xc0 | (reg & 7) << 3 | (rmReg & 7)));
+  }
+
+  void load(bool w, Reg reg, Mem const& m) { rm(w, { 0x8b }, reg, m); }
+  void store(bool w, Mem const& m, Reg reg) { rm(w, { 0x89 }, reg, m); }
+  void store16(Mem const& m, Reg reg) { byte(0x66); rm(false, { 0x89 }, reg, m); }
+  // Only for registers with a low byte without REX, rax to rbx.
+  void store8(Mem const& m, Reg reg) { rm(false, { 0x88 }, reg, m); }
+  void storeImm(bool w, Mem const& m, int32_t imm) { rm(w, { 0xc7 }, 0, m); u32(static_cast<uint32_t>(imm)); }
+  void lea(Reg reg, Mem const& m) { rm(true, { 0x8d }, reg, m); }
+  void mov(bool w, Reg dst, Reg src) { rr(w, { 0x89 }, src, dst); }
+
+  void movImm(Reg reg, uint64_t imm)
+  {
+    if (imm <= numeric_limits<uint32_t>::max()) {
+      rex(false, 0, 0, reg);
+      byte(static_cast<uint8_t>(0xb8 + (reg & 7)));
+      u32(static_cast<uint32_t>(imm));
+    } else {
+      rex(true, 0, 0, reg);
+      byte(static_cast<uint8_t>(0xb8 + (reg & 7)));
+      u64(imm);
+    }
+  }
+
+  // add, or, and, sub, xor, cmp: reg = reg op [mem], or reg op rm
+  void alu(bool w, uint8_t opcode, Reg reg, Mem const& m) { rm(w, { static_cast<uint8_t>(opcode + 2) }, reg, m); }
+  void alu(bool w, uint8_t opcode, Reg dst, Reg src) { rr(w, { opcode }, src, dst); }
+  // The /digit of the 0x81 immediate group.
+  void aluImm(bool w, unsigned digit, Reg reg, int32_t imm) { rr(w, { 0x81 }, digit, reg); u32(static_cast<uint32_t>(imm)); }
+  void aluImm(bool w, unsigned digit, Mem const& m, int32_t imm) { rm(w, { 0x81 }, digit, m); u32(static_cast<uint32_t>(imm)); }
+
+  void imul(bool w, Reg reg, Mem const& m) { rm(w, { 0x0f, 0xaf }, reg, m); }
+  void imul(bool w, Reg dst, Reg src) { rr(w, { 0x0f, 0xaf }, dst, src); }
+  // rol 0, ror 1, shl 4, shr 5, sar 7
+  void shiftCl(bool w, unsigned digit, Reg reg) { rr(w, { 0xd3 }, digit, reg); }
+  void shiftImm(bool w, unsigned digit, Reg reg, uint8_t imm) { rr(w, { 0xc1 }, digit, reg); byte(imm); }
+  // div 6, idiv 7
+  void divide(bool w, unsigned digit, Reg reg) { rr(w, { 0xf7 }, digit, reg); }
+  void signExtendAccumulator(bool w) { if (w) byte(0x48); byte(0x99); }
+  void test(bool w, Reg a, Reg b) { rr(w, { 0x85 }, b, a); }
+  void setcc(Cond cond, Reg reg) { rr(false, { 0x0f, static_cast<uint8_t>(0x90 + cond) }, 0, reg); }
+  void movzx8(Reg dst, Reg src) { rr(false, { 0x0f, 0xb6 }, dst, src); }
+  void cmov(bool w, Cond cond, Reg reg, Mem const& m) { rm(w, { 0x0f, static_cast<uint8_t>(0x40 + cond) }, reg, m); }
+  void cmov(bool w, Cond cond, Reg dst, Reg src) { rr(w, { 0x0f, static_cast<uint8_t>(0x40 + cond) }, dst, src); }
+  void bsr(bool w, Reg dst, Reg src) { rr(w, { 0x0f, 0xbd }, dst, src); }
+  void bsf(bool w, Reg dst, Reg src) { rr(w, { 0x0f, 0xbc }, dst, src); }
+
+  void push(Reg reg) { rex(false, 0, 0, reg); byte(static_cast<uint8_t>(0x50 + (reg & 7))); }
+  void pop(Reg reg) { rex(false, 0, 0, reg); byte(static_cast<uint8_t>(0x58 + (reg & 7))); }
+  void leave() { byte(0xc9); }
+  void ret() { byte(0xc3); }
+  void ud2() { byte(0x0f); byte(0x0b); }
+  void callReg(Reg reg) { rr(false, { 0xff }, 2, reg); }
+  void callMem(Mem const& m) { rm(false, { 0xff }, 2, m); }
+  void jmpReg(Reg reg) { rr(false, { 0xff }, 4, reg); }
+
+  // Return the position of the rel32 to link.
+  size_t jmp() { byte(0xe9); u32(0); return position() - 4; }
+  size_t jcc(Cond cond) { byte(0x0f); byte(static_cast<uint8_t>(0x80 + cond)); u32(0); return position() - 4; }
+  size_t call() { byte(0xe8); u32(0); return position() - 4; }
+  void jmp(size_t target) { link(jmp(), target); }
+  void jcc(Cond cond, size_t target) { link(jcc(cond), target); }
+
+  // lea reg, [rip + rel32], returning the position of the rel32.
+  size_t leaRip(Reg reg)
+  {
+    rex(true, reg, 0, 0);
+    byte(0x8d);
+    byte(static_cast<uint8_t>((reg & 7) << 3 | 5));
+    u32(0);
+    return position() - 4;
+  }
+
+private:
+  void rex(bool w, unsigned reg, unsigned index, unsigned base)
+  {
+    uint8_t prefix = static_cast<uint8_t>(0x40 | (w ? 8 : 0) | (reg >> 3) << 2 | (index >> 3) << 1 | (base >> 3));
+    if (prefix != 0x40)
+      byte(prefix);
+  }
+
+  vector<uint8_t> m_code;
+};
+
+// ALU opcodes of the reg, rm form.
+const uint8_t opAdd = 0x01;
+const uint8_t opOr = 0x09;
+const uint8_t opAnd = 0x21;
+const uint8_t opSub = 0x29;
+const uint8_t opXor = 0x31;
+const uint8_t opCmp = 0x39;
+
+// The registers compiled code keeps.
+const Reg regContext = R15;
+const Reg regMemoryBase = R14;
+const Reg regMemorySize = R13;
+
+}
+
+/*
+ * Compilation
+ */
+
+class BaselineCompiler {
+public:
+  explicit BaselineCompiler(vector<uint8_t> const& code): m_input(code) {}
+
+  unique_ptr<BaselineModule> compile();
+
+private:
+  enum class Kind { Block, Loop, If, Function };
+
+  struct Control {
+    Kind kind;
+    bool hasResult;
+    ValType result;
+    // The height of the value stack when entered.
+    size_t height;
+    // Validation: the rest of the frame is unreachable.
+    bool unreachable;
+    // Code generation: the frame was entered by live code.
+    bool liveAtEntry;
+    // A branch to its end was emitted.
+    bool branched;
+    // Of a loop.
+    size_t start;
+    // Of an if, the jump to its else, until linked.
+    size_t elseJump;
+    bool hasElse;
+    // Jumps to the end.
+    vector<size_t> exits;
+  };
+
+  void readSections();
+  void readTypes(Reader& reader);
+  void readImports(Reader& reader);
+  void readFunctions(Reader& reader);
+  void readTable(Reader& reader);
+  void readMemory(Reader& reader);
+  void readGlobals(Reader& reader);
+  void readExports(Reader& reader);
+  void readElements(Reader& reader);
+  void readCode(Reader& reader);
+  void readData(Reader& reader);
+  void readLimits(Reader& reader, uint32_t max, uint32_t& initial, uint32_t& maximum);
+  ValType readValueType(Reader& reader);
+  uint64_t readConstant(Reader& reader, ValType type);
+  uint32_t readOffset(Reader& reader);
+  void checkContract();
+
+  void emitStubs();
+  void compileFunction(uint32_t index, Reader body);
+  void compileInstruction(uint8_t opcode, Reader& reader);
+
+  // Validation
+  void push(ValType type);
+  ValType pop();
+  ValType pop(ValType expected);
+  void popValues(vector<ValType> const& types);
+  void setUnreachable();
+  Control& label(uint32_t depth);
+  Signature const& functionSignature(uint32_t index) const { return m_types[m_functionTypes[index]]; }
+
+  // Code generation
+  Mem local(uint32_t index) const { return at(RSP, static_cast<int32_t>(8 * index)); }
+  Mem stack(size_t position) const { return at(RSP, static_cast<int32_t>(8 * (m_localCount + position))); }
+  void branch(Control& target, size_t height);
+  void emitCall(uint32_t function, size_t argsPosition);
+  void reloadMemory();
+  void emitTrap(Cond cond, Trap trap) { m_asm.jcc(cond, m_trapStubs[static_cast<uint32_t>(trap)]); }
+  void emitCallC(void const* function);
+  void emitAddress(size_t position, uint32_t offset, uint32_t size);
+  void emitLoad(uint8_t opcode, size_t position, uint32_t offset);
+  void emitStore(uint8_t opcode, size_t position, uint32_t offset);
+  void emitBinary(uint8_t opcode, size_t position);
+  void emitDivide(bool w, bool isSigned, bool remainder, size_t position);
+  void emitCompare(bool w, Cond cond, size_t position);
+  void emitUnary(uint8_t opcode, size_t position);
+  void emitPopcount(bool w);
+
+  vector<uint8_t> const& m_input;
+  unique_ptr<BaselineModule> m_module;
+
+  vector<Signature> m_types;
+  vector<uint32_t> m_canonical;
+  // The type of every function, imports first.
+  vector<uint32_t> m_functionTypes;
+  uint32_t m_importCount = 0;
+  vector<ValType> m_globalTypes;
+  vector<bool> m_globalMutable;
+  bool m_hasTable = false;
+  bool m_hasMemory = false;
+  bool m_hasStart = false;
+  vector<pair<string, pair<uint8_t, uint32_t>>> m_exports;
+  vector<Reader> m_bodies;
+
+  Assembler m_asm;
+  size_t m_exitStub = 0;
+  size_t m_trapStubs[static_cast<uint32_t>(Trap::Count)];
+  // Direct calls to functions compiled later: the rel32 and the callee.
+  vector<pair<size_t, uint32_t>> m_calls;
+
+  // State of the function being compiled.
+  vector<ValType> m_locals;
+  uint32_t m_localCount = 0;
+  vector<ValType> m_values;
+  size_t m_maxHeight = 0;
+  vector<Control> m_controls;
+  bool m_live = true;
+  Signature const* m_signature = nullptr;
+};
+
+unique_ptr<BaselineModule> BaselineModule::compile(vector<uint8_t> const& code)
+{
+  return BaselineCompiler(code).compile();
+}
+
+size_t BaselineModule::footprint() const
+{
+  size_t bytes = sizeof(*this) + m_code.size() +
+    m_functionSignatures.capacity() * sizeof(uint32_t) +
+    m_functionOffsets.capacity() * sizeof(size_t) +
+    m_globals.capacity() * sizeof(uint64_t);
+  for (auto const& import: m_imports)
+    bytes += sizeof(import) + import.module.capacity() + import.base.capacity();
+  for (auto const& segment: m_data)
+    bytes += sizeof(segment) + segment.data.capacity();
+  for (auto const& segment: m_elements)
+    bytes += sizeof(segment) + segment.functions.capacity() * sizeof(uint32_t);
+  return bytes;
+}
+
+unique_ptr<BaselineModule> BaselineCompiler::compile()
+{
+  m_module.reset(new BaselineModule);
+  readSections();
+  checkContract();
+
+  emitStubs();
+  m_module->m_functionOffsets.resize(m_functionTypes.size(), 0);
+  for (uint32_t i = 0; i < m_importCount; ++i) {
+    // A thunk taking the arguments in rdi like compiled functions. The
+    // result comes back in its frame, the status decides whether to exit.
+    m_module->m_functionOffsets[i] = m_asm.position();
+    m_asm.push(RBP);
+    m_asm.mov(true, RBP, RSP);
+    m_asm.aluImm(true, 5, RSP, 16);
+    m_asm.mov(true, RDX, RDI);
+    m_asm.mov(true, RDI, regContext);
+    m_asm.movImm(RSI, i);
+    m_asm.mov(true, RCX, RSP);
+    emitCallC(reinterpret_cast<void const*>(&BaselineInstance::callImport));
+    m_asm.test(false, RAX, RAX);
+    m_asm.jcc(CondNE, m_exitStub);
+    m_asm.load(true, RAX, at(RSP));
+    m_asm.leave();
+    m_asm.ret();
+  }
+  for (uint32_t i = 0; i < m_bodies.size(); ++i)
+    compileFunction(m_importCount + i, m_bodies[i]);
+  for (auto const& call: m_calls)
+    m_asm.link(call.first, m_module->m_functionOffsets[call.second]);
+
+  for (uint32_t type: m_functionTypes)
+    m_module->m_functionSignatures.push_back(m_canonical[type]);
+
+  vector<uint8_t> const& code = m_asm.code();
+  m_module->m_code = PageMapping(code.size());
+  memcpy(m_module->m_code.data(), code.data(), code.size());
+  heraAssert(m_module->m_code.protect(PROT_READ | PROT_EXEC), "Cannot protect compiled code.");
+  return move(m_module);
+}
+
+/*
+ * Sections
+ */
+
+void BaselineCompiler::readSections()
+{
+  Reader reader(m_input.data(), m_input.size());
+  ensureCondition(
+    reader.remaining() >= 8 && memcmp(m_input.data(), "\0asm\1\0\0\0", 8) == 0,
+    ContractValidationFailure,
+    "Invalid contract preamble."
+  );
+  reader.sub(8);
+
+  uint8_t last = 0;
+  bool hasFunctions = false;
+  bool hasCode = false;
+  while (!reader.done()) {
+    uint8_t id = reader.byte();
+    Reader section = reader.sub(reader.u32());
+    if (id == 0) {
+      // Custom sections, like names, are ignored but must be well formed.
+      section.name();
+      continue;
+    }
+    ensureCondition(id > last && id <= 11, ContractValidationFailure, "Invalid section order or id.");
+    last = id;
+    switch (id) {
+    case 1: readTypes(section); break;
+    case 2: readImports(section); break;
+    case 3: readFunctions(section); hasFunctions = true; break;
+    case 4: readTable(section); break;
+    case 5: readMemory(section); break;
+    case 6: readGlobals(section); break;
+    case 7: readExports(section); break;
+    case 8:
+      section.u32();
+      m_hasStart = true;
+      break;
+    case 9: readElements(section); break;
+    case 10: readCode(section); hasCode = true; break;
+    case 11: readData(section); break;
+    }
+    ensureCondition(section.done(), ContractValidationFailure, "Section size mismatch.");
+  }
+  ensureCondition(
+    hasFunctions == hasCode && m_bodies.size() == m_functionTypes.size() - m_importCount,
+    ContractValidationFailure,
+    "Function and code section mismatch."
+  );
+}
+
+ValType BaselineCompiler::readValueType(Reader& reader)
+{
+  uint8_t type = reader.byte();
+  ensureCondition(type != F32 && type != F64, ContractValidationFailure, "Floating point is not supported.");
+  ensureCondition(type == I32 || type == I64, ContractValidationFailure, "Invalid value type.");
+  return static_cast<ValType>(type);
+}
+
+void BaselineCompiler::readTypes(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  for (uint32_t i = 0; i < count; ++i) {
+    ensureCondition(reader.byte() == 0x60, ContractValidationFailure, "Invalid function type.");
+    Signature signature;
+    uint32_t params = reader.u32();
+    ensureCondition(params <= reader.remaining(), ContractValidationFailure, "Invalid function type.");
+    for (uint32_t j = 0; j < params; ++j)
+      signature.params.push_back(readValueType(reader));
+    uint32_t results = reader.u32();
+    ensureCondition(results <= 1, ContractValidationFailure, "Multiple results are not supported.");
+    for (uint32_t j = 0; j < results; ++j)
+      signature.results.push_back(readValueType(reader));
+
+    // Call indirect compares types structurally, by their first occurrence.
+    uint32_t canonical = static_cast<uint32_t>(find(m_types.begin(), m_types.end(), signature) - m_types.begin());
+    m_canonical.push_back(canonical);
+    m_types.push_back(move(signature));
+  }
+}
+
+void BaselineCompiler::readImports(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  for (uint32_t i = 0; i < count; ++i) {
+    BaselineImport import;
+    import.module = reader.name();
+    import.base = reader.name();
+    // Only functions are imported by contracts.
+    ensureCondition(reader.byte() == 0x00, ContractValidationFailure, "Only functions can be imported.");
+    uint32_t type = reader.u32();
+    ensureCondition(type < m_types.size(), ContractValidationFailure, "Invalid type index.");
+
+    Signature expected;
+    if (import.module == "ethereum") {
+      import.function = resolveEEIFunction(import.module, import.base);
+      ensureCondition(import.function != EEIFunction::Unresolved, ContractValidationFailure, "Importing invalid EEI method.");
+      expected = eeiSignature(import.function);
+    } else {
+      ensureCondition(
+        import.module == "debug" && debugSignature(import.base, expected),
+        ContractValidationFailure,
+        "Import from invalid namespace."
+      );
+      import.function = EEIFunction::Unresolved;
+    }
+    ensureCondition(m_types[type] == expected, ContractValidationFailure, "Imported function type mismatch.");
+    import.paramCount = static_cast<uint32_t>(expected.params.size());
+
+    m_module->m_imports.push_back(move(import));
+    m_functionTypes.push_back(type);
+  }
+  m_importCount = count;
+}
+
+void BaselineCompiler::readFunctions(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  ensureCondition(count <= reader.remaining(), ContractValidationFailure, "Invalid function section.");
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t type = reader.u32();
+    ensureCondition(type < m_types.size(), ContractValidationFailure, "Invalid type index.");
+    m_functionTypes.push_back(type);
+  }
+}
+
+void BaselineCompiler::readLimits(Reader& reader, uint32_t max, uint32_t& initial, uint32_t& maximum)
+{
+  uint8_t flags = reader.byte();
+  ensureCondition(flags <= 1, ContractValidationFailure, "Invalid limits.");
+  initial = reader.u32();
+  maximum = flags ? reader.u32() : max;
+  ensureCondition(initial <= max && maximum <= max && initial <= maximum, ContractValidationFailure, "Invalid limits.");
+}
+
+void BaselineCompiler::readTable(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  ensureCondition(count <= 1, ContractValidationFailure, "Multiple tables.");
+  for (uint32_t i = 0; i < count; ++i) {
+    ensureCondition(reader.byte() == 0x70, ContractValidationFailure, "Invalid table element type.");
+    uint32_t maximum;
+    readLimits(reader, maxTableSize, m_module->m_tableSize, maximum);
+    m_hasTable = true;
+  }
+}
+
+void BaselineCompiler::readMemory(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  ensureCondition(count <= 1, ContractValidationFailure, "Multiple memories.");
+  for (uint32_t i = 0; i < count; ++i) {
+    readLimits(reader, maxPages, m_module->m_memoryPages, m_module->m_memoryMaxPages);
+    m_hasMemory = true;
+  }
+}
+
+uint64_t BaselineCompiler::readConstant(Reader& reader, ValType type)
+{
+  uint8_t opcode = reader.byte();
+  uint64_t value;
+  if (opcode == 0x41 && type == I32)
+    value = static_cast<uint32_t>(reader.s32());
+  else if (opcode == 0x42 && type == I64)
+    value = static_cast<uint64_t>(reader.s64());
+  else
+    ensureCondition(false, ContractValidationFailure, "Invalid constant expression.");
+  ensureCondition(reader.byte() == 0x0b, ContractValidationFailure, "Invalid constant expression.");
+  return value;
+}
+
+void BaselineCompiler::readGlobals(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  for (uint32_t i = 0; i < count; ++i) {
+    ValType type = readValueType(reader);
+    uint8_t mutability = reader.byte();
+    ensureCondition(mutability <= 1, ContractValidationFailure, "Invalid global mutability.");
+    m_module->m_globals.push_back(readConstant(reader, type));
+    m_globalTypes.push_back(type);
+    m_globalMutable.push_back(mutability == 1);
+  }
+}
+
+void BaselineCompiler::readExports(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  set<string> names;
+  for (uint32_t i = 0; i < count; ++i) {
+    string name = reader.name();
+    uint8_t kind = reader.byte();
+    uint32_t index = reader.u32();
+    ensureCondition(names.insert(name).second, ContractValidationFailure, "Duplicate export name.");
+    switch (kind) {
+    case 0: ensureCondition(index < m_functionTypes.size(), ContractValidationFailure, "Invalid export."); break;
+    case 1: ensureCondition(m_hasTable && index == 0, ContractValidationFailure, "Invalid export."); break;
+    case 2: ensureCondition(m_hasMemory && index == 0, ContractValidationFailure, "Invalid export."); break;
+    case 3: ensureCondition(index < m_globalTypes.size(), ContractValidationFailure, "Invalid export."); break;
+    default: ensureCondition(false, ContractValidationFailure, "Invalid export.");
+    }
+    m_exports.emplace_back(move(name), make_pair(kind, index));
+  }
+}
+
+uint32_t BaselineCompiler::readOffset(Reader& reader)
+{
+  return static_cast<uint32_t>(readConstant(reader, I32));
+}
+
+void BaselineCompiler::readElements(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  for (uint32_t i = 0; i < count; ++i) {
+    ensureCondition(reader.u32() == 0 && m_hasTable, ContractValidationFailure, "Invalid table index.");
+    BaselineModule::ElementSegment segment;
+    segment.offset = readOffset(reader);
+    uint32_t size = reader.u32();
+    ensureCondition(size <= reader.remaining(), ContractValidationFailure, "Invalid element segment.");
+    for (uint32_t j = 0; j < size; ++j) {
+      uint32_t function = reader.u32();
+      ensureCondition(function < m_functionTypes.size(), ContractValidationFailure, "Invalid function index.");
+      segment.functions.push_back(function);
+    }
+    ensureCondition(
+      static_cast<uint64_t>(segment.offset) + size <= m_module->m_tableSize,
+      ContractValidationFailure,
+      "Element segment does not fit the table."
+    );
+    m_module->m_elements.push_back(move(segment));
+  }
+}
+
+void BaselineCompiler::readCode(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  for (uint32_t i = 0; i < count; ++i)
+    m_bodies.push_back(reader.sub(reader.u32()));
+}
+
+void BaselineCompiler::readData(Reader& reader)
+{
+  uint32_t count = reader.u32();
+  for (uint32_t i = 0; i < count; ++i) {
+    ensureCondition(reader.u32() == 0 && m_hasMemory, ContractValidationFailure, "Invalid memory index.");
+    BaselineModule::DataSegment segment;
+    segment.offset = readOffset(reader);
+    segment.data = reader.bytes(reader.u32());
+    ensureCondition(
+      static_cast<uint64_t>(segment.offset) + segment.data.size() <= static_cast<uint64_t>(m_module->m_memoryPages) * pageSize,
+      ContractValidationFailure,
+      "Data segment does not fit the memory."
+    );
+    m_module->m_data.push_back(move(segment));
+  }
+}
+
+// The same checks as BinaryenEngine::verifyContract().
+void BaselineCompiler::checkContract()
+{
+  ensureCondition(!m_hasStart, ContractValidationFailure, "Contract contains start function.");
+
+  auto find = [&](char const* name) {
+    for (auto const& exported: m_exports)
+      if (exported.first == name)
+        return &exported.second;
+    return static_cast<pair<uint8_t, uint32_t> const*>(nullptr);
+  };
+  auto main = find("main");
+  ensureCondition(main, ContractValidationFailure, "Contract entry point (\"main\") missing.");
+  ensureCondition(find("memory"), ContractValidationFailure, "Contract export (\"memory\") missing.");
+  ensureCondition(m_exports.size() == 2, ContractValidationFailure, "Contract exports more than (\"main\") and (\"memory\").");
+  ensureCondition(main->first == 0, ContractValidationFailure, "Contract is invalid. \"main\" is not a function.");
+  Signature const& signature = functionSignature(main->second);
+  ensureCondition(
+    signature.params.empty() && signature.results.empty(),
+    ContractValidationFailure,
+    "Contract is invalid. \"main\" has an invalid signature."
+  );
+  m_module->m_main = main->second;
+}
+
+/*
+ * Code generation
+ */
+
+namespace {
+const int32_t offsetMemoryBase = offsetof(BaselineInstance::Context, memoryBase);
+const int32_t offsetMemorySize = offsetof(BaselineInstance::Context, memorySize);
+const int32_t offsetGlobals = offsetof(BaselineInstance::Context, globals);
+const int32_t offsetTable = offsetof(BaselineInstance::Context, table);
+const int32_t offsetTableSize = offsetof(BaselineInstance::Context, tableSize);
+const int32_t offsetStackLimit = offsetof(BaselineInstance::Context, stackLimit);
+const int32_t offsetExitStack = offsetof(BaselineInstance::Context, exitStack);
+}
+
+void BaselineCompiler::emitCallC(void const* function)
+{
+  m_asm.movImm(RAX, reinterpret_cast<uintptr_t>(function));
+  m_asm.callReg(RAX);
+}
+
+// The entry, called from C++ as entry(context, function, args), the exit,
+// which returns from the entry at any depth of compiled code, and the traps,
+// jumped to by compiled code.
+void BaselineCompiler::emitStubs()
+{
+  static const Reg saved[] = { RBX, RBP, R12, R13, R14, R15 };
+  for (Reg reg: saved)
+    m_asm.push(reg);
+  // Six pushes and the return address leave the stack misaligned by eight.
+  m_asm.aluImm(true, 5, RSP, 8);
+  m_asm.mov(true, regContext, RDI);
+  m_asm.store(true, at(regContext, offsetExitStack), RSP);
+  reloadMemory();
+  m_asm.mov(true, RDI, RDX);
+  m_asm.callReg(RSI);
+  size_t epilogue = m_asm.position();
+  m_asm.aluImm(true, 0, RSP, 8);
+  for (size_t i = sizeof(saved) / sizeof(saved[0]); i > 0; --i)
+    m_asm.pop(saved[i - 1]);
+  m_asm.ret();
+
+  // Only jumped to once the C++ function which asked for it returned, so
+  // the frames dropped are all of compiled code.
+  m_exitStub = m_asm.position();
+  m_asm.load(true, RSP, at(regContext, offsetExitStack));
+  m_asm.jmp(epilogue);
+
+  for (uint32_t kind = 0; kind < static_cast<uint32_t>(Trap::Count); ++kind) {
+    m_trapStubs[kind] = m_asm.position();
+    m_asm.mov(true, RDI, regContext);
+    m_asm.movImm(RSI, kind);
+    emitCallC(reinterpret_cast<void const*>(&BaselineInstance::trap));
+    m_asm.jmp(m_exitStub);
+  }
+}
+
+void BaselineCompiler::reloadMemory()
+{
+  m_asm.load(true, regMemoryBase, at(regContext, offsetMemoryBase));
+  m_asm.load(true, regMemorySize, at(regContext, offsetMemorySize));
+}
+
+void BaselineCompiler::push(ValType type)
+{
+  m_values.push_back(type);
+  m_maxHeight = max(m_maxHeight, m_values.size());
+}
+
+ValType BaselineCompiler::pop()
+{
+  Control const& frame = m_controls.back();
+  if (m_values.size() == frame.height) {
+    ensureCondition(frame.unreachable, ContractValidationFailure, "Module is not valid: value stack underflow.");
+    return AnyType;
+  }
+  ValType type = m_values.back();
+  m_values.pop_back();
+  return type;
+}
+
+ValType BaselineCompiler::pop(ValType expected)
+{
+  ValType actual = pop();
+  ensureCondition(
+    actual == expected || actual == AnyType || expected == AnyType,
+    ContractValidationFailure,
+    "Module is not valid: type mismatch."
+  );
+  return actual == AnyType ? expected : actual;
+}
+
+void BaselineCompiler::popValues(vector<ValType> const& types)
+{
+  for (size_t i = types.size(); i > 0; --i)
+    pop(types[i - 1]);
+}
+
+void BaselineCompiler::setUnreachable()
+{
+  m_values.resize(m_controls.back().height);
+  m_controls.back().unreachable = true;
+  m_live = false;
+}
+
+BaselineCompiler::Control& BaselineCompiler::label(uint32_t depth)
+{
+  ensureCondition(depth < m_controls.size(), ContractValidationFailure, "Module is not valid: invalid branch depth.");
+  return m_controls[m_controls.size() - 1 - depth];
+}
+
+// Jumps to target from a stack of the given height, moving the result.
+void BaselineCompiler::branch(Control& target, size_t height)
+{
+  if (target.kind == Kind::Loop) {
+    m_asm.jmp(target.start);
+    return;
+  }
+  if (target.hasResult && height - 1 != target.height) {
+    m_asm.load(true, RAX, stack(height - 1));
+    m_asm.store(true, stack(target.height), RAX);
+  }
+  target.exits.push_back(m_asm.jmp());
+  target.branched = true;
+}
+
+void BaselineCompiler::emitCall(uint32_t function, size_t argsPosition)
+{
+  m_asm.lea(RDI, stack(argsPosition));
+  size_t call = m_asm.call();
+  if (function < m_importCount || m_module->m_functionOffsets[function] != 0)
+    m_asm.link(call, m_module->m_functionOffsets[function]);
+  else
+    m_calls.emplace_back(call, function);
+  reloadMemory();
+}
+
+void BaselineCompiler::compileFunction(uint32_t index, Reader body)
+{
+  m_signature = &functionSignature(index);
+  m_locals = m_signature->params;
+  uint32_t groups = body.u32();
+  for (uint32_t i = 0; i < groups; ++i) {
+    uint32_t count = body.u32();
+    ensureCondition(count <= maxLocals - m_locals.size(), ContractValidationFailure, "Too many locals.");
+    ValType type = readValueType(body);
+    m_locals.insert(m_locals.end(), count, type);
+  }
+  ensureCondition(m_locals.size() <= maxLocals, ContractValidationFailure, "Too many locals.");
+  m_localCount = static_cast<uint32_t>(m_locals.size());
+
+  m_module->m_functionOffsets[index] = m_asm.position();
+  m_values.clear();
+  m_maxHeight = 0;
+  m_controls.clear();
+  m_live = true;
+
+  // Prologue, with the frame size linked once known.
+  m_asm.push(RBP);
+  m_asm.mov(true, RBP, RSP);
+  m_asm.lea(RAX, at(RSP, numeric_limits<int32_t>::min()));
+  size_t checkFrame = m_asm.position() - 4;
+  m_asm.alu(true, opCmp, RAX, at(regContext, offsetStackLimit));
+  emitTrap(CondB, Trap::StackExhausted);
+  m_asm.mov(true, RSP, RAX);
+
+  for (uint32_t i = 0; i < m_signature->params.size(); ++i) {
+    m_asm.load(true, RAX, at(RDI, static_cast<int32_t>(8 * i)));
+    m_asm.store(true, local(i), RAX);
+  }
+  uint32_t zeroed = m_localCount - static_cast<uint32_t>(m_signature->params.size());
+  if (zeroed > 0) {
+    m_asm.alu(false, opXor, RAX, RAX);
+    if (zeroed <= 8) {
+      for (uint32_t i = static_cast<uint32_t>(m_signature->params.size()); i < m_localCount; ++i)
+        m_asm.store(true, local(i), RAX);
+    } else {
+      m_asm.lea(RDI, local(static_cast<uint32_t>(m_signature->params.size())));
+      m_asm.movImm(RCX, zeroed);
+      // rep stosq
+      m_asm.byte(0xf3);
+      m_asm.byte(0x48);
+      m_asm.byte(0xab);
+    }
+  }
+
+  Control function{};
+  function.kind = Kind::Function;
+  function.hasResult = !m_signature->results.empty();
+  function.result = function.hasResult ? m_signature->results[0] : AnyType;
+  function.liveAtEntry = true;
+  function.elseJump = SIZE_MAX;
+  m_controls.push_back(function);
+
+  while (!m_controls.empty())
+    compileInstruction(body.byte(), body);
+  ensureCondition(body.done(), ContractValidationFailure, "Module is not valid: code after the end of the function.");
+
+  size_t frameSize = 8 * (m_localCount + m_maxHeight);
+  frameSize = (frameSize + 15) / 16 * 16;
+  m_asm.patch32(checkFrame, static_cast<uint32_t>(-static_cast<int32_t>(frameSize)));
+}
+
+void BaselineCompiler::compileInstruction(uint8_t opcode, Reader& reader)
+{
+  size_t height = m_values.size();
+
+  switch (opcode) {
+  case 0x00: // unreachable
+    if (m_live)
+      m_asm.jmp(m_trapStubs[static_cast<uint32_t>(Trap::Unreachable)]);
+    setUnreachable();
+    return;
+
+  case 0x01: // nop
+    return;
+
+  case 0x02: // block
+  case 0x03: // loop
+  case 0x04: { // if
+    uint8_t type = reader.byte();
+    Control frame{};
+    frame.kind = opcode == 0x02 ? Kind::Block : opcode == 0x03 ? Kind::Loop : Kind::If;
+    if (type != 0x40) {
+      ensureCondition(type != F32 && type != F64, ContractValidationFailure, "Floating point is not supported.");
+      ensureCondition(type == I32 || type == I64, ContractValidationFailure, "Invalid block type.");
+      frame.hasResult = true;
+      frame.result = static_cast<ValType>(type);
+    }
+    frame.elseJump = SIZE_MAX;
+    if (opcode == 0x04) {
+      pop(I32);
+      if (m_live) {
+        m_asm.load(false, RAX, stack(height - 1));
+        m_asm.test(false, RAX, RAX);
+        frame.elseJump = m_asm.jcc(CondE);
+      }
+    }
+    frame.height = m_values.size();
+    frame.liveAtEntry = m_live;
+    frame.start = m_asm.position();
+    m_controls.push_back(move(frame));
+    return;
+  }
+
+  case 0x05: { // else
+    Control& frame = m_controls.back();
+    ensureCondition(frame.kind == Kind::If && !frame.hasElse, ContractValidationFailure, "Module is not valid: misplaced else.");
+    if (frame.hasResult)
+      pop(frame.result);
+    ensureCondition(m_values.size() == frame.height, ContractValidationFailure, "Module is not valid: values left in block.");
+    if (m_live) {
+      frame.exits.push_back(m_asm.jmp());
+      frame.branched = true;
+    }
+    if (frame.elseJump != SIZE_MAX)
+      m_asm.link(frame.elseJump, m_asm.position());
+    frame.elseJump = SIZE_MAX;
+    frame.hasElse = true;
+    frame.unreachable = false;
+    m_live = frame.liveAtEntry;
+    return;
+  }
+
+  case 0x0b: { // end
+    Control& frame = m_controls.back();
+    if (frame.hasResult)
+      pop(frame.result);
+    ensureCondition(m_values.size() == frame.height, ContractValidationFailure, "Module is not valid: values left in block.");
+    ensureCondition(
+      !(frame.kind == Kind::If && !frame.hasElse && frame.hasResult),
+      ContractValidationFailure,
+      "Module is not valid: if with a result needs an else."
+    );
+
+    bool live = m_live || (frame.kind != Kind::Loop && frame.branched);
+    if (frame.elseJump != SIZE_MAX) {
+      m_asm.link(frame.elseJump, m_asm.position());
+      live = true;
+    }
+    for (size_t exit: frame.exits)
+      m_asm.link(exit, m_asm.position());
+
+    if (frame.kind == Kind::Function) {
+      if (live) {
+        if (frame.hasResult)
+          m_asm.load(true, RAX, stack(0));
+        m_asm.leave();
+        m_asm.ret();
+      }
+      m_controls.pop_back();
+      return;
+    }
+
+    bool hasResult = frame.hasResult;
+    ValType result = frame.result;
+    m_controls.pop_back();
+    m_live = live;
+    if (hasResult)
+      push(result);
+    return;
+  }
+
+  case 0x0c: { // br
+    Control& target = label(reader.u32());
+    if (target.kind != Kind::Loop && target.hasResult)
+      pop(target.result);
+    if (m_live)
+      branch(target, height);
+    setUnreachable();
+    return;
+  }
+
+  case 0x0d: { // br_if
+    Control& target = label(reader.u32());
+    pop(I32);
+    bool carries = target.kind != Kind::Loop && target.hasResult;
+    if (carries) {
+      pop(target.result);
+      push(target.result);
+    }
+    if (m_live) {
+      m_asm.load(false, RCX, stack(height - 1));
+      m_asm.test(false, RCX, RCX);
+      if (target.kind == Kind::Loop || !carries || height - 2 == target.height) {
+        size_t jump = m_asm.jcc(CondNE);
+        if (target.kind == Kind::Loop) {
+          m_asm.link(jump, target.start);
+        } else {
+          target.exits.push_back(jump);
+          target.branched = true;
+        }
+      } else {
+        size_t skip = m_asm.jcc(CondE);
+        branch(target, height - 1);
+        m_asm.link(skip, m_asm.position());
+      }
+    }
+    return;
+  }
+
+  case 0x0e: { // br_table
+    uint32_t count = reader.u32();
+    ensureCondition(count <= reader.remaining(), ContractValidationFailure, "Module is not valid: invalid branch table.");
+    vector<uint32_t> depths(count + 1);
+    for (uint32_t i = 0; i <= count; ++i)
+      depths[i] = reader.u32();
+
+    pop(I32);
+    Control& fallback = label(depths[count]);
+    bool carries = fallback.kind != Kind::Loop && fallback.hasResult;
+    for (uint32_t depth: depths) {
+      Control& target = label(depth);
+      bool targetCarries = target.kind != Kind::Loop && target.hasResult;
+      ensureCondition(
+        targetCarries == carries && (!carries || target.result == fallback.result),
+        ContractValidationFailure,
+        "Module is not valid: branch table targets differ in type."
+      );
+    }
+    if (carries)
+      pop(fallback.result);
+
+    if (m_live) {
+      // Indices at or above count go to the last entry, the default.
+      m_asm.load(false, RAX, stack(height - 1));
+      m_asm.aluImm(false, 7, RAX, static_cast<int32_t>(count));
+      m_asm.movImm(RCX, count);
+      m_asm.cmov(false, CondA, RAX, RCX);
+      size_t table = m_asm.leaRip(RCX);
+      m_asm.rm(true, { 0x63 }, RAX, at(RCX, RAX, 4));
+      m_asm.alu(true, opAdd, RAX, RCX);
+      m_asm.jmpReg(RAX);
+      m_asm.link(table, m_asm.position());
+      size_t tableStart = m_asm.position();
+      for (uint32_t i = 0; i <= count; ++i)
+        m_asm.u32(0);
+      // One stub per distinct target.
+      vector<pair<uint32_t, size_t>> stubs;
+      for (uint32_t i = 0; i <= count; ++i) {
+        size_t stub = SIZE_MAX;
+        for (auto const& existing: stubs)
+          if (existing.first == depths[i])
+            stub = existing.second;
+        if (stub == SIZE_MAX) {
+          stub = m_asm.position();
+          stubs.emplace_back(depths[i], stub);
+          branch(label(depths[i]), height - 1);
+        }
+        m_asm.patch32(tableStart + 4 * i, static_cast<uint32_t>(stub - tableStart));
+      }
+    }
+    setUnreachable();
+    return;
+  }
+
+  case 0x0f: { // return
+    if (!m_signature->results.empty())
+      pop(m_signature->results[0]);
+    if (m_live) {
+      if (!m_signature->results.empty())
+        m_asm.load(true, RAX, stack(height - 1));
+      m_asm.leave();
+      m_asm.ret();
+    }
+    setUnreachable();
+    return;
+  }
+
+  case 0x10: { // call
+    uint32_t function = reader.u32();
+    ensureCondition(function < m_functionTypes.size(), ContractValidationFailure, "Module is not valid: invalid function index.");
+    Signature const& signature = functionSignature(function);
+    popValues(signature.params);
+    size_t args = m_values.size();
+    if (m_live) {
+      emitCall(function, args);
+      if (!signature.results.empty())
+        m_asm.store(true, stack(args), RAX);
+    }
+    for (ValType result: signature.results)
+      push(result);
+    return;
+  }
+
+  case 0x11: { // call_indirect
+    uint32_t type = reader.u32();
+    ensureCondition(type < m_types.size(), ContractValidationFailure, "Module is not valid: invalid type index.");
+    ensureCondition(reader.byte() == 0x00 && m_hasTable, ContractValidationFailure, "Module is not valid: invalid table index.");
+    Signature const& signature = m_types[type];
+    pop(I32);
+    popValues(signature.params);
+    size_t args = m_values.size();
+    if (m_live) {
+      m_asm.load(false, RAX, stack(height - 1));
+      m_asm.alu(true, opCmp, RAX, at(regContext, offsetTableSize));
+      emitTrap(CondAE, Trap::UndefinedElement);
+      m_asm.load(true, RCX, at(regContext, offsetTable));
+      m_asm.shiftImm(true, 4, RAX, 4);
+      m_asm.alu(true, opAdd, RCX, RAX);
+      m_asm.aluImm(true, 7, at(RCX), static_cast<int32_t>(m_canonical[type]));
+      emitTrap(CondNE, Trap::IndirectCallMismatch);
+      m_asm.lea(RDI, stack(args));
+      m_asm.callMem(at(RCX, 8));
+      reloadMemory();
+      if (!signature.results.empty())
+        m_asm.store(true, stack(args), RAX);
+    }
+    for (ValType result: signature.results)
+      push(result);
+    return;
+  }
+
+  case 0x1a: // drop
+    pop();
+    return;
+
+  case 0x1b: { // select
+    pop(I32);
+    ValType second = pop();
+    ValType first = pop(second);
+    push(first);
+    if (m_live) {
+      m_asm.load(false, RCX, stack(height - 1));
+      m_asm.load(true, RAX, stack(height - 3));
+      m_asm.test(false, RCX, RCX);
+      m_asm.cmov(true, CondE, RAX, stack(height - 2));
+      m_asm.store(true, stack(height - 3), RAX);
+    }
+    return;
+  }
+
+  case 0x20: // local.get
+  case 0x21: // local.set
+  case 0x22: { // local.tee
+    uint32_t index = reader.u32();
+    ensureCondition(index < m_localCount, ContractValidationFailure, "Module is not valid: invalid local index.");
+    ValType type = m_locals[index];
+    if (opcode == 0x20) {
+      push(type);
+      if (m_live) {
+        m_asm.load(true, RAX, local(index));
+        m_asm.store(true, stack(height), RAX);
+      }
+      return;
+    }
+    pop(type);
+    if (opcode == 0x22)
+      push(type);
+    if (m_live) {
+      m_asm.load(true, RAX, stack(height - 1));
+      m_asm.store(true, local(index), RAX);
+    }
+    return;
+  }
+
+  case 0x23: // global.get
+  case 0x24: { // global.set
+    uint32_t index = reader.u32();
+    ensureCondition(index < m_globalTypes.size(), ContractValidationFailure, "Module is not valid: invalid global index.");
+    ValType type = m_globalTypes[index];
+    if (opcode == 0x23) {
+      push(type);
+      if (m_live) {
+        m_asm.load(true, RCX, at(regContext, offsetGlobals));
+        m_asm.load(true, RAX, at(RCX, static_cast<int32_t>(8 * index)));
+        m_asm.store(true, stack(height), RAX);
+      }
+      return;
+    }
+    ensureCondition(m_globalMutable[index], ContractValidationFailure, "Module is not valid: global is immutable.");
+    pop(type);
+    if (m_live) {
+      m_asm.load(true, RCX, at(regContext, offsetGlobals));
+      m_asm.load(true, RAX, stack(height - 1));
+      m_asm.store(true, at(RCX, static_cast<int32_t>(8 * index)), RAX);
+    }
+    return;
+  }
+
+  case 0x3f: // memory.size
+  case 0x40: { // memory.grow
+    ensureCondition(reader.byte() == 0x00 && m_hasMemory, ContractValidationFailure, "Module is not valid: invalid memory index.");
+    if (opcode == 0x3f) {
+      push(I32);
+      if (m_live) {
+        m_asm.mov(true, RAX, regMemorySize);
+        m_asm.shiftImm(true, 5, RAX, 16);
+        m_asm.store(false, stack(height), RAX);
+      }
+      return;
+    }
+    pop(I32);
+    push(I32);
+    if (m_live) {
+      m_asm.mov(true, RDI, regContext);
+      m_asm.load(false, RSI, stack(height - 1));
+      emitCallC(reinterpret_cast<void const*>(&BaselineInstance::growMemory));
+      m_asm.store(false, stack(height - 1), RAX);
+      reloadMemory();
+    }
+    return;
+  }
+
+  case 0x41: { // i32.const
+    int32_t value = reader.s32();
+    push(I32);
+    if (m_live)
+      m_asm.storeImm(false, stack(height), value);
+    return;
+  }
+
+  case 0x42: { // i64.const
+    int64_t value = reader.s64();
+    push(I64);
+    if (m_live) {
+      if (value >= numeric_limits<int32_t>::min() && value <= numeric_limits<int32_t>::max()) {
+        m_asm.storeImm(true, stack(height), static_cast<int32_t>(value));
+      } else {
+        m_asm.movImm(RAX, static_cast<uint64_t>(value));
+        m_asm.store(true, stack(height), RAX);
+      }
+    }
+    return;
+  }
+
+  default:
+    break;
+  }
+
+  // Loads
+  if (opcode >= 0x28 && opcode <= 0x35) {
+    ensureCondition(opcode != 0x2a && opcode != 0x2b, ContractValidationFailure, "Floating point is not supported.");
+    static const uint8_t alignments[] = { 2, 3, 2, 3, 0, 0, 1, 1, 0, 0, 1, 1, 2, 2 };
+    uint32_t align = reader.u32();
+    uint32_t offset = reader.u32();
+    ensureCondition(m_hasMemory, ContractValidationFailure, "Module is not valid: no memory.");
+    ensureCondition(align <= alignments[opcode - 0x28], ContractValidationFailure, "Module is not valid: alignment too large.");
+    pop(I32);
+    push(opcode == 0x28 || (opcode >= 0x2c && opcode <= 0x2f) ? I32 : I64);
+    if (m_live)
+      emitLoad(opcode, height - 1, offset);
+    return;
+  }
+
+  // Stores
+  if (opcode >= 0x36 && opcode <= 0x3e) {
+    ensureCondition(opcode != 0x38 && opcode != 0x39, ContractValidationFailure, "Floating point is not supported.");
+    static const uint8_t alignments[] = { 2, 3, 2, 3, 0, 1, 0, 1, 2 };
+    uint32_t align = reader.u32();
+    uint32_t offset = reader.u32();
+    ensureCondition(m_hasMemory, ContractValidationFailure, "Module is not valid: no memory.");
+    ensureCondition(align <= alignments[opcode - 0x36], ContractValidationFailure, "Module is not valid: alignment too large.");
+    pop(opcode == 0x36 || opcode == 0x3a || opcode == 0x3b ? I32 : I64);
+    pop(I32);
+    if (m_live)
+      emitStore(opcode, height - 2, offset);
+    return;
+  }
+
+  // i32.eqz, i64.eqz
+  if (opcode == 0x45 || opcode == 0x50) {
+    bool w = opcode == 0x50;
+    pop(w ? I64 : I32);
+    push(I32);
+    if (m_live) {
+      m_asm.load(w, RAX, stack(height - 1));
+      m_asm.test(w, RAX, RAX);
+      m_asm.setcc(CondE, RAX);
+      m_asm.movzx8(RAX, RAX);
+      m_asm.store(false, stack(height - 1), RAX);
+    }
+    return;
+  }
+
+  // Comparisons
+  if ((opcode >= 0x46 && opcode <= 0x4f) || (opcode >= 0x51 && opcode <= 0x5a)) {
+    static const Cond conditions[] = { CondE, CondNE, CondL, CondB, CondG, CondA, CondLE, CondBE, CondGE, CondAE };
+    bool w = opcode >= 0x51;
+    pop(w ? I64 : I32);
+    pop(w ? I64 : I32);
+    push(I32);
+    if (m_live)
+      emitCompare(w, conditions[opcode - (w ? 0x51 : 0x46)], height - 2);
+    return;
+  }
+
+  // clz, ctz, popcnt
+  if ((opcode >= 0x67 && opcode <= 0x69) || (opcode >= 0x79 && opcode <= 0x7b)) {
+    ValType type = opcode >= 0x79 ? I64 : I32;
+    pop(type);
+    push(type);
+    if (m_live)
+      emitUnary(opcode, height - 1);
+    return;
+  }
+
+  // Binary arithmetic
+  if ((opcode >= 0x6a && opcode <= 0x78) || (opcode >= 0x7c && opcode <= 0x8a)) {
+    ValType type = opcode >= 0x7c ? I64 : I32;
+    pop(type);
+    pop(type);
+    push(type);
+    if (m_live)
+      emitBinary(opcode, height - 2);
+    return;
+  }
+
+  // Conversions
+  if (opcode == 0xa7) { // i32.wrap_i64, the low half is the result
+    pop(I64);
+    push(I32);
+    return;
+  }
+  if (opcode == 0xac || opcode == 0xad) { // i64.extend_i32_s, i64.extend_i32_u
+    pop(I32);
+    push(I64);
+    if (m_live) {
+      if (opcode == 0xac)
+        m_asm.rm(true, { 0x63 }, RAX, stack(height - 1));
+      else
+        m_asm.load(false, RAX, stack(height - 1));
+      m_asm.store(true, stack(height - 1), RAX);
+    }
+    return;
+  }
+
+  ensureCondition(
+    !((opcode >= 0x43 && opcode <= 0x44) || (opcode >= 0x5b && opcode <= 0x66) || (opcode >= 0x8b && opcode <= 0xbf)),
+    ContractValidationFailure,
+    "Floating point is not supported."
+  );
+  ensureCondition(false, ContractValidationFailure, "Module is not valid: unknown instruction.");
+}
+
+// Leaves the effective address of an access of @size bytes in rax, trapping
+// if it is out of bounds.
+void BaselineCompiler::emitAddress(size_t position, uint32_t offset, uint32_t size)
+{
+  m_asm.load(false, RAX, stack(position));
+  if (offset > static_cast<uint32_t>(numeric_limits<int32_t>::max())) {
+    m_asm.movImm(RCX, offset);
+    m_asm.alu(true, opAdd, RAX, RCX);
+  } else if (offset != 0) {
+    m_asm.aluImm(true, 0, RAX, static_cast<int32_t>(offset));
+  }
+  m_asm.lea(RCX, at(RAX, static_cast<int32_t>(size)));
+  m_asm.alu(true, opCmp, RCX, regMemorySize);
+  emitTrap(CondA, Trap::OutOfBounds);
+}
+
+void BaselineCompiler::emitLoad(uint8_t opcode, size_t position, uint32_t offset)
+{
+  static const uint8_t sizes[] = { 4, 8, 4, 8, 1, 1, 2, 2, 1, 1, 2, 2, 4, 4 };
+  emitAddress(position, offset, sizes[opcode - 0x28]);
+  Mem address = at(regMemoryBase, RAX, 1);
+  switch (opcode) {
+  case 0x28: m_asm.load(false, RAX, address); break;
+  case 0x29: m_asm.load(true, RAX, address); break;
+  case 0x2c: m_asm.rm(false, { 0x0f, 0xbe }, RAX, address); break;
+  case 0x2d: m_asm.rm(false, { 0x0f, 0xb6 }, RAX, address); break;
+  case 0x2e: m_asm.rm(false, { 0x0f, 0xbf }, RAX, address); break;
+  case 0x2f: m_asm.rm(false, { 0x0f, 0xb7 }, RAX, address); break;
+  case 0x30: m_asm.rm(true, { 0x0f, 0xbe }, RAX, address); break;
+  case 0x31: m_asm.rm(false, { 0x0f, 0xb6 }, RAX, address); break;
+  case 0x32: m_asm.rm(true, { 0x0f, 0xbf }, RAX, address); break;
+  case 0x33: m_asm.rm(false, { 0x0f, 0xb7 }, RAX, address); break;
+  case 0x34: m_asm.rm(true, { 0x63 }, RAX, address); break;
+  case 0x35: m_asm.load(false, RAX, address); break;
+  }
+  m_asm.store(true, stack(position), RAX);
+}
+
+void BaselineCompiler::emitStore(uint8_t opcode, size_t position, uint32_t offset)
+{
+  static const uint8_t sizes[] = { 4, 8, 4, 8, 1, 2, 1, 2, 4 };
+  emitAddress(position, offset, sizes[opcode - 0x36]);
+  m_asm.load(true, RCX, stack(position + 1));
+  Mem address = at(regMemoryBase, RAX, 1);
+  switch (sizes[opcode - 0x36]) {
+  case 1: m_asm.store8(address, RCX); break;
+  case 2: m_asm.store16(address, RCX); break;
+  case 4: m_asm.store(false, address, RCX); break;
+  case 8: m_asm.store(true, address, RCX); break;
+  }
+}
+
+void BaselineCompiler::emitCompare(bool w, Cond cond, size_t position)
+{
+  m_asm.load(w, RAX, stack(position));
+  m_asm.alu(w, opCmp, RAX, stack(position + 1));
+  m_asm.setcc(cond, RAX);
+  m_asm.movzx8(RAX, RAX);
+  m_asm.store(false, stack(position), RAX);
+}
+
+void BaselineCompiler::emitUnary(uint8_t opcode, size_t position)
+{
+  bool w = opcode >= 0x79;
+  unsigned bits = w ? 64 : 32;
+  m_asm.load(w, RAX, stack(position));
+  switch (w ? opcode - 0x79 + 0x67 : opcode) {
+  case 0x67: // clz: bsr is the index of the highest bit, undefined for zero
+    m_asm.movImm(RCX, 2 * bits - 1);
+    m_asm.bsr(w, RAX, RAX);
+    m_asm.cmov(w, CondE, RAX, RCX);
+    m_asm.aluImm(w, 6, RAX, static_cast<int32_t>(bits - 1));
+    break;
+  case 0x68: // ctz
+    m_asm.movImm(RCX, bits);
+    m_asm.bsf(w, RAX, RAX);
+    m_asm.cmov(w, CondE, RAX, RCX);
+    break;
+  case 0x69:
+    emitPopcount(w);
+    break;
+  }
+  m_asm.store(w, stack(position), RAX);
+}
+
+// Counts the bits of rax in parallel, without relying on the popcnt extension.
+void BaselineCompiler::emitPopcount(bool w)
+{
+  uint64_t m1 = w ? 0x5555555555555555 : 0x55555555;
+  uint64_t m2 = w ? 0x3333333333333333 : 0x33333333;
+  uint64_t m4 = w ? 0x0f0f0f0f0f0f0f0f : 0x0f0f0f0f;
+  uint64_t h01 = w ? 0x0101010101010101 : 0x01010101;
+
+  // x -= (x >> 1) & m1
+  m_asm.mov(w, RCX, RAX);
+  m_asm.shiftImm(w, 5, RCX, 1);
+  m_asm.movImm(RDX, m1);
+  m_asm.alu(w, opAnd, RCX, RDX);
+  m_asm.alu(w, opSub, RAX, RCX);
+  // x = (x & m2) + ((x >> 2) & m2)
+  m_asm.movImm(RDX, m2);
+  m_asm.mov(w, RCX, RAX);
+  m_asm.shiftImm(w, 5, RCX, 2);
+  m_asm.alu(w, opAnd, RCX, RDX);
+  m_asm.alu(w, opAnd, RAX, RDX);
+  m_asm.alu(w, opAdd, RAX, RCX);
+  // x = (x + (x >> 4)) & m4
+  m_asm.mov(w, RCX, RAX);
+  m_asm.shiftImm(w, 5, RCX, 4);
+  m_asm.alu(w, opAdd, RAX, RCX);
+  m_asm.movImm(RDX, m4);
+  m_asm.alu(w, opAnd, RAX, RDX);
+  // x = (x * h01) >> (bits - 8)
+  m_asm.movImm(RDX, h01);
+  m_asm.imul(w, RAX, RDX);
+  m_asm.shiftImm(w, 5, RAX, w ? 56 : 24);
+}
+
+void BaselineCompiler::emitBinary(uint8_t opcode, size_t position)
+{
+  bool w = opcode >= 0x7c;
+  uint8_t op = w ? static_cast<uint8_t>(opcode - 0x7c + 0x6a) : opcode;
+  Mem a = stack(position);
+  Mem b = stack(position + 1);
+
+  switch (op) {
+  case 0x6a: case 0x6b: case 0x71: case 0x72: case 0x73: { // add, sub, and, or, xor
+    uint8_t alu = op == 0x6a ? opAdd : op == 0x6b ? opSub : op == 0x71 ? opAnd : op == 0x72 ? opOr : opXor;
+    m_asm.load(w, RAX, a);
+    m_asm.alu(w, alu, RAX, b);
+    break;
+  }
+  case 0x6c: // mul
+    m_asm.load(w, RAX, a);
+    m_asm.imul(w, RAX, b);
+    break;
+  case 0x6d: emitDivide(w, true, false, position); return;
+  case 0x6e: emitDivide(w, false, false, position); return;
+  case 0x6f: emitDivide(w, true, true, position); return;
+  case 0x70: emitDivide(w, false, true, position); return;
+  case 0x74: case 0x75: case 0x76: case 0x77: case 0x78: { // shl, shr_s, shr_u, rotl, rotr
+    // The count is masked like Wasm requires.
+    static const unsigned digits[] = { 4, 7, 5, 0, 1 };
+    m_asm.load(false, RCX, b);
+    m_asm.load(w, RAX, a);
+    m_asm.shiftCl(w, digits[op - 0x74], RAX);
+    break;
+  }
+  }
+  m_asm.store(w, a, RAX);
+}
+
+void BaselineCompiler::emitDivide(bool w, bool isSigned, bool remainder, size_t position)
+{
+  Mem a = stack(position);
+  m_asm.load(w, RCX, stack(position + 1));
+  m_asm.test(w, RCX, RCX);
+  emitTrap(CondE, Trap::DivideByZero);
+  m_asm.load(w, RAX, a);
+
+  size_t done = SIZE_MAX;
+  if (isSigned) {
+    // The minimum divided by -1 overflows, its remainder is zero.
+    m_asm.aluImm(w, 7, RCX, -1);
+    size_t regular = m_asm.jcc(CondNE);
+    if (remainder) {
+      m_asm.alu(false, opXor, RDX, RDX);
+      done = m_asm.jmp();
+    } else {
+      m_asm.movImm(RDX, w ? 0x8000000000000000 : 0x80000000);
+      m_asm.alu(w, opCmp, RAX, RDX);
+      emitTrap(CondE, Trap::IntegerOverflow);
+    }
+    m_asm.link(regular, m_asm.position());
+    m_asm.signExtendAccumulator(w);
+    m_asm.divide(w, 7, RCX);
+  } else {
+    m_asm.alu(false, opXor, RDX, RDX);
+    m_asm.divide(w, 6, RCX);
+  }
+  if (done != SIZE_MAX)
+    m_asm.link(done, m_asm.position());
+  m_asm.store(w, a, remainder ? RDX : RAX);
+}
+
+/*
+ * Execution
+ */
+
+constexpr size_t BaselineInstance::maxStackSize;
+constexpr size_t BaselineInstance::stackReserve;
+
+BaselineInstance::BaselineInstance(BaselineModule const& module, BaselineHost& host):
+  m_module(module),
+  m_host(host),
+  // Grows in place within the reservation, see growMemory().
+  m_memory(
+    static_cast<size_t>(module.m_memoryPages) * pageSize,
+    PageMapping::reservation(static_cast<size_t>(module.m_memoryPages) * pageSize, static_cast<size_t>(module.m_memoryMaxPages) * pageSize)
+  ),
+  m_globals(module.m_globals),
+  // Entries without a function match no signature.
+  m_table(2 * static_cast<size_t>(module.m_tableSize), numeric_limits<uint64_t>::max())
+{
+  for (auto const& segment: module.m_data)
+    if (!segment.data.empty())
+      memcpy(m_memory.data() + segment.offset, segment.data.data(), segment.data.size());
+  for (auto const& segment: module.m_elements)
+    for (size_t i = 0; i < segment.functions.size(); ++i) {
+      uint32_t function = segment.functions[i];
+      m_table[2 * (segment.offset + i)] = module.m_functionSignatures[function];
+      m_table[2 * (segment.offset + i) + 1] = reinterpret_cast<uintptr_t>(module.m_code.data() + module.m_functionOffsets[function]);
+    }
+
+  m_context.memoryBase = m_memory.data();
+  m_context.memorySize = m_memory.size();
+  m_context.globals = m_globals.data();
+  m_context.table = m_table.data();
+  m_context.tableSize = module.m_tableSize;
+  m_context.stackLimit = 0;
+  m_context.exitStack = 0;
+  m_context.instance = this;
+}
+
+void BaselineInstance::trackMemory(MemoryBudget::Charge* charge, size_t extra)
+{
+  m_memoryCharge = charge;
+  m_memoryExtra = extra;
+  charge->update(m_memoryExtra + m_memory.size());
+}
+
+namespace {
+
+// The lowest usable address of the current thread's own stack, or 0 if it
+// is unknown.
+uintptr_t threadStackBottom()
+{
+  static thread_local uintptr_t bottom = 0;
+  if (bottom)
+    return bottom;
+#if __APPLE__
+  pthread_t self = pthread_self();
+  bottom = reinterpret_cast<uintptr_t>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+#else
+  pthread_attr_t attributes;
+  if (pthread_getattr_np(pthread_self(), &attributes) != 0)
+    return 0;
+  void* address;
+  size_t size;
+  if (pthread_attr_getstack(&attributes, &address, &size) == 0)
+    bottom = reinterpret_cast<uintptr_t>(address);
+  pthread_attr_destroy(&attributes);
+#endif
+  return bottom;
+}
+
+}
+
+void BaselineInstance::run()
+{
+  char marker;
+  m_context.stackLimit = reinterpret_cast<uintptr_t>(&marker) - maxStackSize;
+  // Nested calls each start a window of their own below the caller's, so
+  // it is also kept within the bounds of the stack they share.
+  uintptr_t bottom = FiberPool::currentStackBottom();
+  if (!bottom)
+    bottom = threadStackBottom();
+  if (bottom)
+    m_context.stackLimit = max<uintptr_t>(m_context.stackLimit, bottom + stackReserve);
+  m_error = nullptr;
+
+  typedef void (*Entry)(Context*, uint8_t const*, uint64_t const*);
+  Entry entry = reinterpret_cast<Entry>(m_module.m_code.data());
+  entry(&m_context, m_module.m_code.data() + m_module.m_functionOffsets[m_module.m_main], nullptr);
+  // Exited early by a trap, an exception or the contract terminating.
+  if (m_error)
+    rethrow_exception(m_error);
+}
+
+// Called by the thunks of the imports, which exit the compiled code unless
+// it returns 0. Nothing can be thrown through compiled code, so exceptions
+// are kept until it exited.
+uint32_t BaselineInstance::callImport(Context* context, uint32_t index, uint64_t const* args, uint64_t* result) noexcept
+{
+  BaselineInstance& self = *context->instance;
+  try {
+    *result = self.m_host.callImport(self.m_module.m_imports[index], args);
+    return self.m_host.halted() ? 1 : 0;
+  } catch (...) {
+    self.m_error = current_exception();
+    return 1;
+  }
+}
+
+// Compiled code reloads the base after growing, so the memory may move once
+// it outgrows its reservation.
+uint32_t BaselineInstance::growMemory(Context* context, uint32_t delta) noexcept
+{
+  BaselineInstance& self = *context->instance;
+  uint64_t pages = self.m_memory.size() / pageSize;
+  if (delta > self.m_module.m_memoryMaxPages - pages)
+    return numeric_limits<uint32_t>::max();
+  if (!self.m_memory.resize((pages + delta) * pageSize, static_cast<size_t>(self.m_module.m_memoryMaxPages) * pageSize))
+    return numeric_limits<uint32_t>::max();
+  self.m_context.memoryBase = self.m_memory.data();
+  self.m_context.memorySize = self.m_memory.size();
+  if (self.m_memoryCharge)
+    self.m_memoryCharge->update(self.m_memoryExtra + self.m_memory.size());
+  return static_cast<uint32_t>(pages);
+}
+
+// Called by the trap stubs, which exit the compiled code.
+void BaselineInstance::trap(Context* context, uint32_t kind) noexcept
+{
+  BaselineInstance& self = *context->instance;
+  try {
+    self.m_error = make_exception_ptr(VMTrap{trapMessage(kind)});
+  } catch (...) {
+    self.m_error = current_exception();
+  }
+}
+
+}
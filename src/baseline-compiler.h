@@ -0,0 +1,168 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "eei.h"
+#include "huge-pages.h"
+#include "memory-budget.h"
+#include "module-cache.h"
+
+namespace hera {
+
+// A function imported by a contract.
+struct BaselineImport {
+  std::string module;
+  std::string base;
+  // Unresolved for the "debug" namespace.
+  EEIFunction function;
+  uint32_t paramCount;
+};
+
+// Implemented by the engine to serve the imports of a contract.
+class BaselineHost {
+public:
+  // Arguments are passed as 64 bit values, of which i32 arguments only use
+  // the low half. Returns the result, if any. May throw.
+  virtual uint64_t callImport(BaselineImport const& import, uint64_t const* args) = 0;
+  // Whether the contract terminated in the last import called.
+  virtual bool halted() const = 0;
+
+protected:
+  ~BaselineHost() = default;
+};
+
+// A contract compiled to x86-64 code by a single pass over each function
+// body, validating as it goes. The code is immutable once compiled.
+//
+// Every value of the Wasm stack and every local lives in a slot of the
+// native frame of its function, so that blocks merge values by position
+// and calls take their arguments in place. Compiled code keeps the
+// instance in r15 and the base and size of the linear memory in r14 and
+// r13, which the System V ABI preserves across calls into C++.
+class BaselineModule : public CachedModule {
+public:
+  // Throws ContractValidationFailure if the contract is not a valid ewasm
+  // module, which must not use floating point.
+  static std::unique_ptr<BaselineModule> compile(std::vector<uint8_t> const& code);
+
+  BaselineModule(BaselineModule const&) = delete;
+  BaselineModule& operator=(BaselineModule const&) = delete;
+
+  std::vector<BaselineImport> const& imports() const { return m_imports; }
+  size_t codeSize() const { return m_code.size(); }
+
+  size_t footprint() const override;
+
+private:
+  struct DataSegment {
+    uint32_t offset;
+    std::vector<uint8_t> data;
+  };
+
+  struct ElementSegment {
+    uint32_t offset;
+    std::vector<uint32_t> functions;
+  };
+
+  BaselineModule() = default;
+
+  std::vector<BaselineImport> m_imports;
+  // The canonical signature of every function, imports first.
+  std::vector<uint32_t> m_functionSignatures;
+  // Offsets into the code of every function, imports first.
+  std::vector<size_t> m_functionOffsets;
+  std::vector<uint64_t> m_globals;
+  uint32_t m_memoryPages = 0;
+  uint32_t m_memoryMaxPages = 0;
+  uint32_t m_tableSize = 0;
+  std::vector<DataSegment> m_data;
+  std::vector<ElementSegment> m_elements;
+  uint32_t m_main = 0;
+
+  // Executable mapping of the code.
+  PageMapping m_code;
+
+  friend class BaselineCompiler;
+  friend class BaselineInstance;
+};
+
+// The state of an execution of a BaselineModule.
+class BaselineInstance {
+public:
+  BaselineInstance(BaselineModule const& module, BaselineHost& host);
+
+  BaselineInstance(BaselineInstance const&) = delete;
+  BaselineInstance& operator=(BaselineInstance const&) = delete;
+
+  // Keeps charge at @extra bytes plus the size of the linear memory.
+  void trackMemory(MemoryBudget::Charge* charge, size_t extra);
+
+  // Runs "main" until it returns or the contract terminates. Rethrows what
+  // an import threw and throws VMTrap on traps.
+  void run();
+
+  size_t memorySize() const { return m_memory.size(); }
+  uint8_t* memoryData() { return m_memory.data(); }
+
+  // Read by compiled code through r15, see the offsets in the compiler.
+  struct Context {
+    uint8_t* memoryBase;
+    uint64_t memorySize;
+    uint64_t* globals;
+    // Pairs of canonical signature and code address.
+    uint64_t* table;
+    uint64_t tableSize;
+    // Compiled code traps once the stack pointer drops below this.
+    uintptr_t stackLimit;
+    // The stack pointer of the entry, which the exit returns to.
+    uintptr_t exitStack;
+    BaselineInstance* instance;
+  };
+
+  // The native stack compiled code may use per run(). Less if needed to
+  // leave stackReserve for imports and traps above the bottom of the
+  // stack it runs on, the thread's own or a fiber's.
+  static constexpr size_t maxStackSize = 256 * 1024;
+  static constexpr size_t stackReserve = 32 * 1024;
+
+private:
+  static uint32_t callImport(Context* context, uint32_t index, uint64_t const* args, uint64_t* result) noexcept;
+  static uint32_t growMemory(Context* context, uint32_t delta) noexcept;
+  static void trap(Context* context, uint32_t kind) noexcept;
+
+  BaselineModule const& m_module;
+  BaselineHost& m_host;
+  Context m_context;
+  PageMapping m_memory;
+  std::vector<uint64_t> m_globals;
+  std::vector<uint64_t> m_table;
+  MemoryBudget::Charge* m_memoryCharge = nullptr;
+  size_t m_memoryExtra = 0;
+  // What exited the compiled code, or null if the contract terminated.
+  std::exception_ptr m_error;
+
+  friend class BaselineCompiler;
+};
+
+}
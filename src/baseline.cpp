@@ -0,0 +1,299 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <vector>
+#include <iostream>
+
+#include "baseline.h"
+#include "baseline-compiler.h"
+#include "debugging.h"
+#include "eei.h"
+#include "exceptions.h"
+#include "memory-budget.h"
+#include "module-cache.h"
+#include "probes.h"
+
+using namespace std;
+
+namespace hera {
+
+template <evmc_revision Revision>
+class BaselineEthereumInterface : public EthereumInterface<BaselineEthereumInterface<Revision>, Revision>, public BaselineHost {
+  friend class EthereumInterface<BaselineEthereumInterface<Revision>, Revision>;
+
+public:
+  explicit BaselineEthereumInterface(
+    evmc_context* _context,
+    vector<uint8_t> const& _code,
+    evmc_message const& _msg,
+    ExecutionResult & _result,
+    bool _meterGas
+  ):
+    EthereumInterface<BaselineEthereumInterface<Revision>, Revision>(_context, _code, _msg, _result, _meterGas)
+  {}
+
+  void setInstance(BaselineInstance* instance) { m_instance = instance; }
+
+  uint64_t callImport(BaselineImport const& import, uint64_t const* args) override;
+
+  bool halted() const override { return EthereumInterface<BaselineEthereumInterface<Revision>, Revision>::halted(); }
+
+private:
+  uint64_t callEthereumImport(EEIFunction function, uint64_t const* args);
+  uint64_t callDebugImport(BaselineImport const& import, uint64_t const* args);
+
+  // These assume that the instance was set prior to execution.
+  size_t memorySize() const { return m_instance->memorySize(); }
+  uint8_t* memoryData() { return m_instance->memoryData(); }
+
+  BaselineInstance* m_instance = nullptr;
+};
+
+template <evmc_revision Revision>
+uint64_t BaselineEthereumInterface<Revision>::callImport(BaselineImport const& import, uint64_t const* args)
+{
+  // The compiler only accepts imports of the signatures below.
+  if (import.function != EEIFunction::Unresolved)
+    return callEthereumImport(import.function, args);
+  return callDebugImport(import, args);
+}
+
+template <evmc_revision Revision>
+uint64_t BaselineEthereumInterface<Revision>::callEthereumImport(EEIFunction function, uint64_t const* args)
+{
+  // i32 arguments are the low halves.
+  auto arg32 = [args](unsigned i) { return static_cast<uint32_t>(args[i]); };
+
+  switch (function) {
+  case EEIFunction::useGas:
+    this->eeiUseGas(static_cast<int64_t>(args[0]));
+    return 0;
+  case EEIFunction::getGasLeft:
+    return static_cast<uint64_t>(this->eeiGetGasLeft());
+  case EEIFunction::getAddress:
+    this->eeiGetAddress(arg32(0));
+    return 0;
+  case EEIFunction::getExternalBalance:
+    this->eeiGetExternalBalance(arg32(0), arg32(1));
+    return 0;
+  case EEIFunction::getBlockHash:
+    return this->eeiGetBlockHash(args[0], arg32(1));
+  case EEIFunction::getCallDataSize:
+    return this->eeiGetCallDataSize();
+  case EEIFunction::callDataCopy:
+    this->eeiCallDataCopy(arg32(0), arg32(1), arg32(2));
+    return 0;
+  case EEIFunction::getCaller:
+    this->eeiGetCaller(arg32(0));
+    return 0;
+  case EEIFunction::getCallValue:
+    this->eeiGetCallValue(arg32(0));
+    return 0;
+  case EEIFunction::codeCopy:
+    this->eeiCodeCopy(arg32(0), arg32(1), arg32(2));
+    return 0;
+  case EEIFunction::getCodeSize:
+    return this->eeiGetCodeSize();
+  case EEIFunction::externalCodeCopy:
+    this->eeiExternalCodeCopy(arg32(0), arg32(1), arg32(2), arg32(3));
+    return 0;
+  case EEIFunction::getExternalCodeSize:
+    return this->eeiGetExternalCodeSize(arg32(0));
+  case EEIFunction::getBlockCoinbase:
+    this->eeiGetBlockCoinbase(arg32(0));
+    return 0;
+  case EEIFunction::getBlockDifficulty:
+    this->eeiGetBlockDifficulty(arg32(0));
+    return 0;
+  case EEIFunction::getBlockGasLimit:
+    return static_cast<uint64_t>(this->eeiGetBlockGasLimit());
+  case EEIFunction::getTxGasPrice:
+    this->eeiGetTxGasPrice(arg32(0));
+    return 0;
+  case EEIFunction::log:
+    this->eeiLog(arg32(0), arg32(1), arg32(2), arg32(3), arg32(4), arg32(5), arg32(6));
+    return 0;
+  case EEIFunction::getBlockNumber:
+    return static_cast<uint64_t>(this->eeiGetBlockNumber());
+  case EEIFunction::getBlockTimestamp:
+    return static_cast<uint64_t>(this->eeiGetBlockTimestamp());
+  case EEIFunction::getTxOrigin:
+    this->eeiGetTxOrigin(arg32(0));
+    return 0;
+  case EEIFunction::storageStore:
+    this->eeiStorageStore(arg32(0), arg32(1));
+    return 0;
+  case EEIFunction::storageLoad:
+    this->eeiStorageLoad(arg32(0), arg32(1));
+    return 0;
+  // Terminating sets halted(), on which the compiled code exits.
+  case EEIFunction::finish:
+    this->eeiFinish(arg32(0), arg32(1));
+    return 0;
+  case EEIFunction::revert:
+    this->eeiRevert(arg32(0), arg32(1));
+    return 0;
+  case EEIFunction::getReturnDataSize:
+    return this->eeiGetReturnDataSize();
+  case EEIFunction::returnDataCopy:
+    this->eeiReturnDataCopy(arg32(0), arg32(1), arg32(2));
+    return 0;
+  case EEIFunction::call:
+    return this->eeiCall(EEICallKind::Call, static_cast<int64_t>(args[0]), arg32(1), arg32(2), arg32(3), arg32(4));
+  case EEIFunction::callCode:
+    return this->eeiCall(EEICallKind::CallCode, static_cast<int64_t>(args[0]), arg32(1), arg32(2), arg32(3), arg32(4));
+  case EEIFunction::callDelegate:
+    return this->eeiCall(EEICallKind::CallDelegate, static_cast<int64_t>(args[0]), arg32(1), 0, arg32(2), arg32(3));
+  case EEIFunction::callStatic:
+    return this->eeiCall(EEICallKind::CallStatic, static_cast<int64_t>(args[0]), arg32(1), 0, arg32(2), arg32(3));
+  case EEIFunction::create:
+    return this->eeiCreate(arg32(0), arg32(1), arg32(2), arg32(3));
+  case EEIFunction::selfDestruct:
+    this->eeiSelfDestruct(arg32(0));
+    return 0;
+  case EEIFunction::Unresolved:
+    break;
+  }
+  heraAssert(false, "Unsupported import called.");
+}
+
+template <evmc_revision Revision>
+uint64_t BaselineEthereumInterface<Revision>::callDebugImport(BaselineImport const& import, uint64_t const* args)
+{
+  heraAssert(import.module == "debug", "Import namespace error.");
+
+#if HERA_DEBUGGING
+  if (import.base == "evmTrace") {
+    this->evmTrace(
+      static_cast<uint32_t>(args[0]),
+      static_cast<int32_t>(args[1]),
+      static_cast<uint32_t>(args[2]),
+      static_cast<int32_t>(args[3])
+    );
+    return 0;
+  }
+
+  if (import.base == "print32") {
+    uint32_t value = static_cast<uint32_t>(args[0]);
+    cerr << "DEBUG print32: " << value << " " << hex << "0x" << value << dec << endl;
+    return 0;
+  }
+
+  if (import.base == "print64") {
+    uint64_t value = args[0];
+    cerr << "DEBUG print64: " << value << " " << hex << "0x" << value << dec << endl;
+    return 0;
+  }
+
+  if (import.base == "printMem" || import.base == "printMemHex") {
+    this->debugPrintMem(import.base == "printMemHex", static_cast<uint32_t>(args[0]), static_cast<uint32_t>(args[1]));
+    return 0;
+  }
+
+  if (import.base == "printStorage" || import.base == "printStorageHex") {
+    this->debugPrintStorage(import.base == "printStorageHex", static_cast<uint32_t>(args[0]));
+    return 0;
+  }
+#endif
+
+  heraAssert(false, string("Unsupported import called: ") + import.module + "::" + import.base);
+}
+
+unique_ptr<WasmEngine> BaselineEngine::create()
+{
+  return unique_ptr<WasmEngine>{new BaselineEngine};
+}
+
+ExecutionResult BaselineEngine::execute(
+  evmc_context* context,
+  evmc_revision rev,
+  vector<uint8_t> const& code,
+  vector<uint8_t> const& state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas
+) {
+  switch (rev) {
+  case EVMC_BYZANTIUM:
+    return internalExecute<EVMC_BYZANTIUM>(context, code, state_code, msg, meterInterfaceGas);
+  default:
+    heraAssert(false, "Unsupported revision.");
+  }
+}
+
+void BaselineEngine::verifyContract(vector<uint8_t> const& code)
+{
+  // Compiling validates, and is about as fast as validating alone.
+  auto start = chrono::steady_clock::now();
+  shared_ptr<const BaselineModule> module = BaselineModule::compile(code);
+
+  // Deployed code is usually called soon, which then need not compile it again.
+  if (ModuleCache* moduleCache = ModuleCache::current()) {
+    double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    moduleCache->store(code, module, nanoseconds);
+  }
+}
+
+template <evmc_revision Revision>
+ExecutionResult BaselineEngine::internalExecute(
+  evmc_context* context,
+  vector<uint8_t> const& code,
+  vector<uint8_t> const& state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas
+) {
+  HERA_DEBUG << "Executing with the baseline compiler...\n";
+
+  // Executions share the compiled code, which is immutable.
+  ModuleCache* moduleCache = ModuleCache::current();
+  bool remote = false;
+  shared_ptr<const BaselineModule> module = moduleCache ? moduleCache->lookup<BaselineModule>(code, &remote) : nullptr;
+  if (!module || remote) {
+    // Parsing, validation and compilation are a single pass.
+    auto start = chrono::steady_clock::now();
+    module = BaselineModule::compile(code);
+    HERA_PROBE3(parse__done, ProbeScope::codeHash(), msg.gas, code.size());
+    PhaseTimer::done(ExecutionPhase::Parse);
+    HERA_PROBE2(validate__done, ProbeScope::codeHash(), msg.gas);
+    PhaseTimer::done(ExecutionPhase::Validate);
+    HERA_DEBUG << "Compiled " << code.size() << " bytes of Wasm to " << module->codeSize() << " bytes of code.\n";
+
+    if (moduleCache) {
+      double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+      moduleCache->store(code, module, nanoseconds);
+    }
+  }
+
+  ExecutionResult result;
+  BaselineEthereumInterface<Revision> interface{context, state_code, msg, result, meterInterfaceGas};
+  BaselineInstance instance(*module, interface);
+  interface.setInstance(&instance);
+  HERA_PROBE2(instantiate__done, ProbeScope::codeHash(), msg.gas);
+  PhaseTimer::done(ExecutionPhase::Instantiate);
+
+  MemoryBudget* budget = MemoryBudget::current();
+  MemoryBudget::Charge instanceCharge(budget ? &budget->instances() : nullptr, 0);
+  // Cached code is accounted to the cache.
+  if (budget)
+    instance.trackMemory(&instanceCharge, moduleCache ? 0 : code.size() + module->codeSize());
+
+  // Returns on termination through finish, revert or selfDestruct too.
+  instance.run();
+
+  return result;
+}
+
+}
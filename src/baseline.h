@@ -0,0 +1,51 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "eei.h"
+
+namespace hera {
+
+// Compiles contracts to x86-64 in a single pass, see baseline-compiler.h.
+class BaselineEngine : public WasmEngine {
+public:
+  /// Factory method to create the baseline compiler Wasm Engine.
+  static std::unique_ptr<WasmEngine> create();
+
+  ExecutionResult execute(
+    evmc_context* context,
+    evmc_revision rev,
+    std::vector<uint8_t> const& code,
+    std::vector<uint8_t> const& state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas
+  ) override;
+
+  void verifyContract(std::vector<uint8_t> const& code) override;
+
+private:
+  template <evmc_revision Revision>
+  ExecutionResult internalExecute(
+    evmc_context* context,
+    std::vector<uint8_t> const& code,
+    std::vector<uint8_t> const& state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas
+  );
+};
+
+}
@@ -0,0 +1,685 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "binaryen-module.h"
+
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+
+#include "exceptions.h"
+#include "shell-interface.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+// The blocks of all flat modules, which are read on every execution of a
+// cached contract.
+PageArena& flatArena()
+{
+  static PageArena arena;
+  return arena;
+}
+
+// Marks an optional expression which is not there, in place of its id.
+constexpr uint8_t noExpression = 0xff;
+
+class FlatWriter {
+public:
+  explicit FlatWriter(vector<wasm::Name>& names): m_names(names) {
+    m_names.assign(1, wasm::Name());
+    m_nameIndices[nullptr] = 0;
+  }
+
+  template <typename T>
+  void put(T value) {
+    static_assert(is_trivially_copyable<T>::value, "Fields are copied bytewise.");
+    size_t at = m_bytes.size();
+    m_bytes.resize(at + sizeof(T));
+    memcpy(&m_bytes[at], &value, sizeof(T));
+  }
+
+  void count(size_t value) { put(static_cast<uint32_t>(value)); }
+  void type(wasm::Type value) { put(static_cast<uint8_t>(value)); }
+
+  void raw(void const* data, size_t size) {
+    count(size);
+    m_bytes.insert(m_bytes.end(), static_cast<uint8_t const*>(data), static_cast<uint8_t const*>(data) + size);
+  }
+
+  void name(wasm::Name value) {
+    // Interned names are equal exactly when their strings are the same.
+    auto it = m_nameIndices.find(value.str);
+    if (it == m_nameIndices.end()) {
+      it = m_nameIndices.emplace(value.str, static_cast<uint32_t>(m_names.size())).first;
+      m_names.push_back(value);
+    }
+    put(it->second);
+  }
+
+  void types(vector<wasm::Type> const& values) {
+    count(values.size());
+    for (wasm::Type value: values)
+      type(value);
+  }
+
+  void literal(wasm::Literal const& value) {
+    switch (value.type) {
+    case wasm::Type::i32:
+      put(static_cast<uint64_t>(static_cast<uint32_t>(value.geti32())));
+      break;
+    case wasm::Type::i64:
+      put(static_cast<uint64_t>(value.geti64()));
+      break;
+    case wasm::Type::f32:
+      put(static_cast<uint64_t>(static_cast<uint32_t>(value.reinterpreti32())));
+      break;
+    case wasm::Type::f64:
+      put(static_cast<uint64_t>(value.reinterpreti64()));
+      break;
+    default:
+      m_failed = true;
+    }
+  }
+
+  // In preorder, each with its id, its type and its fields before its
+  // children.
+  void expression(wasm::Expression* curr) {
+    if (!curr) {
+      put(noExpression);
+      return;
+    }
+    put(static_cast<uint8_t>(curr->_id));
+    type(curr->type);
+    switch (curr->_id) {
+    case wasm::Expression::NopId:
+    case wasm::Expression::UnreachableId:
+      break;
+    case wasm::Expression::BlockId: {
+      wasm::Block* block = curr->cast<wasm::Block>();
+      name(block->name);
+      count(block->list.size());
+      for (wasm::Expression* child: block->list)
+        expression(child);
+      break;
+    }
+    case wasm::Expression::IfId: {
+      wasm::If* branch = curr->cast<wasm::If>();
+      expression(branch->condition);
+      expression(branch->ifTrue);
+      expression(branch->ifFalse);
+      break;
+    }
+    case wasm::Expression::LoopId: {
+      wasm::Loop* loop = curr->cast<wasm::Loop>();
+      name(loop->name);
+      expression(loop->body);
+      break;
+    }
+    case wasm::Expression::BreakId: {
+      wasm::Break* br = curr->cast<wasm::Break>();
+      name(br->name);
+      expression(br->value);
+      expression(br->condition);
+      break;
+    }
+    case wasm::Expression::SwitchId: {
+      wasm::Switch* sw = curr->cast<wasm::Switch>();
+      count(sw->targets.size());
+      for (wasm::Name target: sw->targets)
+        name(target);
+      name(sw->default_);
+      expression(sw->value);
+      expression(sw->condition);
+      break;
+    }
+    case wasm::Expression::CallId: {
+      wasm::Call* call = curr->cast<wasm::Call>();
+      name(call->target);
+      operands(call->operands);
+      break;
+    }
+    case wasm::Expression::CallImportId: {
+      wasm::CallImport* call = curr->cast<wasm::CallImport>();
+      name(call->target);
+      operands(call->operands);
+      break;
+    }
+    case wasm::Expression::CallIndirectId: {
+      wasm::CallIndirect* call = curr->cast<wasm::CallIndirect>();
+      name(call->fullType);
+      operands(call->operands);
+      expression(call->target);
+      break;
+    }
+    case wasm::Expression::GetLocalId:
+      put(static_cast<uint32_t>(curr->cast<wasm::GetLocal>()->index));
+      break;
+    case wasm::Expression::SetLocalId: {
+      // Whether it is a tee is told by its type.
+      wasm::SetLocal* set = curr->cast<wasm::SetLocal>();
+      put(static_cast<uint32_t>(set->index));
+      expression(set->value);
+      break;
+    }
+    case wasm::Expression::GetGlobalId:
+      name(curr->cast<wasm::GetGlobal>()->name);
+      break;
+    case wasm::Expression::SetGlobalId: {
+      wasm::SetGlobal* set = curr->cast<wasm::SetGlobal>();
+      name(set->name);
+      expression(set->value);
+      break;
+    }
+    case wasm::Expression::LoadId: {
+      wasm::Load* load = curr->cast<wasm::Load>();
+      if (load->isAtomic)
+        m_failed = true;
+      put(static_cast<uint8_t>(load->bytes));
+      put(static_cast<uint8_t>(load->signed_));
+      put(static_cast<uint32_t>(load->offset));
+      put(static_cast<uint32_t>(load->align));
+      expression(load->ptr);
+      break;
+    }
+    case wasm::Expression::StoreId: {
+      wasm::Store* store = curr->cast<wasm::Store>();
+      if (store->isAtomic)
+        m_failed = true;
+      put(static_cast<uint8_t>(store->bytes));
+      put(static_cast<uint32_t>(store->offset));
+      put(static_cast<uint32_t>(store->align));
+      type(store->valueType);
+      expression(store->ptr);
+      expression(store->value);
+      break;
+    }
+    case wasm::Expression::ConstId:
+      literal(curr->cast<wasm::Const>()->value);
+      break;
+    case wasm::Expression::UnaryId: {
+      wasm::Unary* unary = curr->cast<wasm::Unary>();
+      put(static_cast<uint16_t>(unary->op));
+      expression(unary->value);
+      break;
+    }
+    case wasm::Expression::BinaryId: {
+      wasm::Binary* binary = curr->cast<wasm::Binary>();
+      put(static_cast<uint16_t>(binary->op));
+      expression(binary->left);
+      expression(binary->right);
+      break;
+    }
+    case wasm::Expression::SelectId: {
+      wasm::Select* select = curr->cast<wasm::Select>();
+      expression(select->ifTrue);
+      expression(select->ifFalse);
+      expression(select->condition);
+      break;
+    }
+    case wasm::Expression::DropId:
+      expression(curr->cast<wasm::Drop>()->value);
+      break;
+    case wasm::Expression::ReturnId:
+      expression(curr->cast<wasm::Return>()->value);
+      break;
+    case wasm::Expression::HostId: {
+      wasm::Host* host = curr->cast<wasm::Host>();
+      put(static_cast<uint16_t>(host->op));
+      name(host->nameOperand);
+      operands(host->operands);
+      break;
+    }
+    default:
+      // Atomics, which contracts have no use for.
+      m_failed = true;
+    }
+  }
+
+  bool failed() const { return m_failed; }
+  vector<uint8_t> const& bytes() const { return m_bytes; }
+
+private:
+  void operands(wasm::ExpressionList const& list) {
+    count(list.size());
+    for (wasm::Expression* operand: list)
+      expression(operand);
+  }
+
+  vector<uint8_t> m_bytes;
+  vector<wasm::Name>& m_names;
+  unordered_map<char const*, uint32_t> m_nameIndices;
+  bool m_failed = false;
+};
+
+// Reads what FlatWriter wrote, in the same order, allocating the expressions
+// in the arena of the module.
+class FlatReader {
+public:
+  FlatReader(uint8_t const* data, vector<wasm::Name> const& names, wasm::Module& module):
+    m_data(data), m_names(names), m_module(module)
+  {}
+
+  template <typename T>
+  T get() {
+    T value;
+    memcpy(&value, m_data, sizeof(T));
+    m_data += sizeof(T);
+    return value;
+  }
+
+  size_t count() { return get<uint32_t>(); }
+
+  void raw(vector<char>& data) {
+    data.resize(count());
+    if (!data.empty())
+      memcpy(data.data(), m_data, data.size());
+    m_data += data.size();
+  }
+
+  wasm::Type type() { return static_cast<wasm::Type>(get<uint8_t>()); }
+  wasm::Name name() { return m_names[get<uint32_t>()]; }
+
+  void types(vector<wasm::Type>& values) {
+    values.resize(count());
+    for (wasm::Type& value: values)
+      value = type();
+  }
+
+  wasm::Literal literal(wasm::Type literalType) {
+    uint64_t bits = get<uint64_t>();
+    switch (literalType) {
+    case wasm::Type::i32:
+      return wasm::Literal(static_cast<int32_t>(static_cast<uint32_t>(bits)));
+    case wasm::Type::i64:
+      return wasm::Literal(static_cast<int64_t>(bits));
+    case wasm::Type::f32:
+      return wasm::Literal(static_cast<int32_t>(static_cast<uint32_t>(bits))).castToF32();
+    default:
+      return wasm::Literal(static_cast<int64_t>(bits)).castToF64();
+    }
+  }
+
+  wasm::Expression* expression() {
+    uint8_t id = get<uint8_t>();
+    if (id == noExpression)
+      return nullptr;
+    wasm::Type expressionType = type();
+    wasm::Expression* result = nullptr;
+    switch (static_cast<wasm::Expression::Id>(id)) {
+    case wasm::Expression::NopId:
+      result = make<wasm::Nop>();
+      break;
+    case wasm::Expression::UnreachableId:
+      result = make<wasm::Unreachable>();
+      break;
+    case wasm::Expression::BlockId: {
+      wasm::Block* block = make<wasm::Block>();
+      block->name = name();
+      for (size_t i = count(); i > 0; --i)
+        block->list.push_back(expression());
+      result = block;
+      break;
+    }
+    case wasm::Expression::IfId: {
+      wasm::If* branch = make<wasm::If>();
+      branch->condition = expression();
+      branch->ifTrue = expression();
+      branch->ifFalse = expression();
+      result = branch;
+      break;
+    }
+    case wasm::Expression::LoopId: {
+      wasm::Loop* loop = make<wasm::Loop>();
+      loop->name = name();
+      loop->body = expression();
+      result = loop;
+      break;
+    }
+    case wasm::Expression::BreakId: {
+      wasm::Break* br = make<wasm::Break>();
+      br->name = name();
+      br->value = expression();
+      br->condition = expression();
+      result = br;
+      break;
+    }
+    case wasm::Expression::SwitchId: {
+      wasm::Switch* sw = make<wasm::Switch>();
+      for (size_t i = count(); i > 0; --i)
+        sw->targets.push_back(name());
+      sw->default_ = name();
+      sw->value = expression();
+      sw->condition = expression();
+      result = sw;
+      break;
+    }
+    case wasm::Expression::CallId: {
+      wasm::Call* call = make<wasm::Call>();
+      call->target = name();
+      operands(call->operands);
+      result = call;
+      break;
+    }
+    case wasm::Expression::CallImportId: {
+      wasm::CallImport* call = make<wasm::CallImport>();
+      call->target = name();
+      operands(call->operands);
+      result = call;
+      break;
+    }
+    case wasm::Expression::CallIndirectId: {
+      wasm::CallIndirect* call = make<wasm::CallIndirect>();
+      call->fullType = name();
+      operands(call->operands);
+      call->target = expression();
+      result = call;
+      break;
+    }
+    case wasm::Expression::GetLocalId: {
+      wasm::GetLocal* local = make<wasm::GetLocal>();
+      local->index = get<uint32_t>();
+      result = local;
+      break;
+    }
+    case wasm::Expression::SetLocalId: {
+      wasm::SetLocal* local = make<wasm::SetLocal>();
+      local->index = get<uint32_t>();
+      local->value = expression();
+      result = local;
+      break;
+    }
+    case wasm::Expression::GetGlobalId: {
+      wasm::GetGlobal* global = make<wasm::GetGlobal>();
+      global->name = name();
+      result = global;
+      break;
+    }
+    case wasm::Expression::SetGlobalId: {
+      wasm::SetGlobal* global = make<wasm::SetGlobal>();
+      global->name = name();
+      global->value = expression();
+      result = global;
+      break;
+    }
+    case wasm::Expression::LoadId: {
+      wasm::Load* load = make<wasm::Load>();
+      load->bytes = get<uint8_t>();
+      load->signed_ = get<uint8_t>() != 0;
+      load->offset = get<uint32_t>();
+      load->align = get<uint32_t>();
+      load->isAtomic = false;
+      load->ptr = expression();
+      result = load;
+      break;
+    }
+    case wasm::Expression::StoreId: {
+      wasm::Store* store = make<wasm::Store>();
+      store->bytes = get<uint8_t>();
+      store->offset = get<uint32_t>();
+      store->align = get<uint32_t>();
+      store->isAtomic = false;
+      store->valueType = type();
+      store->ptr = expression();
+      store->value = expression();
+      result = store;
+      break;
+    }
+    case wasm::Expression::ConstId: {
+      wasm::Const* constant = make<wasm::Const>();
+      constant->value = literal(expressionType);
+      result = constant;
+      break;
+    }
+    case wasm::Expression::UnaryId: {
+      wasm::Unary* unary = make<wasm::Unary>();
+      unary->op = static_cast<wasm::UnaryOp>(get<uint16_t>());
+      unary->value = expression();
+      result = unary;
+      break;
+    }
+    case wasm::Expression::BinaryId: {
+      wasm::Binary* binary = make<wasm::Binary>();
+      binary->op = static_cast<wasm::BinaryOp>(get<uint16_t>());
+      binary->left = expression();
+      binary->right = expression();
+      result = binary;
+      break;
+    }
+    case wasm::Expression::SelectId: {
+      wasm::Select* select = make<wasm::Select>();
+      select->ifTrue = expression();
+      select->ifFalse = expression();
+      select->condition = expression();
+      result = select;
+      break;
+    }
+    case wasm::Expression::DropId: {
+      wasm::Drop* drop = make<wasm::Drop>();
+      drop->value = expression();
+      result = drop;
+      break;
+    }
+    case wasm::Expression::ReturnId: {
+      wasm::Return* ret = make<wasm::Return>();
+      ret->value = expression();
+      result = ret;
+      break;
+    }
+    case wasm::Expression::HostId: {
+      wasm::Host* host = make<wasm::Host>();
+      host->op = static_cast<wasm::HostOp>(get<uint16_t>());
+      host->nameOperand = name();
+      operands(host->operands);
+      result = host;
+      break;
+    }
+    default:
+      heraAssert(false, "Corrupt flat module.");
+    }
+    // As validated, nothing is finalized again.
+    result->type = expressionType;
+    return result;
+  }
+
+private:
+  template <typename T>
+  T* make() { return m_module.allocator.alloc<T>(); }
+
+  void operands(wasm::ExpressionList& list) {
+    for (size_t i = count(); i > 0; --i)
+      list.push_back(expression());
+  }
+
+  uint8_t const* m_data;
+  vector<wasm::Name> const& m_names;
+  wasm::Module& m_module;
+};
+
+}
+
+shared_ptr<BinaryenModule> BinaryenModule::build(wasm::Module const& module)
+{
+  shared_ptr<BinaryenModule> flat(new BinaryenModule);
+  FlatWriter writer(flat->m_names);
+
+  writer.count(module.functionTypes.size());
+  for (auto const& functionType: module.functionTypes) {
+    writer.name(functionType->name);
+    writer.type(functionType->result);
+    writer.types(functionType->params);
+  }
+
+  flat->m_imports.reserve(module.imports.size());
+  writer.count(module.imports.size());
+  for (auto const& import: module.imports) {
+    flat->m_imports.push_back(resolveEEIFunction(import->module.str, import->base.str));
+    writer.name(import->name);
+    writer.name(import->module);
+    writer.name(import->base);
+    writer.put(static_cast<uint8_t>(import->kind));
+    writer.name(import->functionType);
+    writer.type(import->globalType);
+  }
+
+  writer.count(module.globals.size());
+  for (auto const& global: module.globals) {
+    writer.name(global->name);
+    writer.type(global->type);
+    writer.put(static_cast<uint8_t>(global->mutable_));
+    writer.expression(global->init);
+  }
+
+  writer.count(module.functions.size());
+  for (auto const& function: module.functions) {
+    writer.name(function->name);
+    writer.name(function->type);
+    writer.type(function->result);
+    writer.types(function->params);
+    writer.types(function->vars);
+    writer.expression(function->body);
+  }
+
+  flat->m_tableLayout = module.table;
+  flat->m_tableLayout.segments.clear();
+  writer.count(module.table.segments.size());
+  for (auto const& segment: module.table.segments) {
+    writer.expression(segment.offset);
+    writer.count(segment.data.size());
+    for (wasm::Name function: segment.data)
+      writer.name(function);
+  }
+
+  flat->m_memoryLayout = module.memory;
+  flat->m_memoryLayout.segments.clear();
+  writer.count(module.memory.segments.size());
+  for (auto const& segment: module.memory.segments) {
+    writer.expression(segment.offset);
+    writer.raw(segment.data.data(), segment.data.size());
+  }
+
+  writer.count(module.exports.size());
+  for (auto const& exported: module.exports) {
+    writer.name(exported->name);
+    writer.name(exported->value);
+    writer.put(static_cast<uint8_t>(exported->kind));
+  }
+  writer.name(module.start);
+
+  if (writer.failed())
+    return nullptr;
+
+  if (!wasm::ShellExternalInterface::resolveTable(module, flat->m_table))
+    vector<wasm::Index>().swap(flat->m_table);
+
+  vector<uint8_t> const& bytes = writer.bytes();
+  flat->m_code = flatArena().allocate(bytes.size());
+  memcpy(flat->m_code.data(), bytes.data(), bytes.size());
+  vector<wasm::Name>(flat->m_names).swap(flat->m_names);
+  return flat;
+}
+
+BinaryenModule::BinaryenModule(BinaryenModule const& other):
+  CachedModule(other),
+  m_code(flatArena().allocate(other.m_code.size())),
+  m_names(other.m_names),
+  m_tableLayout(other.m_tableLayout),
+  m_memoryLayout(other.m_memoryLayout),
+  m_imports(other.m_imports),
+  m_table(other.m_table)
+{
+  memcpy(m_code.data(), other.m_code.data(), m_code.size());
+}
+
+void BinaryenModule::instantiate(wasm::Module & module) const
+{
+  FlatReader reader(m_code.data(), m_names, module);
+
+  for (size_t i = reader.count(); i > 0; --i) {
+    wasm::FunctionType* functionType = new wasm::FunctionType;
+    functionType->name = reader.name();
+    functionType->result = reader.type();
+    reader.types(functionType->params);
+    module.addFunctionType(functionType);
+  }
+
+  for (size_t i = reader.count(); i > 0; --i) {
+    wasm::Import* import = new wasm::Import;
+    import->name = reader.name();
+    import->module = reader.name();
+    import->base = reader.name();
+    import->kind = static_cast<wasm::ExternalKind>(reader.get<uint8_t>());
+    import->functionType = reader.name();
+    import->globalType = reader.type();
+    module.addImport(import);
+  }
+
+  for (size_t i = reader.count(); i > 0; --i) {
+    wasm::Global* global = new wasm::Global;
+    global->name = reader.name();
+    global->type = reader.type();
+    global->mutable_ = reader.get<uint8_t>() != 0;
+    global->init = reader.expression();
+    module.addGlobal(global);
+  }
+
+  for (size_t i = reader.count(); i > 0; --i) {
+    wasm::Function* function = new wasm::Function;
+    function->name = reader.name();
+    function->type = reader.name();
+    function->result = reader.type();
+    reader.types(function->params);
+    reader.types(function->vars);
+    function->body = reader.expression();
+    module.addFunction(function);
+  }
+
+  module.table = m_tableLayout;
+  module.table.segments.resize(reader.count());
+  for (auto& segment: module.table.segments) {
+    segment.offset = reader.expression();
+    segment.data.resize(reader.count());
+    for (wasm::Name& function: segment.data)
+      function = reader.name();
+  }
+
+  module.memory = m_memoryLayout;
+  module.memory.segments.resize(reader.count());
+  for (auto& segment: module.memory.segments) {
+    segment.offset = reader.expression();
+    reader.raw(segment.data);
+  }
+
+  for (size_t i = reader.count(); i > 0; --i) {
+    wasm::Export* exported = new wasm::Export;
+    exported->name = reader.name();
+    exported->value = reader.name();
+    exported->kind = static_cast<wasm::ExternalKind>(reader.get<uint8_t>());
+    module.addExport(exported);
+  }
+  module.start = reader.name();
+}
+
+size_t BinaryenModule::footprint() const
+{
+  return sizeof(*this) + m_code.size() + m_names.capacity() * sizeof(wasm::Name) +
+    m_imports.capacity() * sizeof(EEIFunction) + m_table.capacity() * sizeof(wasm::Index);
+}
+
+}
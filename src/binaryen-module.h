@@ -0,0 +1,76 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <wasm.h>
+
+#include "eei.h"
+#include "huge-pages.h"
+#include "module-cache.h"
+
+namespace hera {
+
+// A contract which passed validation, kept flat: its function types,
+// imports, globals, functions with their code, table and memory segments
+// and exports are encoded one after another in a single block of an arena,
+// with fixed width fields and names referring to a table of interned names.
+// The EEI function of each import and the function of each table element
+// are resolved once as well.
+//
+// Instances are rebuilt from it without parsing the binary, resolving names,
+// inferring types or validating, and a cached contract takes about the size
+// of its binary instead of that of a wasm::Module, which is many times more.
+class BinaryenModule : public CachedModule {
+public:
+  // Flattens @module, which must have passed verifyContract(). Returns
+  // nullptr if it uses expressions which are not flattened, such as atomics.
+  static std::shared_ptr<BinaryenModule> build(wasm::Module const& module);
+
+  // A copy in memory of the calling thread's NUMA node.
+  BinaryenModule(BinaryenModule const& other);
+  BinaryenModule& operator=(BinaryenModule const&) = delete;
+
+  // Rebuilds the module into the empty @module, whose arena holds its
+  // expressions.
+  void instantiate(wasm::Module & module) const;
+
+  // In the order of declaration, Unresolved for those of other namespaces.
+  std::vector<EEIFunction> const& imports() const { return m_imports; }
+
+  // See wasm::ShellExternalInterface::resolveTable(), nullptr if the table
+  // depends on the instance.
+  std::vector<wasm::Index> const* table() const { return m_table.empty() ? nullptr : &m_table; }
+
+  size_t footprint() const override;
+
+private:
+  BinaryenModule() = default;
+
+  PageArena::Block m_code;
+  // Null first, for names which are not set.
+  std::vector<wasm::Name> m_names;
+  // Their segments are in m_code.
+  wasm::Table m_tableLayout;
+  wasm::Memory m_memoryLayout;
+  std::vector<EEIFunction> m_imports;
+  std::vector<wasm::Index> m_table;
+};
+
+}
@@ -14,6 +14,15 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 
 #include <pass.h>
@@ -25,9 +34,17 @@
 #include <wasm-validator.h>
 
 #include "binaryen.h"
+#include "binaryen-module.h"
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
+#include "execution-stats.h"
+#include "memory-budget.h"
+#include "module-cache.h"
+#include "numa.h"
+#include "probes.h"
+#include "profiler.h"
+#include "worker-pool.h"
 
 #include "shell-interface.h"
 
@@ -35,7 +52,42 @@ using namespace std;
 
 namespace hera {
 
-class BinaryenEthereumInterface : public wasm::ShellExternalInterface, EthereumInterface {
+// The EEI functions of the imports of a parsed module, by the address of
+// the import.
+class ImportTable {
+public:
+  // Pairs the first imports of @module with @functions, which are in the
+  // order of declaration.
+  ImportTable(wasm::Module const& module, vector<EEIFunction> const& functions) {
+    heraAssert(functions.size() <= module.imports.size(), "Import count mismatch.");
+    for (size_t i = 0; i < functions.size(); ++i)
+      if (functions[i] != EEIFunction::Unresolved)
+        m_entries.emplace_back(module.imports[i].get(), functions[i]);
+    sort(m_entries.begin(), m_entries.end());
+  }
+
+  EEIFunction resolve(wasm::Import const* import) const {
+    auto it = lower_bound(m_entries.begin(), m_entries.end(), make_pair(import, EEIFunction{}));
+    return (it != m_entries.end() && it->first == import) ? it->second : EEIFunction::Unresolved;
+  }
+
+private:
+  vector<pair<wasm::Import const*, EEIFunction>> m_entries;
+};
+
+// The EEI functions of the imports of a module which has no flat form.
+vector<EEIFunction> resolveImports(wasm::Module const& module)
+{
+  vector<EEIFunction> functions;
+  for (auto const& import: module.imports)
+    functions.push_back(resolveEEIFunction(import->module.str, import->base.str));
+  return functions;
+}
+
+template <evmc_revision Revision>
+class BinaryenEthereumInterface : public wasm::ShellExternalInterface, EthereumInterface<BinaryenEthereumInterface<Revision>, Revision> {
+  friend class EthereumInterface<BinaryenEthereumInterface<Revision>, Revision>;
+
 public:
   explicit BinaryenEthereumInterface(
     evmc_context* _context,
@@ -45,35 +97,79 @@ public:
     bool _meterGas
   ):
     ShellExternalInterface(),
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface<BinaryenEthereumInterface<Revision>, Revision>(_context, _code, _msg, _result, _meterGas)
   { }
 
+  // Counts executed instructions and EEI calls into stats. The histograms
+  // are those of the blocks instrumented by instrumentBlocks().
+  void collectStats(ExecutionStats* stats, vector<WasmOpHistogram> const* histograms) {
+    m_stats = stats;
+    m_histograms = histograms;
+  }
+
+  // Reports function entries and returns to profiler. The frames are those
+  // of the functions instrumented by instrumentFunctions(), in order.
+  void collectProfile(Profiler* profiler, vector<uint32_t> const* frames) {
+    m_profiler = profiler;
+    m_frames = frames;
+  }
+
+  // The EEI functions of the imports of the executed module.
+  void useImports(ImportTable const* imports) {
+    m_imports = imports;
+  }
+
+  // Keeps charge at @extra bytes plus the size of the linear memory.
+  void trackMemory(MemoryBudget::Charge* charge, size_t extra) {
+    m_memoryCharge = charge;
+    m_memoryExtra = extra;
+    charge->update(m_memoryExtra + memory.size());
+  }
+
 protected:
   wasm::Literal callImport(wasm::Import *import, wasm::LiteralList& arguments) override;
+  wasm::Literal callEthereumImport(EEIFunction function, wasm::Import *import, wasm::LiteralList& arguments);
 #if HERA_DEBUGGING
   wasm::Literal callDebugImport(wasm::Import *import, wasm::LiteralList& arguments);
 #endif
 
   void importGlobals(map<wasm::Name, wasm::Literal>& globals, wasm::Module& wasm) override;
 
+  bool halted() const override { return EthereumInterface<BinaryenEthereumInterface<Revision>, Revision>::halted(); }
+
   void trap(const char* why) override {
     ensureCondition(false, VMTrap, why);
   }
 
+  void growMemory(wasm::Address oldSize, wasm::Address newSize) override {
+    wasm::ShellExternalInterface::growMemory(oldSize, newSize);
+    if (m_memoryCharge)
+      m_memoryCharge->update(m_memoryExtra + memory.size());
+  }
+
 private:
-  size_t memorySize() const override { return memory.size(); }
-  void memorySet(size_t offset, uint8_t value) override { memory.set<uint8_t>(offset, value); }
-  uint8_t memoryGet(size_t offset) override { return memory.get<uint8_t>(offset); }
+  size_t memorySize() const { return memory.size(); }
+  uint8_t* memoryData() { return reinterpret_cast<uint8_t*>(memory.data()); }
+
+  ExecutionStats* m_stats = nullptr;
+  vector<WasmOpHistogram> const* m_histograms = nullptr;
+  Profiler* m_profiler = nullptr;
+  vector<uint32_t> const* m_frames = nullptr;
+  MemoryBudget::Charge* m_memoryCharge = nullptr;
+  size_t m_memoryExtra = 0;
+  ImportTable const* m_imports = nullptr;
 };
 
-  void BinaryenEthereumInterface::importGlobals(map<wasm::Name, wasm::Literal>& globals, wasm::Module& wasm) {
+  template <evmc_revision Revision>
+  void BinaryenEthereumInterface<Revision>::importGlobals(map<wasm::Name, wasm::Literal>& globals, wasm::Module& wasm) {
     (void)globals;
     (void)wasm;
     HERA_DEBUG << "importGlobals\n";
   }
 
 #if HERA_DEBUGGING
-  wasm::Literal BinaryenEthereumInterface::callDebugImport(wasm::Import *import, wasm::LiteralList& arguments) {
+  template <evmc_revision Revision>
+  wasm::Literal BinaryenEthereumInterface<Revision>::callDebugImport(wasm::Import *import, wasm::LiteralList& arguments) {
     heraAssert(import->module == wasm::Name("debug"), "Import namespace error.");
 
     if (import->base == wasm::Name("print32")) {
@@ -102,7 +198,7 @@ private:
       uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[1].geti32());
 
-      debugPrintMem(import->base == wasm::Name("printMemHex"), offset, length);
+      this->debugPrintMem(import->base == wasm::Name("printMemHex"), offset, length);
 
       return wasm::Literal();
     }
@@ -112,7 +208,7 @@ private:
 
       uint32_t pathOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      debugPrintStorage(import->base == wasm::Name("printStorageHex"), pathOffset);
+      this->debugPrintStorage(import->base == wasm::Name("printStorageHex"), pathOffset);
 
       return wasm::Literal();
     }
@@ -125,7 +221,7 @@ private:
       uint32_t cost = static_cast<uint32_t>(arguments[2].geti32());
       int32_t sp = arguments[3].geti32();
 
-      debugEvmTrace(pc, opcode, cost, sp);
+      this->evmTrace(pc, opcode, cost, sp);
 
       return wasm::Literal();
     }
@@ -134,7 +230,38 @@ private:
   }
 #endif
 
-  wasm::Literal BinaryenEthereumInterface::callImport(wasm::Import *import, wasm::LiteralList& arguments) {
+  template <evmc_revision Revision>
+  wasm::Literal BinaryenEthereumInterface<Revision>::callImport(wasm::Import *import, wasm::LiteralList& arguments) {
+    EEIFunction function = m_imports->resolve(import);
+
+    if (function != EEIFunction::Unresolved) {
+      if (m_stats)
+        ++m_stats->eeiCalls[import->base.str];
+      return callEthereumImport(function, import, arguments);
+    }
+
+    if (m_profiler && import->module == wasm::Name("hera")) {
+      if (import->base == wasm::Name("profileEnter")) {
+        uint32_t index = static_cast<uint32_t>(arguments[0].geti32());
+        heraAssert(index < m_frames->size(), "Invalid function index.");
+        m_profiler->push((*m_frames)[index]);
+        return wasm::Literal();
+      }
+      if (import->base == wasm::Name("profileLeave")) {
+        m_profiler->pop();
+        return wasm::Literal();
+      }
+    }
+
+    if (m_stats && import->module == wasm::Name("hera") && import->base == wasm::Name("profileBlock")) {
+      uint32_t index = static_cast<uint32_t>(arguments[0].geti32());
+      heraAssert(index < m_histograms->size(), "Invalid block index.");
+      WasmOpHistogram const& histogram = (*m_histograms)[index];
+      for (size_t i = 0; i < histogram.size(); ++i)
+        m_stats->wasmOps[i] += histogram[i];
+      return wasm::Literal();
+    }
+
 #if HERA_DEBUGGING
     if (import->module == wasm::Name("debug"))
       // Reroute to debug namespace
@@ -142,110 +269,115 @@ private:
 #endif
 
     heraAssert(import->module == wasm::Name("ethereum"), "Only imports from the 'ethereum' namespace are allowed.");
+    heraAssert(false, string("Unsupported import called: ") + import->module.str + "::" + import->base.str + " (" + to_string(arguments.size()) + "arguments)");
+  }
 
-    if (import->base == wasm::Name("useGas")) {
+  template <evmc_revision Revision>
+  wasm::Literal BinaryenEthereumInterface<Revision>::callEthereumImport(EEIFunction function, wasm::Import *import, wasm::LiteralList& arguments) {
+    switch (function) {
+    case EEIFunction::useGas: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       int64_t gas = arguments[0].geti64();
 
-      eeiUseGas(gas);
+      this->eeiUseGas(gas);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getGasLeft")) {
+    case EEIFunction::getGasLeft: {
       heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal(eeiGetGasLeft());
+      return wasm::Literal(this->eeiGetGasLeft());
     }
 
-    if (import->base == wasm::Name("getAddress")) {
+    case EEIFunction::getAddress: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      eeiGetAddress(resultOffset);
+      this->eeiGetAddress(resultOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getExternalBalance")) {
+    case EEIFunction::getExternalBalance: {
       heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
 
-      eeiGetExternalBalance(addressOffset, resultOffset);
+      this->eeiGetExternalBalance(addressOffset, resultOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockHash")) {
+    case EEIFunction::getBlockHash: {
       heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
 
       uint64_t number = static_cast<uint64_t>(arguments[0].geti64());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
 
-      return wasm::Literal(eeiGetBlockHash(number, resultOffset));
+      return wasm::Literal(this->eeiGetBlockHash(number, resultOffset));
     }
 
-    if (import->base == wasm::Name("getCallDataSize")) {
+    case EEIFunction::getCallDataSize: {
       heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal(eeiGetCallDataSize());
+      return wasm::Literal(this->eeiGetCallDataSize());
     }
 
-    if (import->base == wasm::Name("callDataCopy")) {
+    case EEIFunction::callDataCopy: {
       heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t dataOffset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
 
-      eeiCallDataCopy(resultOffset, dataOffset, length);
+      this->eeiCallDataCopy(resultOffset, dataOffset, length);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getCaller")) {
+    case EEIFunction::getCaller: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      eeiGetCaller(resultOffset);
+      this->eeiGetCaller(resultOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getCallValue")) {
+    case EEIFunction::getCallValue: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      eeiGetCallValue(resultOffset);
+      this->eeiGetCallValue(resultOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("codeCopy")) {
+    case EEIFunction::codeCopy: {
       heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t codeOffset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
 
-      eeiCodeCopy(resultOffset, codeOffset, length);
+      this->eeiCodeCopy(resultOffset, codeOffset, length);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getCodeSize")) {
+    case EEIFunction::getCodeSize: {
       heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal(eeiGetCodeSize());
+      return wasm::Literal(this->eeiGetCodeSize());
     }
 
-    if (import->base == wasm::Name("externalCodeCopy")) {
+    case EEIFunction::externalCodeCopy: {
       heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
@@ -253,56 +385,56 @@ private:
       uint32_t codeOffset = static_cast<uint32_t>(arguments[2].geti32());
       uint32_t length = static_cast<uint32_t>(arguments[3].geti32());
 
-      eeiExternalCodeCopy(addressOffset, resultOffset, codeOffset, length);
+      this->eeiExternalCodeCopy(addressOffset, resultOffset, codeOffset, length);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getExternalCodeSize")) {
+    case EEIFunction::getExternalCodeSize: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      return wasm::Literal(eeiGetExternalCodeSize(addressOffset));
+      return wasm::Literal(this->eeiGetExternalCodeSize(addressOffset));
     }
 
-    if (import->base == wasm::Name("getBlockCoinbase")) {
+    case EEIFunction::getBlockCoinbase: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      eeiGetBlockCoinbase(resultOffset);
+      this->eeiGetBlockCoinbase(resultOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockDifficulty")) {
+    case EEIFunction::getBlockDifficulty: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
 
-      eeiGetBlockDifficulty(offset);
+      this->eeiGetBlockDifficulty(offset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockGasLimit")) {
+    case EEIFunction::getBlockGasLimit: {
       heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal(eeiGetBlockGasLimit());
+      return wasm::Literal(this->eeiGetBlockGasLimit());
     }
 
-    if (import->base == wasm::Name("getTxGasPrice")) {
+    case EEIFunction::getTxGasPrice: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t valueOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      eeiGetTxGasPrice(valueOffset);
+      this->eeiGetTxGasPrice(valueOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("log")) {
+    case EEIFunction::log: {
       heraAssert(arguments.size() == 7, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t dataOffset = static_cast<uint32_t>(arguments[0].geti32());
@@ -313,110 +445,110 @@ private:
       uint32_t topic3 = static_cast<uint32_t>(arguments[5].geti32());
       uint32_t topic4 = static_cast<uint32_t>(arguments[6].geti32());
 
-      eeiLog(dataOffset, length, numberOfTopics, topic1, topic2, topic3, topic4);
+      this->eeiLog(dataOffset, length, numberOfTopics, topic1, topic2, topic3, topic4);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getBlockNumber")) {
+    case EEIFunction::getBlockNumber: {
       heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal(eeiGetBlockNumber());
+      return wasm::Literal(this->eeiGetBlockNumber());
     }
 
-    if (import->base == wasm::Name("getBlockTimestamp")) {
+    case EEIFunction::getBlockTimestamp: {
       heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal(eeiGetBlockTimestamp());
+      return wasm::Literal(this->eeiGetBlockTimestamp());
     }
 
-    if (import->base == wasm::Name("getTxOrigin")) {
+    case EEIFunction::getTxOrigin: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t resultOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      eeiGetTxOrigin(resultOffset);
+      this->eeiGetTxOrigin(resultOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("storageStore")) {
+    case EEIFunction::storageStore: {
       heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t pathOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t valueOffset = static_cast<uint32_t>(arguments[1].geti32());
 
-      eeiStorageStore(pathOffset, valueOffset);
+      this->eeiStorageStore(pathOffset, valueOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("storageLoad")) {
+    case EEIFunction::storageLoad: {
       heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t pathOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[1].geti32());
 
-      eeiStorageLoad(pathOffset, resultOffset);
+      this->eeiStorageLoad(pathOffset, resultOffset);
 
       return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("finish")) {
+    case EEIFunction::finish: {
       heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t size = static_cast<uint32_t>(arguments[1].geti32());
 
-      // This traps.
-      eeiFinish(offset, size);
+      this->eeiFinish(offset, size);
+
+      // The patched interpreter returns from every frame once halted.
+      return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("revert")) {
+    case EEIFunction::revert: {
       heraAssert(arguments.size() == 2, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t offset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t size = static_cast<uint32_t>(arguments[1].geti32());
 
-      // This traps.
-      eeiRevert(offset, size);
+      this->eeiRevert(offset, size);
+
+      // The patched interpreter returns from every frame once halted.
+      return wasm::Literal();
     }
 
-    if (import->base == wasm::Name("getReturnDataSize")) {
+    case EEIFunction::getReturnDataSize: {
       heraAssert(arguments.size() == 0, string("Argument count mismatch in: ") + import->base.str);
 
-      return wasm::Literal(eeiGetReturnDataSize());
+      return wasm::Literal(this->eeiGetReturnDataSize());
     }
 
-    if (import->base == wasm::Name("returnDataCopy")) {
+    case EEIFunction::returnDataCopy: {
       heraAssert(arguments.size() == 3, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t dataOffset = static_cast<uint32_t>(arguments[0].geti32());
       uint32_t offset = static_cast<uint32_t>(arguments[1].geti32());
       uint32_t size = static_cast<uint32_t>(arguments[2].geti32());
 
-      eeiReturnDataCopy(dataOffset, offset, size);
+      this->eeiReturnDataCopy(dataOffset, offset, size);
 
       return wasm::Literal();
     }
 
-    if (
-      import->base == wasm::Name("call") ||
-      import->base == wasm::Name("callCode") ||
-      import->base == wasm::Name("callDelegate") ||
-      import->base == wasm::Name("callStatic")
-    ) {
+    case EEIFunction::call:
+    case EEIFunction::callCode:
+    case EEIFunction::callDelegate:
+    case EEIFunction::callStatic: {
       EEICallKind kind;
-      if (import->base == wasm::Name("call"))
+      if (function == EEIFunction::call)
         kind = EEICallKind::Call;
-      else if (import->base == wasm::Name("callCode"))
+      else if (function == EEIFunction::callCode)
         kind = EEICallKind::CallCode;
-      else if (import->base == wasm::Name("callDelegate"))
+      else if (function == EEIFunction::callDelegate)
         kind = EEICallKind::CallDelegate;
-      else if (import->base == wasm::Name("callStatic"))
-        kind = EEICallKind::CallStatic;
       else
-        heraAssert(false, "");
+        kind = EEICallKind::CallStatic;
 
       if ((kind == EEICallKind::Call) || (kind == EEICallKind::CallCode)) {
         heraAssert(arguments.size() == 5, string("Argument count mismatch in: ") + import->base.str);
@@ -440,10 +572,10 @@ private:
         dataLength = static_cast<uint32_t>(arguments[3].geti32());
       }
 
-      return wasm::Literal(eeiCall(kind, gas, addressOffset, valueOffset, dataOffset, dataLength));
+      return wasm::Literal(this->eeiCall(kind, gas, addressOffset, valueOffset, dataOffset, dataLength));
     }
 
-    if (import->base == wasm::Name("create")) {
+    case EEIFunction::create: {
       heraAssert(arguments.size() == 4, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t valueOffset = static_cast<uint32_t>(arguments[0].geti32());
@@ -451,16 +583,22 @@ private:
       uint32_t length = static_cast<uint32_t>(arguments[2].geti32());
       uint32_t resultOffset = static_cast<uint32_t>(arguments[3].geti32());
 
-      return wasm::Literal(eeiCreate(valueOffset, dataOffset, length, resultOffset));
+      return wasm::Literal(this->eeiCreate(valueOffset, dataOffset, length, resultOffset));
     }
 
-    if (import->base == wasm::Name("selfDestruct")) {
+    case EEIFunction::selfDestruct: {
       heraAssert(arguments.size() == 1, string("Argument count mismatch in: ") + import->base.str);
 
       uint32_t addressOffset = static_cast<uint32_t>(arguments[0].geti32());
 
-      // This traps.
-      eeiSelfDestruct(addressOffset);
+      this->eeiSelfDestruct(addressOffset);
+
+      // The patched interpreter returns from every frame once halted.
+      return wasm::Literal();
+    }
+
+    case EEIFunction::Unresolved:
+      break;
     }
 
     heraAssert(false, string("Unsupported import called: ") + import->module.str + "::" + import->base.str + " (" + to_string(arguments.size()) + "arguments)");
@@ -471,44 +609,516 @@ unique_ptr<WasmEngine> BinaryenEngine::create()
   return unique_ptr<WasmEngine>{new BinaryenEngine};
 }
 
-// Execute the contract through Binaryen.
 ExecutionResult BinaryenEngine::execute(
   evmc_context* context,
+  evmc_revision rev,
   vector<uint8_t> const& code,
   vector<uint8_t> const& state_code,
   evmc_message const& msg,
   bool meterInterfaceGas
 ) {
-  wasm::Module module;
+  switch (rev) {
+  case EVMC_BYZANTIUM:
+    return internalExecute<EVMC_BYZANTIUM>(context, code, state_code, msg, meterInterfaceGas);
+  default:
+    heraAssert(false, "Unsupported revision.");
+  }
+}
 
-  // Load module
-  loadModule(code, module);
+// Execute the contract through Binaryen.
+template <evmc_revision Revision>
+ExecutionResult BinaryenEngine::internalExecute(
+  evmc_context* context,
+  vector<uint8_t> const& code,
+  vector<uint8_t> const& state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas
+) {
+  ExecutionStatsSink* statsSink = ExecutionStatsSink::current();
+  Profiler* profiler = Profiler::current();
 
-  // Print
-  // WasmPrinter::printModule(module);
+  ModuleCache* moduleCache = ModuleCache::current();
+  bool remote = false;
+  shared_ptr<const BinaryenModule> cached = moduleCache ? moduleCache->lookup<BinaryenModule>(code, &remote) : nullptr;
 
-  // Validate
-  verifyContract(module);
+  // Load module, from the flat form of a cached contract, which passed
+  // validation already, if there is one.
+  wasm::Module module;
+  if (cached) {
+    cached->instantiate(module);
+    HERA_PROBE3(parse__done, ProbeScope::codeHash(), msg.gas, code.size());
+    PhaseTimer::done(ExecutionPhase::Parse);
+    if (remote) {
+      // Copying the entry beats reading it from afar on every execution.
+      moduleCache->store(code, make_shared<BinaryenModule>(*cached), 0);
+    }
+  } else {
+    auto start = chrono::steady_clock::now();
+    loadModule(code, module);
+    HERA_PROBE3(parse__done, ProbeScope::codeHash(), msg.gas, code.size());
+    PhaseTimer::done(ExecutionPhase::Parse);
+
+    // Print
+    // WasmPrinter::printModule(module);
+
+    // Validate
+    verifyContract(module);
+    HERA_PROBE2(validate__done, ProbeScope::codeHash(), msg.gas);
+    PhaseTimer::done(ExecutionPhase::Validate);
+    cached = BinaryenModule::build(module);
+    if (moduleCache && cached) {
+      double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+      moduleCache->store(code, cached, nanoseconds);
+    }
+  }
+  // Before instrumenting, whose imports are appended.
+  ImportTable imports(module, cached ? cached->imports() : resolveImports(module));
 
   // NOTE: DO NOT use the optimiser here, it will conflict with metering
 
+  ExecutionStats stats;
+  vector<WasmOpHistogram> histograms;
+  if (statsSink)
+    instrumentBlocks(module, histograms);
+
+  // Instrumented last, so that the stats do not count the calls it adds.
+  vector<uint32_t> frames;
+  if (profiler)
+    instrumentFunctions(module, *profiler, frames);
+
   // Interpret
   ExecutionResult result;
-  BinaryenEthereumInterface interface(context, state_code, msg, result, meterInterfaceGas);
+  BinaryenEthereumInterface<Revision> interface(context, state_code, msg, result, meterInterfaceGas);
+  interface.useImports(&imports);
+  interface.useResolvedTable(cached ? cached->table() : nullptr);
+  if (statsSink)
+    interface.collectStats(&stats, &histograms);
+  if (profiler)
+    interface.collectProfile(profiler, &frames);
   wasm::ModuleInstance instance(module, &interface);
+  HERA_PROBE2(instantiate__done, ProbeScope::codeHash(), msg.gas);
+  PhaseTimer::done(ExecutionPhase::Instantiate);
+  MemoryBudget* budget = MemoryBudget::current();
+  MemoryBudget::Charge instanceCharge(budget ? &budget->instances() : nullptr, 0);
+  // The parsed module is the execution's own, its expressions live in the
+  // arena of the module.
+  interface.trackMemory(&instanceCharge, code.size() + module.allocator.chunks.size() * wasm::MixedArena::CHUNK_SIZE);
 
   try {
     wasm::Name main = wasm::Name("main");
     wasm::LiteralList args;
     instance.callExport(main, args);
-  } catch (EndExecution const&) {
-    // This exception is ignored here because we consider it to be a success.
-    // It is only a clutch for POSIX style exit()
+  } catch (...) {
+    // Failed executions consume all gas.
+    if (statsSink)
+      statsSink->append(msg, msg.gas, stats);
+    throw;
   }
 
+  if (statsSink)
+    statsSink->append(msg, msg.gas - result.gasLeft, stats);
+
   return result;
 }
 
+namespace {
+
+WasmOpClass classifyExpression(wasm::Expression* curr)
+{
+  switch (curr->_id) {
+  case wasm::Expression::BlockId:
+  case wasm::Expression::IfId:
+  case wasm::Expression::LoopId:
+  case wasm::Expression::BreakId:
+  case wasm::Expression::SwitchId:
+  case wasm::Expression::ReturnId:
+  case wasm::Expression::UnreachableId:
+    return WasmOpClass::Control;
+  case wasm::Expression::CallId:
+  case wasm::Expression::CallImportId:
+    return WasmOpClass::Call;
+  case wasm::Expression::CallIndirectId:
+    return WasmOpClass::CallIndirect;
+  case wasm::Expression::GetLocalId:
+  case wasm::Expression::SetLocalId:
+    return WasmOpClass::Local;
+  case wasm::Expression::GetGlobalId:
+  case wasm::Expression::SetGlobalId:
+    return WasmOpClass::Global;
+  case wasm::Expression::LoadId:
+    return WasmOpClass::Load;
+  case wasm::Expression::StoreId:
+    return WasmOpClass::Store;
+  case wasm::Expression::ConstId:
+    return WasmOpClass::Const;
+  case wasm::Expression::UnaryId:
+    return WasmOpClass::Unary;
+  case wasm::Expression::BinaryId:
+    switch (curr->cast<wasm::Binary>()->op) {
+    case wasm::MulInt32:
+    case wasm::MulInt64:
+      return WasmOpClass::Multiply;
+    case wasm::DivSInt32:
+    case wasm::DivUInt32:
+    case wasm::RemSInt32:
+    case wasm::RemUInt32:
+    case wasm::DivSInt64:
+    case wasm::DivUInt64:
+    case wasm::RemSInt64:
+    case wasm::RemUInt64:
+      return WasmOpClass::Divide;
+    default:
+      return WasmOpClass::Binary;
+    }
+  case wasm::Expression::HostId:
+    return WasmOpClass::Memory;
+  default:
+    return WasmOpClass::Other;
+  }
+}
+
+// The zero value of a value type.
+wasm::Literal makeZero(wasm::Type type)
+{
+  switch (type) {
+  case wasm::Type::i32:
+    return wasm::Literal(int32_t(0));
+  case wasm::Type::i64:
+    return wasm::Literal(int64_t(0));
+  case wasm::Type::f32:
+    return wasm::Literal(float(0));
+  case wasm::Type::f64:
+    return wasm::Literal(double(0));
+  default:
+    heraAssert(false, "Not a value type.");
+  }
+}
+
+// Adds an import of a function from the "hera" namespace, which is only
+// provided by the engine itself. Returns its internal name.
+wasm::Name addHeraImport(wasm::Module& module, char const* base, vector<wasm::Type> params)
+{
+  wasm::Name name(string("hera$") + base);
+  heraAssert(!module.getImportOrNull(name) && !module.getFunctionOrNull(name), "Cannot instrument contract.");
+
+  wasm::FunctionType* type = new wasm::FunctionType;
+  type->name = wasm::Name(string("hera$") + base + "Type");
+  type->params = move(params);
+  type->result = wasm::Type::none;
+  module.addFunctionType(type);
+
+  wasm::Import* import = new wasm::Import;
+  import->name = name;
+  import->module = wasm::Name("hera");
+  import->base = wasm::Name(base);
+  import->functionType = type->name;
+  import->kind = wasm::ExternalKind::Function;
+  module.addImport(import);
+
+  return name;
+}
+
+// Makes every block and loop report its entry by calling the given import
+// with the index of a histogram of the instructions it contains outside of
+// nested blocks. Like the Sentinel's metering, a block is counted in full
+// once entered, including instructions a branch out of it skips.
+class BlockProfiler : public wasm::PostWalker<BlockProfiler, wasm::UnifiedExpressionVisitor<BlockProfiler>> {
+  using Super = wasm::PostWalker<BlockProfiler, wasm::UnifiedExpressionVisitor<BlockProfiler>>;
+
+public:
+  BlockProfiler(wasm::Module& module, wasm::Name import, vector<WasmOpHistogram>& histograms):
+    m_builder(module), m_import(import), m_histograms(histograms)
+  {}
+
+  static void scan(BlockProfiler* self, wasm::Expression** currp) {
+    Super::scan(self, currp);
+    // Pushed last, so it runs before the children are walked.
+    if ((*currp)->is<wasm::Block>() || (*currp)->is<wasm::Loop>())
+      self->pushTask(enterRegion, currp);
+  }
+
+  void doWalkFunction(wasm::Function* func) {
+    m_regions.emplace_back();
+    walk(func->body);
+    func->body = prependCounter(func->body);
+  }
+
+  void visitExpression(wasm::Expression* curr) {
+    // Global initialisers and segment offsets are not executed by the contract.
+    if (m_regions.empty())
+      return;
+
+    if (wasm::Block* block = curr->dynCast<wasm::Block>()) {
+      if (block->list.empty())
+        m_regions.pop_back();
+      else
+        block->list[0] = prependCounter(block->list[0]);
+    } else if (wasm::Loop* loop = curr->dynCast<wasm::Loop>()) {
+      loop->body = prependCounter(loop->body);
+    }
+
+    ++m_regions.back()[static_cast<size_t>(classifyExpression(curr))];
+  }
+
+private:
+  static void enterRegion(BlockProfiler* self, wasm::Expression**) {
+    self->m_regions.emplace_back();
+  }
+
+  // Closes the innermost region and makes expression report it first.
+  wasm::Expression* prependCounter(wasm::Expression* expression) {
+    WasmOpHistogram histogram = m_regions.back();
+    m_regions.pop_back();
+
+    bool empty = true;
+    for (uint64_t count: histogram)
+      empty = empty && count == 0;
+    if (empty)
+      return expression;
+
+    m_histograms.push_back(histogram);
+    wasm::Expression* index = m_builder.makeConst(wasm::Literal(static_cast<int32_t>(m_histograms.size() - 1)));
+    return m_builder.makeSequence(m_builder.makeCallImport(m_import, { index }, wasm::Type::none), expression);
+  }
+
+  wasm::Builder m_builder;
+  wasm::Name m_import;
+  vector<WasmOpHistogram>& m_histograms;
+  vector<WasmOpHistogram> m_regions;
+};
+
+// Makes every function call the given imports when it is entered, with its
+// index, and when it returns. Traps and halting unwind the whole execution,
+// which is handled by the caller.
+class FunctionProfiler : public wasm::PostWalker<FunctionProfiler> {
+public:
+  FunctionProfiler(wasm::Module& module, wasm::Name enter, wasm::Name leave):
+    m_builder(module), m_enter(enter), m_leave(leave)
+  {}
+
+  void doWalkFunction(wasm::Function* func) {
+    // The result is kept in a new local while leaving.
+    if (func->result != wasm::Type::none)
+      m_result = wasm::Builder::addVar(func, func->result);
+    walk(func->body);
+
+    wasm::Block* body = m_builder.makeBlock();
+    wasm::Expression* index = m_builder.makeConst(wasm::Literal(static_cast<int32_t>(m_index++)));
+    body->list.push_back(m_builder.makeCallImport(m_enter, { index }, wasm::Type::none));
+    if (func->result != wasm::Type::none) {
+      body->list.push_back(m_builder.makeSetLocal(m_result, func->body));
+      body->list.push_back(makeLeave());
+      body->list.push_back(m_builder.makeGetLocal(m_result, func->result));
+    } else {
+      body->list.push_back(func->body);
+      body->list.push_back(makeLeave());
+    }
+    body->finalize();
+    func->body = body;
+  }
+
+  void visitReturn(wasm::Return* curr) {
+    if (!curr->value) {
+      replaceCurrent(m_builder.makeSequence(makeLeave(), curr));
+      return;
+    }
+    wasm::Block* block = m_builder.makeBlock();
+    block->list.push_back(m_builder.makeSetLocal(m_result, curr->value));
+    block->list.push_back(makeLeave());
+    curr->value = m_builder.makeGetLocal(m_result, getFunction()->result);
+    block->list.push_back(curr);
+    block->finalize();
+    replaceCurrent(block);
+  }
+
+private:
+  wasm::Expression* makeLeave() {
+    return m_builder.makeCallImport(m_leave, {}, wasm::Type::none);
+  }
+
+  wasm::Builder m_builder;
+  wasm::Name m_enter;
+  wasm::Name m_leave;
+  wasm::Index m_result = 0;
+  int32_t m_index = 0;
+};
+
+bool isHaltingImport(wasm::Import const& import)
+{
+  if (import.module != wasm::Name("ethereum"))
+    return false;
+  char const* base = import.base.str;
+  return !strcmp(base, "finish") || !strcmp(base, "revert") || !strcmp(base, "selfDestruct");
+}
+
+// Finds the functions which may halt the execution: those calling a halting
+// EEI function, or a function which may halt, directly or through the table.
+class HaltingAnalysis : public wasm::PostWalker<HaltingAnalysis> {
+public:
+  explicit HaltingAnalysis(wasm::Module& module): m_module(module) {
+    walkModule(&module);
+    propagate(module);
+  }
+
+  bool any() const { return !m_halting.empty(); }
+  bool mayHalt(wasm::Name function) const { return m_halting.count(function) > 0; }
+  // Whether a call_indirect of @type may reach a function which may halt.
+  bool mayHaltIndirect(wasm::Name type) const { return m_indirect.count(signature(*m_module.getFunctionType(type))) > 0; }
+
+  void visitCallImport(wasm::CallImport* curr) {
+    if (isHaltingImport(*getModule()->getImport(curr->target)))
+      m_halting.insert(getFunction()->name);
+  }
+  void visitCall(wasm::Call* curr) { m_calls.emplace_back(getFunction()->name, curr->target); }
+  void visitCallIndirect(wasm::CallIndirect* curr) { m_indirectCalls.emplace_back(getFunction()->name, curr->fullType); }
+
+private:
+  // call_indirect compares types structurally.
+  typedef pair<vector<wasm::Type>, wasm::Type> Signature;
+  static Signature signature(wasm::FunctionType const& type) { return { type.params, type.result }; }
+  static Signature signature(wasm::Function const& function) { return { function.params, function.result }; }
+
+  // Adds the callers of functions which may halt until there are no more.
+  void propagate(wasm::Module& module) {
+    for (bool changed = true; changed; ) {
+      changed = false;
+      for (auto const& segment: module.table.segments)
+        for (wasm::Name function: segment.data)
+          if (mayHalt(function))
+            m_indirect.insert(signature(*module.getFunction(function)));
+      for (auto const& call: m_calls)
+        if (mayHalt(call.second) && m_halting.insert(call.first).second)
+          changed = true;
+      for (auto const& call: m_indirectCalls)
+        if (mayHaltIndirect(call.second) && m_halting.insert(call.first).second)
+          changed = true;
+    }
+  }
+
+  wasm::Module& m_module;
+  set<wasm::Name> m_halting;
+  // The signatures of the table's functions which may halt.
+  set<Signature> m_indirect;
+  // Calls by caller and callee or type.
+  vector<pair<wasm::Name, wasm::Name>> m_calls;
+  vector<pair<wasm::Name, wasm::Name>> m_indirectCalls;
+};
+
+// Makes the module return from every function once a halting EEI function
+// was called, for engines which cannot stop compiled code otherwise: those
+// calls set a global, which is checked after every call of a function which
+// may halt.
+class HaltingInstrumenter : public wasm::PostWalker<HaltingInstrumenter> {
+public:
+  HaltingInstrumenter(wasm::Module& module, HaltingAnalysis const& analysis, wasm::Name halted):
+    m_builder(module), m_analysis(analysis), m_halted(halted)
+  {}
+
+  void doWalkFunction(wasm::Function* func) {
+    m_results.clear();
+    walk(func->body);
+  }
+
+  void visitCallImport(wasm::CallImport* curr) {
+    if (!isHaltingImport(*getModule()->getImport(curr->target)))
+      return;
+    wasm::Block* block = m_builder.makeBlock();
+    block->list.push_back(curr);
+    block->list.push_back(m_builder.makeSetGlobal(m_halted, m_builder.makeConst(wasm::Literal(int32_t(1)))));
+    block->list.push_back(makeReturn());
+    block->finalize();
+    replaceCurrent(block);
+  }
+
+  void visitCall(wasm::Call* curr) {
+    if (m_analysis.mayHalt(curr->target))
+      replaceCurrent(checked(curr));
+  }
+  void visitCallIndirect(wasm::CallIndirect* curr) {
+    if (m_analysis.mayHaltIndirect(curr->fullType))
+      replaceCurrent(checked(curr));
+  }
+
+private:
+  // Returns from the function after call if the execution was halted. The
+  // result is kept in a local of the function meanwhile.
+  wasm::Expression* checked(wasm::Expression* call) {
+    if (call->type == wasm::Type::unreachable)
+      return call;
+    wasm::Expression* check = m_builder.makeIf(m_builder.makeGetGlobal(m_halted, wasm::Type::i32), makeReturn());
+    if (call->type == wasm::Type::none)
+      return m_builder.makeSequence(call, check);
+
+    auto result = m_results.find(call->type);
+    if (result == m_results.end())
+      result = m_results.emplace(call->type, wasm::Builder::addVar(getFunction(), call->type)).first;
+    wasm::Block* block = m_builder.makeBlock();
+    block->list.push_back(m_builder.makeSetLocal(result->second, call));
+    block->list.push_back(check);
+    block->list.push_back(m_builder.makeGetLocal(result->second, call->type));
+    block->finalize(call->type);
+    return block;
+  }
+
+  wasm::Expression* makeReturn() {
+    wasm::Type result = getFunction()->result;
+    return m_builder.makeReturn(result == wasm::Type::none ? nullptr : m_builder.makeConst(makeZero(result)));
+  }
+
+  wasm::Builder m_builder;
+  HaltingAnalysis const& m_analysis;
+  wasm::Name m_halted;
+  map<wasm::Type, wasm::Index> m_results;
+};
+
+}
+
+void BinaryenEngine::instrumentBlocks(wasm::Module & module, vector<WasmOpHistogram> & histograms)
+{
+  wasm::Name import = addHeraImport(module, "profileBlock", { wasm::Type::i32 });
+  BlockProfiler(module, import, histograms).walkModule(&module);
+}
+
+void BinaryenEngine::instrumentFunctions(wasm::Module & module, Profiler & profiler, vector<uint32_t> & frames)
+{
+  for (auto const& function: module.functions)
+    frames.push_back(profiler.frame(function->name.str));
+
+  wasm::Name enter = addHeraImport(module, "profileEnter", { wasm::Type::i32 });
+  wasm::Name leave = addHeraImport(module, "profileLeave", {});
+  FunctionProfiler(module, enter, leave).walkModule(&module);
+}
+
+vector<uint8_t> BinaryenEngine::instrumentHalting(vector<uint8_t> const& code)
+{
+  wasm::Module module;
+  loadModule(code, module);
+  // It is instrumented once, when deployed or first run, before the engine
+  // validated it.
+  ensureCondition(wasm::WasmValidator().validate(module), ContractValidationFailure, "Module is not valid.");
+
+  // Contracts which never call finish, revert or selfDestruct run as they are.
+  HaltingAnalysis analysis(module);
+  if (!analysis.any())
+    return code;
+
+  wasm::Name halted("hera$halted");
+  heraAssert(!module.getGlobalOrNull(halted), "Cannot instrument contract.");
+  wasm::Global* global = new wasm::Global;
+  global->name = halted;
+  global->type = wasm::Type::i32;
+  global->init = wasm::Builder(module).makeConst(wasm::Literal(int32_t(0)));
+  global->mutable_ = true;
+  module.addGlobal(global);
+
+  HaltingInstrumenter(module, analysis, halted).walkModule(&module);
+
+  wasm::BufferWithRandomAccess buffer(false);
+  wasm::WasmBinaryWriter writer(&module, buffer, false);
+  writer.write();
+  return vector<uint8_t>(buffer.begin(), buffer.end());
+}
+
 void BinaryenEngine::loadModule(vector<uint8_t> const& code, wasm::Module & module)
 {
   try {
@@ -524,9 +1134,19 @@ void BinaryenEngine::loadModule(vector<uint8_t> const& code, wasm::Module & modu
 
 void BinaryenEngine::verifyContract(vector<uint8_t> const& code)
 {
+  auto start = chrono::steady_clock::now();
   wasm::Module module;
   loadModule(code, module);
   verifyContract(module);
+
+  // Deployed code is usually called soon, which then need not parse and
+  // validate it again.
+  ModuleCache* moduleCache = ModuleCache::current();
+  shared_ptr<const BinaryenModule> cached = moduleCache ? BinaryenModule::build(module) : nullptr;
+  if (cached) {
+    double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    moduleCache->store(code, cached, nanoseconds);
+  }
 }
 
 namespace {
@@ -536,12 +1156,160 @@ wasm::FunctionType createFunctionType(vector<wasm::Type> params, wasm::Type resu
   ret.result = move(result);
   return ret;
 }
+
+// Adds the function types, imports, functions and exports of module to
+// shard. Only the functions in [begin, end) keep their bodies, which the
+// shard shares with module. The others keep their signatures, so that calls
+// to them still validate, but have an unreachable body and no locals.
+void addValidationFunctions(wasm::Module & module, size_t begin, size_t end, wasm::Module & shard)
+{
+  for (auto const& type: module.functionTypes)
+    shard.addFunctionType(new wasm::FunctionType(*type));
+  for (auto const& import: module.imports)
+    shard.addImport(new wasm::Import(*import));
+
+  wasm::Builder builder(shard);
+  for (size_t i = 0; i < module.functions.size(); ++i) {
+    wasm::Function const& original = *module.functions[i];
+    if (i >= begin && i < end) {
+      shard.addFunction(new wasm::Function(original));
+      continue;
+    }
+    wasm::Function* stub = new wasm::Function;
+    stub->name = original.name;
+    stub->type = original.type;
+    stub->params = original.params;
+    stub->result = original.result;
+    stub->body = builder.makeUnreachable();
+    shard.addFunction(stub);
+  }
+
+  for (auto const& exported: module.exports)
+    shard.addExport(new wasm::Export(*exported));
+  shard.start = module.start;
+}
+
+// Moves the data and element segments of a module aside for its lifetime,
+// so that copies of its memory and table leave them out.
+class SegmentsAside {
+public:
+  explicit SegmentsAside(wasm::Module & module): m_module(module) {
+    swap(m_data, module.memory.segments);
+    swap(m_elements, module.table.segments);
+  }
+  ~SegmentsAside() {
+    swap(m_data, m_module.memory.segments);
+    swap(m_elements, m_module.table.segments);
+  }
+
+  // Lends the segments to shard while validating it.
+  bool validateWith(wasm::Module & shard) {
+    swap(m_data, shard.memory.segments);
+    swap(m_elements, shard.table.segments);
+    bool valid;
+    try {
+      valid = wasm::WasmValidator().validate(shard);
+    } catch (...) {
+      swap(m_data, shard.memory.segments);
+      swap(m_elements, shard.table.segments);
+      throw;
+    }
+    swap(m_data, shard.memory.segments);
+    swap(m_elements, shard.table.segments);
+    return valid;
+  }
+
+private:
+  wasm::Module & m_module;
+  vector<wasm::Memory::Segment> m_data;
+  vector<wasm::Table::Segment> m_elements;
+};
+}
+
+// The functions are validated on the threads of the worker pool, in shards
+// holding the bodies of a range of them each. No expression is shared
+// between threads, as the validator writes to those it visits when it
+// finalizes them again. The shards have stub globals of the same types and
+// no segments, whose initializers and offsets are validated once, on the
+// calling thread, in a shard of their own in which every function is a
+// stub. Every part of the module is thereby validated exactly once, so the
+// shards all pass exactly when the whole module does.
+//
+// The module was just parsed into the memory of the calling thread's NUMA
+// node, so the workers run on its CPUs, by default one for each.
+bool BinaryenEngine::validateModule(wasm::Module & module)
+{
+  size_t functions = module.functions.size();
+  unsigned node = Numa::currentNode();
+  size_t threads = m_validationThreads;
+  if (!threads)
+    threads = Numa::nodeCount() > 1 && Numa::cpuCount(node) > 0 ? Numa::cpuCount(node) : thread::hardware_concurrency();
+  threads = min(threads, functions / functionsPerValidationThread);
+  WorkerPool* pool = WorkerPool::current();
+  if (!pool || functions < parallelValidationThreshold || threads <= 1)
+    return wasm::WasmValidator().validate(module);
+
+  vector<unique_ptr<wasm::Module>> shards;
+  {
+    SegmentsAside segments(module);
+    for (size_t i = 0; i < threads; ++i) {
+      wasm::Module* shard = new wasm::Module;
+      shards.emplace_back(shard);
+      addValidationFunctions(module, functions * i / threads, functions * (i + 1) / threads, *shard);
+      wasm::Builder builder(*shard);
+      for (auto const& global: module.globals) {
+        wasm::Global* stub = new wasm::Global;
+        stub->name = global->name;
+        stub->type = global->type;
+        stub->mutable_ = global->mutable_;
+        stub->init = builder.makeConst(makeZero(global->type));
+        shard->addGlobal(stub);
+      }
+      shard->table = module.table;
+      shard->memory = module.memory;
+    }
+
+    // Sharing the initializers and offsets, which only this thread visits.
+    wasm::Module moduleLevel;
+    addValidationFunctions(module, 0, 0, moduleLevel);
+    for (auto const& global: module.globals)
+      moduleLevel.addGlobal(new wasm::Global(*global));
+    moduleLevel.table = module.table;
+    moduleLevel.memory = module.memory;
+    if (!segments.validateWith(moduleLevel))
+      return false;
+  }
+
+  atomic<size_t> next{0};
+  atomic<bool> valid{true};
+  exception_ptr error;
+  mutex errorMutex;
+  pool->run(static_cast<unsigned>(threads), [&]() {
+    // The pool's threads run batches as well, so they are only bound while
+    // validating.
+    Numa::Binding binding(node);
+    for (size_t i = next++; i < threads && valid; i = next++) {
+      try {
+        if (!wasm::WasmValidator().validate(*shards[i]))
+          valid = false;
+      } catch (...) {
+        lock_guard<mutex> lock(errorMutex);
+        if (!error)
+          error = current_exception();
+        valid = false;
+      }
+    }
+  });
+
+  if (error)
+    rethrow_exception(error);
+  return valid;
 }
 
 void BinaryenEngine::verifyContract(wasm::Module & module)
 {
   ensureCondition(
-    wasm::WasmValidator().validate(module),
+    validateModule(module),
     ContractValidationFailure,
     "Module is not valid."
   );
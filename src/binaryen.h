@@ -17,6 +17,8 @@
 #pragma once
 
 #include "eei.h"
+#include "execution-stats.h"
+#include "profiler.h"
 
 namespace wasm {
 class Module;
@@ -31,6 +33,7 @@ public:
 
   ExecutionResult execute(
     evmc_context* context,
+    evmc_revision rev,
     std::vector<uint8_t> const& code,
     std::vector<uint8_t> const& state_code,
     evmc_message const& msg,
@@ -39,12 +42,48 @@ public:
 
   void verifyContract(std::vector<uint8_t> const& code) override;
 
+  void setValidationThreads(unsigned threads) override { m_validationThreads = threads; }
+
+  /// Rewrites a contract to return from every function once finish, revert
+  /// or selfDestruct was called, for engines which can only stop compiled
+  /// code by unwinding it otherwise. Only calls of functions which may reach
+  /// one of them are checked, and a contract which calls none is returned as
+  /// it is. Throws ContractValidationFailure if Binaryen rejects the contract.
+  static std::vector<uint8_t> instrumentHalting(std::vector<uint8_t> const& code);
+
 private:
+  /// Modules with fewer functions are validated on the calling thread.
+  static constexpr size_t parallelValidationThreshold = 256;
+  /// The least number of functions worth a thread of their own.
+  static constexpr size_t functionsPerValidationThread = 128;
+
+  template <evmc_revision Revision>
+  ExecutionResult internalExecute(
+    evmc_context* context,
+    std::vector<uint8_t> const& code,
+    std::vector<uint8_t> const& state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas
+  );
+
   void verifyContract(wasm::Module & module);
 
+  /// Runs the Binaryen validator, splitting large modules across threads.
+  bool validateModule(wasm::Module & module);
+
+  /// Instruments the module to count executed instructions, used for the
+  /// "instrument" option. Must be called after verifyContract().
+  void instrumentBlocks(wasm::Module & module, std::vector<WasmOpHistogram> & histograms);
+
+  /// Instruments the module to report function calls to the profiler, used
+  /// for the "profile" option. Returns the frames of the functions in frames.
+  void instrumentFunctions(wasm::Module & module, Profiler & profiler, std::vector<uint32_t> & frames);
+
   /// Parses and loads a Wasm module.
   /// Don't ask, Module has no copy constructor, hence the reference.
-  void loadModule(std::vector<uint8_t> const& code, wasm::Module & module);
+  static void loadModule(std::vector<uint8_t> const& code, wasm::Module & module);
+
+  unsigned m_validationThreads = 0;
 };
 
 }
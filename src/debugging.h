@@ -20,7 +20,7 @@ namespace hera {
 
 #if HERA_DEBUGGING
 
-#define HERA_DEBUG cerr
+#define HERA_DEBUG std::cerr
 
 #else
 
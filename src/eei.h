@@ -16,11 +16,23 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include <evmc/evmc.h>
+#include <evmc/instructions.h>
 
+#include "async-host.h"
+#include "debugging.h"
+#include "evm-trace.h"
 #include "exceptions.h"
+#include "helpers.h"
+#include "probes.h"
 
 namespace hera {
 
@@ -28,8 +40,29 @@ struct ExecutionResult {
   int64_t gasLeft = 0;
   std::vector<uint8_t> returnValue;
   bool isRevert = false;
+  // The starting gas needed to make the sub-calls seen so far with the same
+  // outcome, accounting for the 63/64 forwarding rule. The overall requirement
+  // is the larger of this and the gas used.
+  int64_t gasRequired = 0;
+  // What the outcome may depend on besides the host state and the input: the
+  // TxContextField mask of the transaction context fields read, and whether
+  // the gas left was read.
+  uint32_t txContextRead = 0;
+  bool gasLeftRead = false;
 };
 
+// The starting gas needed to forward @calleeGasUsed to a callee after
+// having used @usedBeforeCall, retaining one 64th as per EIP150.
+inline int64_t gasRequiredForCallee(int64_t usedBeforeCall, int64_t calleeGasUsed)
+{
+  // The smallest amount of gas left before the call which still forwards
+  // calleeGasUsed after retaining one 64th of it.
+  int64_t needed = calleeGasUsed + calleeGasUsed / 63;
+  while (needed - needed / 64 < calleeGasUsed)
+    ++needed;
+  return usedBeforeCall + needed;
+}
+
 // There is a single engine instance in each VM instance and
 // likely execute() is called multiple times. As a result
 // an engine implementation cannot have instance variables with
@@ -40,6 +73,7 @@ public:
 
   virtual ExecutionResult execute(
     evmc_context* context,
+    evmc_revision rev,
     std::vector<uint8_t> const& code,
     std::vector<uint8_t> const& state_code,
     evmc_message const& msg,
@@ -47,8 +81,136 @@ public:
   ) = 0;
 
   virtual void verifyContract(std::vector<uint8_t> const& code) = 0;
+
+  /// Whether execute() may be called from several threads at once.
+  virtual bool supportsConcurrentExecution() const { return true; }
+
+  /// The number of threads validation of a large module may use, zero for
+  /// one per core. Ignored by engines which validate sequentially.
+  virtual void setValidationThreads(unsigned threads) { (void)threads; }
+};
+
+enum class EEICallKind {
+  Call,
+  CallCode,
+  CallDelegate,
+  CallStatic
+};
+
+// The functions of the "ethereum" import namespace.
+#define HERA_EEI_FUNCTIONS(X) \
+  X(useGas) \
+  X(getGasLeft) \
+  X(getAddress) \
+  X(getExternalBalance) \
+  X(getBlockHash) \
+  X(getCallDataSize) \
+  X(callDataCopy) \
+  X(getCaller) \
+  X(getCallValue) \
+  X(codeCopy) \
+  X(getCodeSize) \
+  X(externalCodeCopy) \
+  X(getExternalCodeSize) \
+  X(getBlockCoinbase) \
+  X(getBlockDifficulty) \
+  X(getBlockGasLimit) \
+  X(getTxGasPrice) \
+  X(log) \
+  X(getBlockNumber) \
+  X(getBlockTimestamp) \
+  X(getTxOrigin) \
+  X(storageStore) \
+  X(storageLoad) \
+  X(finish) \
+  X(revert) \
+  X(getReturnDataSize) \
+  X(returnDataCopy) \
+  X(call) \
+  X(callCode) \
+  X(callDelegate) \
+  X(callStatic) \
+  X(create) \
+  X(selfDestruct)
+
+// Identifies an EEI function, so that engines can resolve the imports of a
+// module once instead of comparing names on every call.
+enum class EEIFunction : uint8_t {
+#define HERA_EEI_FUNCTION_ID(name) name,
+  HERA_EEI_FUNCTIONS(HERA_EEI_FUNCTION_ID)
+#undef HERA_EEI_FUNCTION_ID
+  // Not a function of the "ethereum" namespace.
+  Unresolved
+};
+
+inline EEIFunction resolveEEIFunction(std::string const& module, std::string const& name)
+{
+  static const std::unordered_map<std::string, EEIFunction> functions {
+#define HERA_EEI_FUNCTION_ENTRY(name) { #name, EEIFunction::name },
+    HERA_EEI_FUNCTIONS(HERA_EEI_FUNCTION_ENTRY)
+#undef HERA_EEI_FUNCTION_ENTRY
+  };
+  if (module != "ethereum")
+    return EEIFunction::Unresolved;
+  auto it = functions.find(name);
+  return it != functions.end() ? it->second : EEIFunction::Unresolved;
+}
+
+// The gas costs of a revision, specialised for each supported one so that
+// every cost is a compile time constant. Byzantium is the only one for now.
+// The EEI and the EVM1 interpreter share it, the costs only the interpreter
+// charges are listed last.
+template <evmc_revision Revision>
+struct GasSchedule;
+
+template <>
+struct GasSchedule<EVMC_BYZANTIUM> {
+  static constexpr unsigned storageLoad = 200;
+  static constexpr unsigned storageStoreCreate = 20000;
+  static constexpr unsigned storageStoreChange = 5000;
+  static constexpr unsigned log = 375;
+  static constexpr unsigned logData = 8;
+  static constexpr unsigned logTopic = 375;
+  static constexpr unsigned create = 32000;
+  static constexpr unsigned call = 700;
+  static constexpr unsigned copy = 3;
+  static constexpr unsigned blockhash = 800;
+  static constexpr unsigned balance = 400;
+  static constexpr unsigned base = 2;
+  static constexpr unsigned verylow = 3;
+  static constexpr unsigned extcode = 700;
+  static constexpr unsigned selfdestruct = 5000;
+  static constexpr unsigned valuetransfer = 9000;
+  static constexpr unsigned valueStipend = 2300;
+  static constexpr unsigned callNewAccount = 25000;
+
+  // EVM1 only.
+  static constexpr unsigned selfdestructNewAccount = 25000;
+  static constexpr unsigned expByte = 50;
+  static constexpr unsigned sha3Word = 6;
+  // Memory of n words costs memory * n + n * n / memoryQuadDivisor.
+  static constexpr unsigned memory = 3;
+  static constexpr unsigned memoryQuadDivisor = 512;
 };
 
+/// Returns true if there is a GasSchedule (and hence an EEI) for the revision.
+inline bool isSupportedRevision(evmc_revision rev)
+{
+  return rev == EVMC_BYZANTIUM;
+}
+
+// The interface is parameterised on the engine specific subclass (CRTP), which
+// provides access to the linear memory of the running instance via the
+// following non-virtual methods:
+//
+//   size_t memorySize() const;
+//   uint8_t* memoryData();
+//
+// This lets the memory helpers below compile to plain (inlined) copies.
+//
+// It is also parameterised on the revision, which selects the GasSchedule.
+// Engines instantiate it once per supported revision, see isSupportedRevision().
+template <typename Derived, evmc_revision Revision>
 class EthereumInterface {
 public:
   explicit EthereumInterface(
@@ -71,34 +233,27 @@ public:
     // set sane defaults
     m_result.returnValue = std::vector<uint8_t>{};
     m_result.isRevert = false;
-
-    // cache the transaction context here
-    m_tx_context = m_context->host->get_tx_context(m_context);
   }
 
+  /// Returns true once the contract has terminated through finish, revert or selfDestruct.
+  bool halted() const { return m_halted; }
+
 // WAVM/WABT host functions access this interface through an instance,
 // which requires public methods.
 // TODO: update upstream WAVM/WABT to have a context (user data) passed down.
 #if HERA_WAVM == 0 && HERA_WABT == 0
 protected:
 #endif
-  virtual size_t memorySize() const = 0 ;
-  virtual void memorySet(size_t offset, uint8_t value) = 0;
-  virtual uint8_t memoryGet(size_t offset) = 0;
-
-  enum class EEICallKind {
-    Call,
-    CallCode,
-    CallDelegate,
-    CallStatic
-  };
-
   // EEI methods
 
 #if HERA_DEBUGGING
   void debugPrintMem(bool useHex, uint32_t offset, uint32_t length);
   void debugPrintStorage(bool useHex, uint32_t pathOffset);
   void debugEvmTrace(uint32_t pc, int32_t opcode, uint32_t cost, int32_t sp);
+
+  // Implements debug::evmTrace: writes the step to the current EvmTraceSink,
+  // or prints it if there is none.
+  void evmTrace(uint32_t pc, int32_t opcode, uint32_t cost, int32_t sp);
 #endif
 
   void eeiUseGas(int64_t gas);
@@ -124,6 +279,8 @@ protected:
   void eeiGetTxOrigin(uint32_t resultOffset);
   void eeiStorageStore(uint32_t pathOffset, uint32_t valueOffset);
   void eeiStorageLoad(uint32_t pathOffset, uint32_t resultOffset);
+  // NOTE: finish, revert and selfDestruct only record the outcome and return.
+  // The engine is responsible for stopping execution once halted() is set.
   void eeiFinish(uint32_t offset, uint32_t size) { eeiRevertOrFinish(false, offset, size); }
   void eeiRevert(uint32_t offset, uint32_t size) { eeiRevertOrFinish(true, offset, size); }
   uint32_t eeiGetReturnDataSize();
@@ -137,10 +294,14 @@ private:
 
   // Helpers methods
 
+  Derived& derived() { return *static_cast<Derived*>(this); }
+  Derived const& derived() const { return *static_cast<Derived const*>(this); }
+
   void takeGas(int64_t gas);
   void takeInterfaceGas(int64_t gas);
 
   void ensureSourceMemoryBounds(uint32_t offset, uint32_t length);
+  uint8_t const* memoryView(uint32_t offset, uint32_t length);
   void loadMemoryReverse(uint32_t srcOffset, uint8_t *dst, size_t length);
   void loadMemory(uint32_t srcOffset, uint8_t *dst, size_t length);
   void loadMemory(uint32_t srcOffset, std::vector<uint8_t> & dst, size_t length);
@@ -159,6 +320,9 @@ private:
 
   inline int64_t maxCallGas(int64_t gas) { return gas - (gas / 64); }
 
+  /* Records the gas needed before forwarding @forwardedGas to a callee which used @calleeGasUsed of it */
+  void recordCalleeGasUsed(int64_t forwardedGas, int64_t calleeGasUsed);
+
   /* Checks for overflow and safely charges gas for variable length data copies */
   void safeChargeDataCopy(uint32_t length, unsigned baseCost);
 
@@ -175,34 +339,942 @@ private:
   /* Checks if a 256 bit value is all zeroes */
   static bool isZeroUint256(evmc_uint256be const& value);
 
+  // Fetches the transaction context on first use and records @field as read.
+  evmc_tx_context const& txContext(TxContextField field)
+  {
+    if (!m_haveTxContext) {
+      m_tx_context = HERA_HOST_CALL("get_tx_context", m_result.gasLeft, m_context->host->get_tx_context(m_context));
+      m_haveTxContext = true;
+    }
+    m_result.txContextRead |= field;
+    return m_tx_context;
+  }
+
   evmc_tx_context m_tx_context{};
+  bool m_haveTxContext = false;
   evmc_context* m_context = nullptr;
   std::vector<uint8_t> const& m_code;
   evmc_message const& m_msg;
   std::vector<uint8_t> m_lastReturnData;
   ExecutionResult & m_result;
   bool m_meterGas = true;
+  bool m_halted = false;
 };
 
-struct GasSchedule {
-  static constexpr unsigned storageLoad = 200;
-  static constexpr unsigned storageStoreCreate = 20000;
-  static constexpr unsigned storageStoreChange = 5000;
-  static constexpr unsigned log = 375;
-  static constexpr unsigned logData = 8;
-  static constexpr unsigned logTopic = 375;
-  static constexpr unsigned create = 32000;
-  static constexpr unsigned call = 700;
-  static constexpr unsigned copy = 3;
-  static constexpr unsigned blockhash = 800;
-  static constexpr unsigned balance = 400;
-  static constexpr unsigned base = 2;
-  static constexpr unsigned verylow = 3;
-  static constexpr unsigned extcode = 700;
-  static constexpr unsigned selfdestruct = 5000;
-  static constexpr unsigned valuetransfer = 9000;
-  static constexpr unsigned valueStipend = 2300;
-  static constexpr unsigned callNewAccount = 25000;
-};
+#if HERA_DEBUGGING
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::debugPrintMem(bool useHex, uint32_t offset, uint32_t length)
+  {
+      heraAssert((offset + length) > offset, "Overflow.");
+      heraAssert(derived().memorySize() >= (offset + length), "Out of memory bounds.");
+
+      uint8_t const* memory = derived().memoryData();
+
+      std::cerr << "DEBUG printMem" << (useHex ? "Hex(" : "(") << std::hex << "0x" << offset << ":0x" << length << "): " << std::dec;
+      if (useHex)
+      {
+        std::cerr << std::hex;
+        for (uint32_t i = offset; i < (offset + length); i++) {
+          std::cerr << static_cast<int>(memory[i]) << " ";
+        }
+        std::cerr << std::dec;
+      }
+      else
+      {
+        for (uint32_t i = offset; i < (offset + length); i++) {
+          std::cerr << memory[i] << " ";
+        }
+      }
+      std::cerr << std::endl;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::debugPrintStorage(bool useHex, uint32_t pathOffset)
+  {
+      evmc_uint256be path = loadBytes32(pathOffset);
+
+      HERA_DEBUG << "DEBUG printStorage" << (useHex ? "Hex" : "") << "(0x" << std::hex;
+
+      // Print out the path
+      for (uint8_t b: path.bytes)
+        std::cerr << static_cast<int>(b);
+
+      HERA_DEBUG << "): " << std::dec;
+
+      evmc_bytes32 result = HERA_HOST_CALL("get_storage", m_result.gasLeft, m_context->host->get_storage(m_context, &m_msg.destination, &path));
+
+      if (useHex)
+      {
+        std::cerr << std::hex;
+        for (uint8_t b: result.bytes)
+          std::cerr << static_cast<int>(b) << " ";
+        std::cerr << std::dec;
+      }
+      else
+      {
+        for (uint8_t b: result.bytes)
+          std::cerr << b << " ";
+      }
+      std::cerr << std::endl;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::debugEvmTrace(uint32_t pc, int32_t opcode, uint32_t cost, int32_t sp)
+  {
+      HERA_DEBUG << "evmTrace\n";
+
+      static constexpr int stackItemSize = sizeof(evmc_uint256be);
+      heraAssert(sp <= (1024 * stackItemSize), "EVM stack pointer out of bounds.");
+      heraAssert(opcode >= 0x00 && opcode <= 0xff, "Invalid EVM instruction.");
+
+      const char* const* const opNamesTable = evmc_get_instruction_names_table(Revision);
+      const char* opName = opNamesTable[static_cast<uint8_t>(opcode)];
+      if (opName == nullptr)
+        opName = "UNDEFINED";
+
+      std::cout << "{\"depth\":" << std::dec << m_msg.depth
+        << ",\"gas\":" << m_result.gasLeft
+        << ",\"gasCost\":" << cost
+        << ",\"op\":" << opName
+        << ",\"pc\":" << pc
+        << ",\"stack\":[";
+
+      for (int32_t i = 0; i <= sp; i += stackItemSize) {
+        evmc_uint256be x = loadUint256(static_cast<uint32_t>(i));
+        std::cout << '"' << toHex(x) << '"';
+        if (i != sp)
+          std::cout << ',';
+      }
+      std::cout << "]}" << std::endl;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::evmTrace(uint32_t pc, int32_t opcode, uint32_t cost, int32_t sp)
+  {
+      EvmTraceSink* sink = EvmTraceSink::current();
+      if (!sink) {
+        debugEvmTrace(pc, opcode, cost, sp);
+        return;
+      }
+
+      static constexpr int stackItemSize = sizeof(evmc_uint256be);
+      heraAssert(sp <= (1024 * stackItemSize), "EVM stack pointer out of bounds.");
+      heraAssert(opcode >= 0x00 && opcode <= 0xff, "Invalid EVM instruction.");
+
+      uint64_t sequence;
+      EvmTraceRecord& record = sink->reserve(sequence);
+      record.gas = m_result.gasLeft;
+      record.pc = pc;
+      record.gasCost = cost;
+      record.depth = m_msg.depth;
+      record.stackSize = static_cast<uint16_t>(sp < 0 ? 0 : sp / stackItemSize + 1);
+      record.opcode = static_cast<uint8_t>(opcode);
+      record.revision = static_cast<uint8_t>(Revision);
+      unsigned count = 0;
+      for (int32_t i = sp; i >= 0 && count < EvmTraceRecord::stackItems; i -= stackItemSize)
+        record.stack[count++] = loadUint256(static_cast<uint32_t>(i));
+      sink->commit(record, sequence);
+  }
+#endif
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiUseGas(int64_t gas)
+  {
+      HERA_DEBUG << "useGas " << gas << "\n";
+
+      ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
+
+      takeGas(gas);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  int64_t EthereumInterface<Derived, Revision>::eeiGetGasLeft()
+  {
+      HERA_DEBUG << "getGasLeft\n";
+
+      static_assert(std::is_same<decltype(m_result.gasLeft), int64_t>::value, "int64_t type expected");
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      m_result.gasLeftRead = true;
+      return m_result.gasLeft;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetAddress(uint32_t resultOffset)
+  {
+      HERA_DEBUG << "getAddress " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      storeAddress(m_msg.destination, resultOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetExternalBalance(uint32_t addressOffset, uint32_t resultOffset)
+  {
+      HERA_DEBUG << "getExternalBalance " << std::hex << addressOffset << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::balance);
+
+      evmc_address address = loadAddress(addressOffset);
+      AsyncScheduler::awaitBalance(address);
+      evmc_uint256be balance = HERA_HOST_CALL("get_balance", m_result.gasLeft, m_context->host->get_balance(m_context, &address));
+      storeUint128(balance, resultOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  uint32_t EthereumInterface<Derived, Revision>::eeiGetBlockHash(uint64_t number, uint32_t resultOffset)
+  {
+      HERA_DEBUG << "getBlockHash " << std::hex << number << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::blockhash);
+
+      evmc_bytes32 blockhash = HERA_HOST_CALL("get_block_hash", m_result.gasLeft, m_context->host->get_block_hash(m_context, static_cast<int64_t>(number)));
+
+      if (isZeroUint256(blockhash))
+        return 1;
+
+      storeBytes32(blockhash, resultOffset);
+
+      return 0;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  uint32_t EthereumInterface<Derived, Revision>::eeiGetCallDataSize()
+  {
+      HERA_DEBUG << "getCallDataSize\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      return static_cast<uint32_t>(m_msg.input_size);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiCallDataCopy(uint32_t resultOffset, uint32_t dataOffset, uint32_t length)
+  {
+      HERA_DEBUG << "callDataCopy " << std::hex << resultOffset << " " << dataOffset << " " << length << std::dec << "\n";
+
+      safeChargeDataCopy(length, GasSchedule<Revision>::verylow);
+
+      std::vector<uint8_t> input(m_msg.input_data, m_msg.input_data + m_msg.input_size);
+      storeMemory(input, dataOffset, resultOffset, length);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetCaller(uint32_t resultOffset)
+  {
+      HERA_DEBUG << "getCaller " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      storeAddress(m_msg.sender, resultOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetCallValue(uint32_t resultOffset)
+  {
+      HERA_DEBUG << "getCallValue " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      storeUint128(m_msg.value, resultOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiCodeCopy(uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
+  {
+      HERA_DEBUG << "codeCopy " << std::hex << resultOffset << " " << codeOffset << " " << length << std::dec << "\n";
+
+      safeChargeDataCopy(length, GasSchedule<Revision>::verylow);
+
+      storeMemory(m_code, codeOffset, resultOffset, length);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  uint32_t EthereumInterface<Derived, Revision>::eeiGetCodeSize()
+  {
+      HERA_DEBUG << "getCodeSize\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      return static_cast<uint32_t>(m_code.size());
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiExternalCodeCopy(uint32_t addressOffset, uint32_t resultOffset, uint32_t codeOffset, uint32_t length)
+  {
+      HERA_DEBUG << "externalCodeCopy " << std::hex << addressOffset << " " << resultOffset << " " << codeOffset << " " << length << std::dec << "\n";
+
+      safeChargeDataCopy(length, GasSchedule<Revision>::extcode);
+
+      evmc_address address = loadAddress(addressOffset);
+      // FIXME: optimise this so no vector needs to be created
+      std::vector<uint8_t> codeBuffer(length);
+      AsyncScheduler::awaitCode(address);
+      size_t numCopied = HERA_HOST_CALL("copy_code", m_result.gasLeft, m_context->host->copy_code(m_context, &address, codeOffset, codeBuffer.data(), codeBuffer.size()));
+      ensureCondition(numCopied == length, InvalidMemoryAccess, "Out of bounds (source) memory copy");
+
+      storeMemory(codeBuffer, 0, resultOffset, length);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  uint32_t EthereumInterface<Derived, Revision>::eeiGetExternalCodeSize(uint32_t addressOffset)
+  {
+      HERA_DEBUG << "getExternalCodeSize " << std::hex << addressOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::extcode);
+
+      evmc_address address = loadAddress(addressOffset);
+      AsyncScheduler::awaitCode(address);
+      size_t code_size = HERA_HOST_CALL("get_code_size", m_result.gasLeft, m_context->host->get_code_size(m_context, &address));
+
+      return static_cast<uint32_t>(code_size);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetBlockCoinbase(uint32_t resultOffset)
+  {
+      HERA_DEBUG << "getBlockCoinbase " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      storeAddress(txContext(BlockCoinbase).block_coinbase, resultOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetBlockDifficulty(uint32_t offset)
+  {
+      HERA_DEBUG << "getBlockDifficulty " << std::hex << offset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      storeUint256(txContext(BlockDifficulty).block_difficulty, offset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  int64_t EthereumInterface<Derived, Revision>::eeiGetBlockGasLimit()
+  {
+      HERA_DEBUG << "getBlockGasLimit\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      static_assert(std::is_same<decltype(m_tx_context.block_gas_limit), int64_t>::value, "int64_t type expected");
+
+      return txContext(BlockGasLimit).block_gas_limit;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetTxGasPrice(uint32_t valueOffset)
+  {
+      HERA_DEBUG << "getTxGasPrice " << std::hex << valueOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      storeUint128(txContext(TxGasPrice).tx_gas_price, valueOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiLog(uint32_t dataOffset, uint32_t length, uint32_t numberOfTopics, uint32_t topic1, uint32_t topic2, uint32_t topic3, uint32_t topic4)
+  {
+      HERA_DEBUG << "log " << std::hex << dataOffset << " " << length << " " << numberOfTopics << std::dec << "\n";
+
+      static_assert(GasSchedule<Revision>::log <= 65536, "Gas cost of log could lead to overflow");
+      static_assert(GasSchedule<Revision>::logTopic <= 65536, "Gas cost of logTopic could lead to overflow");
+      static_assert(GasSchedule<Revision>::logData <= 65536, "Gas cost of logData could lead to overflow");
+      // Using uint64_t to force a type issue if the underlying API changes.
+      takeInterfaceGas(GasSchedule<Revision>::log + (GasSchedule<Revision>::logTopic * numberOfTopics) + (GasSchedule<Revision>::logData * int64_t(length)));
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "log");
+
+      ensureCondition(numberOfTopics <= 4, ContractValidationFailure, "Too many topics specified");
+
+      // FIXME: should this assert that unused topic offsets must be 0?
+      std::array<evmc_uint256be, 4> topics;
+      topics[0] = (numberOfTopics >= 1) ? loadBytes32(topic1) : evmc_uint256be{};
+      topics[1] = (numberOfTopics >= 2) ? loadBytes32(topic2) : evmc_uint256be{};
+      topics[2] = (numberOfTopics >= 3) ? loadBytes32(topic3) : evmc_uint256be{};
+      topics[3] = (numberOfTopics == 4) ? loadBytes32(topic4) : evmc_uint256be{};
+
+      uint8_t const* data = memoryView(dataOffset, length);
+
+      HERA_HOST_CALL("emit_log", m_result.gasLeft, m_context->host->emit_log(m_context, &m_msg.destination, data, length, topics.data(), numberOfTopics));
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  int64_t EthereumInterface<Derived, Revision>::eeiGetBlockNumber()
+  {
+      HERA_DEBUG << "getBlockNumber\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      static_assert(std::is_same<decltype(m_tx_context.block_number), int64_t>::value, "int64_t type expected");
+
+      return txContext(BlockNumber).block_number;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  int64_t EthereumInterface<Derived, Revision>::eeiGetBlockTimestamp()
+  {
+      HERA_DEBUG << "getBlockTimestamp\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      static_assert(std::is_same<decltype(m_tx_context.block_timestamp), int64_t>::value, "int64_t type expected");
+
+      return txContext(BlockTimestamp).block_timestamp;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiGetTxOrigin(uint32_t resultOffset)
+  {
+      HERA_DEBUG << "getTxOrigin " << std::hex << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      storeAddress(txContext(TxOrigin).tx_origin, resultOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiStorageStore(uint32_t pathOffset, uint32_t valueOffset)
+  {
+      HERA_DEBUG << "storageStore " << std::hex << pathOffset << " " << valueOffset << std::dec << "\n";
+
+      static_assert(
+        GasSchedule<Revision>::storageStoreCreate >= GasSchedule<Revision>::storageStoreChange,
+        "storageStoreChange costs more than storageStoreCreate"
+      );
+
+      // Charge this here as it is the minimum cost.
+      takeInterfaceGas(GasSchedule<Revision>::storageStoreChange);
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "storageStore");
+
+      evmc_bytes32 path = loadBytes32(pathOffset);
+      evmc_bytes32 value = loadBytes32(valueOffset);
+      AsyncScheduler::awaitStorage(m_msg.destination, path);
+      evmc_bytes32 current = HERA_HOST_CALL("get_storage", m_result.gasLeft, m_context->host->get_storage(m_context, &m_msg.destination, &path));
+
+      // Charge the right amount in case of the create case.
+      if (isZeroUint256(current) && !isZeroUint256(value))
+        takeInterfaceGas(GasSchedule<Revision>::storageStoreCreate - GasSchedule<Revision>::storageStoreChange);
+
+      // We do not need to take care about the delete case (gas refund), the client does it.
+
+      HERA_HOST_CALL("set_storage", m_result.gasLeft, m_context->host->set_storage(m_context, &m_msg.destination, &path, &value));
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiStorageLoad(uint32_t pathOffset, uint32_t resultOffset)
+  {
+      HERA_DEBUG << "storageLoad " << std::hex << pathOffset << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::storageLoad);
+
+      evmc_bytes32 path = loadBytes32(pathOffset);
+      AsyncScheduler::awaitStorage(m_msg.destination, path);
+      evmc_bytes32 result = HERA_HOST_CALL("get_storage", m_result.gasLeft, m_context->host->get_storage(m_context, &m_msg.destination, &path));
+
+      storeBytes32(result, resultOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiRevertOrFinish(bool revert, uint32_t offset, uint32_t size)
+  {
+      HERA_DEBUG << (revert ? "revert " : "finish ") << std::hex << offset << " " << size << std::dec << "\n";
+
+      ensureSourceMemoryBounds(offset, size);
+      m_result.returnValue = std::vector<uint8_t>(size);
+      loadMemory(offset, m_result.returnValue, size);
+
+      m_result.isRevert = revert;
+
+      m_halted = true;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  uint32_t EthereumInterface<Derived, Revision>::eeiGetReturnDataSize()
+  {
+      HERA_DEBUG << "getReturnDataSize\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::base);
+
+      return static_cast<uint32_t>(m_lastReturnData.size());
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiReturnDataCopy(uint32_t dataOffset, uint32_t offset, uint32_t size)
+  {
+      HERA_DEBUG << "returnDataCopy " << std::hex << dataOffset << " " << offset << " " << size << std::dec << "\n";
+
+      safeChargeDataCopy(size, GasSchedule<Revision>::verylow);
+
+      storeMemory(m_lastReturnData, offset, dataOffset, size);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  uint32_t EthereumInterface<Derived, Revision>::eeiCall(EEICallKind kind, int64_t gas, uint32_t addressOffset, uint32_t valueOffset, uint32_t dataOffset, uint32_t dataLength)
+  {
+      ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
+
+      evmc_message call_message;
+      call_message.destination = loadAddress(addressOffset);
+      call_message.flags = m_msg.flags & EVMC_STATIC;
+      call_message.depth = m_msg.depth + 1;
+
+      switch (kind) {
+      case EEICallKind::Call:
+      case EEICallKind::CallCode:
+        call_message.kind = (kind == EEICallKind::CallCode) ? EVMC_CALLCODE : EVMC_CALL;
+        call_message.sender = m_msg.destination;
+        call_message.value = loadUint128(valueOffset);
+
+        if ((kind == EEICallKind::Call) && !isZeroUint128(call_message.value)) {
+          ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "call");
+        }
+        break;
+      case EEICallKind::CallDelegate:
+        call_message.kind = EVMC_DELEGATECALL;
+        call_message.sender = m_msg.sender;
+        call_message.value = m_msg.value;
+        break;
+      case EEICallKind::CallStatic:
+        call_message.kind = EVMC_CALL;
+        call_message.flags |= EVMC_STATIC;
+        call_message.sender = m_msg.destination;
+        call_message.value = {};
+        break;
+      }
+
+#if HERA_DEBUGGING
+      std::string methodName;
+      switch (kind) {
+      case EEICallKind::Call: methodName = "call"; break;
+      case EEICallKind::CallCode: methodName = "callCode"; break;
+      case EEICallKind::CallDelegate: methodName = "callDelegate"; break;
+      case EEICallKind::CallStatic: methodName = "callStatic"; break;
+      }
+
+      HERA_DEBUG <<
+        methodName << " " << std::hex <<
+        gas << " " <<
+        addressOffset << " " <<
+        valueOffset << " " <<
+        dataOffset << " " <<
+        dataLength << std::dec << "\n";
+#endif
+
+      if (dataLength) {
+        call_message.input_data = memoryView(dataOffset, dataLength);
+        call_message.input_size = dataLength;
+      } else {
+        call_message.input_data = nullptr;
+        call_message.input_size = 0;
+      }
+
+      // Start with base call gas
+      takeInterfaceGas(GasSchedule<Revision>::call);
+
+      if (m_msg.depth >= 1024)
+        return 1;
+
+      // These checks are in EIP150 but not in the YellowPaper
+      // Charge valuetransfer gas if value is being transferred.
+      if ((kind == EEICallKind::Call || kind == EEICallKind::CallCode) && !isZeroUint128(call_message.value)) {
+        takeInterfaceGas(GasSchedule<Revision>::valuetransfer);
+
+        if (!enoughSenderBalanceFor(call_message.value))
+          return 1;
+
+        // Only charge callNewAccount gas if the account is new and non-zero value is being transferred per EIP161.
+        if ((kind == EEICallKind::Call) && !HERA_HOST_CALL("account_exists", m_result.gasLeft, m_context->host->account_exists(m_context, &call_message.destination)))
+          takeInterfaceGas(GasSchedule<Revision>::callNewAccount);
+      }
+
+      // This is the gas we are forwarding to the callee.
+      // Retain one 64th of it as per EIP150
+      gas = std::min(gas, maxCallGas(m_result.gasLeft));
+
+      takeInterfaceGas(gas);
+
+      // Add gas stipend for value transfers
+      if (!isZeroUint128(call_message.value))
+        gas += GasSchedule<Revision>::valueStipend;
+
+      call_message.gas = gas;
+
+      HERA_PROBE3(call__start, ProbeScope::codeHash(), call_message.gas, static_cast<int>(call_message.kind));
+      evmc_result call_result = m_context->host->call(m_context, &call_message);
+      HERA_PROBE3(call__done, ProbeScope::codeHash(), call_result.gas_left, static_cast<int>(call_result.status_code));
+
+      // The stipend is not paid by the caller.
+      int64_t stipend = isZeroUint128(call_message.value) ? 0 : GasSchedule<Revision>::valueStipend;
+      recordCalleeGasUsed(call_message.gas - stipend, call_message.gas - call_result.gas_left - stipend);
+
+      if (call_result.output_data) {
+        m_lastReturnData.assign(call_result.output_data, call_result.output_data + call_result.output_size);
+      } else {
+        m_lastReturnData.clear();
+      }
+
+      if (call_result.release)
+        call_result.release(&call_result);
+
+      /* Return unspent gas */
+      heraAssert(call_result.gas_left >= 0, "EVMC returned negative gas left");
+      m_result.gasLeft += call_result.gas_left;
+
+      switch (call_result.status_code) {
+      case EVMC_SUCCESS:
+        return 0;
+      case EVMC_REVERT:
+        return 2;
+      default:
+        return 1;
+      }
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  uint32_t EthereumInterface<Derived, Revision>::eeiCreate(uint32_t valueOffset, uint32_t dataOffset, uint32_t length, uint32_t resultOffset)
+  {
+      HERA_DEBUG << "create " << std::hex << valueOffset << " " << dataOffset << " " << length << std::dec << " " << resultOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::create);
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "create");
+
+      evmc_message create_message;
+
+      create_message.destination = {};
+      create_message.sender = m_msg.destination;
+      create_message.value = loadUint128(valueOffset);
+
+      if (m_msg.depth >= 1024)
+        return 1;
+      if (!enoughSenderBalanceFor(create_message.value))
+        return 1;
+
+      if (length) {
+        create_message.input_data = memoryView(dataOffset, length);
+        create_message.input_size = length;
+      } else {
+        create_message.input_data = nullptr;
+        create_message.input_size = 0;
+      }
+
+      create_message.depth = m_msg.depth + 1;
+      create_message.kind = EVMC_CREATE;
+      create_message.flags = 0;
+
+      int64_t gas = maxCallGas(m_result.gasLeft);
+      create_message.gas = gas;
+      takeInterfaceGas(gas);
+
+      HERA_PROBE3(call__start, ProbeScope::codeHash(), create_message.gas, static_cast<int>(create_message.kind));
+      evmc_result create_result = m_context->host->call(m_context, &create_message);
+      HERA_PROBE3(call__done, ProbeScope::codeHash(), create_result.gas_left, static_cast<int>(create_result.status_code));
+
+      recordCalleeGasUsed(create_message.gas, create_message.gas - create_result.gas_left);
+
+      /* Return unspent gas */
+      heraAssert(create_result.gas_left >= 0, "EVMC returned negative gas left");
+      m_result.gasLeft += create_result.gas_left;
+
+      if (create_result.status_code == EVMC_SUCCESS) {
+        storeAddress(create_result.create_address, resultOffset);
+        m_lastReturnData.clear();
+      } else if (create_result.output_data) {
+        m_lastReturnData.assign(create_result.output_data, create_result.output_data + create_result.output_size);
+      } else {
+        m_lastReturnData.clear();
+      }
+
+      if (create_result.release)
+        create_result.release(&create_result);
+
+      switch (create_result.status_code) {
+      case EVMC_SUCCESS:
+        return 0;
+      case EVMC_REVERT:
+        return 2;
+      default:
+        return 1;
+      }
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::eeiSelfDestruct(uint32_t addressOffset)
+  {
+      HERA_DEBUG << "selfDestruct " << std::hex << addressOffset << std::dec << "\n";
+
+      takeInterfaceGas(GasSchedule<Revision>::selfdestruct);
+
+      ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "selfDestruct");
+
+      evmc_address address = loadAddress(addressOffset);
+
+      if (!HERA_HOST_CALL("account_exists", m_result.gasLeft, m_context->host->account_exists(m_context, &address)))
+        takeInterfaceGas(GasSchedule<Revision>::callNewAccount);
+
+      HERA_HOST_CALL("selfdestruct", m_result.gasLeft, m_context->host->selfdestruct(m_context, &m_msg.destination, &address));
+
+      m_halted = true;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::takeGas(int64_t gas)
+  {
+    // NOTE: gas >= 0 is validated by the callers of this method
+    ensureCondition(gas <= m_result.gasLeft, OutOfGas, "Out of gas.");
+    m_result.gasLeft -= gas;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::takeInterfaceGas(int64_t gas)
+  {
+    if (!m_meterGas)
+      return;
+    heraAssert(gas >= 0, "Trying to take negative gas.");
+    takeGas(gas);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::recordCalleeGasUsed(int64_t forwardedGas, int64_t calleeGasUsed)
+  {
+    if (!m_meterGas || calleeGasUsed <= 0)
+      return;
+
+    // The forwarded gas has already been taken, but not yet returned.
+    int64_t usedBeforeCall = m_msg.gas - (m_result.gasLeft + forwardedGas);
+    m_result.gasRequired = std::max(m_result.gasRequired, gasRequiredForCallee(usedBeforeCall, calleeGasUsed));
+  }
+
+  /*
+   * Memory Operations
+   */
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::ensureSourceMemoryBounds(uint32_t offset, uint32_t length) {
+    ensureCondition((offset + length) >= offset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(derived().memorySize() >= (offset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+  }
+
+  // Returns a pointer straight into linear memory, valid until the contract
+  // resumes. Host calls cannot grow or modify this instance's memory, so it
+  // is safe to hand out for the duration of a single host call.
+  template <typename Derived, evmc_revision Revision>
+  uint8_t const* EthereumInterface<Derived, Revision>::memoryView(uint32_t offset, uint32_t length)
+  {
+    ensureSourceMemoryBounds(offset, length);
+    return derived().memoryData() + offset;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::loadMemoryReverse(uint32_t srcOffset, uint8_t *dst, size_t length)
+  {
+    // FIXME: the source bound check is not needed as the caller already ensures it
+    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(derived().memorySize() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory load from offset 0x" << std::hex << srcOffset << std::dec << "\n";
+
+    uint8_t const* src = derived().memoryData() + srcOffset;
+    std::reverse_copy(src, src + length, dst);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::loadMemory(uint32_t srcOffset, uint8_t *dst, size_t length)
+  {
+    // FIXME: the source bound check is not needed as the caller already ensures it
+    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(derived().memorySize() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory load from offset 0x" << std::hex << srcOffset << std::dec << "\n";
+
+    std::copy_n(derived().memoryData() + srcOffset, length, dst);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::loadMemory(uint32_t srcOffset, std::vector<uint8_t> & dst, size_t length)
+  {
+    // FIXME: the source bound check is not needed as the caller already ensures it
+    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(derived().memorySize() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(dst.size() >= length, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory load from offset 0x" << std::hex << srcOffset << std::dec <<"\n";
+
+    std::copy_n(derived().memoryData() + srcOffset, length, dst.begin());
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::storeMemoryReverse(const uint8_t *src, uint32_t dstOffset, uint32_t length)
+  {
+    ensureCondition((dstOffset + length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+    ensureCondition(derived().memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory store to offset 0x" << std::hex << dstOffset << std::dec << "\n";
+
+    std::reverse_copy(src, src + length, derived().memoryData() + dstOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::storeMemory(const uint8_t *src, uint32_t dstOffset, uint32_t length)
+  {
+    ensureCondition((dstOffset + length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+    ensureCondition(derived().memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory store to offset 0x" << std::hex << dstOffset << std::dec << "\n";
+
+    std::copy_n(src, length, derived().memoryData() + dstOffset);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::storeMemory(std::vector<uint8_t> const& src, uint32_t srcOffset, uint32_t dstOffset, uint32_t length)
+  {
+    ensureCondition((srcOffset + length) >= srcOffset, InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition(src.size() >= (srcOffset + length), InvalidMemoryAccess, "Out of bounds (source) memory copy.");
+    ensureCondition((dstOffset + length) >= dstOffset, InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+    ensureCondition(derived().memorySize() >= (dstOffset + length), InvalidMemoryAccess, "Out of bounds (destination) memory copy.");
+
+    if (!length)
+      HERA_DEBUG << "Zero-length memory store to offset 0x" << std::hex << dstOffset << std::dec << "\n";
+
+    std::copy_n(src.begin() + srcOffset, length, derived().memoryData() + dstOffset);
+  }
+
+  /*
+   * Memory Op Wrapper Functions
+   */
+
+  template <typename Derived, evmc_revision Revision>
+  evmc_uint256be EthereumInterface<Derived, Revision>::loadBytes32(uint32_t srcOffset)
+  {
+    evmc_uint256be dst = {};
+    loadMemory(srcOffset, dst.bytes, 32);
+    return dst;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::storeBytes32(evmc_uint256be const& src, uint32_t dstOffset)
+  {
+    storeMemory(src.bytes, dstOffset, 32);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  evmc_uint256be EthereumInterface<Derived, Revision>::loadUint256(uint32_t srcOffset)
+  {
+    evmc_uint256be dst = {};
+    loadMemoryReverse(srcOffset, dst.bytes, 32);
+    return dst;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::storeUint256(evmc_uint256be const& src, uint32_t dstOffset)
+  {
+    storeMemoryReverse(src.bytes, dstOffset, 32);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  evmc_address EthereumInterface<Derived, Revision>::loadAddress(uint32_t srcOffset)
+  {
+    evmc_address dst = {};
+    loadMemory(srcOffset, dst.bytes, 20);
+    return dst;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::storeAddress(evmc_address const& src, uint32_t dstOffset)
+  {
+    storeMemory(src.bytes, dstOffset, 20);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  evmc_uint256be EthereumInterface<Derived, Revision>::loadUint128(uint32_t srcOffset)
+  {
+    evmc_uint256be dst = {};
+    loadMemoryReverse(srcOffset, dst.bytes + 16, 16);
+    return dst;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::storeUint128(evmc_uint256be const& src, uint32_t dstOffset)
+  {
+    ensureCondition(!exceedsUint128(src), ArgumentOutOfRange, "Account balance (or transaction value) exceeds 128 bits.");
+    storeMemoryReverse(src.bytes + 16, dstOffset, 16);
+  }
+
+  /*
+   * Utilities
+   */
+  template <typename Derived, evmc_revision Revision>
+  void EthereumInterface<Derived, Revision>::safeChargeDataCopy(uint32_t length, unsigned baseCost) {
+    takeInterfaceGas(baseCost);
+
+    // Since length here is 32 bits divided by 32 (aka shifted right by 5 bits), we
+    // can assume the upper bound for values is 27 bits.
+    //
+    // Since `gas` is 63 bits wide, that means we have an extra 36 bits of headroom.
+    //
+    // Allow 16 bits here.
+    static_assert(GasSchedule<Revision>::copy <= 65536, "Gas cost of copy could lead to overflow");
+    // Using uint64_t to force a type issue if the underlying API changes.
+    takeInterfaceGas(GasSchedule<Revision>::copy * ((int64_t(length) + 31) / 32));
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  bool EthereumInterface<Derived, Revision>::enoughSenderBalanceFor(evmc_uint256be const& value) const
+  {
+    AsyncScheduler::awaitBalance(m_msg.destination);
+    evmc_uint256be balance = HERA_HOST_CALL("get_balance", m_result.gasLeft, m_context->host->get_balance(m_context, &m_msg.destination));
+    return safeLoadUint128(balance) >= safeLoadUint128(value);
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  unsigned __int128 EthereumInterface<Derived, Revision>::safeLoadUint128(evmc_uint256be const& value)
+  {
+    ensureCondition(!exceedsUint128(value), ArgumentOutOfRange, "Account balance (or transaction value) exceeds 128 bits.");
+    unsigned __int128 ret = 0;
+    for (unsigned i = 16; i < 32; i++) {
+      ret <<= 8;
+      ret |= value.bytes[i];
+    }
+    return ret;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  bool EthereumInterface<Derived, Revision>::exceedsUint128(evmc_uint256be const& value)
+  {
+    for (unsigned i = 0; i < 16; i++) {
+      if (value.bytes[i])
+        return true;
+    }
+    return false;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  bool EthereumInterface<Derived, Revision>::isZeroUint128(evmc_uint256be const& value)
+  {
+    for (unsigned i = 16; i < 32; i++) {
+      if (value.bytes[i] != 0)
+        return false;
+    }
+    return true;
+  }
+
+  template <typename Derived, evmc_revision Revision>
+  bool EthereumInterface<Derived, Revision>::isZeroUint256(evmc_uint256be const& value)
+  {
+    for (unsigned i = 0; i < 32; i++) {
+      if (value.bytes[i] != 0)
+        return false;
+    }
+    return true;
+  }
 
 }
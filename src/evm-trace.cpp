@@ -0,0 +1,88 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "evm-trace.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "exceptions.h"
+
+using namespace std;
+
+namespace hera {
+
+constexpr unsigned EvmTraceRecord::stackItems;
+constexpr uint64_t EvmTraceSink::defaultCapacity;
+
+thread_local FiberLocal<EvmTraceSink> EvmTraceSink::s_current;
+
+unique_ptr<EvmTraceSink> EvmTraceSink::create(string const& path, uint64_t capacity)
+{
+  heraAssert(capacity > 0, "Trace capacity must not be zero.");
+  size_t size = sizeof(EvmTraceFileHeader) + capacity * sizeof(EvmTraceRecord);
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  heraAssert(fd >= 0, "Cannot create trace file.");
+  // The file is sparse, untouched slots take no space.
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    heraAssert(false, "Cannot size trace file.");
+  }
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  heraAssert(mapping != MAP_FAILED, "Cannot map trace file.");
+
+  EvmTraceFileHeader* header = static_cast<EvmTraceFileHeader*>(mapping);
+  memcpy(header->magic, evmTraceMagic, sizeof(header->magic));
+  header->version = evmTraceVersion;
+  header->recordSize = sizeof(EvmTraceRecord);
+  header->capacity = capacity;
+  header->next = 0;
+
+  return unique_ptr<EvmTraceSink>(new EvmTraceSink(mapping, size));
+}
+
+EvmTraceSink::EvmTraceSink(void* mapping, size_t size):
+  m_mapping(mapping),
+  m_size(size),
+  m_header(static_cast<EvmTraceFileHeader*>(mapping)),
+  m_records(reinterpret_cast<EvmTraceRecord*>(static_cast<uint8_t*>(mapping) + sizeof(EvmTraceFileHeader)))
+{
+}
+
+EvmTraceSink::~EvmTraceSink() noexcept
+{
+  munmap(m_mapping, m_size);
+}
+
+EvmTraceRecord& EvmTraceSink::reserve(uint64_t& sequence)
+{
+  sequence = __atomic_fetch_add(&m_header->next, 1, __ATOMIC_RELAXED);
+  EvmTraceRecord& record = m_records[sequence % m_header->capacity];
+  __atomic_store_n(&record.sequence, 0, __ATOMIC_RELAXED);
+  return record;
+}
+
+void EvmTraceSink::commit(EvmTraceRecord& record, uint64_t sequence)
+{
+  __atomic_store_n(&record.sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+}
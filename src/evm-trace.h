@@ -0,0 +1,111 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <evmc/evmc.h>
+
+#include "fiber-local.h"
+
+namespace hera {
+
+// The layout of an EVM trace file: a header followed by a ring of fixed
+// size records. The file is mapped into memory, so it is in host byte order.
+// See hera-trace-convert for turning it into JSON lines.
+
+constexpr char evmTraceMagic[8] = {'H', 'E', 'R', 'A', 'T', 'R', 'C', 0};
+constexpr uint32_t evmTraceVersion = 2;
+
+struct EvmTraceFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t capacity;
+  // The number of records ever appended, updated atomically. The record with
+  // sequence number n is stored in slot n % capacity.
+  uint64_t next;
+  uint8_t reserved[32];
+};
+
+struct EvmTraceRecord {
+  // Only the topmost items of the stack are kept, as many as the deepest
+  // reaching opcode, SWAP16, reads.
+  static constexpr unsigned stackItems = 17;
+
+  // The sequence number plus one, stored last. Zero while the slot is empty
+  // or being written.
+  uint64_t sequence;
+  int64_t gas;
+  uint32_t pc;
+  uint32_t gasCost;
+  int32_t depth;
+  // The full height of the stack.
+  uint16_t stackSize;
+  uint8_t opcode;
+  uint8_t revision;
+  // The topmost item first.
+  evmc_uint256be stack[stackItems];
+};
+
+static_assert(sizeof(EvmTraceFileHeader) == 64, "Unexpected trace header layout.");
+static_assert(sizeof(EvmTraceRecord) == 576, "Unexpected trace record layout.");
+
+// Collects the steps reported through debug::evmTrace in a memory mapped
+// ring file. Appending is lock free and may be done from several threads.
+class EvmTraceSink {
+public:
+  // The default number of records the ring holds before it wraps around.
+  static constexpr uint64_t defaultCapacity = 1 << 20;
+
+  // Throws InternalErrorException if the file cannot be created or mapped.
+  static std::unique_ptr<EvmTraceSink> create(std::string const& path, uint64_t capacity = defaultCapacity);
+
+  ~EvmTraceSink() noexcept;
+
+  // Returns the slot for the next record. The caller fills it in, then calls commit().
+  EvmTraceRecord& reserve(uint64_t& sequence);
+  void commit(EvmTraceRecord& record, uint64_t sequence);
+
+  // The sink used by executions on the current thread, if any.
+  static EvmTraceSink* current() { return s_current.get(); }
+
+  // Sets the sink of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(EvmTraceSink* sink): m_previous(s_current.get()) { s_current.set(sink); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    EvmTraceSink* m_previous;
+  };
+
+private:
+  EvmTraceSink(void* mapping, size_t size);
+
+  void* m_mapping;
+  size_t m_size;
+  EvmTraceFileHeader* m_header;
+  EvmTraceRecord* m_records;
+
+  static thread_local FiberLocal<EvmTraceSink> s_current;
+};
+
+}
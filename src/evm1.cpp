@@ -0,0 +1,914 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+#include <chrono>
+#include <memory>
+
+#include <evmc/instructions.h>
+
+#include "evm1.h"
+#include "debugging.h"
+#include "exceptions.h"
+#include "helpers.h"
+#include "module-cache.h"
+#include "uint256.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+inline uint256 fromBytes32(evmc_bytes32 const& value) { return fromBigEndian(value.bytes, 32); }
+inline uint256 fromAddress(evmc_address const& value) { return fromBigEndian(value.bytes, 20); }
+
+inline evmc_bytes32 toBytes32(uint256 const& a)
+{
+  evmc_bytes32 ret;
+  toBigEndian(a, ret.bytes);
+  return ret;
+}
+
+inline evmc_address toAddress(uint256 const& a)
+{
+  uint8_t bytes[32];
+  toBigEndian(a, bytes);
+  evmc_address ret;
+  std::copy_n(bytes + 12, 20, ret.bytes);
+  return ret;
+}
+
+/*
+ * Interpreter
+ */
+
+enum Opcode : uint8_t {
+  STOP = 0x00, ADD = 0x01, MUL = 0x02, SUB = 0x03, DIV = 0x04, SDIV = 0x05, MOD = 0x06, SMOD = 0x07,
+  ADDMOD = 0x08, MULMOD = 0x09, EXP = 0x0a, SIGNEXTEND = 0x0b,
+  LT = 0x10, GT = 0x11, SLT = 0x12, SGT = 0x13, EQ = 0x14, ISZERO = 0x15, AND = 0x16, OR = 0x17,
+  XOR = 0x18, NOT = 0x19, BYTE = 0x1a, SHL = 0x1b, SHR = 0x1c, SAR = 0x1d,
+  SHA3 = 0x20,
+  ADDRESS = 0x30, BALANCE = 0x31, ORIGIN = 0x32, CALLER = 0x33, CALLVALUE = 0x34, CALLDATALOAD = 0x35,
+  CALLDATASIZE = 0x36, CALLDATACOPY = 0x37, CODESIZE = 0x38, CODECOPY = 0x39, GASPRICE = 0x3a,
+  EXTCODESIZE = 0x3b, EXTCODECOPY = 0x3c, RETURNDATASIZE = 0x3d, RETURNDATACOPY = 0x3e, EXTCODEHASH = 0x3f,
+  BLOCKHASH = 0x40, COINBASE = 0x41, TIMESTAMP = 0x42, NUMBER = 0x43, DIFFICULTY = 0x44, GASLIMIT = 0x45,
+  POP = 0x50, MLOAD = 0x51, MSTORE = 0x52, MSTORE8 = 0x53, SLOAD = 0x54, SSTORE = 0x55, JUMP = 0x56,
+  JUMPI = 0x57, PC = 0x58, MSIZE = 0x59, GAS = 0x5a, JUMPDEST = 0x5b,
+  PUSH1 = 0x60, PUSH32 = 0x7f, DUP1 = 0x80, DUP16 = 0x8f, SWAP1 = 0x90, SWAP16 = 0x9f,
+  LOG0 = 0xa0, LOG4 = 0xa4,
+  CREATE = 0xf0, CALL = 0xf1, CALLCODE = 0xf2, RETURN = 0xf3, DELEGATECALL = 0xf4, CREATE2 = 0xf5,
+  STATICCALL = 0xfa, REVERT = 0xfd, INVALID = 0xfe, SELFDESTRUCT = 0xff
+};
+
+const size_t stackLimit = 1024;
+
+// A straight run of instructions which is entered at the top only.
+struct BasicBlock {
+  // The sum of the base gas costs.
+  int64_t gas = 0;
+  // The stack height needed on entry, and the largest growth above it.
+  int32_t stackRequired = 0;
+  int32_t stackGrowth = 0;
+  // The position just past the last instruction.
+  size_t end = 0;
+};
+
+// Whether an instruction ends its block. Besides control flow, this covers
+// every instruction which observes the gas left, so that it sees the exact
+// figure despite the block being charged up front.
+bool endsBlock(uint8_t op, bool defined)
+{
+  if (!defined)
+    return true;
+  switch (op) {
+  case STOP: case JUMP: case JUMPI: case GAS: case RETURN: case REVERT: case INVALID: case SELFDESTRUCT:
+  case CREATE: case CREATE2: case CALL: case CALLCODE: case DELEGATECALL: case STATICCALL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The code of a contract split into basic blocks, which the executions of
+// it share through the module cache.
+template <evmc_revision Revision>
+struct Evm1Code : CachedModule {
+  explicit Evm1Code(vector<uint8_t> const& _code);
+
+  size_t footprint() const override
+  {
+    return sizeof(*this) + code.capacity() + jumpdest.capacity() +
+      blockAt.capacity() * sizeof(int32_t) + blocks.capacity() * sizeof(BasicBlock);
+  }
+
+  // Padded, so that push data and the implicit STOP never read past the end.
+  vector<uint8_t> code;
+  size_t codeSize;
+
+  // Whether every opcode is an instruction of the revision. Undefined ones
+  // take no gas or stack in the analysis and trap when executed.
+  array<bool, 256> defined;
+  vector<uint8_t> jumpdest;
+  // The index into blocks of the block starting at every position, or -1.
+  vector<int32_t> blockAt;
+  vector<BasicBlock> blocks;
+};
+
+template <evmc_revision Revision>
+Evm1Code<Revision>::Evm1Code(vector<uint8_t> const& _code):
+  codeSize(_code.size())
+{
+  evmc_instruction_metrics const* metrics = evmc_get_instruction_metrics_table(Revision);
+  char const* const* names = evmc_get_instruction_names_table(Revision);
+  heraAssert(metrics && names, "Unsupported revision.");
+  for (size_t op = 0; op < defined.size(); ++op)
+    defined[op] = names[op] != nullptr;
+
+  code.reserve(codeSize + 33);
+  code.assign(_code.begin(), _code.end());
+  code.resize(codeSize + 33, STOP);
+
+  jumpdest.assign(codeSize, 0);
+  blockAt.assign(code.size(), -1);
+
+  BasicBlock block;
+  bool open = false;
+  int32_t height = 0;
+  size_t start = 0;
+  size_t pc = 0;
+
+  auto close = [&](size_t end) {
+    block.end = end;
+    blockAt[start] = static_cast<int32_t>(blocks.size());
+    blocks.push_back(block);
+    open = false;
+  };
+
+  while (pc < codeSize) {
+    uint8_t op = code[pc];
+    if (op == JUMPDEST) {
+      jumpdest[pc] = 1;
+      if (open)
+        close(pc);
+    }
+    if (!open) {
+      block = BasicBlock{};
+      height = 0;
+      start = pc;
+      open = true;
+    }
+
+    if (defined[op]) {
+      evmc_instruction_metrics const& metric = metrics[op];
+      block.gas += metric.gas_cost;
+      block.stackRequired = max(block.stackRequired, metric.num_stack_arguments - height);
+      height += metric.num_stack_returned_items - metric.num_stack_arguments;
+      block.stackGrowth = max(block.stackGrowth, height);
+    }
+
+    size_t next = pc + 1;
+    if (op >= PUSH1 && op <= PUSH32)
+      next += op - PUSH1 + 1;
+    if (endsBlock(op, defined[op]))
+      close(next);
+    pc = next;
+  }
+
+  if (open)
+    close(pc);
+  // Running past the end of the code executes STOP.
+  block = BasicBlock{};
+  start = pc;
+  close(pc + 1);
+}
+
+template <evmc_revision Revision>
+class Evm1Execution {
+public:
+  Evm1Execution(
+    evmc_context* context,
+    shared_ptr<const Evm1Code<Revision>> code,
+    evmc_message const& msg
+  ):
+    m_context(context),
+    m_analysis(move(code)),
+    m_code(m_analysis->code),
+    m_codeSize(m_analysis->codeSize),
+    m_defined(m_analysis->defined),
+    m_jumpdest(m_analysis->jumpdest),
+    m_blockAt(m_analysis->blockAt),
+    m_blocks(m_analysis->blocks),
+    m_msg(msg),
+    m_stack(stackLimit)
+  {
+  }
+
+  ExecutionResult run();
+
+private:
+  using Gas = GasSchedule<Revision>;
+
+  void useGas(int64_t gas)
+  {
+    ensureCondition(gas <= m_gasLeft, OutOfGas, "Out of gas.");
+    m_gasLeft -= gas;
+  }
+
+  void useCopyGas(int64_t perWord, uint256 const& size)
+  {
+    // size has already been bounded by memoryRegion()
+    useGas(perWord * ((static_cast<int64_t>(size.w[0]) + 31) / 32));
+  }
+
+  uint256& top(size_t n = 0) { return m_stack[m_sp - 1 - n]; }
+  uint256 pop() { return m_stack[--m_sp]; }
+  void push(uint256 const& value) { m_stack[m_sp++] = value; }
+
+  size_t memoryRegion(uint256 const& offset, uint256 const& size);
+  void copyToMemory(size_t memoryOffset, uint256 const& size, uint8_t const* data, size_t dataSize, uint256 const& dataOffset);
+
+  // Fetches the transaction context on first use and records @field as read.
+  evmc_tx_context const& txContext(TxContextField field);
+  bool enoughBalanceFor(uint256 const& value);
+  void ensureNotStatic(char const* name) const;
+  // See EthereumInterface::recordCalleeGasUsed().
+  void recordCalleeGasUsed(int64_t forwardedGas, int64_t calleeGasUsed);
+
+  void log(unsigned topics);
+  void storageStore();
+  void call(uint8_t op);
+  void create();
+  void selfDestruct();
+
+  evmc_context* m_context;
+  shared_ptr<const Evm1Code<Revision>> m_analysis;
+  vector<uint8_t> const& m_code;
+  size_t m_codeSize;
+  array<bool, 256> const& m_defined;
+  vector<uint8_t> const& m_jumpdest;
+  vector<int32_t> const& m_blockAt;
+  vector<BasicBlock> const& m_blocks;
+  evmc_message const& m_msg;
+
+  vector<uint256> m_stack;
+  size_t m_sp = 0;
+  vector<uint8_t> m_memory;
+  int64_t m_memoryCost = 0;
+  vector<uint8_t> m_returnData;
+  int64_t m_gasLeft = 0;
+  int64_t m_gasRequired = 0;
+  evmc_tx_context m_txContext{};
+  bool m_haveTxContext = false;
+  // See ExecutionResult.
+  uint32_t m_txContextRead = 0;
+  bool m_gasLeftRead = false;
+};
+
+template <evmc_revision Revision>
+size_t Evm1Execution<Revision>::memoryRegion(uint256 const& offset, uint256 const& size)
+{
+  if (isZero(size))
+    return 0;
+
+  // Anything larger would cost more gas than fits into int64_t.
+  const uint64_t limit = numeric_limits<uint32_t>::max();
+  ensureCondition(fitsUint64(offset) && fitsUint64(size) && offset.w[0] <= limit && size.w[0] <= limit, OutOfGas, "Out of gas.");
+
+  uint64_t end = offset.w[0] + size.w[0];
+  if (end > m_memory.size()) {
+    int64_t words = static_cast<int64_t>((end + 31) / 32);
+    int64_t cost = Gas::memory * words + words * words / Gas::memoryQuadDivisor;
+    useGas(cost - m_memoryCost);
+    m_memoryCost = cost;
+    m_memory.resize(static_cast<size_t>(words) * 32);
+  }
+  return static_cast<size_t>(offset.w[0]);
+}
+
+// Copies @size bytes of @data starting at @dataOffset, padded with zeroes past its end.
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::copyToMemory(size_t memoryOffset, uint256 const& size, uint8_t const* data, size_t dataSize, uint256 const& dataOffset)
+{
+  if (isZero(size))
+    return;
+  size_t length = static_cast<size_t>(size.w[0]);
+  size_t copied = 0;
+  if (fitsUint64(dataOffset) && dataOffset.w[0] < dataSize) {
+    copied = min(length, dataSize - static_cast<size_t>(dataOffset.w[0]));
+    std::copy_n(data + dataOffset.w[0], copied, m_memory.begin() + static_cast<ptrdiff_t>(memoryOffset));
+  }
+  std::fill_n(m_memory.begin() + static_cast<ptrdiff_t>(memoryOffset + copied), length - copied, 0);
+}
+
+template <evmc_revision Revision>
+evmc_tx_context const& Evm1Execution<Revision>::txContext(TxContextField field)
+{
+  if (!m_haveTxContext) {
+    m_txContext = HERA_HOST_CALL("get_tx_context", m_gasLeft, m_context->host->get_tx_context(m_context));
+    m_haveTxContext = true;
+  }
+  m_txContextRead |= field;
+  return m_txContext;
+}
+
+template <evmc_revision Revision>
+bool Evm1Execution<Revision>::enoughBalanceFor(uint256 const& value)
+{
+  if (isZero(value))
+    return true;
+  AsyncScheduler::awaitBalance(m_msg.destination);
+  evmc_uint256be balance = HERA_HOST_CALL("get_balance", m_gasLeft, m_context->host->get_balance(m_context, &m_msg.destination));
+  return !(fromBytes32(balance) < value);
+}
+
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::ensureNotStatic(char const* name) const
+{
+  ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, name);
+}
+
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::recordCalleeGasUsed(int64_t forwardedGas, int64_t calleeGasUsed)
+{
+  if (calleeGasUsed <= 0)
+    return;
+  // The forwarded gas has already been taken, but not yet returned.
+  int64_t usedBeforeCall = m_msg.gas - (m_gasLeft + forwardedGas);
+  m_gasRequired = max(m_gasRequired, gasRequiredForCallee(usedBeforeCall, calleeGasUsed));
+}
+
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::log(unsigned topicCount)
+{
+  ensureNotStatic("log");
+  uint256 offset = pop();
+  uint256 size = pop();
+  size_t memoryOffset = memoryRegion(offset, size);
+  useGas(Gas::logData * static_cast<int64_t>(size.w[0]));
+
+  evmc_bytes32 topics[4];
+  for (unsigned i = 0; i < topicCount; ++i)
+    topics[i] = toBytes32(pop());
+
+  uint8_t const* data = isZero(size) ? nullptr : &m_memory[memoryOffset];
+  HERA_HOST_CALL("emit_log", m_gasLeft, m_context->host->emit_log(m_context, &m_msg.destination, data, static_cast<size_t>(size.w[0]), topics, topicCount));
+}
+
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::storageStore()
+{
+  ensureNotStatic("storageStore");
+  evmc_bytes32 key = toBytes32(pop());
+  evmc_bytes32 value = toBytes32(pop());
+
+  AsyncScheduler::awaitStorage(m_msg.destination, key);
+  evmc_bytes32 current = HERA_HOST_CALL("get_storage", m_gasLeft, m_context->host->get_storage(m_context, &m_msg.destination, &key));
+  if (isZero(fromBytes32(current)) && !isZero(fromBytes32(value)))
+    useGas(Gas::storageStoreCreate);
+  else
+    useGas(Gas::storageStoreChange);
+  HERA_HOST_CALL("set_storage", m_gasLeft, m_context->host->set_storage(m_context, &m_msg.destination, &key, &value));
+}
+
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::call(uint8_t op)
+{
+  uint256 gasArgument = pop();
+  evmc_address destination = toAddress(pop());
+  uint256 value = (op == CALL || op == CALLCODE) ? pop() : makeUint256(0);
+  uint256 inputOffset = pop();
+  uint256 inputSize = pop();
+  uint256 outputOffset = pop();
+  uint256 outputSize = pop();
+
+  size_t input = memoryRegion(inputOffset, inputSize);
+  size_t output = memoryRegion(outputOffset, outputSize);
+
+  bool hasValue = !isZero(value);
+  if (op == CALL && hasValue)
+    ensureNotStatic("call");
+
+  if (hasValue) {
+    useGas(Gas::valuetransfer);
+    // Only charge for a new account if value is transferred to it (EIP-161).
+    if (op == CALL && !HERA_HOST_CALL("account_exists", m_gasLeft, m_context->host->account_exists(m_context, &destination)))
+      useGas(Gas::callNewAccount);
+  }
+
+  // Retain one 64th of the gas left (EIP-150).
+  int64_t gas = m_gasLeft - m_gasLeft / 64;
+  if (fitsUint64(gasArgument) && gasArgument.w[0] < static_cast<uint64_t>(gas))
+    gas = static_cast<int64_t>(gasArgument.w[0]);
+  useGas(gas);
+  if (hasValue)
+    gas += Gas::valueStipend;
+
+  evmc_message message{};
+  message.gas = gas;
+  message.depth = m_msg.depth + 1;
+  message.destination = destination;
+  message.input_data = isZero(inputSize) ? nullptr : &m_memory[input];
+  message.input_size = static_cast<size_t>(inputSize.w[0]);
+  message.flags = m_msg.flags;
+  switch (op) {
+  case CALL:
+    message.kind = EVMC_CALL;
+    message.sender = m_msg.destination;
+    message.value = toBytes32(value);
+    break;
+  case CALLCODE:
+    message.kind = EVMC_CALLCODE;
+    message.sender = m_msg.destination;
+    message.value = toBytes32(value);
+    break;
+  case DELEGATECALL:
+    message.kind = EVMC_DELEGATECALL;
+    message.sender = m_msg.sender;
+    message.value = m_msg.value;
+    break;
+  default:
+    message.kind = EVMC_CALL;
+    message.flags |= EVMC_STATIC;
+    message.sender = m_msg.destination;
+    break;
+  }
+
+  m_returnData.clear();
+
+  if (m_msg.depth >= 1024 || !enoughBalanceFor(value)) {
+    m_gasLeft += gas;
+    push(makeUint256(0));
+    return;
+  }
+
+  HERA_PROBE3(call__start, ProbeScope::codeHash(), message.gas, static_cast<int>(message.kind));
+  evmc_result result = m_context->host->call(m_context, &message);
+  HERA_PROBE3(call__done, ProbeScope::codeHash(), result.gas_left, static_cast<int>(result.status_code));
+  heraAssert(result.gas_left >= 0, "EVMC returned negative gas left");
+
+  // The stipend is not paid by the caller.
+  int64_t stipend = hasValue ? Gas::valueStipend : 0;
+  recordCalleeGasUsed(gas - stipend, gas - result.gas_left - stipend);
+
+  if (result.output_data)
+    m_returnData.assign(result.output_data, result.output_data + result.output_size);
+  if (result.release)
+    result.release(&result);
+
+  size_t copied = min(static_cast<size_t>(outputSize.w[0]), m_returnData.size());
+  if (copied)
+    std::copy_n(m_returnData.begin(), copied, m_memory.begin() + static_cast<ptrdiff_t>(output));
+
+  m_gasLeft += result.gas_left;
+  push(makeUint256(result.status_code == EVMC_SUCCESS ? 1 : 0));
+}
+
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::create()
+{
+  ensureNotStatic("create");
+
+  uint256 value = pop();
+  uint256 offset = pop();
+  uint256 size = pop();
+
+  size_t memoryOffset = memoryRegion(offset, size);
+
+  int64_t gas = m_gasLeft - m_gasLeft / 64;
+  useGas(gas);
+
+  evmc_message message{};
+  message.kind = EVMC_CREATE;
+  message.gas = gas;
+  message.depth = m_msg.depth + 1;
+  message.sender = m_msg.destination;
+  message.value = toBytes32(value);
+  message.input_data = isZero(size) ? nullptr : &m_memory[memoryOffset];
+  message.input_size = static_cast<size_t>(size.w[0]);
+
+  m_returnData.clear();
+
+  if (m_msg.depth >= 1024 || !enoughBalanceFor(value)) {
+    m_gasLeft += gas;
+    push(makeUint256(0));
+    return;
+  }
+
+  HERA_PROBE3(call__start, ProbeScope::codeHash(), message.gas, static_cast<int>(message.kind));
+  evmc_result result = m_context->host->call(m_context, &message);
+  HERA_PROBE3(call__done, ProbeScope::codeHash(), result.gas_left, static_cast<int>(result.status_code));
+  heraAssert(result.gas_left >= 0, "EVMC returned negative gas left");
+
+  recordCalleeGasUsed(gas, gas - result.gas_left);
+
+  if (result.status_code != EVMC_SUCCESS && result.output_data)
+    m_returnData.assign(result.output_data, result.output_data + result.output_size);
+  evmc_address created = result.create_address;
+  bool success = result.status_code == EVMC_SUCCESS;
+  if (result.release)
+    result.release(&result);
+
+  m_gasLeft += result.gas_left;
+  push(success ? fromAddress(created) : makeUint256(0));
+}
+
+template <evmc_revision Revision>
+void Evm1Execution<Revision>::selfDestruct()
+{
+  ensureNotStatic("selfDestruct");
+  evmc_address beneficiary = toAddress(pop());
+
+  if (!HERA_HOST_CALL("account_exists", m_gasLeft, m_context->host->account_exists(m_context, &beneficiary))) {
+    AsyncScheduler::awaitBalance(m_msg.destination);
+    evmc_uint256be balance = HERA_HOST_CALL("get_balance", m_gasLeft, m_context->host->get_balance(m_context, &m_msg.destination));
+    if (!isZero(fromBytes32(balance)))
+      useGas(Gas::selfdestructNewAccount);
+  }
+
+  HERA_HOST_CALL("selfdestruct", m_gasLeft, m_context->host->selfdestruct(m_context, &m_msg.destination, &beneficiary));
+}
+
+template <evmc_revision Revision>
+ExecutionResult Evm1Execution<Revision>::run()
+{
+  ExecutionResult result;
+  m_gasLeft = m_msg.gas;
+
+  size_t pc = 0;
+  for (;;) {
+    heraAssert(m_blockAt[pc] >= 0, "Not at the start of a basic block.");
+    BasicBlock const& block = m_blocks[static_cast<size_t>(m_blockAt[pc])];
+    useGas(block.gas);
+    ensureCondition(m_sp >= static_cast<size_t>(block.stackRequired), VMTrap, "Stack underflow.");
+    ensureCondition(m_sp + static_cast<size_t>(block.stackGrowth) <= stackLimit, VMTrap, "Stack overflow.");
+
+    while (pc < block.end) {
+      uint8_t op = m_code[pc];
+      // Before any operand is touched: the block did not account for them.
+      ensureCondition(m_defined[op], VMTrap, op == INVALID ? "Invalid instruction." : "Undefined instruction.");
+      switch (op) {
+      case STOP:
+        result.gasLeft = m_gasLeft;
+        result.gasRequired = m_gasRequired;
+        result.txContextRead = m_txContextRead;
+        result.gasLeftRead = m_gasLeftRead;
+        return result;
+
+      case ADD: { uint256 a = pop(); top() = a + top(); break; }
+      case MUL: { uint256 a = pop(); top() = a * top(); break; }
+      case SUB: { uint256 a = pop(); top() = a - top(); break; }
+      case DIV: {
+        uint256 a = pop();
+        uint256& b = top();
+        if (isZero(b))
+          break;
+        divide(a, b, &b, nullptr);
+        break;
+      }
+      case SDIV: {
+        uint256 a = pop();
+        uint256& b = top();
+        if (isZero(b))
+          break;
+        bool negative = isNegative(a) != isNegative(b);
+        uint256 q;
+        divide(isNegative(a) ? negate(a) : a, isNegative(b) ? negate(b) : b, &q, nullptr);
+        b = negative ? negate(q) : q;
+        break;
+      }
+      case MOD: {
+        uint256 a = pop();
+        uint256& b = top();
+        if (isZero(b))
+          break;
+        divide(a, b, nullptr, &b);
+        break;
+      }
+      case SMOD: {
+        uint256 a = pop();
+        uint256& b = top();
+        if (isZero(b))
+          break;
+        uint256 r;
+        divide(isNegative(a) ? negate(a) : a, isNegative(b) ? negate(b) : b, nullptr, &r);
+        b = isNegative(a) ? negate(r) : r;
+        break;
+      }
+      case ADDMOD: {
+        uint256 a = pop();
+        uint256 b = pop();
+        uint256& n = top();
+        n = isZero(n) ? n : addMod(a, b, n);
+        break;
+      }
+      case MULMOD: {
+        uint256 a = pop();
+        uint256 b = pop();
+        uint256& n = top();
+        n = isZero(n) ? n : mulMod(a, b, n);
+        break;
+      }
+      case EXP: {
+        uint256 base = pop();
+        uint256& exponent = top();
+        useGas(Gas::expByte * static_cast<int64_t>(byteLength(exponent)));
+        exponent = exp(base, exponent);
+        break;
+      }
+      case SIGNEXTEND: {
+        uint256 b = pop();
+        uint256& x = top();
+        if (fitsUint64(b) && b.w[0] < 31) {
+          unsigned bit = static_cast<unsigned>(b.w[0]) * 8 + 7;
+          uint256 mask = shiftLeft(makeUint256(1), bit + 1) - makeUint256(1);
+          x = (shiftRight(x, bit).w[0] & 1) ? (x | ~mask) : (x & mask);
+        }
+        break;
+      }
+
+      case LT: { uint256 a = pop(); top() = makeUint256(a < top()); break; }
+      case GT: { uint256 a = pop(); top() = makeUint256(top() < a); break; }
+      case SLT: { uint256 a = pop(); top() = makeUint256(signedLess(a, top())); break; }
+      case SGT: { uint256 a = pop(); top() = makeUint256(signedLess(top(), a)); break; }
+      case EQ: { uint256 a = pop(); top() = makeUint256(a == top()); break; }
+      case ISZERO: top() = makeUint256(isZero(top())); break;
+      case AND: { uint256 a = pop(); top() = a & top(); break; }
+      case OR: { uint256 a = pop(); top() = a | top(); break; }
+      case XOR: { uint256 a = pop(); top() = a ^ top(); break; }
+      case NOT: top() = ~top(); break;
+      case BYTE: {
+        uint256 i = pop();
+        uint256& x = top();
+        x = (fitsUint64(i) && i.w[0] < 32) ? makeUint256(shiftRight(x, 8 * (31 - static_cast<unsigned>(i.w[0]))).w[0] & 0xff) : makeUint256(0);
+        break;
+      }
+
+      case SHA3: {
+        uint256 offset = pop();
+        uint256& size = top();
+        size_t memoryOffset = memoryRegion(offset, size);
+        useCopyGas(Gas::sha3Word, size);
+        evmc_bytes32 hash = keccak256(isZero(size) ? nullptr : &m_memory[memoryOffset], static_cast<size_t>(size.w[0]));
+        size = fromBytes32(hash);
+        break;
+      }
+
+      case ADDRESS: push(fromAddress(m_msg.destination)); break;
+      case BALANCE: {
+        evmc_address address = toAddress(top());
+        AsyncScheduler::awaitBalance(address);
+        top() = fromBytes32(HERA_HOST_CALL("get_balance", m_gasLeft, m_context->host->get_balance(m_context, &address)));
+        break;
+      }
+      case ORIGIN: push(fromAddress(txContext(TxOrigin).tx_origin)); break;
+      case CALLER: push(fromAddress(m_msg.sender)); break;
+      case CALLVALUE: push(fromBytes32(m_msg.value)); break;
+      case CALLDATALOAD: {
+        uint256& offset = top();
+        uint8_t data[32] = {};
+        if (fitsUint64(offset) && offset.w[0] < m_msg.input_size)
+          std::copy_n(m_msg.input_data + offset.w[0], min<size_t>(32, m_msg.input_size - static_cast<size_t>(offset.w[0])), data);
+        offset = fromBigEndian(data, 32);
+        break;
+      }
+      case CALLDATASIZE: push(makeUint256(m_msg.input_size)); break;
+      case CALLDATACOPY: {
+        uint256 memoryOffset = pop();
+        uint256 dataOffset = pop();
+        uint256 size = pop();
+        size_t offset = memoryRegion(memoryOffset, size);
+        useCopyGas(Gas::copy, size);
+        copyToMemory(offset, size, m_msg.input_data, m_msg.input_size, dataOffset);
+        break;
+      }
+      case CODESIZE: push(makeUint256(m_codeSize)); break;
+      case CODECOPY: {
+        uint256 memoryOffset = pop();
+        uint256 codeOffset = pop();
+        uint256 size = pop();
+        size_t offset = memoryRegion(memoryOffset, size);
+        useCopyGas(Gas::copy, size);
+        copyToMemory(offset, size, m_code.data(), m_codeSize, codeOffset);
+        break;
+      }
+      case GASPRICE: push(fromBytes32(txContext(TxGasPrice).tx_gas_price)); break;
+      case EXTCODESIZE: {
+        evmc_address address = toAddress(top());
+        AsyncScheduler::awaitCode(address);
+        top() = makeUint256(HERA_HOST_CALL("get_code_size", m_gasLeft, m_context->host->get_code_size(m_context, &address)));
+        break;
+      }
+      case EXTCODECOPY: {
+        evmc_address address = toAddress(pop());
+        uint256 memoryOffset = pop();
+        uint256 codeOffset = pop();
+        uint256 size = pop();
+        size_t offset = memoryRegion(memoryOffset, size);
+        useCopyGas(Gas::copy, size);
+        if (isZero(size))
+          break;
+        size_t length = static_cast<size_t>(size.w[0]);
+        size_t copied = 0;
+        if (fitsUint64(codeOffset)) {
+          AsyncScheduler::awaitCode(address);
+          copied = HERA_HOST_CALL("copy_code", m_gasLeft, m_context->host->copy_code(m_context, &address, static_cast<size_t>(codeOffset.w[0]), &m_memory[offset], length));
+        }
+        std::fill_n(m_memory.begin() + static_cast<ptrdiff_t>(offset + copied), length - copied, 0);
+        break;
+      }
+      case RETURNDATASIZE: push(makeUint256(m_returnData.size())); break;
+      case RETURNDATACOPY: {
+        uint256 memoryOffset = pop();
+        uint256 dataOffset = pop();
+        uint256 size = pop();
+        size_t offset = memoryRegion(memoryOffset, size);
+        ensureCondition(
+          fitsUint64(dataOffset) && dataOffset.w[0] <= m_returnData.size() && size.w[0] <= m_returnData.size() - dataOffset.w[0],
+          InvalidMemoryAccess,
+          "Out of bounds (source) memory copy."
+        );
+        useCopyGas(Gas::copy, size);
+        copyToMemory(offset, size, m_returnData.data(), m_returnData.size(), dataOffset);
+        break;
+      }
+
+      case BLOCKHASH: {
+        uint256& number = top();
+        int64_t current = txContext(BlockNumber).block_number;
+        if (fitsUint64(number) && number.w[0] < static_cast<uint64_t>(current) && static_cast<int64_t>(number.w[0]) >= current - 256)
+          number = fromBytes32(HERA_HOST_CALL("get_block_hash", m_gasLeft, m_context->host->get_block_hash(m_context, static_cast<int64_t>(number.w[0]))));
+        else
+          number = makeUint256(0);
+        break;
+      }
+      case COINBASE: push(fromAddress(txContext(BlockCoinbase).block_coinbase)); break;
+      case TIMESTAMP: push(makeUint256(static_cast<uint64_t>(txContext(BlockTimestamp).block_timestamp))); break;
+      case NUMBER: push(makeUint256(static_cast<uint64_t>(txContext(BlockNumber).block_number))); break;
+      case DIFFICULTY: push(fromBytes32(txContext(BlockDifficulty).block_difficulty)); break;
+      case GASLIMIT: push(makeUint256(static_cast<uint64_t>(txContext(BlockGasLimit).block_gas_limit))); break;
+
+      case POP: --m_sp; break;
+      case MLOAD: {
+        uint256& offset = top();
+        size_t memoryOffset = memoryRegion(offset, makeUint256(32));
+        offset = fromBigEndian(&m_memory[memoryOffset], 32);
+        break;
+      }
+      case MSTORE: {
+        uint256 offset = pop();
+        uint256 value = pop();
+        size_t memoryOffset = memoryRegion(offset, makeUint256(32));
+        toBigEndian(value, &m_memory[memoryOffset]);
+        break;
+      }
+      case MSTORE8: {
+        uint256 offset = pop();
+        uint256 value = pop();
+        size_t memoryOffset = memoryRegion(offset, makeUint256(1));
+        m_memory[memoryOffset] = static_cast<uint8_t>(value.w[0]);
+        break;
+      }
+      case SLOAD: {
+        evmc_bytes32 key = toBytes32(top());
+        AsyncScheduler::awaitStorage(m_msg.destination, key);
+        top() = fromBytes32(HERA_HOST_CALL("get_storage", m_gasLeft, m_context->host->get_storage(m_context, &m_msg.destination, &key)));
+        break;
+      }
+      case SSTORE: storageStore(); break;
+      case JUMP: {
+        uint256 destination = pop();
+        ensureCondition(fitsUint64(destination) && destination.w[0] < m_codeSize && m_jumpdest[destination.w[0]], VMTrap, "Bad jump destination.");
+        pc = static_cast<size_t>(destination.w[0]);
+        goto nextBlock;
+      }
+      case JUMPI: {
+        uint256 destination = pop();
+        uint256 condition = pop();
+        if (isZero(condition))
+          break;
+        ensureCondition(fitsUint64(destination) && destination.w[0] < m_codeSize && m_jumpdest[destination.w[0]], VMTrap, "Bad jump destination.");
+        pc = static_cast<size_t>(destination.w[0]);
+        goto nextBlock;
+      }
+      case PC: push(makeUint256(pc)); break;
+      case MSIZE: push(makeUint256(m_memory.size())); break;
+      case GAS: m_gasLeftRead = true; push(makeUint256(static_cast<uint64_t>(m_gasLeft))); break;
+      case JUMPDEST: break;
+
+      case LOG0: case LOG0 + 1: case LOG0 + 2: case LOG0 + 3: case LOG4:
+        log(op - LOG0);
+        break;
+
+      case CREATE:
+        create();
+        break;
+      case CALL:
+      case CALLCODE:
+      case DELEGATECALL:
+      case STATICCALL:
+        call(op);
+        break;
+
+      case RETURN:
+      case REVERT: {
+        uint256 offset = pop();
+        uint256 size = pop();
+        size_t memoryOffset = memoryRegion(offset, size);
+        if (!isZero(size))
+          result.returnValue.assign(m_memory.begin() + static_cast<ptrdiff_t>(memoryOffset), m_memory.begin() + static_cast<ptrdiff_t>(memoryOffset + size.w[0]));
+        result.isRevert = op == REVERT;
+        result.gasLeft = m_gasLeft;
+        result.gasRequired = m_gasRequired;
+        result.txContextRead = m_txContextRead;
+        result.gasLeftRead = m_gasLeftRead;
+        return result;
+      }
+      case SELFDESTRUCT:
+        selfDestruct();
+        result.gasLeft = m_gasLeft;
+        result.gasRequired = m_gasRequired;
+        result.txContextRead = m_txContextRead;
+        result.gasLeftRead = m_gasLeftRead;
+        return result;
+
+      default:
+        if (op >= PUSH1 && op <= PUSH32) {
+          size_t length = op - PUSH1 + 1u;
+          push(fromBigEndian(&m_code[pc + 1], length));
+          pc += length;
+        } else if (op >= DUP1 && op <= DUP16) {
+          push(top(op - DUP1));
+        } else if (op >= SWAP1 && op <= SWAP16) {
+          std::swap(top(), top(op - SWAP1 + 1u));
+        } else {
+          // INVALID, which has a name but no behaviour.
+          ensureCondition(false, VMTrap, "Invalid instruction.");
+        }
+        break;
+      }
+      ++pc;
+    }
+  nextBlock:;
+  }
+}
+
+}
+
+ExecutionResult Evm1Interpreter::execute(
+  evmc_context* context,
+  evmc_revision rev,
+  vector<uint8_t> const& code,
+  evmc_message const& msg
+) {
+  HERA_DEBUG << "Executing EVM1 with the interpreter...\n";
+
+  switch (rev) {
+  case EVMC_BYZANTIUM:
+    return internalExecute<EVMC_BYZANTIUM>(context, code, msg);
+  default:
+    heraAssert(false, "Unsupported revision.");
+  }
+}
+
+template <evmc_revision Revision>
+ExecutionResult Evm1Interpreter::internalExecute(
+  evmc_context* context,
+  vector<uint8_t> const& code,
+  evmc_message const& msg
+) {
+  // Executions share the analysis, which only depends on the code.
+  ModuleCache* moduleCache = ModuleCache::current();
+  bool remote = false;
+  shared_ptr<const Evm1Code<Revision>> analysis = moduleCache ? moduleCache->lookup<Evm1Code<Revision>>(code, &remote) : nullptr;
+  if (!analysis || remote) {
+    auto start = chrono::steady_clock::now();
+    analysis = make_shared<Evm1Code<Revision>>(code);
+    if (moduleCache) {
+      double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+      moduleCache->store(code, analysis, nanoseconds);
+    }
+  }
+
+  Evm1Execution<Revision> execution(context, move(analysis), msg);
+  return execution.run();
+}
+
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <evmc/evmc.h>
+
+#include "eei.h"
+
+namespace hera {
+
+// Executes EVM1 bytecode directly, without translating it to WebAssembly.
+//
+// The code is split into basic blocks ahead of execution. The base gas cost
+// and the stack requirements of a whole block are checked once on entry,
+// only the dynamic costs (memory expansion, copies, storage, calls) are
+// charged by the individual instructions. With the module cache, the
+// blocks of a contract are found once for all executions of it.
+//
+// Failures are reported through the same exceptions as the EEI.
+class Evm1Interpreter {
+public:
+  static ExecutionResult execute(
+    evmc_context* context,
+    evmc_revision rev,
+    std::vector<uint8_t> const& code,
+    evmc_message const& msg
+  );
+
+private:
+  template <evmc_revision Revision>
+  static ExecutionResult internalExecute(
+    evmc_context* context,
+    std::vector<uint8_t> const& code,
+    evmc_message const& msg
+  );
+};
+
+}
@@ -47,9 +47,6 @@ class ContractValidationFailure : public HeraException {
 class InvalidMemoryAccess : public HeraException {
   using HeraException::HeraException;
 };
-class EndExecution : public HeraException {
-  using HeraException::HeraException;
-};
 
 /// Static Mode Violation.
 ///
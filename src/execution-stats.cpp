@@ -0,0 +1,94 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "execution-stats.h"
+
+#include <sstream>
+
+#include "exceptions.h"
+#include "memory-budget.h"
+
+using namespace std;
+
+namespace hera {
+
+thread_local FiberLocal<ExecutionStatsSink> ExecutionStatsSink::s_current;
+
+char const* wasmOpClassName(WasmOpClass opClass)
+{
+  switch (opClass) {
+  case WasmOpClass::Control: return "control";
+  case WasmOpClass::Call: return "call";
+  case WasmOpClass::CallIndirect: return "callIndirect";
+  case WasmOpClass::Local: return "local";
+  case WasmOpClass::Global: return "global";
+  case WasmOpClass::Load: return "load";
+  case WasmOpClass::Store: return "store";
+  case WasmOpClass::Const: return "const";
+  case WasmOpClass::Unary: return "unary";
+  case WasmOpClass::Binary: return "binary";
+  case WasmOpClass::Multiply: return "multiply";
+  case WasmOpClass::Divide: return "divide";
+  case WasmOpClass::Memory: return "memory";
+  case WasmOpClass::Other: return "other";
+  case WasmOpClass::Count: break;
+  }
+  return "unknown";
+}
+
+unique_ptr<ExecutionStatsSink> ExecutionStatsSink::create(string const& path)
+{
+  unique_ptr<ExecutionStatsSink> sink(new ExecutionStatsSink);
+  sink->m_file.open(path, ios::trunc);
+  heraAssert(sink->m_file.is_open(), "Cannot create statistics file.");
+  return sink;
+}
+
+void ExecutionStatsSink::append(evmc_message const& msg, int64_t gasUsed, ExecutionStats const& stats) noexcept
+{
+  try {
+    ostringstream line;
+    line << "{\"depth\":" << msg.depth << ",\"gas\":" << msg.gas << ",\"gasUsed\":" << gasUsed << ",\"wasm\":{";
+    for (size_t i = 0; i < stats.wasmOps.size(); ++i) {
+      if (i)
+        line << ',';
+      line << '"' << wasmOpClassName(static_cast<WasmOpClass>(i)) << "\":" << stats.wasmOps[i];
+    }
+    line << "},\"eei\":{";
+    bool first = true;
+    for (auto const& call: stats.eeiCalls) {
+      if (!first)
+        line << ',';
+      first = false;
+      line << '"' << call.first << "\":" << call.second;
+    }
+    line << '}';
+    if (MemoryBudget* budget = MemoryBudget::current()) {
+      line << ",\"memory\":{";
+      for (auto const& account: budget->usage())
+        line << '"' << account.first << "\":" << account.second << ',';
+      line << "\"total\":" << budget->total() << ",\"evictions\":" << budget->evictions() << '}';
+    }
+    line << "}\n";
+
+    lock_guard<mutex> lock(m_mutex);
+    m_file << line.str();
+    m_file.flush();
+  } catch (...) {
+  }
+}
+
+}
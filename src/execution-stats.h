@@ -0,0 +1,96 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <evmc/evmc.h>
+
+#include "fiber-local.h"
+
+namespace hera {
+
+// The classes Wasm instructions are counted by, chosen to match the
+// distinctions a gas schedule would make.
+enum class WasmOpClass {
+  Control,
+  Call,
+  CallIndirect,
+  Local,
+  Global,
+  Load,
+  Store,
+  Const,
+  Unary,
+  Binary,
+  Multiply,
+  Divide,
+  Memory,
+  Other,
+  Count
+};
+
+using WasmOpHistogram = std::array<uint64_t, static_cast<size_t>(WasmOpClass::Count)>;
+
+char const* wasmOpClassName(WasmOpClass opClass);
+
+// What a single execution did, as collected with the "instrument" option.
+struct ExecutionStats {
+  WasmOpHistogram wasmOps{};
+  // Calls by EEI method name.
+  std::map<std::string, uint64_t> eeiCalls;
+};
+
+// Appends the statistics of every execution as a JSON line to a file.
+class ExecutionStatsSink {
+public:
+  // Throws InternalErrorException if the file cannot be created.
+  static std::unique_ptr<ExecutionStatsSink> create(std::string const& path);
+
+  // Failures to write are ignored.
+  void append(evmc_message const& msg, int64_t gasUsed, ExecutionStats const& stats) noexcept;
+
+  // The sink used by executions on the current thread, if any.
+  static ExecutionStatsSink* current() { return s_current.get(); }
+
+  // Sets the sink of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(ExecutionStatsSink* sink): m_previous(s_current.get()) { s_current.set(sink); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    ExecutionStatsSink* m_previous;
+  };
+
+private:
+  ExecutionStatsSink() = default;
+
+  std::mutex m_mutex;
+  std::ofstream m_file;
+
+  static thread_local FiberLocal<ExecutionStatsSink> s_current;
+};
+
+}
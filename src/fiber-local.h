@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+namespace hera {
+
+// What fibers switch of a FiberLocal.
+class FiberLocalBase {
+public:
+  FiberLocalBase(FiberLocalBase const&) = delete;
+  FiberLocalBase& operator=(FiberLocalBase const&) = delete;
+
+protected:
+  FiberLocalBase();
+  ~FiberLocalBase() noexcept;
+
+  void* m_value = nullptr;
+
+private:
+  friend class Fiber;
+};
+
+// A pointer with a value of its own on every fiber and on the thread
+// outside of them, see Fiber. Must be thread_local itself:
+//
+//   static thread_local FiberLocal<Sink> s_current;
+template <typename T>
+class FiberLocal : public FiberLocalBase {
+public:
+  T* get() const { return static_cast<T*>(m_value); }
+  void set(T* value) { m_value = value; }
+};
+
+}
@@ -0,0 +1,467 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fiber.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(__x86_64__) && !defined(__aarch64__)
+#include <ucontext.h>
+#endif
+
+#include "numa.h"
+
+using namespace std;
+
+namespace hera {
+
+constexpr size_t FiberPool::defaultStackSize;
+
+thread_local uintptr_t FiberPool::s_stackBottom = 0;
+thread_local Fiber* Fiber::s_current = nullptr;
+
+namespace {
+
+// The fiber local pointers of the current thread.
+thread_local vector<FiberLocalBase*> fiberLocals;
+
+// The top of a free stack which stays committed, being used by every
+// execution.
+constexpr size_t residentStackSize = 64 * 1024;
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+// Switching stacks only exchanges the callee saved registers, which are
+// pushed onto the stack left. Unlike swapcontext(), this does not save the
+// signal mask, which takes a system call.
+extern "C" void hera_switch_stack(void** from, void* to);
+extern "C" void hera_start_stack();
+
+#if defined(__x86_64__)
+// The floating point control words are callee saved as well. A new stack
+// starts in hera_start_stack, which calls r13(r12).
+asm(
+  ".text\n"
+  ".globl hera_switch_stack\n"
+  ".hidden hera_switch_stack\n"
+  ".type hera_switch_stack, @function\n"
+  "hera_switch_stack:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  ldmxcsr (%rsp)\n"
+  "  fldcw 4(%rsp)\n"
+  "  addq $8, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size hera_switch_stack, .-hera_switch_stack\n"
+  ".globl hera_start_stack\n"
+  ".hidden hera_start_stack\n"
+  ".type hera_start_stack, @function\n"
+  "hera_start_stack:\n"
+  "  movq %r12, %rdi\n"
+  "  callq *%r13\n"
+  "  ud2\n"
+  ".size hera_start_stack, .-hera_start_stack\n"
+);
+
+// Control words, r15, r14, r13, r12, rbx, rbp and the return address,
+// leaving the stack aligned to 16 bytes after returning.
+constexpr size_t savedWords = 8;
+constexpr size_t functionWord = 3;
+constexpr size_t argumentWord = 4;
+constexpr size_t returnWord = 7;
+#else
+// A new stack starts in hera_start_stack, which calls x20(x19).
+asm(
+  ".text\n"
+  ".globl hera_switch_stack\n"
+  ".hidden hera_switch_stack\n"
+  ".type hera_switch_stack, %function\n"
+  "hera_switch_stack:\n"
+  "  sub sp, sp, #160\n"
+  "  stp x19, x20, [sp, #0]\n"
+  "  stp x21, x22, [sp, #16]\n"
+  "  stp x23, x24, [sp, #32]\n"
+  "  stp x25, x26, [sp, #48]\n"
+  "  stp x27, x28, [sp, #64]\n"
+  "  stp x29, x30, [sp, #80]\n"
+  "  stp d8, d9, [sp, #96]\n"
+  "  stp d10, d11, [sp, #112]\n"
+  "  stp d12, d13, [sp, #128]\n"
+  "  stp d14, d15, [sp, #144]\n"
+  "  mov x2, sp\n"
+  "  str x2, [x0]\n"
+  "  mov sp, x1\n"
+  "  ldp x19, x20, [sp, #0]\n"
+  "  ldp x21, x22, [sp, #16]\n"
+  "  ldp x23, x24, [sp, #32]\n"
+  "  ldp x25, x26, [sp, #48]\n"
+  "  ldp x27, x28, [sp, #64]\n"
+  "  ldp x29, x30, [sp, #80]\n"
+  "  ldp d8, d9, [sp, #96]\n"
+  "  ldp d10, d11, [sp, #112]\n"
+  "  ldp d12, d13, [sp, #128]\n"
+  "  ldp d14, d15, [sp, #144]\n"
+  "  add sp, sp, #160\n"
+  "  ret\n"
+  ".size hera_switch_stack, .-hera_switch_stack\n"
+  ".globl hera_start_stack\n"
+  ".hidden hera_start_stack\n"
+  ".type hera_start_stack, %function\n"
+  "hera_start_stack:\n"
+  "  mov x0, x19\n"
+  "  blr x20\n"
+  "  brk #0\n"
+  ".size hera_start_stack, .-hera_start_stack\n"
+);
+
+// x19 to x30 and d8 to d15, x30 being the return address.
+constexpr size_t savedWords = 20;
+constexpr size_t functionWord = 1;
+constexpr size_t argumentWord = 0;
+constexpr size_t returnWord = 11;
+#endif
+
+// A stack which is not running: where its registers were saved.
+struct StackContext {
+  void* pointer = nullptr;
+};
+
+// Prepares @context to call fn(arg) on the given stack once switched to.
+// fn must switch away instead of returning.
+bool prepareStack(StackContext& context, void* base, size_t size, void (*fn)(void*), void* arg) noexcept
+{
+  uintptr_t top = (reinterpret_cast<uintptr_t>(base) + size) & ~uintptr_t(15);
+  uintptr_t* words = reinterpret_cast<uintptr_t*>(top) - savedWords;
+  memset(words, 0, savedWords * sizeof(uintptr_t));
+#if defined(__x86_64__)
+  // The defaults of the ABI.
+  uint32_t controlWords[2] = {0x1f80, 0x037f};
+  memcpy(words, controlWords, sizeof(controlWords));
+#endif
+  words[functionWord] = reinterpret_cast<uintptr_t>(fn);
+  words[argumentWord] = reinterpret_cast<uintptr_t>(arg);
+  words[returnWord] = reinterpret_cast<uintptr_t>(&hera_start_stack);
+  context.pointer = words;
+  return true;
+}
+
+void switchStack(StackContext& from, StackContext const& to) noexcept
+{
+  hera_switch_stack(&from.pointer, to.pointer);
+}
+
+#else
+
+struct StackContext {
+  ucontext_t context;
+  void (*fn)(void*);
+  void* arg;
+};
+
+// makecontext() only passes int arguments, so the pointer is split in two.
+void stackEntry(unsigned high, unsigned low)
+{
+  StackContext* context = reinterpret_cast<StackContext*>((static_cast<uintptr_t>(high) << 16 << 16) | low);
+  context->fn(context->arg);
+}
+
+bool prepareStack(StackContext& context, void* base, size_t size, void (*fn)(void*), void* arg) noexcept
+{
+  if (getcontext(&context.context) != 0)
+    return false;
+  context.context.uc_stack.ss_sp = base;
+  context.context.uc_stack.ss_size = size;
+  context.context.uc_link = nullptr;
+  context.fn = fn;
+  context.arg = arg;
+  uintptr_t address = reinterpret_cast<uintptr_t>(&context);
+  makecontext(&context.context, reinterpret_cast<void (*)()>(stackEntry), 2,
+    static_cast<unsigned>(address >> 16 >> 16), static_cast<unsigned>(address & 0xffffffff));
+  return true;
+}
+
+void switchStack(StackContext& from, StackContext const& to) noexcept
+{
+  swapcontext(&from.context, &to.context);
+}
+
+#endif
+
+// The state of FiberPool::run(), on the stack of its caller.
+struct Run {
+  function<void()> const* fn;
+  StackContext stack;
+  StackContext caller;
+};
+
+void runEntry(void* arg)
+{
+  Run* run = static_cast<Run*>(arg);
+  (*run->fn)();
+  switchStack(run->stack, run->caller);
+}
+
+}
+
+FiberPool::FiberPool(size_t stackSize, MemoryBudget* budget):
+  m_guardSize(static_cast<size_t>(sysconf(_SC_PAGESIZE))),
+  m_account(budget, "fiber-stacks", this)
+{
+  // Whole pages, so that the guard page stays aligned.
+  m_stackSize = (stackSize + m_guardSize - 1) / m_guardSize * m_guardSize;
+  m_residentSize = min(m_stackSize, residentStackSize);
+}
+
+FiberPool::~FiberPool() noexcept
+{
+  lock_guard<mutex> lock(m_mutex);
+  for (FreeStack const& stack: m_free)
+    unmap(stack.mapping);
+  m_free.clear();
+}
+
+uint64_t FiberPool::remoteReuses()
+{
+  lock_guard<mutex> lock(m_mutex);
+  return m_remoteReuses;
+}
+
+void* FiberPool::acquire(unsigned& node) noexcept
+{
+  node = Numa::currentNode();
+  {
+    lock_guard<mutex> lock(m_mutex);
+    ++m_acquires;
+    if (!m_free.empty()) {
+      ++m_reuses;
+      // The most recently released local stack, else the most recent one.
+      auto it = find_if(m_free.rbegin(), m_free.rend(), [node](FreeStack const& stack) { return stack.node == node; });
+      if (it == m_free.rend()) {
+        ++m_remoteReuses;
+        it = m_free.rbegin();
+      }
+      void* mapping = it->mapping;
+      node = it->node;
+      m_free.erase(next(it).base());
+      return mapping;
+    }
+  }
+
+  // Pages are only committed once touched.
+  auto start = chrono::steady_clock::now();
+  void* mapping = mmap(nullptr, m_guardSize + m_stackSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED)
+    return nullptr;
+  if (mprotect(static_cast<uint8_t*>(mapping) + m_guardSize, m_stackSize, PROT_READ | PROT_WRITE) != 0) {
+    munmap(mapping, m_guardSize + m_stackSize);
+    return nullptr;
+  }
+  double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_mapNanoseconds = nanoseconds;
+  }
+
+  m_account.charge(m_residentSize);
+  return mapping;
+}
+
+void FiberPool::release(void* mapping, unsigned node) noexcept
+{
+  // The pages deeper calls used go back to the system until touched again.
+  if (m_stackSize > m_residentSize)
+    madvise(static_cast<uint8_t*>(mapping) + m_guardSize, m_stackSize - m_residentSize, MADV_DONTNEED);
+
+  try {
+    lock_guard<mutex> lock(m_mutex);
+    m_free.push_back(FreeStack{mapping, node});
+  } catch (...) {
+    unmap(mapping);
+  }
+}
+
+void FiberPool::unmap(void* mapping) noexcept
+{
+  munmap(mapping, m_guardSize + m_stackSize);
+  m_account.release(m_residentSize);
+}
+
+void FiberPool::candidates(vector<MemoryBudget::Candidate>& out)
+{
+  lock_guard<mutex> lock(m_mutex);
+  double reuseRate = static_cast<double>(m_reuses + 1) / static_cast<double>(m_acquires + 1);
+  for (FreeStack const& stack: m_free)
+    out.push_back(MemoryBudget::Candidate{reinterpret_cast<uintptr_t>(stack.mapping), m_residentSize, m_mapNanoseconds * reuseRate});
+}
+
+void FiberPool::evict(uint64_t id) noexcept
+{
+  lock_guard<mutex> lock(m_mutex);
+  void* mapping = reinterpret_cast<void*>(static_cast<uintptr_t>(id));
+  auto it = find_if(m_free.begin(), m_free.end(), [mapping](FreeStack const& stack) { return stack.mapping == mapping; });
+  if (it == m_free.end())
+    return;
+  unmap(it->mapping);
+  m_free.erase(it);
+}
+
+bool FiberPool::run(function<void()> const& fn) noexcept
+{
+  // Nested calls stay on the stack of their caller while half of it is left.
+  char marker;
+  if (s_stackBottom && reinterpret_cast<uintptr_t>(&marker) - s_stackBottom >= m_stackSize / 2) {
+    fn();
+    return true;
+  }
+
+  unsigned node;
+  void* mapping = acquire(node);
+  if (!mapping)
+    return false;
+
+  void* base = static_cast<uint8_t*>(mapping) + m_guardSize;
+  Run run;
+  run.fn = &fn;
+  if (!prepareStack(run.stack, base, m_stackSize, runEntry, &run)) {
+    release(mapping, node);
+    return false;
+  }
+
+  uintptr_t previousBottom = s_stackBottom;
+  s_stackBottom = reinterpret_cast<uintptr_t>(base);
+  switchStack(run.caller, run.stack);
+  s_stackBottom = previousBottom;
+  release(mapping, node);
+  return true;
+}
+
+struct Fiber::Contexts {
+  StackContext fiber;
+  StackContext caller;
+};
+
+Fiber::Fiber(FiberPool& pool, function<void()> fn):
+  m_pool(pool),
+  m_fn(move(fn)),
+  m_contexts(new Contexts)
+{
+}
+
+Fiber::~Fiber() noexcept
+{
+  if (m_mapping)
+    m_pool.release(m_mapping, m_node);
+}
+
+void Fiber::entry(void* arg)
+{
+  Fiber* fiber = static_cast<Fiber*>(arg);
+  fiber->m_fn();
+  fiber->m_finished = true;
+  switchStack(fiber->m_contexts->fiber, fiber->m_contexts->caller);
+}
+
+bool Fiber::resume() noexcept
+{
+  if (m_finished)
+    return true;
+
+  if (!m_mapping) {
+    m_mapping = m_pool.acquire(m_node);
+    if (!m_mapping)
+      return false;
+    void* base = static_cast<uint8_t*>(m_mapping) + m_pool.m_guardSize;
+    if (!prepareStack(m_contexts->fiber, base, m_pool.m_stackSize, entry, this)) {
+      m_pool.release(m_mapping, m_node);
+      m_mapping = nullptr;
+      return false;
+    }
+  }
+
+  m_previous = s_current;
+  s_current = this;
+  switchLocals();
+  uintptr_t previousBottom = FiberPool::s_stackBottom;
+  FiberPool::s_stackBottom = reinterpret_cast<uintptr_t>(m_mapping) + m_pool.m_guardSize;
+  switchStack(m_contexts->caller, m_contexts->fiber);
+  FiberPool::s_stackBottom = previousBottom;
+  switchLocals();
+  s_current = m_previous;
+
+  if (m_finished) {
+    m_pool.release(m_mapping, m_node);
+    m_mapping = nullptr;
+  }
+  return true;
+}
+
+void Fiber::suspend() noexcept
+{
+  Fiber* fiber = s_current;
+  switchStack(fiber->m_contexts->fiber, fiber->m_contexts->caller);
+}
+
+void Fiber::switchLocals() noexcept
+{
+  // A pointer registered after the fiber last ran starts out empty on it.
+  for (FiberLocalBase* local: fiberLocals) {
+    auto saved = find_if(m_locals.begin(), m_locals.end(),
+      [local](pair<FiberLocalBase*, void*> const& entry) { return entry.first == local; });
+    if (saved != m_locals.end()) {
+      swap(saved->second, local->m_value);
+    } else {
+      try {
+        m_locals.emplace_back(local, local->m_value);
+        local->m_value = nullptr;
+      } catch (...) {
+        // Leaves the value shared with the caller.
+      }
+    }
+  }
+}
+
+FiberLocalBase::FiberLocalBase()
+{
+  fiberLocals.push_back(this);
+}
+
+FiberLocalBase::~FiberLocalBase() noexcept
+{
+  fiberLocals.erase(remove(fiberLocals.begin(), fiberLocals.end(), this), fiberLocals.end());
+}
+
+}
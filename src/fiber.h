@@ -0,0 +1,157 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "fiber-local.h"
+#include "memory-budget.h"
+
+namespace hera {
+
+// Runs functions on stacks of a fixed size, taken from a pool and returned
+// to it afterwards. Every stack has a guard page below it, so an overflow
+// faults instead of corrupting memory.
+//
+// Executing messages on these stacks keeps a deep chain of nested calls
+// off the stack of the client's thread. A nested call continues on the
+// stack of its caller while half of it is left, and switches to another
+// one beyond that.
+//
+// Stacks are accounted as "fiber-stacks" in the memory budget at the top
+// part which stays committed between runs, and the free ones can be
+// evicted. Deeper pages are only committed while a run uses them and are
+// returned when the stack goes back to the pool.
+class FiberPool : private MemoryBudget::Evictor {
+public:
+  static constexpr size_t defaultStackSize = 8 * 1024 * 1024;
+
+  explicit FiberPool(size_t stackSize = defaultStackSize, MemoryBudget* budget = nullptr);
+  ~FiberPool() noexcept;
+
+  FiberPool(FiberPool const&) = delete;
+  FiberPool& operator=(FiberPool const&) = delete;
+
+  size_t stackSize() const { return m_stackSize; }
+
+  // Runs fn on a stack of the pool, or on the current one if it still has
+  // room, and returns once it finished. fn must not throw. Returns false
+  // without running fn if no stack is available.
+  bool run(std::function<void()> const& fn) noexcept;
+
+  // The lowest usable address of the pool stack the current thread runs
+  // on, or 0 on the thread's own stack.
+  static uintptr_t currentStackBottom() { return s_stackBottom; }
+
+  // The stacks reused by a thread on another NUMA node than the one they
+  // were first used on, for want of a free stack on its own.
+  uint64_t remoteReuses();
+
+private:
+  struct FreeStack {
+    void* mapping;
+    // The NUMA node its pages were committed on.
+    unsigned node;
+  };
+
+  // The lowest address of the mapping, including the guard page. Prefers
+  // a stack of the current thread's node, and sets @node to the stack's.
+  void* acquire(unsigned& node) noexcept;
+  void release(void* mapping, unsigned node) noexcept;
+  void unmap(void* mapping) noexcept;
+
+  void candidates(std::vector<MemoryBudget::Candidate>& out) override;
+  void evict(uint64_t id) noexcept override;
+
+  size_t m_stackSize;
+  size_t m_guardSize;
+  // What stays committed of a stack between runs.
+  size_t m_residentSize;
+
+  std::mutex m_mutex;
+  std::vector<FreeStack> m_free;
+  // To value free stacks by: the time the last one took to map, times the
+  // rate at which they are reused.
+  uint64_t m_acquires = 0;
+  uint64_t m_reuses = 0;
+  uint64_t m_remoteReuses = 0;
+  double m_mapNanoseconds = 0;
+
+  // Last, so that the budget stops evicting before the stacks go.
+  MemoryBudget::Account m_account;
+
+  static thread_local uintptr_t s_stackBottom;
+
+  friend class Fiber;
+};
+
+// A function running on a stack of a pool, which can suspend itself and be
+// resumed later by the thread that started it.
+//
+// Thread local state which follows the scope of an execution, like the
+// trace sink or the profiler of the current thread, is kept in FiberLocal
+// pointers. They are switched along with the fiber, so that suspended
+// executions interleaving on a thread keep seeing their own.
+class Fiber {
+public:
+  // fn must not throw.
+  Fiber(FiberPool& pool, std::function<void()> fn);
+  // The fiber must not be suspended.
+  ~Fiber() noexcept;
+
+  Fiber(Fiber const&) = delete;
+  Fiber& operator=(Fiber const&) = delete;
+
+  // Runs the fiber until it suspends or finishes. Returns false if it could
+  // not be started, because no stack is available.
+  bool resume() noexcept;
+  bool finished() const { return m_finished; }
+
+  // Suspends the fiber running on the current thread, returning from its
+  // resume(). Must only be called on a fiber.
+  static void suspend() noexcept;
+
+  // The fiber running on the current thread, if any. Functions run by
+  // FiberPool::run() belong to the fiber which called it.
+  static Fiber* current() { return s_current; }
+
+private:
+  static void entry(void* arg);
+  // Exchanges the values of the thread's fiber local pointers with the saved ones.
+  void switchLocals() noexcept;
+
+  FiberPool& m_pool;
+  std::function<void()> m_fn;
+  void* m_mapping = nullptr;
+  unsigned m_node = 0;
+  bool m_finished = false;
+  // Of the fiber and of the caller of resume().
+  struct Contexts;
+  std::unique_ptr<Contexts> m_contexts;
+  std::vector<std::pair<FiberLocalBase*, void*>> m_locals;
+  Fiber* m_previous = nullptr;
+
+  static thread_local Fiber* s_current;
+};
+
+}
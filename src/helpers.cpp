@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <vector>
 #include <iomanip>
 #include <sstream>
@@ -104,4 +105,95 @@ bool hasWasmVersion(vector<uint8_t> const& _input, uint8_t _version) {
     _input[7] == 0;
 }
 
+uint64_t hashBytes(uint8_t const* data, size_t size, uint64_t seed)
+{
+  uint64_t result = seed;
+  for (size_t i = 0; i < size; ++i) {
+    result ^= data[i];
+    result *= 0x100000001b3;
+  }
+  return result;
+}
+
+namespace {
+
+void keccakF1600(uint64_t state[25])
+{
+  static const uint64_t roundConstants[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a, 0x8000000080008000,
+    0x000000000000808b, 0x0000000080000001, 0x8000000080008081, 0x8000000000008009,
+    0x000000000000008a, 0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089, 0x8000000000008003,
+    0x8000000000008002, 0x8000000000000080, 0x000000000000800a, 0x800000008000000a,
+    0x8000000080008081, 0x8000000000008080, 0x0000000080000001, 0x8000000080008008
+  };
+  static const unsigned rotations[24] = {
+    1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+  };
+  static const unsigned lanes[24] = {
+    10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+  };
+
+  for (unsigned round = 0; round < 24; ++round) {
+    uint64_t c[5];
+    for (unsigned x = 0; x < 5; ++x)
+      c[x] = state[x] ^ state[x + 5] ^ state[x + 10] ^ state[x + 15] ^ state[x + 20];
+    for (unsigned x = 0; x < 5; ++x) {
+      uint64_t d = c[(x + 4) % 5] ^ ((c[(x + 1) % 5] << 1) | (c[(x + 1) % 5] >> 63));
+      for (unsigned y = 0; y < 25; y += 5)
+        state[y + x] ^= d;
+    }
+
+    uint64_t t = state[1];
+    for (unsigned i = 0; i < 24; ++i) {
+      unsigned j = lanes[i];
+      uint64_t next = state[j];
+      state[j] = (t << rotations[i]) | (t >> (64 - rotations[i]));
+      t = next;
+    }
+
+    for (unsigned y = 0; y < 25; y += 5) {
+      uint64_t row[5];
+      for (unsigned x = 0; x < 5; ++x)
+        row[x] = state[y + x];
+      for (unsigned x = 0; x < 5; ++x)
+        state[y + x] = row[x] ^ (~row[(x + 1) % 5] & row[(x + 2) % 5]);
+    }
+
+    state[0] ^= roundConstants[round];
+  }
+}
+
+}
+
+evmc_bytes32 keccak256(uint8_t const* data, size_t length)
+{
+  const size_t rate = 136;
+  uint64_t state[25] = {};
+
+  auto absorb = [&state](uint8_t const* block) {
+    for (unsigned i = 0; i < rate / 8; ++i) {
+      uint64_t lane = 0;
+      for (unsigned j = 0; j < 8; ++j)
+        lane |= static_cast<uint64_t>(block[8 * i + j]) << (8 * j);
+      state[i] ^= lane;
+    }
+    keccakF1600(state);
+  };
+
+  for (; length >= rate; data += rate, length -= rate)
+    absorb(data);
+
+  uint8_t last[rate] = {};
+  copy_n(data, length, last);
+  last[length] ^= 0x01;
+  last[rate - 1] ^= 0x80;
+  absorb(last);
+
+  evmc_bytes32 ret;
+  for (unsigned i = 0; i < 32; ++i)
+    ret.bytes[i] = static_cast<uint8_t>(state[i / 8] >> (8 * (i % 8)));
+  return ret;
+}
+
 }
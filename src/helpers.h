@@ -35,4 +35,22 @@ bool hasWasmPreamble(std::vector<uint8_t> const& _input);
 
 bool hasWasmVersion(std::vector<uint8_t> const& _input, uint8_t _version);
 
+// FNV-1a, which is plenty for telling contracts apart, but not collision
+// resistant: comparing the bytes must settle equal hashes. Continues from
+// @seed, so that several buffers can be hashed as one.
+uint64_t hashBytes(uint8_t const* data, size_t size, uint64_t seed = 0xcbf29ce484222325);
+
+evmc_bytes32 keccak256(uint8_t const* data, size_t length);
+
+// The fields of evmc_tx_context, as bits of a mask of those an execution read.
+enum TxContextField : uint32_t {
+  TxGasPrice = 1 << 0,
+  TxOrigin = 1 << 1,
+  BlockCoinbase = 1 << 2,
+  BlockNumber = 1 << 3,
+  BlockTimestamp = 1 << 4,
+  BlockGasLimit = 1 << 5,
+  BlockDifficulty = 1 << 6
+};
+
 }
@@ -17,6 +17,7 @@
 #include <hera/hera.h>
 
 #include <limits>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <unistd.h>
@@ -24,15 +25,38 @@
 #include <fstream>
 #include <iomanip>
 #include <map>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
 
 #include <evmc/evmc.h>
+#include <evmc/helpers.h>
 #include <evmc/helpers.hpp>
 
+#include "async-host.h"
 #include "binaryen.h"
 #include "debugging.h"
 #include "eei.h"
+#include "evm-trace.h"
+#include "evm1.h"
 #include "exceptions.h"
+#include "fiber.h"
+#include "execution-stats.h"
 #include "helpers.h"
+#include "huge-pages.h"
+#include "memory-budget.h"
+#include "host-recording.h"
+#include "numa.h"
+#include "precompiles.h"
+#include "probes.h"
+#include "profiler.h"
+#include "module-cache.h"
+#include "static-call-cache.h"
+#include "worker-pool.h"
+#if HERA_BASELINE
+#include "baseline.h"
+#endif
 #if HERA_WAVM
 #include "wavm.h"
 #endif
@@ -51,12 +75,16 @@ enum class hera_evm1mode {
   reject,
   fallback,
   evm2wasm_contract,
+  interpret,
 };
 
 using WasmEngineCreateFn = unique_ptr<WasmEngine>(*)();
 
 const map<string, WasmEngineCreateFn> wasm_engine_map {
   { "binaryen", BinaryenEngine::create },
+#if HERA_BASELINE
+  { "baseline", BaselineEngine::create },
+#endif
 #if HERA_WAVM
   { "wavm", WavmEngine::create },
 #endif
@@ -69,13 +97,30 @@ const map<string, hera_evm1mode> evm1mode_options {
   { "reject", hera_evm1mode::reject },
   { "fallback", hera_evm1mode::fallback },
   { "evm2wasm", hera_evm1mode::evm2wasm_contract },
+  { "interpret", hera_evm1mode::interpret },
 };
 
 struct hera_instance : evmc_instance {
   unique_ptr<WasmEngine> engine{new BinaryenEngine};
   hera_evm1mode evm1mode = hera_evm1mode::reject;
   bool metering = false;
+  bool gasEstimation = false;
+  unsigned validationThreads = 0;
+  HugePages hugePages;
+  // Before everything accounted in it.
+  MemoryBudget memoryBudget;
+  unique_ptr<ModuleCache> moduleCache;
+  unique_ptr<StaticCallCache> staticCallCache;
+  unique_ptr<HostRecorder> recorder;
+  unique_ptr<EvmTraceSink> evmTrace;
+  unique_ptr<ExecutionStatsSink> statsSink;
+  unique_ptr<Profiler> profiler;
+  unique_ptr<PhaseTimes> phaseTimes;
+  unique_ptr<FiberPool> fibers;
+  // Validates large contracts and runs batches.
+  WorkerPool workers;
   map<evmc_address, vector<uint8_t>> contract_preload_list;
+  map<evmc_address, NativePrecompile> native_precompiles;
 
   hera_instance() noexcept : evmc_instance({EVMC_ABI_VERSION, "hera", hera_get_buildinfo()->project_version, nullptr, nullptr, nullptr, nullptr, nullptr}) {}
 };
@@ -176,30 +221,98 @@ vector<uint8_t> evm2wasm(evmc_context* context, vector<uint8_t> const& input) {
   return ret;
 }
 
+// Results of a batch are released with their arena.
+void hera_keep_batch_result(evmc_result const*) noexcept
+{
+}
+
 void hera_destroy_result(evmc_result const* result) noexcept
 {
   delete[] result->output_data;
 }
 
-evmc_result hera_execute(
-  evmc_instance *instance,
+// Stores the required gas in the optional storage of @result, see
+// hera_get_required_gas(). It overlaps create_address, which is only set in
+// results of the host's call and never in those of the VM.
+void hera_store_required_gas(evmc_result& result, int64_t gas_required)
+{
+  static_assert(sizeof(evmc_result_optional_storage) >= sizeof(int64_t), "Optional storage too small");
+  memcpy(evmc_get_optional_storage(&result)->bytes, &gas_required, sizeof(int64_t));
+}
+
+// The outcome of a single message, before it is handed out to the client.
+struct hera_message_result {
+  evmc_status_code status_code = EVMC_SUCCESS;
+  int64_t gas_left = 0;
+  // Only set if gas estimation is enabled.
+  int64_t gas_required = 0;
+  vector<uint8_t> output;
+  // The least starting gas with the same outcome, whether or not it is
+  // reported, and what the outcome depends on besides the host state, see
+  // ExecutionResult. For the static call cache.
+  int64_t gas_needed = 0;
+  uint32_t tx_context_read = 0;
+  bool gas_left_read = false;
+};
+
+// Copies the output of @result to @output_data, which holds as many bytes.
+void hera_fill_output(evmc_result& ret, hera_message_result const& result, uint8_t* output_data)
+{
+  copy(result.output.begin(), result.output.end(), output_data);
+  ret.output_data = output_data;
+  ret.output_size = result.output.size();
+}
+
+// The root frame of an execution in the profile: the hash of the code run,
+// or its address if the client does not know the hash (e.g. when deploying).
+string profileFrameName(evmc_context* context, evmc_message const& msg)
+{
+  evmc_bytes32 hash = context->host->get_code_hash(context, &msg.destination);
+  if (hash == evmc_bytes32{})
+    return bytesAsHexStr(msg.destination.bytes, sizeof(msg.destination.bytes));
+  return toHex(hash);
+}
+
+hera_message_result hera_run_message(
+  hera_instance* hera,
   evmc_context *context,
-  enum evmc_revision rev,
+  evmc_revision rev,
   const evmc_message *msg,
   const uint8_t *code,
   size_t code_size
 ) noexcept {
-  hera_instance* hera = static_cast<hera_instance*>(instance);
-
   HERA_DEBUG << "Executing message in Hera\n";
 
-  evmc_result ret;
-  memset(&ret, 0, sizeof(evmc_result));
+  hera_message_result ret;
+
+  EvmTraceSink::Scope traceScope(hera->evmTrace.get());
+  ExecutionStatsSink::Scope statsScope(hera->statsSink.get());
+  Profiler::Scope profilerScope(hera->profiler.get());
+  MemoryBudget::Scope memoryScope(&hera->memoryBudget);
+  ModuleCache::Scope moduleCacheScope(hera->moduleCache.get());
+  HugePages::Scope hugePagesScope(&hera->hugePages);
+  WorkerPool::Scope workersScope(&hera->workers);
+  PhaseTimes::Scope phaseTimesScope(hera->phaseTimes.get());
+  PhaseTimer phaseTimer;
+  Profiler::Frame profilerFrame(hera->profiler.get(), hera->profiler ? profileFrameName(context, *msg) : string());
 
   try {
-    heraAssert(rev == EVMC_BYZANTIUM, "Only Byzantium supported.");
+    heraAssert(isSupportedRevision(rev), "Only Byzantium supported.");
     heraAssert(msg->gas >= 0, "EVMC supplied negative startgas");
 
+    // run a native implementation if there is one, unless the code was overridden
+    auto native = hera->native_precompiles.find(msg->destination);
+    if (native != hera->native_precompiles.end() && !hera->contract_preload_list.count(msg->destination)) {
+      HERA_DEBUG << "Executing native precompile.\n";
+      ExecutionResult result = native->second(*msg);
+      ret.gas_left = result.gasLeft;
+      ret.gas_needed = max(result.gasRequired, msg->gas - result.gasLeft);
+      if (hera->gasEstimation)
+        ret.gas_required = ret.gas_needed;
+      ret.output = move(result.returnValue);
+      return ret;
+    }
+
     bool meterInterfaceGas = true;
 
     // the bytecode residing in the state - this will be used by interface methods (i.e. codecopy)
@@ -226,6 +339,20 @@ evmc_result hera_execute(
         // TODO: enable this once evm2wasm does metering of interfaces
         // meterInterfaceGas = false;
         break;
+      case hera_evm1mode::interpret: {
+        HERA_DEBUG << "Non-WebAssembly input, interpreting as EVM1.\n";
+        ExecutionResult result = Evm1Interpreter::execute(context, rev, run_code, *msg);
+        heraAssert(result.gasLeft >= 0, "Negative gas left after execution.");
+        ret.status_code = result.isRevert ? EVMC_REVERT : EVMC_SUCCESS;
+        ret.gas_left = result.gasLeft;
+        ret.gas_needed = max(result.gasRequired, msg->gas - result.gasLeft);
+        if (hera->gasEstimation)
+          ret.gas_required = ret.gas_needed;
+        ret.tx_context_read = result.txContextRead;
+        ret.gas_left_read = result.gasLeftRead;
+        ret.output = move(result.returnValue);
+        return ret;
+      }
       case hera_evm1mode::fallback:
         HERA_DEBUG << "Non-WebAssembly input, but fallback mode enabled, asking client to deal with it.\n";
         ret.status_code = EVMC_REJECTED;
@@ -258,7 +385,7 @@ evmc_result hera_execute(
     heraAssert(hera->engine, "Wasm engine not set.");
     WasmEngine& engine = *hera->engine;
 
-    ExecutionResult result = engine.execute(context, run_code, state_code, *msg, meterInterfaceGas);
+    ExecutionResult result = engine.execute(context, rev, run_code, state_code, *msg, meterInterfaceGas);
     heraAssert(result.gasLeft >= 0, "Negative gas left after execution.");
 
     // copy call result
@@ -285,19 +412,16 @@ evmc_result hera_execute(
         returnValue = move(result.returnValue);
       }
 
-      uint8_t* output_data = new uint8_t[returnValue.size()];
-      copy(returnValue.begin(), returnValue.end(), output_data);
-
-      ret.output_size = returnValue.size();
-      ret.output_data = output_data;
-      ret.release = hera_destroy_result;
+      ret.output = move(returnValue);
     }
 
     ret.status_code = result.isRevert ? EVMC_REVERT : EVMC_SUCCESS;
     ret.gas_left = result.gasLeft;
-  } catch (EndExecution const&) {
-    ret.status_code = EVMC_INTERNAL_ERROR;
-    HERA_DEBUG << "EndExecution exception has leaked through.\n";
+    ret.gas_needed = max(result.gasRequired, msg->gas - result.gasLeft);
+    if (hera->gasEstimation)
+      ret.gas_required = ret.gas_needed;
+    ret.tx_context_read = result.txContextRead;
+    ret.gas_left_read = result.gasLeftRead;
   } catch (VMTrap const& e) {
     // TODO: use specific error code? EVMC_INVALID_INSTRUCTION or EVMC_TRAP_INSTRUCTION?
     ret.status_code = EVMC_FAILURE;
@@ -331,6 +455,145 @@ evmc_result hera_execute(
   return ret;
 }
 
+// Runs the message, or reuses the result of an identical static call if the
+// state it read is unchanged.
+hera_message_result hera_execute_message(
+  hera_instance* hera,
+  evmc_context *context,
+  evmc_revision rev,
+  const evmc_message *msg,
+  const uint8_t *code,
+  size_t code_size
+) noexcept {
+  if (!hera->staticCallCache || !(msg->flags & EVMC_STATIC) || msg->kind != EVMC_CALL)
+    return hera_run_message(hera, context, rev, msg, code, code_size);
+
+  StaticCallCache::Key key{};
+  try {
+    key = StaticCallCache::makeKey(rev, *msg, code, code_size);
+    shared_ptr<const StaticCallCache::Entry> entry = hera->staticCallCache->lookup(key, *msg, code, code_size, context);
+    if (entry) {
+      HERA_DEBUG << "Reusing the result of a static call.\n";
+      hera_message_result ret;
+      ret.status_code = entry->status;
+      ret.gas_left = msg->gas - entry->gasUsed;
+      if (hera->gasEstimation)
+        ret.gas_required = entry->gasRequired;
+      ret.output = entry->output;
+      return ret;
+    }
+  } catch (...) {
+    // Only allocations can fail above, run it uncached instead.
+    return hera_run_message(hera, context, rev, msg, code, code_size);
+  }
+
+  RecordingHost recorder(context);
+  auto start = chrono::steady_clock::now();
+  hera_message_result ret = hera_run_message(hera, &recorder, rev, msg, code, code_size);
+  double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+  try {
+    vector<HostRead> reads;
+    if ((ret.status_code == EVMC_SUCCESS || ret.status_code == EVMC_REVERT) && StaticCallCache::collectReads(recorder.events(), ret.tx_context_read, reads))
+      hera->staticCallCache->store(key, *msg, code, code_size, StaticCallCache::Entry{
+        ret.status_code, msg->gas - ret.gas_left, ret.gas_needed, ret.gas_left_read, msg->gas, ret.output, move(reads)
+      }, nanoseconds);
+  } catch (...) {
+    // The message has run already, running it again would repeat its host calls.
+    HERA_DEBUG << "Failed to cache static call result.\n";
+  }
+  return ret;
+}
+
+// Runs the message, recording it together with all host interactions.
+hera_message_result hera_record_message(
+  hera_instance* hera,
+  evmc_context *context,
+  evmc_revision rev,
+  const evmc_message *msg,
+  const uint8_t *code,
+  size_t code_size
+) noexcept {
+  RecordingHost host(context);
+  hera_message_result ret = hera_execute_message(hera, &host, rev, msg, code, code_size);
+
+  try {
+    RecordedFrame frame;
+    frame.rev = rev;
+    frame.message = RecordedMessage(*msg);
+    frame.code.assign(code, code + code_size);
+    frame.result.status = ret.status_code;
+    frame.result.gasLeft = ret.gas_left;
+    frame.result.output = ret.output;
+    frame.events = move(host.events());
+    hera->recorder->append(frame);
+  } catch (...) {
+    // Losing a frame must not fail the execution itself.
+    HERA_DEBUG << "Failed to record message.\n";
+  }
+  return ret;
+}
+
+// The path every message takes in, whether through execute or a batch:
+// probes, recording and the switch to a stack of the pool. Messages which
+// already run on a fiber of their own keep its stack.
+hera_message_result hera_enter_message(
+  hera_instance* hera,
+  evmc_context *context,
+  evmc_revision rev,
+  const evmc_message *msg,
+  const uint8_t *code,
+  size_t code_size,
+  bool onFiber = false
+) noexcept {
+  ProbeScope probeScope(context, *msg);
+  HERA_PROBE3(execute__start, ProbeScope::codeHash(), msg->gas, msg->depth);
+
+  hera_message_result result;
+  auto run = [&]() {
+    result = hera->recorder ?
+      hera_record_message(hera, context, rev, msg, code, code_size) :
+      hera_execute_message(hera, context, rev, msg, code, code_size);
+  };
+  // Nested calls come through here as well.
+  if (onFiber || !hera->fibers || !hera->fibers->run(run))
+    run();
+
+  HERA_PROBE3(execute__done, ProbeScope::codeHash(), result.gas_left, static_cast<int>(result.status_code));
+  return result;
+}
+
+evmc_result hera_execute(
+  evmc_instance *instance,
+  evmc_context *context,
+  enum evmc_revision rev,
+  const evmc_message *msg,
+  const uint8_t *code,
+  size_t code_size
+) noexcept {
+  hera_instance* hera = static_cast<hera_instance*>(instance);
+  hera_message_result result = hera_enter_message(hera, context, rev, msg, code, code_size);
+
+  evmc_result ret;
+  memset(&ret, 0, sizeof(evmc_result));
+  ret.status_code = result.status_code;
+  ret.gas_left = result.gas_left;
+  hera_store_required_gas(ret, result.gas_required);
+
+  if (result.output.size() > 0) {
+    uint8_t* output_data = new (nothrow) uint8_t[result.output.size()];
+    if (!output_data) {
+      memset(&ret, 0, sizeof(evmc_result));
+      ret.status_code = EVMC_INTERNAL_ERROR;
+      return ret;
+    }
+    hera_fill_output(ret, result, output_data);
+    ret.release = hera_destroy_result;
+  }
+
+  return ret;
+}
+
 bool hera_parse_sys_option(hera_instance *hera, string const& _name, string const& value)
 {
   heraAssert(_name.find("sys:") == 0, "");
@@ -398,10 +661,158 @@ evmc_set_option_result hera_set_option(
     return EVMC_SET_OPTION_SUCCESS;
   }
 
+  if (strcmp(name, "native-precompiles") == 0) {
+    if (strcmp(value, "true") == 0)
+      hera->native_precompiles = builtinNativePrecompiles();
+    else
+      hera->native_precompiles.clear();
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "module-cache") == 0) {
+    if (strcmp(value, "true") == 0) {
+      if (!hera->moduleCache)
+        hera->moduleCache.reset(new ModuleCache(&hera->memoryBudget));
+    } else {
+      hera->moduleCache.reset();
+    }
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "phase-times") == 0) {
+    // Starts over.
+    if (strcmp(value, "true") == 0)
+      hera->phaseTimes.reset(new (nothrow) PhaseTimes);
+    else
+      hera->phaseTimes.reset();
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "static-call-cache") == 0) {
+    if (strcmp(value, "true") == 0) {
+      if (!hera->staticCallCache)
+        hera->staticCallCache.reset(new StaticCallCache(&hera->memoryBudget));
+    } else {
+      hera->staticCallCache.reset();
+    }
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "record") == 0) {
+    if (strlen(value) == 0) {
+      hera->recorder.reset();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    try {
+      hera->recorder.reset(new HostRecorder(value));
+    } catch (...) {
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    }
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+#if HERA_DEBUGGING
+  if (strcmp(name, "evm-trace") == 0) {
+    if (strlen(value) == 0) {
+      hera->evmTrace.reset();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    try {
+      hera->evmTrace = EvmTraceSink::create(value);
+    } catch (...) {
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    }
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+#endif
+
+  if (strcmp(name, "instrument") == 0) {
+    if (strlen(value) == 0) {
+      hera->statsSink.reset();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    try {
+      hera->statsSink = ExecutionStatsSink::create(value);
+    } catch (...) {
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    }
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "profile") == 0) {
+    // Writes the profile collected so far.
+    hera->profiler.reset();
+    if (strlen(value) == 0)
+      return EVMC_SET_OPTION_SUCCESS;
+    try {
+      hera->profiler = Profiler::create(value);
+    } catch (...) {
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    }
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "fibers") == 0) {
+    if (strcmp(value, "true") == 0) {
+      if (!hera->fibers)
+        hera->fibers.reset(new FiberPool(FiberPool::defaultStackSize, &hera->memoryBudget));
+    } else {
+      hera->fibers.reset();
+    }
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "fiber-stack-size") == 0) {
+    char* end = nullptr;
+    unsigned long long size = strtoull(value, &end, 10);
+    if (!*value || *end || size < 64 * 1024)
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->fibers.reset(new FiberPool(static_cast<size_t>(size), &hera->memoryBudget));
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "memory-budget") == 0) {
+    char* end = nullptr;
+    unsigned long long bytes = strtoull(value, &end, 10);
+    if (!*value || *end)
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->memoryBudget.setLimit(static_cast<size_t>(bytes));
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "huge-pages") == 0) {
+    if (strcmp(value, "true") == 0)
+      hera->hugePages.setMode(HugePages::Mode::Transparent);
+    else if (strcmp(value, "reserved") == 0)
+      hera->hugePages.setMode(HugePages::Mode::Reserved);
+    else if (strcmp(value, "false") == 0)
+      hera->hugePages.setMode(HugePages::Mode::Off);
+    else
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "validation-threads") == 0) {
+    char* end = nullptr;
+    unsigned long threads = strtoul(value, &end, 10);
+    if (!*value || *end || threads > 1024)
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    hera->validationThreads = static_cast<unsigned>(threads);
+    if (hera->engine)
+      hera->engine->setValidationThreads(hera->validationThreads);
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "gas-estimation") == 0) {
+    hera->gasEstimation = strcmp(value, "true") == 0;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
   if (strcmp(name, "engine") == 0) {
     auto it = wasm_engine_map.find(value);
     if (it != wasm_engine_map.end()) {
       hera->engine = it->second();
+      hera->engine->setValidationThreads(hera->validationThreads);
       return EVMC_SET_OPTION_SUCCESS;
     }
     return EVMC_SET_OPTION_INVALID_VALUE;
@@ -432,6 +843,75 @@ evmc_capabilities_flagset hera_get_capabilities(evmc_instance* instance)
 
 } // anonymous namespace
 
+// The output blocks of a batch, placed into large chunks as the messages
+// complete. Chunks never move, the results point into them.
+struct hera_batch_arena {
+  static constexpr size_t chunkSize = 64 * 1024;
+
+  // Returns nullptr if no memory is left.
+  uint8_t* allocate(size_t size) noexcept;
+
+  mutex lock;
+  vector<unique_ptr<uint8_t[]>> chunks;
+  uint8_t* next = nullptr;
+  size_t left = 0;
+};
+
+constexpr size_t hera_batch_arena::chunkSize;
+
+uint8_t* hera_batch_arena::allocate(size_t size) noexcept
+{
+  lock_guard<mutex> guard(lock);
+  if (size > left) {
+    // A larger output gets a chunk of its own, leaving the current one be.
+    size_t allocation = max(size, chunkSize);
+    try {
+      chunks.emplace_back(new uint8_t[allocation]);
+    } catch (...) {
+      return nullptr;
+    }
+    if (allocation > chunkSize)
+      return chunks.back().get();
+    next = chunks.back().get();
+    left = allocation;
+  }
+  uint8_t* block = next;
+  next += size;
+  left -= size;
+  return block;
+}
+
+namespace {
+
+void hera_fail_batch(evmc_result* results, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    memset(&results[i], 0, sizeof(evmc_result));
+    results[i].status_code = EVMC_INTERNAL_ERROR;
+  }
+}
+
+// Hands out @result as @ret, with its output placed in @arena.
+void hera_store_batch_result(hera_batch_arena& arena, hera_message_result const& result, evmc_result& ret) noexcept
+{
+  memset(&ret, 0, sizeof(evmc_result));
+  ret.status_code = result.status_code;
+  ret.gas_left = result.gas_left;
+  hera_store_required_gas(ret, result.gas_required);
+  ret.release = hera_keep_batch_result;
+  if (result.output.size() > 0) {
+    uint8_t* output_data = arena.allocate(result.output.size());
+    if (!output_data) {
+      memset(&ret, 0, sizeof(evmc_result));
+      ret.status_code = EVMC_INTERNAL_ERROR;
+      return;
+    }
+    hera_fill_output(ret, result, output_data);
+  }
+}
+
+}
+
 extern "C" {
 
 evmc_instance* evmc_create_hera() noexcept
@@ -444,6 +924,150 @@ evmc_instance* evmc_create_hera() noexcept
   return instance;
 }
 
+hera_batch_arena* hera_execute_batch(
+  evmc_instance* instance,
+  hera_batch_item const* items,
+  evmc_result* results,
+  size_t count,
+  unsigned num_threads
+) noexcept {
+  hera_instance* hera = static_cast<hera_instance*>(instance);
+
+  unique_ptr<hera_batch_arena> arena(new (nothrow) hera_batch_arena);
+  if (!arena) {
+    hera_fail_batch(results, count);
+    return nullptr;
+  }
+
+  atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      hera_message_result result = hera_enter_message(hera, items[i].context, items[i].rev, items[i].msg, items[i].code, items[i].code_size);
+      hera_store_batch_result(*arena, result, results[i]);
+    }
+  };
+
+  if (!hera->engine || !hera->engine->supportsConcurrentExecution())
+    num_threads = 1;
+
+  try {
+    function<void()> task(worker);
+    hera->workers.run(static_cast<unsigned>(min<size_t>(num_threads, count)), task);
+  } catch (...) {
+    // Items are claimed one by one, so this only runs those nobody took.
+    worker();
+  }
+
+  return arena.release();
+}
+
+hera_batch_arena* hera_execute_async_batch(
+  evmc_instance* instance,
+  hera_async_host* async_host,
+  hera_batch_item const* items,
+  evmc_result* results,
+  size_t count
+) noexcept {
+  hera_instance* hera = static_cast<hera_instance*>(instance);
+
+  unique_ptr<hera_batch_arena> arena(new (nothrow) hera_batch_arena);
+  vector<function<void()>> tasks;
+  // Which tasks started, so that none runs twice if scheduling fails.
+  vector<char> started;
+  try {
+    if (!arena)
+      throw bad_alloc();
+    tasks.reserve(count);
+    started.assign(count, 0);
+    hera_batch_arena* blocks = arena.get();
+    char* startedFlags = started.data();
+    for (size_t i = 0; i < count; ++i)
+      tasks.emplace_back([hera, items, results, blocks, startedFlags, i]() {
+        startedFlags[i] = 1;
+        // Scheduled tasks run on a fiber of their own already.
+        hera_message_result result = hera_enter_message(hera, items[i].context, items[i].rev, items[i].msg, items[i].code, items[i].code_size, Fiber::current() != nullptr);
+        hera_store_batch_result(*blocks, result, results[i]);
+      });
+  } catch (...) {
+    hera_fail_batch(results, count);
+    return nullptr;
+  }
+
+  // Interleaving executions is as good as running them concurrently.
+  if (!hera->engine || !hera->engine->supportsConcurrentExecution()) {
+    for (auto const& task: tasks)
+      task();
+    return arena.release();
+  }
+
+  try {
+    unique_ptr<FiberPool> pool;
+    if (!hera->fibers)
+      pool.reset(new FiberPool(FiberPool::defaultStackSize, &hera->memoryBudget));
+    AsyncScheduler(async_host, hera->fibers ? *hera->fibers : *pool).run(tasks);
+  } catch (...) {
+    for (size_t i = 0; i < count; ++i)
+      if (!started[i])
+        tasks[i]();
+  }
+
+  return arena.release();
+}
+
+void hera_release_batch(hera_batch_arena* arena) noexcept
+{
+  delete arena;
+}
+
+void hera_get_memory_usage(evmc_instance* instance, hera_memory_usage* usage) noexcept
+{
+  MemoryBudget& budget = static_cast<hera_instance*>(instance)->memoryBudget;
+  memset(usage, 0, sizeof(hera_memory_usage));
+  usage->budget = budget.limit();
+  usage->total = budget.total();
+  usage->evictions = budget.evictions();
+  try {
+    map<string, size_t> accounts = budget.usage();
+    usage->module_cache = accounts["module-cache"];
+    usage->static_call_cache = accounts["static-call-cache"];
+    usage->fiber_stacks = accounts["fiber-stacks"];
+    usage->instances = accounts["instances"];
+  } catch (...) {
+    // Only the totals then.
+  }
+}
+
+void hera_get_numa_stats(evmc_instance* instance, hera_numa_stats* stats) noexcept
+{
+  hera_instance* hera = static_cast<hera_instance*>(instance);
+  memset(stats, 0, sizeof(hera_numa_stats));
+  stats->nodes = Numa::nodeCount();
+  if (hera->moduleCache)
+    stats->module_cache_remote_hits = hera->moduleCache->remoteHits();
+  if (hera->fibers)
+    stats->fiber_stack_remote_reuses = hera->fibers->remoteReuses();
+}
+
+void hera_get_phase_times(evmc_instance* instance, hera_phase_times* times) noexcept
+{
+  PhaseTimes const* phaseTimes = static_cast<hera_instance*>(instance)->phaseTimes.get();
+  memset(times, 0, sizeof(hera_phase_times));
+  if (!phaseTimes)
+    return;
+  times->executions = phaseTimes->executions();
+  times->parse_ns = phaseTimes->nanoseconds(ExecutionPhase::Parse);
+  times->validate_ns = phaseTimes->nanoseconds(ExecutionPhase::Validate);
+  times->instantiate_ns = phaseTimes->nanoseconds(ExecutionPhase::Instantiate);
+  times->run_ns = phaseTimes->nanoseconds(ExecutionPhase::Run);
+}
+
+int64_t hera_get_required_gas(evmc_result const* result) noexcept
+{
+  int64_t gas_required;
+  memcpy(&gas_required, evmc_get_const_optional_storage(result)->bytes, sizeof(int64_t));
+  return gas_required;
+}
+
 #if hera_EXPORTS
 // If compiled as shared library, also export this symbol.
 EVMC_EXPORT evmc_instance* evmc_create() noexcept
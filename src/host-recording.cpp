@@ -0,0 +1,555 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host-recording.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "exceptions.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+const char recordingMagic[8] = {'H', 'E', 'R', 'A', 'R', 'E', 'C', 0};
+const uint32_t recordingVersion = 1;
+
+class Writer {
+public:
+  explicit Writer(vector<uint8_t>& out): m_out(out) {}
+
+  void u8(uint8_t value) { m_out.push_back(value); }
+  void u32(uint32_t value) { integer(value, 4); }
+  void u64(uint64_t value) { integer(value, 8); }
+  void i32(int32_t value) { u32(static_cast<uint32_t>(value)); }
+  void i64(int64_t value) { u64(static_cast<uint64_t>(value)); }
+  void raw(uint8_t const* data, size_t size) { m_out.insert(m_out.end(), data, data + size); }
+  void bytes(uint8_t const* data, size_t size) { u64(size); if (size) raw(data, size); }
+  void bytes(vector<uint8_t> const& data) { bytes(data.data(), data.size()); }
+  void address(evmc_address const& value) { raw(value.bytes, sizeof(value.bytes)); }
+  void bytes32(evmc_bytes32 const& value) { raw(value.bytes, sizeof(value.bytes)); }
+
+  void message(RecordedMessage const& msg)
+  {
+    u32(static_cast<uint32_t>(msg.kind));
+    u32(msg.flags);
+    i32(msg.depth);
+    i64(msg.gas);
+    address(msg.destination);
+    address(msg.sender);
+    bytes(msg.input);
+    bytes32(msg.value);
+    bytes32(msg.create2Salt);
+  }
+
+  void result(RecordedResult const& result)
+  {
+    i32(static_cast<int32_t>(result.status));
+    i64(result.gasLeft);
+    bytes(result.output);
+    address(result.createAddress);
+  }
+
+  void txContext(evmc_tx_context const& context)
+  {
+    bytes32(context.tx_gas_price);
+    address(context.tx_origin);
+    address(context.block_coinbase);
+    i64(context.block_number);
+    i64(context.block_timestamp);
+    i64(context.block_gas_limit);
+    bytes32(context.block_difficulty);
+  }
+
+private:
+  void integer(uint64_t value, unsigned size)
+  {
+    for (unsigned i = 0; i < size; ++i)
+      m_out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  vector<uint8_t>& m_out;
+};
+
+class Reader {
+public:
+  explicit Reader(istream& in): m_in(in) {}
+
+  uint8_t u8() { uint8_t ret; raw(&ret, 1); return ret; }
+  uint32_t u32() { return static_cast<uint32_t>(integer(4)); }
+  uint64_t u64() { return integer(8); }
+  int32_t i32() { return static_cast<int32_t>(u32()); }
+  int64_t i64() { return static_cast<int64_t>(u64()); }
+
+  void raw(uint8_t* data, size_t size)
+  {
+    m_in.read(reinterpret_cast<char*>(data), static_cast<streamsize>(size));
+    heraAssert(m_in.gcount() == static_cast<streamsize>(size), "Truncated recording.");
+  }
+
+  vector<uint8_t> bytes()
+  {
+    uint64_t size = u64();
+    vector<uint8_t> ret;
+    // Grow while reading, a corrupt length must not cause a huge allocation.
+    while (ret.size() < size) {
+      size_t chunk = static_cast<size_t>(min<uint64_t>(size - ret.size(), 65536));
+      size_t offset = ret.size();
+      ret.resize(offset + chunk);
+      raw(ret.data() + offset, chunk);
+    }
+    return ret;
+  }
+
+  evmc_address address() { evmc_address ret; raw(ret.bytes, sizeof(ret.bytes)); return ret; }
+  evmc_bytes32 bytes32() { evmc_bytes32 ret; raw(ret.bytes, sizeof(ret.bytes)); return ret; }
+
+  RecordedMessage message()
+  {
+    RecordedMessage msg;
+    msg.kind = static_cast<evmc_call_kind>(u32());
+    msg.flags = u32();
+    msg.depth = i32();
+    msg.gas = i64();
+    msg.destination = address();
+    msg.sender = address();
+    msg.input = bytes();
+    msg.value = bytes32();
+    msg.create2Salt = bytes32();
+    return msg;
+  }
+
+  RecordedResult result()
+  {
+    RecordedResult result;
+    result.status = static_cast<evmc_status_code>(i32());
+    result.gasLeft = i64();
+    result.output = bytes();
+    result.createAddress = address();
+    return result;
+  }
+
+  evmc_tx_context txContext()
+  {
+    evmc_tx_context context;
+    context.tx_gas_price = bytes32();
+    context.tx_origin = address();
+    context.block_coinbase = address();
+    context.block_number = i64();
+    context.block_timestamp = i64();
+    context.block_gas_limit = i64();
+    context.block_difficulty = bytes32();
+    return context;
+  }
+
+private:
+  uint64_t integer(unsigned size)
+  {
+    uint8_t data[8];
+    raw(data, size);
+    uint64_t ret = 0;
+    for (unsigned i = 0; i < size; ++i)
+      ret |= static_cast<uint64_t>(data[i]) << (8 * i);
+    return ret;
+  }
+
+  istream& m_in;
+};
+
+void writeEvent(Writer& out, HostEvent const& event)
+{
+  out.u8(static_cast<uint8_t>(event.type));
+  switch (event.type) {
+  case HostEventType::AccountExists:
+    out.address(event.address);
+    out.i32(event.status);
+    break;
+  case HostEventType::GetStorage:
+    out.address(event.address);
+    out.bytes32(event.key);
+    out.bytes32(event.value);
+    break;
+  case HostEventType::SetStorage:
+    out.address(event.address);
+    out.bytes32(event.key);
+    out.bytes32(event.value);
+    out.i32(event.status);
+    break;
+  case HostEventType::GetBalance:
+  case HostEventType::GetCodeHash:
+    out.address(event.address);
+    out.bytes32(event.value);
+    break;
+  case HostEventType::GetCodeSize:
+    out.address(event.address);
+    out.u64(event.size);
+    break;
+  case HostEventType::CopyCode:
+    out.address(event.address);
+    out.i64(event.number);
+    out.u64(event.size);
+    out.bytes(event.data);
+    break;
+  case HostEventType::SelfDestruct:
+    out.address(event.address);
+    out.address(event.beneficiary);
+    break;
+  case HostEventType::Call:
+    out.message(event.message);
+    out.result(event.result);
+    break;
+  case HostEventType::GetTxContext:
+    out.txContext(event.txContext);
+    break;
+  case HostEventType::GetBlockHash:
+    out.i64(event.number);
+    out.bytes32(event.value);
+    break;
+  case HostEventType::EmitLog:
+    out.address(event.address);
+    out.bytes(event.data);
+    out.u64(event.topics.size());
+    for (auto const& topic: event.topics)
+      out.bytes32(topic);
+    break;
+  }
+}
+
+HostEvent readEvent(Reader& in)
+{
+  uint8_t type = in.u8();
+  heraAssert(type <= static_cast<uint8_t>(HostEventType::EmitLog), "Unknown host event in recording.");
+  HostEvent event(static_cast<HostEventType>(type));
+  switch (event.type) {
+  case HostEventType::AccountExists:
+    event.address = in.address();
+    event.status = in.i32();
+    break;
+  case HostEventType::GetStorage:
+    event.address = in.address();
+    event.key = in.bytes32();
+    event.value = in.bytes32();
+    break;
+  case HostEventType::SetStorage:
+    event.address = in.address();
+    event.key = in.bytes32();
+    event.value = in.bytes32();
+    event.status = in.i32();
+    break;
+  case HostEventType::GetBalance:
+  case HostEventType::GetCodeHash:
+    event.address = in.address();
+    event.value = in.bytes32();
+    break;
+  case HostEventType::GetCodeSize:
+    event.address = in.address();
+    event.size = in.u64();
+    break;
+  case HostEventType::CopyCode:
+    event.address = in.address();
+    event.number = in.i64();
+    event.size = in.u64();
+    event.data = in.bytes();
+    break;
+  case HostEventType::SelfDestruct:
+    event.address = in.address();
+    event.beneficiary = in.address();
+    break;
+  case HostEventType::Call:
+    event.message = in.message();
+    event.result = in.result();
+    break;
+  case HostEventType::GetTxContext:
+    event.txContext = in.txContext();
+    break;
+  case HostEventType::GetBlockHash:
+    event.number = in.i64();
+    event.value = in.bytes32();
+    break;
+  case HostEventType::EmitLog: {
+    event.address = in.address();
+    event.data = in.bytes();
+    uint64_t count = in.u64();
+    heraAssert(count <= 4, "Too many log topics in recording.");
+    for (uint64_t i = 0; i < count; ++i)
+      event.topics.push_back(in.bytes32());
+    break;
+  }
+  }
+  return event;
+}
+
+}
+
+RecordedMessage::RecordedMessage(evmc_message const& msg):
+  kind(msg.kind),
+  flags(msg.flags),
+  depth(msg.depth),
+  gas(msg.gas),
+  destination(msg.destination),
+  sender(msg.sender),
+  input(msg.input_data, msg.input_data + msg.input_size),
+  value(msg.value),
+  create2Salt(msg.create2_salt)
+{
+}
+
+evmc_message RecordedMessage::get() const
+{
+  evmc_message msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.destination = destination;
+  msg.sender = sender;
+  msg.input_data = input.data();
+  msg.input_size = input.size();
+  msg.value = value;
+  msg.create2_salt = create2Salt;
+  msg.gas = gas;
+  msg.depth = depth;
+  msg.kind = kind;
+  msg.flags = flags;
+  return msg;
+}
+
+void writeRecordingHeader(vector<uint8_t>& out)
+{
+  Writer writer(out);
+  writer.raw(reinterpret_cast<uint8_t const*>(recordingMagic), sizeof(recordingMagic));
+  writer.u32(recordingVersion);
+}
+
+void writeFrame(vector<uint8_t>& out, RecordedFrame const& frame)
+{
+  Writer writer(out);
+  writer.u32(static_cast<uint32_t>(frame.rev));
+  writer.message(frame.message);
+  writer.bytes(frame.code);
+  writer.result(frame.result);
+  writer.u64(frame.events.size());
+  for (auto const& event: frame.events)
+    writeEvent(writer, event);
+}
+
+void readRecordingHeader(istream& in)
+{
+  Reader reader(in);
+  uint8_t magic[sizeof(recordingMagic)];
+  reader.raw(magic, sizeof(magic));
+  heraAssert(memcmp(magic, recordingMagic, sizeof(magic)) == 0, "Not a Hera recording.");
+  heraAssert(reader.u32() == recordingVersion, "Unsupported recording version.");
+}
+
+bool readFrame(istream& in, RecordedFrame& frame)
+{
+  if (in.peek() == istream::traits_type::eof())
+    return false;
+
+  Reader reader(in);
+  frame.rev = static_cast<evmc_revision>(reader.u32());
+  frame.message = reader.message();
+  frame.code = reader.bytes();
+  frame.result = reader.result();
+  uint64_t count = reader.u64();
+  frame.events.clear();
+  for (uint64_t i = 0; i < count; ++i)
+    frame.events.push_back(readEvent(reader));
+  return true;
+}
+
+const evmc_host_interface RecordingHost::interface = {
+  RecordingHost::accountExists,
+  RecordingHost::getStorage,
+  RecordingHost::setStorage,
+  RecordingHost::getBalance,
+  RecordingHost::getCodeSize,
+  RecordingHost::getCodeHash,
+  RecordingHost::copyCode,
+  RecordingHost::selfDestruct,
+  RecordingHost::call,
+  RecordingHost::getTxContext,
+  RecordingHost::getBlockHash,
+  RecordingHost::emitLog,
+};
+
+RecordingHost::RecordingHost(evmc_context* inner):
+  evmc_context{&interface},
+  m_inner(inner)
+{
+}
+
+bool RecordingHost::accountExists(evmc_context* context, evmc_address const* address)
+{
+  RecordingHost& recorder = self(context);
+  bool ret = recorder.m_inner->host->account_exists(recorder.m_inner, address);
+  HostEvent event(HostEventType::AccountExists);
+  event.address = *address;
+  event.status = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+evmc_bytes32 RecordingHost::getStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key)
+{
+  RecordingHost& recorder = self(context);
+  evmc_bytes32 ret = recorder.m_inner->host->get_storage(recorder.m_inner, address, key);
+  HostEvent event(HostEventType::GetStorage);
+  event.address = *address;
+  event.key = *key;
+  event.value = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+evmc_storage_status RecordingHost::setStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key, evmc_bytes32 const* value)
+{
+  RecordingHost& recorder = self(context);
+  evmc_storage_status ret = recorder.m_inner->host->set_storage(recorder.m_inner, address, key, value);
+  HostEvent event(HostEventType::SetStorage);
+  event.address = *address;
+  event.key = *key;
+  event.value = *value;
+  event.status = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+evmc_uint256be RecordingHost::getBalance(evmc_context* context, evmc_address const* address)
+{
+  RecordingHost& recorder = self(context);
+  evmc_uint256be ret = recorder.m_inner->host->get_balance(recorder.m_inner, address);
+  HostEvent event(HostEventType::GetBalance);
+  event.address = *address;
+  event.value = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+size_t RecordingHost::getCodeSize(evmc_context* context, evmc_address const* address)
+{
+  RecordingHost& recorder = self(context);
+  size_t ret = recorder.m_inner->host->get_code_size(recorder.m_inner, address);
+  HostEvent event(HostEventType::GetCodeSize);
+  event.address = *address;
+  event.size = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+evmc_bytes32 RecordingHost::getCodeHash(evmc_context* context, evmc_address const* address)
+{
+  RecordingHost& recorder = self(context);
+  evmc_bytes32 ret = recorder.m_inner->host->get_code_hash(recorder.m_inner, address);
+  HostEvent event(HostEventType::GetCodeHash);
+  event.address = *address;
+  event.value = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+size_t RecordingHost::copyCode(evmc_context* context, evmc_address const* address, size_t code_offset, uint8_t* buffer_data, size_t buffer_size)
+{
+  RecordingHost& recorder = self(context);
+  size_t ret = recorder.m_inner->host->copy_code(recorder.m_inner, address, code_offset, buffer_data, buffer_size);
+  HostEvent event(HostEventType::CopyCode);
+  event.address = *address;
+  event.number = static_cast<int64_t>(code_offset);
+  event.size = buffer_size;
+  event.data.assign(buffer_data, buffer_data + ret);
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+void RecordingHost::selfDestruct(evmc_context* context, evmc_address const* address, evmc_address const* beneficiary)
+{
+  RecordingHost& recorder = self(context);
+  recorder.m_inner->host->selfdestruct(recorder.m_inner, address, beneficiary);
+  HostEvent event(HostEventType::SelfDestruct);
+  event.address = *address;
+  event.beneficiary = *beneficiary;
+  recorder.m_events.push_back(move(event));
+}
+
+evmc_result RecordingHost::call(evmc_context* context, evmc_message const* msg)
+{
+  RecordingHost& recorder = self(context);
+  evmc_result ret = recorder.m_inner->host->call(recorder.m_inner, msg);
+  HostEvent event(HostEventType::Call);
+  event.message = RecordedMessage(*msg);
+  event.result.status = ret.status_code;
+  event.result.gasLeft = ret.gas_left;
+  if (ret.output_data)
+    event.result.output.assign(ret.output_data, ret.output_data + ret.output_size);
+  event.result.createAddress = ret.create_address;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+evmc_tx_context RecordingHost::getTxContext(evmc_context* context)
+{
+  RecordingHost& recorder = self(context);
+  evmc_tx_context ret = recorder.m_inner->host->get_tx_context(recorder.m_inner);
+  HostEvent event(HostEventType::GetTxContext);
+  event.txContext = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+evmc_bytes32 RecordingHost::getBlockHash(evmc_context* context, int64_t number)
+{
+  RecordingHost& recorder = self(context);
+  evmc_bytes32 ret = recorder.m_inner->host->get_block_hash(recorder.m_inner, number);
+  HostEvent event(HostEventType::GetBlockHash);
+  event.number = number;
+  event.value = ret;
+  recorder.m_events.push_back(move(event));
+  return ret;
+}
+
+void RecordingHost::emitLog(evmc_context* context, evmc_address const* address, uint8_t const* data, size_t data_size, evmc_bytes32 const topics[], size_t topics_count)
+{
+  RecordingHost& recorder = self(context);
+  recorder.m_inner->host->emit_log(recorder.m_inner, address, data, data_size, topics, topics_count);
+  HostEvent event(HostEventType::EmitLog);
+  event.address = *address;
+  if (data_size)
+    event.data.assign(data, data + data_size);
+  event.topics.assign(topics, topics + topics_count);
+  recorder.m_events.push_back(move(event));
+}
+
+HostRecorder::HostRecorder(string const& path):
+  m_file(path, ios::binary | ios::trunc)
+{
+  heraAssert(m_file.is_open(), "Cannot create recording file.");
+  vector<uint8_t> header;
+  writeRecordingHeader(header);
+  m_file.write(reinterpret_cast<char const*>(header.data()), static_cast<streamsize>(header.size()));
+  m_file.flush();
+}
+
+void HostRecorder::append(RecordedFrame const& frame)
+{
+  vector<uint8_t> data;
+  writeFrame(data, frame);
+  lock_guard<mutex> lock(m_mutex);
+  m_file.write(reinterpret_cast<char const*>(data.data()), static_cast<streamsize>(data.size()));
+  m_file.flush();
+}
+
+}
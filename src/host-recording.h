@@ -0,0 +1,160 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <evmc/evmc.h>
+
+namespace hera {
+
+// A recording holds every message Hera executed together with all its host
+// interactions, so that it can be replayed offline (see hera-replay).
+//
+// The file starts with a magic and a version, followed by one frame per
+// message. A frame is appended once its message completes, hence nested
+// calls precede their caller. Integers are stored little endian.
+
+enum class HostEventType : uint8_t {
+  AccountExists,
+  GetStorage,
+  SetStorage,
+  GetBalance,
+  GetCodeSize,
+  GetCodeHash,
+  CopyCode,
+  SelfDestruct,
+  Call,
+  GetTxContext,
+  GetBlockHash,
+  EmitLog
+};
+
+struct RecordedMessage {
+  RecordedMessage() = default;
+  explicit RecordedMessage(evmc_message const& msg);
+
+  // Points into @input, valid as long as this object is.
+  evmc_message get() const;
+
+  evmc_call_kind kind = EVMC_CALL;
+  uint32_t flags = 0;
+  int32_t depth = 0;
+  int64_t gas = 0;
+  evmc_address destination{};
+  evmc_address sender{};
+  std::vector<uint8_t> input;
+  evmc_uint256be value{};
+  evmc_bytes32 create2Salt{};
+};
+
+struct RecordedResult {
+  evmc_status_code status = EVMC_SUCCESS;
+  int64_t gasLeft = 0;
+  std::vector<uint8_t> output;
+  evmc_address createAddress{};
+};
+
+// A single host callback, with its arguments and what the host returned.
+// Only the fields relevant to the type are used.
+struct HostEvent {
+  explicit HostEvent(HostEventType _type): type(_type) {}
+
+  HostEventType type;
+  evmc_address address{};
+  // The beneficiary of a selfdestruct.
+  evmc_address beneficiary{};
+  evmc_bytes32 key{};
+  // The storage value written or read, balance, code hash or block hash.
+  evmc_bytes32 value{};
+  // The block number or code offset of the query.
+  int64_t number = 0;
+  // The code size returned, or the buffer size of a code copy.
+  uint64_t size = 0;
+  // The code copied, or the log data.
+  std::vector<uint8_t> data;
+  std::vector<evmc_bytes32> topics;
+  // The account existence or storage status returned.
+  int32_t status = 0;
+  RecordedMessage message;
+  RecordedResult result;
+  evmc_tx_context txContext{};
+};
+
+struct RecordedFrame {
+  evmc_revision rev = EVMC_BYZANTIUM;
+  RecordedMessage message;
+  std::vector<uint8_t> code;
+  RecordedResult result;
+  std::vector<HostEvent> events;
+};
+
+void writeRecordingHeader(std::vector<uint8_t>& out);
+void writeFrame(std::vector<uint8_t>& out, RecordedFrame const& frame);
+
+// Both throw InternalErrorException if the input is not a valid recording.
+void readRecordingHeader(std::istream& in);
+// Returns false at the end of the recording.
+bool readFrame(std::istream& in, RecordedFrame& frame);
+
+// A host context which forwards every callback to @inner and records it.
+class RecordingHost : public evmc_context {
+public:
+  explicit RecordingHost(evmc_context* inner);
+
+  std::vector<HostEvent>& events() { return m_events; }
+
+private:
+  static RecordingHost& self(evmc_context* context) { return *static_cast<RecordingHost*>(context); }
+
+  static bool accountExists(evmc_context* context, evmc_address const* address);
+  static evmc_bytes32 getStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key);
+  static evmc_storage_status setStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key, evmc_bytes32 const* value);
+  static evmc_uint256be getBalance(evmc_context* context, evmc_address const* address);
+  static size_t getCodeSize(evmc_context* context, evmc_address const* address);
+  static evmc_bytes32 getCodeHash(evmc_context* context, evmc_address const* address);
+  static size_t copyCode(evmc_context* context, evmc_address const* address, size_t code_offset, uint8_t* buffer_data, size_t buffer_size);
+  static void selfDestruct(evmc_context* context, evmc_address const* address, evmc_address const* beneficiary);
+  static evmc_result call(evmc_context* context, evmc_message const* msg);
+  static evmc_tx_context getTxContext(evmc_context* context);
+  static evmc_bytes32 getBlockHash(evmc_context* context, int64_t number);
+  static void emitLog(evmc_context* context, evmc_address const* address, uint8_t const* data, size_t data_size, evmc_bytes32 const topics[], size_t topics_count);
+
+  static const evmc_host_interface interface;
+
+  evmc_context* m_inner;
+  std::vector<HostEvent> m_events;
+};
+
+// Appends frames to a recording file, shared by all executions of an instance.
+class HostRecorder {
+public:
+  // Throws InternalErrorException if the file cannot be created.
+  explicit HostRecorder(std::string const& path);
+
+  void append(RecordedFrame const& frame);
+
+private:
+  std::mutex m_mutex;
+  std::ofstream m_file;
+};
+
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "huge-pages.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+namespace hera {
+
+constexpr size_t HugePages::pageSize;
+constexpr size_t PageMapping::growthWindow;
+
+thread_local FiberLocal<HugePages> HugePages::s_current;
+
+namespace {
+
+size_t roundUp(size_t size, size_t alignment)
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+size_t systemPageSize()
+{
+  return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Maps @size bytes, reserving them without committing any if @protection is
+// PROT_NONE.
+void* mapAnonymous(size_t size, int protection, int flags)
+{
+  if (protection == PROT_NONE)
+    flags |= MAP_NORESERVE;
+  void* mapping = mmap(nullptr, size, protection, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return mapping == MAP_FAILED ? nullptr : mapping;
+}
+
+// Maps @size bytes aligned to a huge page, so that the kernel can back all
+// of it with transparent huge pages.
+void* mapAligned(size_t size, int protection)
+{
+  uint8_t* mapping = static_cast<uint8_t*>(mapAnonymous(size + HugePages::pageSize, protection, 0));
+  if (!mapping)
+    return nullptr;
+  uintptr_t start = roundUp(reinterpret_cast<uintptr_t>(mapping), HugePages::pageSize);
+  size_t head = start - reinterpret_cast<uintptr_t>(mapping);
+  if (head > 0)
+    munmap(mapping, head);
+  if (HugePages::pageSize - head > 0)
+    munmap(reinterpret_cast<uint8_t*>(start) + size, HugePages::pageSize - head);
+  return reinterpret_cast<void*>(start);
+}
+
+}
+
+PageMapping::PageMapping(size_t size):
+  PageMapping(size, size)
+{
+}
+
+PageMapping::PageMapping(size_t size, size_t capacity)
+{
+  capacity = max(size, capacity);
+  if (capacity == 0)
+    return;
+
+  // Growable mappings are reserved inaccessible and committed as they grow.
+  bool growable = capacity > size;
+  int protection = growable ? PROT_NONE : PROT_READ | PROT_WRITE;
+
+  HugePages* hugePages = HugePages::current();
+  HugePages::Mode mode = hugePages ? hugePages->mode() : HugePages::Mode::Off;
+  if (capacity >= HugePages::pageSize && mode != HugePages::Mode::Off) {
+    m_mappedSize = roundUp(capacity, HugePages::pageSize);
+#ifdef MAP_HUGETLB
+    if (mode == HugePages::Mode::Reserved && !growable)
+      m_data = static_cast<uint8_t*>(mapAnonymous(m_mappedSize, protection, MAP_HUGETLB));
+#endif
+#ifdef MADV_HUGEPAGE
+    // Without reserved pages left, or if none are configured.
+    if (!m_data) {
+      m_data = static_cast<uint8_t*>(mapAligned(m_mappedSize, protection));
+      // Only a hint, the mapping works with normal pages all the same.
+      if (m_data)
+        madvise(m_data, m_mappedSize, MADV_HUGEPAGE);
+    }
+#endif
+    m_huge = m_data != nullptr;
+  }
+
+  if (!m_data) {
+    m_mappedSize = roundUp(capacity, systemPageSize());
+    m_data = static_cast<uint8_t*>(mapAnonymous(m_mappedSize, protection, 0));
+    if (!m_data)
+      throw bad_alloc();
+  }
+
+  m_committedSize = growable ? 0 : m_mappedSize;
+  m_size = growable ? 0 : size;
+  if (!grow(size)) {
+    munmap(m_data, m_mappedSize);
+    throw bad_alloc();
+  }
+}
+
+PageMapping::~PageMapping() noexcept
+{
+  if (m_data)
+    munmap(m_data, m_mappedSize);
+}
+
+PageMapping::PageMapping(PageMapping&& other) noexcept:
+  m_data(other.m_data),
+  m_size(other.m_size),
+  m_committedSize(other.m_committedSize),
+  m_mappedSize(other.m_mappedSize),
+  m_huge(other.m_huge)
+{
+  other.m_data = nullptr;
+  other.m_size = 0;
+  other.m_committedSize = 0;
+  other.m_mappedSize = 0;
+  other.m_huge = false;
+}
+
+PageMapping& PageMapping::operator=(PageMapping&& other) noexcept
+{
+  swap(m_data, other.m_data);
+  swap(m_size, other.m_size);
+  swap(m_committedSize, other.m_committedSize);
+  swap(m_mappedSize, other.m_mappedSize);
+  swap(m_huge, other.m_huge);
+  return *this;
+}
+
+bool PageMapping::grow(size_t size)
+{
+  if (size > m_mappedSize)
+    return false;
+  if (size > m_committedSize) {
+    // Whole huge pages, so that the kernel can back the new part with them.
+    size_t committed = min(roundUp(size, m_huge ? HugePages::pageSize : systemPageSize()), m_mappedSize);
+    if (mprotect(m_data + m_committedSize, committed - m_committedSize, PROT_READ | PROT_WRITE) != 0)
+      return false;
+    m_committedSize = committed;
+  }
+  m_size = max(m_size, size);
+  return true;
+}
+
+size_t PageMapping::reservation(size_t size, size_t limit)
+{
+  if (size >= limit)
+    return size;
+  return size + min(max(size, growthWindow), limit - size);
+}
+
+bool PageMapping::resize(size_t size, size_t limit) noexcept
+{
+  if (size > limit)
+    return false;
+  if (size <= m_mappedSize)
+    return grow(size);
+  try {
+    PageMapping moved(size, reservation(size, limit));
+    if (m_size > 0)
+      memcpy(moved.m_data, m_data, m_size);
+    *this = move(moved);
+    return true;
+  } catch (bad_alloc const&) {
+    return false;
+  }
+}
+
+bool PageMapping::protect(int protection)
+{
+  return !m_data || m_committedSize == 0 || mprotect(m_data, m_committedSize, protection) == 0;
+}
+
+constexpr size_t PageArena::chunkSize;
+
+PageArena::Block PageArena::allocate(size_t size)
+{
+  Block block;
+  block.m_size = size;
+  if (size == 0)
+    return block;
+  // Keeps blocks aligned for any type.
+  size_t span = roundUp(size, alignof(max_align_t));
+  if (span > chunkSize / 8) {
+    block.m_chunk = map(size);
+    block.m_data = block.m_chunk->data();
+    return block;
+  }
+
+  lock_guard<mutex> lock(m_mutex);
+  if (!m_chunk || m_used + span > chunkSize) {
+    m_chunk = map(chunkSize);
+    m_used = 0;
+  }
+  block.m_chunk = m_chunk;
+  block.m_data = m_chunk->data() + m_used;
+  m_used += span;
+  return block;
+}
+
+shared_ptr<PageMapping> PageArena::map(size_t size)
+{
+  MemoryBudget::Account* account = m_account;
+  PageMapping* mapping = new PageMapping(size);
+  size_t bytes = mapping->capacity();
+  if (account)
+    account->charge(bytes);
+  // The deleter also runs if the shared_ptr cannot be made.
+  return shared_ptr<PageMapping>(mapping, [account, bytes](PageMapping* unmapped) {
+    delete unmapped;
+    if (account)
+      account->release(bytes);
+  });
+}
+
+}
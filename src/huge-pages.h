@@ -0,0 +1,176 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "fiber-local.h"
+#include "memory-budget.h"
+
+namespace hera {
+
+// Whether large mappings are backed by 2 MiB pages, to relieve the TLB.
+class HugePages {
+public:
+  enum class Mode {
+    Off,
+    // Transparent huge pages, requested with madvise().
+    Transparent,
+    // Pages reserved in the hugetlb pool, falling back to transparent ones.
+    Reserved
+  };
+
+  static constexpr size_t pageSize = 2 * 1024 * 1024;
+
+  explicit HugePages(Mode mode = Mode::Off): m_mode(mode) {}
+
+  Mode mode() const { return m_mode; }
+  void setMode(Mode mode) { m_mode = mode; }
+
+  // The setting of executions on the current thread, if any.
+  static HugePages* current() { return s_current.get(); }
+
+  // Sets the setting of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(HugePages* hugePages): m_previous(s_current.get()) { s_current.set(hugePages); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    HugePages* m_previous;
+  };
+
+private:
+  Mode m_mode;
+
+  static thread_local FiberLocal<HugePages> s_current;
+};
+
+// Zeroed, writable anonymous memory. Mappings of at least a huge page are
+// backed by huge pages as the current thread's HugePages allow, smaller
+// ones and those the system cannot back use normal pages.
+//
+// A mapping may reserve address space beyond its size, so that it can grow
+// in place, without copying, as linear memories do.
+class PageMapping {
+public:
+  // Reserved at least for growable mappings, see reservation().
+  static constexpr size_t growthWindow = 16 * 1024 * 1024;
+
+  // The capacity to reserve for a mapping of @size bytes which may grow to
+  // @limit: twice its size or growthWindow more, whichever is larger, but
+  // not beyond @limit. Reserving the limit, which is 4 GiB for a linear
+  // memory without a maximum, would exhaust the address space with many
+  // instances at once.
+  static size_t reservation(size_t size, size_t limit);
+
+  PageMapping() = default;
+  // Throws std::bad_alloc if the memory cannot be mapped.
+  explicit PageMapping(size_t size);
+  // Reserves @capacity bytes of which the first @size are writable. Growable
+  // mappings use transparent huge pages even if pages are reserved, those of
+  // the hugetlb pool would be taken for the whole capacity at once.
+  PageMapping(size_t size, size_t capacity);
+  ~PageMapping() noexcept;
+
+  PageMapping(PageMapping&& other) noexcept;
+  PageMapping& operator=(PageMapping&& other) noexcept;
+
+  uint8_t* data() const { return m_data; }
+  // The size asked for, the mapping may span more.
+  size_t size() const { return m_size; }
+  // The bytes mapped, which is the size rounded up to whole pages, or the
+  // capacity reserved.
+  size_t capacity() const { return m_mappedSize; }
+  // Whether huge pages were reserved or requested for the mapping.
+  bool huge() const { return m_huge; }
+
+  // Grows the mapping in place to @size bytes. Returns false if that
+  // exceeds its capacity or the memory cannot be committed. A smaller
+  // @size leaves it as it is.
+  bool grow(size_t size);
+
+  // Grows the mapping to @size bytes, in place within its capacity and
+  // otherwise by moving its contents to a new mapping of reservation(@size,
+  // @limit), which changes data(). Returns false if @size exceeds @limit or
+  // the memory cannot be mapped, leaving the mapping as it is.
+  bool resize(size_t size, size_t limit) noexcept;
+
+  // Changes the protection of the writable part, see mprotect(). Returns
+  // false on failure.
+  bool protect(int protection);
+
+private:
+  uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+  // The bytes which are accessible, from the start.
+  size_t m_committedSize = 0;
+  size_t m_mappedSize = 0;
+  bool m_huge = false;
+};
+
+// Small blocks carved out of shared chunks of a huge page each, for many
+// buffers which are kept long and read often, such as the code of the
+// module cache entries: together they take a few TLB entries instead of
+// pages of their own. Large blocks get a mapping of their own.
+//
+// A chunk is unmapped once the arena moved on to the next and its last
+// block is freed, space freed before is not reused. Thread-safe.
+class PageArena {
+public:
+  static constexpr size_t chunkSize = HugePages::pageSize;
+
+  // Charges chunks and large blocks to @account, if any, as they are mapped
+  // and releases them as they are unmapped, so that the account holds what
+  // the arena maps rather than the size of its blocks. The account must
+  // outlive the blocks.
+  explicit PageArena(MemoryBudget::Account* account = nullptr): m_account(account) {}
+
+  class Block {
+  public:
+    Block() = default;
+
+    uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+  private:
+    friend class PageArena;
+
+    std::shared_ptr<PageMapping> m_chunk;
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+  };
+
+  // Throws std::bad_alloc if no chunk can be mapped. Charging a new chunk
+  // may evict, see MemoryBudget::Account.
+  Block allocate(size_t size);
+
+private:
+  // A charged mapping of @size bytes.
+  std::shared_ptr<PageMapping> map(size_t size);
+
+  MemoryBudget::Account* m_account;
+  std::mutex m_mutex;
+  std::shared_ptr<PageMapping> m_chunk;
+  size_t m_used = 0;
+};
+
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "memory-budget.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+namespace hera {
+
+thread_local FiberLocal<MemoryBudget> MemoryBudget::s_current;
+
+MemoryBudget::Account::Account(MemoryBudget* budget, string name, Evictor* evictor):
+  m_budget(budget),
+  m_name(move(name)),
+  m_evictor(evictor)
+{
+  if (!m_budget)
+    return;
+  lock_guard<mutex> lock(m_budget->m_mutex);
+  m_budget->m_accounts.push_back(this);
+}
+
+MemoryBudget::Account::~Account() noexcept
+{
+  if (!m_budget)
+    return;
+  lock_guard<mutex> lock(m_budget->m_mutex);
+  auto& accounts = m_budget->m_accounts;
+  accounts.erase(remove(accounts.begin(), accounts.end(), this), accounts.end());
+  m_budget->m_total -= m_bytes.load(memory_order_relaxed);
+}
+
+void MemoryBudget::Account::charge(size_t bytes) noexcept
+{
+  if (!m_budget || bytes == 0)
+    return;
+  m_bytes += bytes;
+  m_budget->m_total += bytes;
+  m_budget->enforce();
+}
+
+void MemoryBudget::Account::release(size_t bytes) noexcept
+{
+  if (!m_budget || bytes == 0)
+    return;
+  m_bytes -= bytes;
+  m_budget->m_total -= bytes;
+}
+
+MemoryBudget::Charge::Charge(Account* account, size_t bytes) noexcept:
+  m_account(account)
+{
+  update(bytes);
+}
+
+MemoryBudget::Charge::~Charge() noexcept
+{
+  if (m_account)
+    m_account->release(m_bytes);
+}
+
+void MemoryBudget::Charge::update(size_t bytes) noexcept
+{
+  if (!m_account || bytes == m_bytes)
+    return;
+  if (bytes > m_bytes) {
+    size_t delta = bytes - m_bytes;
+    m_bytes = bytes;
+    m_account->charge(delta);
+  } else {
+    m_account->release(m_bytes - bytes);
+    m_bytes = bytes;
+  }
+}
+
+MemoryBudget::MemoryBudget():
+  m_instances(this, "instances")
+{
+}
+
+MemoryBudget::~MemoryBudget() noexcept = default;
+
+void MemoryBudget::setLimit(size_t bytes)
+{
+  m_limit = bytes;
+  enforce();
+}
+
+map<string, size_t> MemoryBudget::usage()
+{
+  map<string, size_t> ret;
+  lock_guard<mutex> lock(m_mutex);
+  for (Account const* account: m_accounts)
+    ret[account->m_name] += account->bytes();
+  return ret;
+}
+
+void MemoryBudget::enforce() noexcept
+{
+  size_t limit = m_limit.load(memory_order_relaxed);
+  if (limit == 0 || total() <= limit)
+    return;
+
+  // Another thread evicting already makes room.
+  unique_lock<mutex> lock(m_mutex, try_to_lock);
+  if (!lock)
+    return;
+
+  vector<pair<Evictor*, Candidate>> candidates;
+  try {
+    vector<Candidate> entries;
+    for (Account* account: m_accounts) {
+      if (!account->m_evictor)
+        continue;
+      entries.clear();
+      account->m_evictor->candidates(entries);
+      for (Candidate const& entry: entries)
+        candidates.emplace_back(account->m_evictor, entry);
+    }
+  } catch (...) {
+    // Evict what could be collected.
+  }
+
+  // Cheapest to lose per byte first.
+  sort(candidates.begin(), candidates.end(),
+    [](pair<Evictor*, Candidate> const& a, pair<Evictor*, Candidate> const& b) {
+      return a.second.value * static_cast<double>(b.second.bytes) < b.second.value * static_cast<double>(a.second.bytes);
+    });
+
+  size_t target = limit - limit / 8;
+  for (auto const& candidate: candidates) {
+    if (total() <= target)
+      break;
+    candidate.first->evict(candidate.second.id);
+    ++m_evictions;
+  }
+}
+
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fiber-local.h"
+
+namespace hera {
+
+// Accounts the memory held by the caches, pools and live instances of a VM
+// and keeps it within a budget.
+//
+// Everything holding memory charges and releases it through an Account.
+// Accounts of caches have an Evictor: once the total exceeds the budget, the
+// entries of all caches are evicted in the order of their value per byte,
+// until the total is an eighth below the budget. The value of an entry is
+// the time it took to build times the rate at which it is hit. Live
+// instances cannot be evicted, they only leave less room for the caches.
+class MemoryBudget {
+public:
+  // An entry a cache could evict.
+  struct Candidate {
+    uint64_t id;
+    size_t bytes;
+    // Nanoseconds to build it again, times its hits per lookup.
+    double value;
+  };
+
+  // Implemented by caches whose entries can be evicted.
+  class Evictor {
+  public:
+    // Appends every entry which could be evicted. May throw on allocation
+    // failures.
+    virtual void candidates(std::vector<Candidate>& out) = 0;
+    // Evicts an entry appended by candidates(), if it is still there, and
+    // releases its bytes from the account.
+    virtual void evict(uint64_t id) noexcept = 0;
+
+  protected:
+    ~Evictor() = default;
+  };
+
+  // Bytes held under a name. Without a budget nothing is accounted.
+  //
+  // The budget calls the evictor with the budget's lock held, so the owner
+  // must not charge bytes while holding a lock the evictor takes, and must
+  // destroy the account before anything the evictor uses.
+  class Account {
+  public:
+    Account(MemoryBudget* budget, std::string name, Evictor* evictor = nullptr);
+    ~Account() noexcept;
+
+    Account(Account const&) = delete;
+    Account& operator=(Account const&) = delete;
+
+    // Evicts from the caches if the budget is exceeded.
+    void charge(size_t bytes) noexcept;
+    void release(size_t bytes) noexcept;
+
+    size_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+
+  private:
+    MemoryBudget* m_budget;
+    std::string m_name;
+    Evictor* m_evictor;
+    std::atomic<size_t> m_bytes{0};
+
+    friend class MemoryBudget;
+  };
+
+  // Charges bytes to an account for its lifetime, like the memory of an
+  // instance. Accepts a null account.
+  class Charge {
+  public:
+    Charge(Account* account, size_t bytes) noexcept;
+    ~Charge() noexcept;
+
+    Charge(Charge const&) = delete;
+    Charge& operator=(Charge const&) = delete;
+
+    // Changes the bytes charged.
+    void update(size_t bytes) noexcept;
+
+  private:
+    Account* m_account;
+    size_t m_bytes = 0;
+  };
+
+  MemoryBudget();
+  ~MemoryBudget() noexcept;
+
+  MemoryBudget(MemoryBudget const&) = delete;
+  MemoryBudget& operator=(MemoryBudget const&) = delete;
+
+  // Zero means unlimited. Lowering the limit evicts right away.
+  void setLimit(size_t bytes);
+  size_t limit() const { return m_limit.load(std::memory_order_relaxed); }
+
+  size_t total() const { return m_total.load(std::memory_order_relaxed); }
+  uint64_t evictions() const { return m_evictions.load(std::memory_order_relaxed); }
+
+  // The bytes of the accounts, summed by name.
+  std::map<std::string, size_t> usage();
+
+  // The account of the instances being executed.
+  Account& instances() { return m_instances; }
+
+  // The budget of executions on the current thread, if any.
+  static MemoryBudget* current() { return s_current.get(); }
+
+  // Sets the budget of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(MemoryBudget* budget): m_previous(s_current.get()) { s_current.set(budget); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    MemoryBudget* m_previous;
+  };
+
+private:
+  // Evicts until the total is below the low watermark, if it exceeds the limit.
+  void enforce() noexcept;
+
+  std::atomic<size_t> m_limit{0};
+  std::atomic<size_t> m_total{0};
+  std::atomic<uint64_t> m_evictions{0};
+
+  // Guards the accounts and serialises eviction.
+  std::mutex m_mutex;
+  std::vector<Account*> m_accounts;
+
+  Account m_instances;
+
+  static thread_local FiberLocal<MemoryBudget> s_current;
+};
+
+}
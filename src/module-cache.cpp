@@ -0,0 +1,192 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "module-cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "helpers.h"
+#include "numa.h"
+#include "probes.h"
+
+using namespace std;
+
+namespace hera {
+
+thread_local FiberLocal<ModuleCache> ModuleCache::s_current;
+
+ModuleCache::ModuleCache(MemoryBudget* budget):
+  m_arenaAccount(budget, "module-cache"),
+  m_arena(&m_arenaAccount),
+  m_account(budget, "module-cache", this)
+{
+}
+
+shared_ptr<const CachedModule> ModuleCache::find(vector<uint8_t> const& code, type_info const& type, bool* remote)
+{
+  uint64_t key = hashBytes(code.data(), code.size());
+  unsigned node = Numa::currentNode();
+  shared_ptr<const CachedModule> module;
+  {
+    lock_guard<mutex> lock(m_mutex);
+    ++m_lookups;
+    auto it = m_entries.find(key);
+    if (it != m_entries.end() && matches(it->second, code, type)) {
+      Slot& slot = it->second;
+      ++slot.hits;
+      module = slot.replicas[node];
+      if (remote)
+        *remote = !module;
+      if (!module) {
+        ++m_remoteHits;
+        module = slot.replicas[slot.home];
+      }
+    }
+  }
+  if (module)
+    HERA_PROBE2(cache__hit, ProbeScope::codeHash(), code.size());
+  else
+    HERA_PROBE2(cache__miss, ProbeScope::codeHash(), code.size());
+  return module;
+}
+
+uint64_t ModuleCache::remoteHits()
+{
+  lock_guard<mutex> lock(m_mutex);
+  return m_remoteHits;
+}
+
+void ModuleCache::store(vector<uint8_t> const& code, shared_ptr<const CachedModule> module, double nanoseconds)
+{
+  uint64_t key = hashBytes(code.data(), code.size());
+  type_index type(typeid(*module));
+  size_t bytes = 0;
+  bool added;
+  {
+    lock_guard<mutex> lock(m_mutex);
+    added = addReplica(key, code, type, module, bytes);
+  }
+  if (!added) {
+    // Copied without the lock, as the arena charges the chunks it maps,
+    // which may evict.
+    PageArena::Block copy = m_arena.allocate(code.size());
+    if (!code.empty())
+      memcpy(copy.data(), code.data(), code.size());
+
+    lock_guard<mutex> lock(m_mutex);
+    // Unless another thread stored the contract meanwhile.
+    if (!addReplica(key, code, type, module, bytes)) {
+      unsigned node = Numa::currentNode();
+      vector<shared_ptr<const CachedModule>> replicas(Numa::nodeCount());
+      replicas[node] = move(module);
+      Slot fresh{move(copy), type, move(replicas), node, m_nextId, nanoseconds, 0, m_lookups};
+      bytes = footprint(fresh);
+      auto it = m_entries.find(key);
+      if (it != m_entries.end()) {
+        m_account.release(footprint(it->second));
+        m_keys.erase(it->second.id);
+        m_entries.erase(it);
+      } else if (m_entries.size() >= maxEntries) {
+        evictCheapest();
+      }
+      uint64_t id = m_nextId++;
+      it = m_entries.emplace(key, move(fresh)).first;
+      try {
+        m_keys.emplace(id, key);
+      } catch (...) {
+        m_entries.erase(it);
+        throw;
+      }
+    }
+  }
+  // Outside of the lock, this may evict.
+  m_account.charge(bytes);
+}
+
+bool ModuleCache::addReplica(uint64_t key, vector<uint8_t> const& code, type_index type,
+  shared_ptr<const CachedModule>& module, size_t& bytes)
+{
+  auto it = m_entries.find(key);
+  if (it == m_entries.end() || !matches(it->second, code, type))
+    return false;
+  shared_ptr<const CachedModule>& replica = it->second.replicas[Numa::currentNode()];
+  if (!replica) {
+    bytes = module->footprint();
+    replica = move(module);
+  }
+  return true;
+}
+
+double ModuleCache::value(Slot const& slot) const
+{
+  // Counting one hit more keeps the build time of unused entries apart.
+  double hitRate = static_cast<double>(slot.hits + 1) / static_cast<double>(m_lookups - slot.lookupsBefore + 1);
+  return slot.nanoseconds * hitRate;
+}
+
+void ModuleCache::evictCheapest()
+{
+  auto cheapest = m_entries.end();
+  for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+    if (cheapest == m_entries.end() ||
+        value(it->second) * static_cast<double>(footprint(cheapest->second)) <
+          value(cheapest->second) * static_cast<double>(footprint(it->second)))
+      cheapest = it;
+  }
+  if (cheapest == m_entries.end())
+    return;
+  m_account.release(footprint(cheapest->second));
+  m_keys.erase(cheapest->second.id);
+  m_entries.erase(cheapest);
+}
+
+bool ModuleCache::matches(Slot const& slot, vector<uint8_t> const& code, type_index type)
+{
+  return slot.type == type && slot.code.size() == code.size() && equal(code.begin(), code.end(), slot.code.data());
+}
+
+size_t ModuleCache::footprint(Slot const& slot)
+{
+  size_t bytes = sizeof(Slot);
+  for (auto const& replica: slot.replicas)
+    if (replica)
+      bytes += replica->footprint();
+  return bytes;
+}
+
+void ModuleCache::candidates(vector<MemoryBudget::Candidate>& out)
+{
+  lock_guard<mutex> lock(m_mutex);
+  for (auto const& entry: m_entries) {
+    Slot const& slot = entry.second;
+    out.push_back(MemoryBudget::Candidate{slot.id, footprint(slot), value(slot)});
+  }
+}
+
+void ModuleCache::evict(uint64_t id) noexcept
+{
+  lock_guard<mutex> lock(m_mutex);
+  auto key = m_keys.find(id);
+  if (key == m_keys.end())
+    return;
+  auto it = m_entries.find(key->second);
+  m_account.release(footprint(it->second));
+  m_entries.erase(it);
+  m_keys.erase(key);
+}
+
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "fiber-local.h"
+#include "huge-pages.h"
+#include "memory-budget.h"
+
+namespace hera {
+
+// What an engine keeps of a contract which passed its validation, so that
+// later executions of it start right away: a parsed module, compiled code
+// or the analysis of EVM1 bytecode. It is immutable once cached and shared
+// by concurrent executions.
+class CachedModule {
+public:
+  virtual ~CachedModule() = default;
+
+  // The bytes it holds, as accounted in the memory budget.
+  virtual size_t footprint() const = 0;
+};
+
+// Modules by the code they were built from, so that repeated executions of
+// a contract skip parsing, validation and whatever else its engine does
+// before running it. A contract has one module at a time, of the type of
+// the engine which stored it.
+//
+// Modules are accounted as "module-cache" in the memory budget, valued by
+// the time building them took, as are the chunks of the arena holding the
+// code of the entries.
+//
+// On NUMA machines, an entry holds a module for every node it was stored
+// from. Engines build a module again on a node where only another node's
+// is cached, so that executions read their module from local memory.
+class ModuleCache : private MemoryBudget::Evictor {
+public:
+  explicit ModuleCache(MemoryBudget* budget = nullptr);
+
+  // Returns the module of type T cached for @code, nullptr if there is none.
+  // @remote is set if it is the module of another NUMA node, which is worth
+  // building and storing again for the current one.
+  template <typename T>
+  std::shared_ptr<const T> lookup(std::vector<uint8_t> const& code, bool* remote = nullptr)
+  {
+    return std::static_pointer_cast<const T>(find(code, typeid(T), remote));
+  }
+
+  // Caches @module for @code. It replaces a module of another code or type,
+  // or is added to the modules of the entry for other NUMA nodes.
+  // @nanoseconds is the time building it took.
+  void store(std::vector<uint8_t> const& code, std::shared_ptr<const CachedModule> module, double nanoseconds);
+
+  // The lookups which found the module only on another NUMA node.
+  uint64_t remoteHits();
+
+  // The cache of executions on the current thread, if any.
+  static ModuleCache* current() { return s_current.get(); }
+
+  // Sets the cache of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(ModuleCache* cache): m_previous(s_current.get()) { s_current.set(cache); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    ModuleCache* m_previous;
+  };
+
+private:
+  // Storing another module once the cache holds this many evicts the entry
+  // of the lowest value per byte, as the budget would.
+  static constexpr size_t maxEntries = 1024;
+
+  struct Slot {
+    // To settle collisions of the hash. Compared on every lookup, so kept
+    // together with the code of the other entries, see PageArena.
+    PageArena::Block code;
+    std::type_index type;
+    // The modules by NUMA node, only the one of the node it was first stored
+    // from is always there.
+    std::vector<std::shared_ptr<const CachedModule>> replicas;
+    unsigned home;
+    uint64_t id;
+    double nanoseconds;
+    uint64_t hits;
+    // The number of lookups before it was stored.
+    uint64_t lookupsBefore;
+  };
+
+  // The bytes charged for an entry, its code is charged with the chunks of
+  // the arena.
+  static size_t footprint(Slot const& slot);
+  static bool matches(Slot const& slot, std::vector<uint8_t> const& code, std::type_index type);
+
+  std::shared_ptr<const CachedModule> find(std::vector<uint8_t> const& code, std::type_info const& type, bool* remote);
+
+  // The following are called with m_mutex held.
+
+  // Adds @module to the entry of @code for the modules of other NUMA nodes
+  // and sets @bytes to what it takes. Returns false if there is no such
+  // entry, leaving @module as it is.
+  bool addReplica(uint64_t key, std::vector<uint8_t> const& code, std::type_index type,
+    std::shared_ptr<const CachedModule>& module, size_t& bytes);
+  // See MemoryBudget::Candidate.
+  double value(Slot const& slot) const;
+  void evictCheapest();
+
+  void candidates(std::vector<MemoryBudget::Candidate>& out) override;
+  void evict(uint64_t id) noexcept override;
+
+  // First, so that it outlives the blocks of the entries.
+  MemoryBudget::Account m_arenaAccount;
+
+  std::mutex m_mutex;
+  // By the hash of the code. Another module with the same hash replaces it.
+  std::unordered_map<uint64_t, Slot> m_entries;
+  // The hash of every entry by its id.
+  std::unordered_map<uint64_t, uint64_t> m_keys;
+  uint64_t m_nextId = 0;
+  uint64_t m_lookups = 0;
+  uint64_t m_remoteHits = 0;
+  PageArena m_arena;
+
+  // Last, so that the budget stops evicting before the entries go.
+  MemoryBudget::Account m_account;
+
+  static thread_local FiberLocal<ModuleCache> s_current;
+};
+
+}
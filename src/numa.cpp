@@ -0,0 +1,137 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "numa.h"
+
+#if __linux__
+#include <sched.h>
+#endif
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+// Parses a sysfs list like "0-3,8-11".
+vector<unsigned> parseList(string const& list)
+{
+  vector<unsigned> result;
+  size_t position = 0;
+  while (position < list.size()) {
+    size_t end = list.find(',', position);
+    if (end == string::npos)
+      end = list.size();
+    string range = list.substr(position, end - position);
+    size_t dash = range.find('-');
+    unsigned first = static_cast<unsigned>(strtoul(range.c_str(), nullptr, 10));
+    unsigned last = dash == string::npos ? first : static_cast<unsigned>(strtoul(range.c_str() + dash + 1, nullptr, 10));
+    for (unsigned i = first; i <= last && !range.empty(); ++i)
+      result.push_back(i);
+    position = end + 1;
+  }
+  return result;
+}
+
+bool readLine(string const& path, string& line)
+{
+  ifstream file(path);
+  return file && getline(file, line);
+}
+
+}
+
+Numa::Topology const& Numa::topology()
+{
+  static Topology const topology = [] {
+    Topology result;
+#if __linux__
+    string nodes;
+    if (readLine("/sys/devices/system/node/possible", nodes)) {
+      for (unsigned node: parseList(nodes)) {
+        string cpus;
+        if (node >= result.cpus.size())
+          result.cpus.resize(node + 1);
+        if (readLine("/sys/devices/system/node/node" + to_string(node) + "/cpulist", cpus))
+          result.cpus[node] = parseList(cpus);
+        for (unsigned cpu: result.cpus[node]) {
+          if (cpu >= result.nodes.size())
+            result.nodes.resize(cpu + 1);
+          result.nodes[cpu] = node;
+        }
+      }
+    }
+#endif
+    if (result.cpus.empty())
+      result.cpus.resize(1);
+    return result;
+  }();
+  return topology;
+}
+
+unsigned Numa::nodeCount()
+{
+  return static_cast<unsigned>(topology().cpus.size());
+}
+
+unsigned Numa::currentNode()
+{
+  if (nodeCount() == 1)
+    return 0;
+#if __linux__
+  // Served from the vDSO, without entering the kernel.
+  int cpu = sched_getcpu();
+  vector<unsigned> const& nodes = topology().nodes;
+  if (cpu >= 0 && static_cast<size_t>(cpu) < nodes.size())
+    return nodes[static_cast<size_t>(cpu)];
+#endif
+  return 0;
+}
+
+unsigned Numa::cpuCount(unsigned node)
+{
+  return node < nodeCount() ? static_cast<unsigned>(topology().cpus[node].size()) : 0;
+}
+
+Numa::Binding::Binding(unsigned node)
+{
+  if (nodeCount() == 1 || cpuCount(node) == 0)
+    return;
+#if __linux__
+  if (sched_getaffinity(0, sizeof(m_previous), &m_previous) != 0)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned cpu: topology().cpus[node])
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  m_bound = sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+}
+
+Numa::Binding::~Binding()
+{
+#if __linux__
+  if (m_bound)
+    sched_setaffinity(0, sizeof(m_previous), &m_previous);
+#endif
+}
+
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#if __linux__
+#include <sched.h>
+#endif
+
+namespace hera {
+
+// The NUMA nodes of the machine, as Linux reports them in sysfs. Elsewhere
+// everything is on a single node.
+//
+// Memory is placed by the default first touch policy, on the node of the
+// thread which first writes it, so what a thread builds is local to it.
+class Numa {
+public:
+  // At least 1.
+  static unsigned nodeCount();
+  // The node of the CPU the calling thread runs on.
+  static unsigned currentNode();
+  // The number of CPUs of @node.
+  static unsigned cpuCount(unsigned node);
+
+  // Restricts the calling thread to the CPUs of @node while it lives, and
+  // gives it back the affinity it had before. Does nothing if there is a
+  // single node or the affinity could not be read.
+  class Binding {
+  public:
+    explicit Binding(unsigned node);
+    ~Binding();
+    Binding(Binding const&) = delete;
+    Binding& operator=(Binding const&) = delete;
+  private:
+    bool m_bound = false;
+#if __linux__
+    cpu_set_t m_previous;
+#endif
+  };
+
+private:
+  struct Topology {
+    // The CPUs of every node.
+    std::vector<std::vector<unsigned>> cpus;
+    // The node of every CPU.
+    std::vector<unsigned> nodes;
+  };
+
+  static Topology const& topology();
+};
+
+}
@@ -0,0 +1,886 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "precompiles.h"
+#include "exceptions.h"
+#include "helpers.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+inline uint32_t rotl(uint32_t x, unsigned n) { return (x << n) | (x >> (32 - n)); }
+inline uint32_t rotr(uint32_t x, unsigned n) { return (x >> n) | (x << (32 - n)); }
+
+// Feeds @input to @compress in 64 byte blocks, followed by the padding both
+// SHA-256 and RIPEMD-160 expect, with the bit length appended in the given
+// byte order. Only the last, partial block of the input is copied.
+template <typename Compress>
+void hashBlocks(uint8_t const* input, size_t length, bool bigEndian, Compress compress)
+{
+  size_t full = length - length % 64;
+  for (size_t block = 0; block < full; block += 64)
+    compress(input + block);
+
+  uint8_t tail[128] = {};
+  size_t rest = length - full;
+  if (rest)
+    memcpy(tail, input + full, rest);
+  tail[rest] = 0x80;
+  size_t tailSize = rest < 56 ? 64 : 128;
+  uint64_t bits = uint64_t(length) * 8;
+  for (unsigned i = 0; i < 8; ++i)
+    tail[tailSize - 8 + i] = uint8_t(bits >> (bigEndian ? (56 - 8 * i) : (8 * i)));
+  compress(tail);
+  if (tailSize == 128)
+    compress(tail + 64);
+}
+
+array<uint8_t, 32> sha256(uint8_t const* input, size_t length)
+{
+  static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  uint32_t h[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  hashBlocks(input, length, true, [&](uint8_t const* block) {
+    uint32_t w[64];
+    for (unsigned i = 0; i < 16; ++i) {
+      uint8_t const* p = block + 4 * i;
+      w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+    for (unsigned i = 16; i < 64; ++i) {
+      uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (unsigned i = 0; i < 64; ++i) {
+      uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+      uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      hh = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+  });
+
+  array<uint8_t, 32> ret;
+  for (unsigned i = 0; i < 8; ++i)
+    for (unsigned j = 0; j < 4; ++j)
+      ret[4 * i + j] = uint8_t(h[i] >> (24 - 8 * j));
+  return ret;
+}
+
+array<uint8_t, 20> ripemd160(uint8_t const* input, size_t length)
+{
+  static const uint8_t r[80] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+    3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+    1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+    4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13
+  };
+  static const uint8_t rp[80] = {
+    5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+    6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+    15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+    8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+    12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11
+  };
+  static const uint8_t s[80] = {
+    11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+    7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+    11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+    11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+    9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6
+  };
+  static const uint8_t sp[80] = {
+    8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+    9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+    9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+    15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+    8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11
+  };
+  static const uint32_t k[5] = { 0x00000000, 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xa953fd4e };
+  static const uint32_t kp[5] = { 0x50a28be6, 0x5c4dd124, 0x6d703ef3, 0x7a6d76e9, 0x00000000 };
+
+  auto f = [](unsigned j, uint32_t x, uint32_t y, uint32_t z) -> uint32_t {
+    switch (j / 16) {
+    case 0: return x ^ y ^ z;
+    case 1: return (x & y) | (~x & z);
+    case 2: return (x | ~y) ^ z;
+    case 3: return (x & z) | (y & ~z);
+    default: return x ^ (y | ~z);
+    }
+  };
+
+  uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+  hashBlocks(input, length, false, [&](uint8_t const* block) {
+    uint32_t x[16];
+    for (unsigned i = 0; i < 16; ++i) {
+      uint8_t const* p = block + 4 * i;
+      x[i] = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    uint32_t ap = h[0], bp = h[1], cp = h[2], dp = h[3], ep = h[4];
+    for (unsigned j = 0; j < 80; ++j) {
+      uint32_t t = rotl(a + f(j, b, c, d) + x[r[j]] + k[j / 16], s[j]) + e;
+      a = e; e = d; d = rotl(c, 10); c = b; b = t;
+      t = rotl(ap + f(79 - j, bp, cp, dp) + x[rp[j]] + kp[j / 16], sp[j]) + ep;
+      ap = ep; ep = dp; dp = rotl(cp, 10); cp = bp; bp = t;
+    }
+    uint32_t t = h[1] + c + dp;
+    h[1] = h[2] + d + ep;
+    h[2] = h[3] + e + ap;
+    h[3] = h[4] + a + bp;
+    h[4] = h[0] + b + cp;
+    h[0] = t;
+  });
+
+  array<uint8_t, 20> ret;
+  for (unsigned i = 0; i < 5; ++i)
+    for (unsigned j = 0; j < 4; ++j)
+      ret[4 * i + j] = uint8_t(h[i] >> (8 * j));
+  return ret;
+}
+
+/*
+ * Arbitrary precision numbers for modexp, least significant limb first and
+ * without leading zero limbs.
+ */
+
+typedef vector<uint64_t> Limbs;
+
+void trim(Limbs& x)
+{
+  while (!x.empty() && x.back() == 0)
+    x.pop_back();
+}
+
+Limbs limbsFromBigEndian(uint8_t const* bytes, size_t length)
+{
+  Limbs ret((length + 7) / 8, 0);
+  for (size_t i = 0; i < length; ++i) {
+    size_t bit = 8 * (length - 1 - i);
+    ret[bit / 64] |= uint64_t(bytes[i]) << (bit % 64);
+  }
+  trim(ret);
+  return ret;
+}
+
+Limbs multiply(Limbs const& a, Limbs const& b)
+{
+  Limbs ret(a.size() + b.size(), 0);
+  for (size_t i = 0; i < a.size(); ++i) {
+    unsigned __int128 carry = 0;
+    for (size_t j = 0; j < b.size(); ++j) {
+      carry += static_cast<unsigned __int128>(a[i]) * b[j] + ret[i + j];
+      ret[i + j] = static_cast<uint64_t>(carry);
+      carry >>= 64;
+    }
+    ret[i + b.size()] = static_cast<uint64_t>(carry);
+  }
+  trim(ret);
+  return ret;
+}
+
+// The remainder of @u divided by @v, which must not be zero, following
+// Knuth's algorithm D as divideLimbs() of the EVM1 interpreter does.
+Limbs remainder(Limbs const& u, Limbs const& v)
+{
+  size_t m = u.size(), n = v.size();
+  if (m < n)
+    return u;
+
+  if (n == 1) {
+    unsigned __int128 rem = 0;
+    for (size_t i = m; i-- > 0;)
+      rem = ((rem << 64) | u[i]) % v[0];
+    Limbs ret{static_cast<uint64_t>(rem)};
+    trim(ret);
+    return ret;
+  }
+
+  // Normalise so that the top bit of the divisor is set.
+  unsigned shift = static_cast<unsigned>(__builtin_clzll(v[n - 1]));
+  Limbs vn(n), un(m + 1);
+  for (size_t i = n - 1; i > 0; --i)
+    vn[i] = (v[i] << shift) | (shift ? v[i - 1] >> (64 - shift) : 0);
+  vn[0] = v[0] << shift;
+  un[m] = shift ? u[m - 1] >> (64 - shift) : 0;
+  for (size_t i = m - 1; i > 0; --i)
+    un[i] = (u[i] << shift) | (shift ? u[i - 1] >> (64 - shift) : 0);
+  un[0] = u[0] << shift;
+
+  const unsigned __int128 base = static_cast<unsigned __int128>(1) << 64;
+  for (size_t j = m - n + 1; j-- > 0;) {
+    unsigned __int128 numerator = (static_cast<unsigned __int128>(un[j + n]) << 64) | un[j + n - 1];
+    unsigned __int128 qhat = numerator / vn[n - 1];
+    unsigned __int128 rhat = numerator % vn[n - 1];
+    while (qhat >= base || qhat * vn[n - 2] > ((rhat << 64) | un[j + n - 2])) {
+      --qhat;
+      rhat += vn[n - 1];
+      if (rhat >= base)
+        break;
+    }
+
+    // Multiply and subtract.
+    __int128 borrow = 0;
+    __int128 t;
+    for (size_t i = 0; i < n; ++i) {
+      unsigned __int128 p = qhat * vn[i];
+      t = static_cast<__int128>(un[i + j]) - borrow - static_cast<__int128>(static_cast<uint64_t>(p));
+      un[i + j] = static_cast<uint64_t>(t);
+      borrow = static_cast<__int128>(p >> 64) - (t >> 64);
+    }
+    t = static_cast<__int128>(un[j + n]) - borrow;
+    un[j + n] = static_cast<uint64_t>(t);
+
+    if (t < 0) {
+      // Subtracted one too many, add it back.
+      unsigned __int128 carry = 0;
+      for (size_t i = 0; i < n; ++i) {
+        carry += static_cast<unsigned __int128>(un[i + j]) + vn[i];
+        un[i + j] = static_cast<uint64_t>(carry);
+        carry >>= 64;
+      }
+      un[j + n] += static_cast<uint64_t>(carry);
+    }
+  }
+
+  Limbs ret(n);
+  for (size_t i = 0; i + 1 < n; ++i)
+    ret[i] = (un[i] >> shift) | (shift ? un[i + 1] << (64 - shift) : 0);
+  ret[n - 1] = un[n - 1] >> shift;
+  trim(ret);
+  return ret;
+}
+
+bool isOne(Limbs const& x) { return x.size() == 1 && x[0] == 1; }
+
+// @base to the power of the big-endian @exponent followed by @zeroBytes zero
+// bytes, modulo @mod, which must not be zero. The exponent is never
+// materialised, since its zero bytes may be far more than the input holds.
+Limbs modExp(Limbs const& base, uint8_t const* exponent, size_t length, unsigned __int128 zeroBytes, Limbs const& mod)
+{
+  Limbs b = remainder(base, mod);
+  Limbs result = remainder(Limbs{1}, mod);
+  bool started = false;
+  for (size_t i = 0; i < length; ++i)
+    for (int bit = 7; bit >= 0; --bit) {
+      if (started)
+        result = remainder(multiply(result, result), mod);
+      if ((exponent[i] >> bit) & 1) {
+        result = started ? remainder(multiply(result, b), mod) : b;
+        started = true;
+      }
+    }
+  // Squaring leaves 0 and 1 as they are.
+  for (unsigned __int128 i = 0; started && i < zeroBytes * 8 && !result.empty() && !isOne(result); ++i)
+    result = remainder(multiply(result, result), mod);
+  return result;
+}
+
+/*
+ * 256 bit prime fields and short Weierstrass curves y^2 = x^3 + b over them,
+ * for ecrecover (secp256k1) and the bn128 precompiles.
+ */
+
+// A 256 bit number, least significant limb first.
+typedef array<uint64_t, 4> Word;
+
+Word wordFromBigEndian(uint8_t const* bytes)
+{
+  Word ret;
+  for (unsigned i = 0; i < 4; ++i) {
+    ret[3 - i] = 0;
+    for (unsigned j = 0; j < 8; ++j)
+      ret[3 - i] = (ret[3 - i] << 8) | bytes[8 * i + j];
+  }
+  return ret;
+}
+
+void wordToBigEndian(Word const& x, uint8_t* bytes)
+{
+  for (unsigned i = 0; i < 4; ++i)
+    for (unsigned j = 0; j < 8; ++j)
+      bytes[8 * i + j] = uint8_t(x[3 - i] >> (56 - 8 * j));
+}
+
+bool isZero(Word const& x) { return (x[0] | x[1] | x[2] | x[3]) == 0; }
+
+bool less(Word const& a, Word const& b)
+{
+  for (unsigned i = 4; i-- > 0;)
+    if (a[i] != b[i])
+      return a[i] < b[i];
+  return false;
+}
+
+// Returns the carry out of @a + @b.
+bool addTo(Word& a, Word const& b)
+{
+  unsigned __int128 carry = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    carry += static_cast<unsigned __int128>(a[i]) + b[i];
+    a[i] = static_cast<uint64_t>(carry);
+    carry >>= 64;
+  }
+  return carry != 0;
+}
+
+// Returns the borrow out of @a - @b.
+bool subtractFrom(Word& a, Word const& b)
+{
+  uint64_t borrow = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    uint64_t d = a[i] - b[i];
+    uint64_t next = (a[i] < b[i]) || (d < borrow);
+    a[i] = d - borrow;
+    borrow = next;
+  }
+  return borrow != 0;
+}
+
+// The integers modulo an odd prime p < 2^256. Elements are kept in Montgomery
+// form, x * 2^256 mod p, so that multiplying needs no division.
+class PrimeField {
+public:
+  explicit PrimeField(Word const& p): m_p(p)
+  {
+    // -p^-1 mod 2^64 by Newton's iteration, each step doubling the bits.
+    uint64_t inverse = 1;
+    for (unsigned i = 0; i < 6; ++i)
+      inverse *= 2 - p[0] * inverse;
+    m_inverse = 0 - inverse;
+
+    // 2^512 mod p, by doubling 1.
+    Word r2{{1, 0, 0, 0}};
+    for (unsigned i = 0; i < 512; ++i)
+      r2 = add(r2, r2);
+    m_r2 = r2;
+    m_one = fromInt(Word{{1, 0, 0, 0}});
+
+    m_inverseExponent = p;
+    subtractFrom(m_inverseExponent, Word{{2, 0, 0, 0}});
+    // (p + 1) / 4, which does not overflow as p is odd.
+    for (unsigned i = 0; i < 4; ++i)
+      m_sqrtExponent[i] = (p[i] >> 2) | (i < 3 ? p[i + 1] << 62 : 0);
+    addTo(m_sqrtExponent, Word{{1, 0, 0, 0}});
+  }
+
+  Word const& modulus() const { return m_p; }
+  Word const& one() const { return m_one; }
+
+  // Converts @x, which must be below the modulus, to Montgomery form.
+  Word fromInt(Word const& x) const { return mul(x, m_r2); }
+  Word toInt(Word const& x) const { return mul(x, Word{{1, 0, 0, 0}}); }
+
+  Word add(Word a, Word const& b) const
+  {
+    if (addTo(a, b) || !less(a, m_p))
+      subtractFrom(a, m_p);
+    return a;
+  }
+
+  Word sub(Word a, Word const& b) const
+  {
+    if (subtractFrom(a, b))
+      addTo(a, m_p);
+    return a;
+  }
+
+  Word neg(Word const& a) const { return sub(Word{}, a); }
+
+  // Montgomery multiplication, coarsely integrated operand scanning.
+  Word mul(Word const& a, Word const& b) const
+  {
+    uint64_t t[6] = {};
+    for (unsigned i = 0; i < 4; ++i) {
+      unsigned __int128 carry = 0;
+      for (unsigned j = 0; j < 4; ++j) {
+        carry += static_cast<unsigned __int128>(a[j]) * b[i] + t[j];
+        t[j] = static_cast<uint64_t>(carry);
+        carry >>= 64;
+      }
+      carry += t[4];
+      t[4] = static_cast<uint64_t>(carry);
+      t[5] = static_cast<uint64_t>(carry >> 64);
+
+      uint64_t m = t[0] * m_inverse;
+      carry = (static_cast<unsigned __int128>(m) * m_p[0] + t[0]) >> 64;
+      for (unsigned j = 1; j < 4; ++j) {
+        carry += static_cast<unsigned __int128>(m) * m_p[j] + t[j];
+        t[j - 1] = static_cast<uint64_t>(carry);
+        carry >>= 64;
+      }
+      carry += t[4];
+      t[3] = static_cast<uint64_t>(carry);
+      t[4] = t[5] + static_cast<uint64_t>(carry >> 64);
+    }
+    Word ret{{t[0], t[1], t[2], t[3]}};
+    if (t[4] || !less(ret, m_p))
+      subtractFrom(ret, m_p);
+    return ret;
+  }
+
+  Word square(Word const& a) const { return mul(a, a); }
+
+  // @a to the power of @exponent, which is a plain integer.
+  Word pow(Word const& a, Word const& exponent) const
+  {
+    Word ret = m_one;
+    for (unsigned i = 256; i-- > 0;) {
+      ret = square(ret);
+      if ((exponent[i / 64] >> (i % 64)) & 1)
+        ret = mul(ret, a);
+    }
+    return ret;
+  }
+
+  // Requires @a not to be zero.
+  Word inverse(Word const& a) const { return pow(a, m_inverseExponent); }
+
+  // A square root of @a, if it has one. Requires p = 3 mod 4, which holds
+  // for both curves.
+  bool sqrt(Word const& a, Word& root) const
+  {
+    root = pow(a, m_sqrtExponent);
+    return square(root) == a;
+  }
+
+private:
+  Word m_p;
+  uint64_t m_inverse;
+  Word m_r2;
+  Word m_one;
+  Word m_inverseExponent;
+  Word m_sqrtExponent;
+};
+
+// A point in Jacobian coordinates, (x / z^2, y / z^3), in Montgomery form.
+// The point at infinity has z = 0.
+struct Point {
+  Word x, y, z;
+};
+
+class Curve {
+public:
+  // @b is a plain integer.
+  Curve(Word const& p, Word const& b): m_field(p), m_b(m_field.fromInt(b)) {}
+
+  PrimeField const& field() const { return m_field; }
+
+  Point infinity() const { return Point{m_field.one(), m_field.one(), Word{}}; }
+
+  // The affine point (@x, @y), given as plain integers, if both are below
+  // the modulus and the point is on the curve.
+  bool fromAffine(Word const& x, Word const& y, Point& point) const
+  {
+    if (!less(x, m_field.modulus()) || !less(y, m_field.modulus()))
+      return false;
+    point = Point{m_field.fromInt(x), m_field.fromInt(y), m_field.one()};
+    return m_field.square(point.y) == rhs(point.x);
+  }
+
+  // The affine coordinates of @point as plain integers, unless it is the
+  // point at infinity.
+  bool toAffine(Point const& point, Word& x, Word& y) const
+  {
+    if (isZero(point.z))
+      return false;
+    Word zi = m_field.inverse(point.z);
+    Word zi2 = m_field.square(zi);
+    x = m_field.toInt(m_field.mul(point.x, zi2));
+    y = m_field.toInt(m_field.mul(point.y, m_field.mul(zi2, zi)));
+    return true;
+  }
+
+  // x^3 + b.
+  Word rhs(Word const& x) const { return m_field.add(m_field.mul(m_field.square(x), x), m_b); }
+
+  // Doubling for a = 0 ("dbl-2009-l").
+  Point dbl(Point const& p) const
+  {
+    PrimeField const& f = m_field;
+    Word a = f.square(p.x);
+    Word b = f.square(p.y);
+    Word c = f.square(b);
+    Word d = f.sub(f.sub(f.square(f.add(p.x, b)), a), c);
+    d = f.add(d, d);
+    Word e = f.add(f.add(a, a), a);
+    Word x = f.sub(f.square(e), f.add(d, d));
+    Word c8 = f.add(c, c);
+    c8 = f.add(c8, c8);
+    c8 = f.add(c8, c8);
+    Word y = f.sub(f.mul(e, f.sub(d, x)), c8);
+    Word z = f.mul(p.y, p.z);
+    return Point{x, y, f.add(z, z)};
+  }
+
+  Point add(Point const& p, Point const& q) const
+  {
+    if (isZero(p.z))
+      return q;
+    if (isZero(q.z))
+      return p;
+
+    PrimeField const& f = m_field;
+    Word pz2 = f.square(p.z);
+    Word qz2 = f.square(q.z);
+    Word u1 = f.mul(p.x, qz2);
+    Word u2 = f.mul(q.x, pz2);
+    Word s1 = f.mul(p.y, f.mul(q.z, qz2));
+    Word s2 = f.mul(q.y, f.mul(p.z, pz2));
+    Word h = f.sub(u2, u1);
+    Word r = f.sub(s2, s1);
+    if (isZero(h))
+      return isZero(r) ? dbl(p) : infinity();
+
+    Word h2 = f.square(h);
+    Word h3 = f.mul(h, h2);
+    Word v = f.mul(u1, h2);
+    Word x = f.sub(f.sub(f.square(r), h3), f.add(v, v));
+    Word y = f.sub(f.mul(r, f.sub(v, x)), f.mul(s1, h3));
+    return Point{x, y, f.mul(f.mul(p.z, q.z), h)};
+  }
+
+  // @k1 * @p1 + @k2 * @p2, sharing the doublings. @k1 and @k2 are plain
+  // integers.
+  Point mul(Word const& k1, Point const& p1, Word const& k2, Point const& p2) const
+  {
+    Point sum = add(p1, p2);
+    Point ret = infinity();
+    for (unsigned i = 256; i-- > 0;) {
+      ret = dbl(ret);
+      bool b1 = (k1[i / 64] >> (i % 64)) & 1;
+      bool b2 = (k2[i / 64] >> (i % 64)) & 1;
+      if (b1 || b2)
+        ret = add(ret, b1 && b2 ? sum : (b1 ? p1 : p2));
+    }
+    return ret;
+  }
+
+private:
+  PrimeField m_field;
+  Word m_b;
+};
+
+Curve const& secp256k1()
+{
+  static const Curve curve(
+    Word{{ 0xfffffffefffffc2f, 0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff }},
+    Word{{ 7, 0, 0, 0 }}
+  );
+  return curve;
+}
+
+// The order of the secp256k1 group.
+PrimeField const& secp256k1Order()
+{
+  static const PrimeField field(Word{{ 0xbfd25e8cd0364141, 0xbaaedce6af48a03b, 0xfffffffffffffffe, 0xffffffffffffffff }});
+  return field;
+}
+
+Curve const& bn128()
+{
+  static const Curve curve(
+    Word{{ 0x3c208c16d87cfd47, 0x97816a916871ca8d, 0xb85045b68181585d, 0x30644e72e131a029 }},
+    Word{{ 3, 0, 0, 0 }}
+  );
+  return curve;
+}
+
+// Charges @base + @perWord for every started 32 byte word of the input.
+ExecutionResult chargeGas(evmc_message const& msg, int64_t base, int64_t perWord)
+{
+  ensureCondition(msg.gas >= base, OutOfGas, "Out of gas.");
+  uint64_t words = (uint64_t(msg.input_size) + 31) / 32;
+  ensureCondition(words <= uint64_t(msg.gas - base) / uint64_t(perWord), OutOfGas, "Out of gas.");
+
+  ExecutionResult result;
+  result.gasLeft = msg.gas - base - int64_t(words) * perWord;
+  return result;
+}
+
+ExecutionResult sha256Precompile(evmc_message const& msg)
+{
+  ExecutionResult result = chargeGas(msg, 60, 12);
+  array<uint8_t, 32> hash = sha256(msg.input_data, msg.input_size);
+  result.returnValue.assign(hash.begin(), hash.end());
+  return result;
+}
+
+ExecutionResult ripemd160Precompile(evmc_message const& msg)
+{
+  ExecutionResult result = chargeGas(msg, 600, 120);
+  array<uint8_t, 20> hash = ripemd160(msg.input_data, msg.input_size);
+  // Left-padded to 32 bytes.
+  result.returnValue.assign(12, 0);
+  result.returnValue.insert(result.returnValue.end(), hash.begin(), hash.end());
+  return result;
+}
+
+ExecutionResult identityPrecompile(evmc_message const& msg)
+{
+  ExecutionResult result = chargeGas(msg, 15, 3);
+  result.returnValue.assign(msg.input_data, msg.input_data + msg.input_size);
+  return result;
+}
+
+// Charges @gas.
+ExecutionResult chargeGas(evmc_message const& msg, int64_t gas)
+{
+  ensureCondition(msg.gas >= gas, OutOfGas, "Out of gas.");
+  ExecutionResult result;
+  result.gasLeft = msg.gas - gas;
+  return result;
+}
+
+// Copies @length bytes of the input from @offset, zero padded past its end.
+void readInput(evmc_message const& msg, unsigned __int128 offset, size_t length, uint8_t* out)
+{
+  memset(out, 0, length);
+  if (offset < msg.input_size)
+    memcpy(out, msg.input_data + size_t(offset), min<size_t>(length, msg.input_size - size_t(offset)));
+}
+
+// The 32 byte big-endian length at @offset of the input, capped at 2^72:
+// beyond that, any length makes modexp cost more than any gas.
+unsigned __int128 readLength(evmc_message const& msg, size_t offset)
+{
+  uint8_t word[32];
+  readInput(msg, offset, 32, word);
+  unsigned __int128 ret = 0;
+  for (unsigned i = 0; i < 32; ++i) {
+    if (i < 23 && word[i])
+      return static_cast<unsigned __int128>(1) << 72;
+    ret = (ret << 8) | word[i];
+  }
+  return ret;
+}
+
+ExecutionResult ecrecoverPrecompile(evmc_message const& msg)
+{
+  ExecutionResult result = chargeGas(msg, 3000);
+
+  uint8_t input[128];
+  readInput(msg, 0, 128, input);
+  Word h = wordFromBigEndian(input);
+  Word v = wordFromBigEndian(input + 32);
+  Word r = wordFromBigEndian(input + 64);
+  Word s = wordFromBigEndian(input + 96);
+
+  // An invalid signature recovers nothing, which is not a failure.
+  Curve const& curve = secp256k1();
+  PrimeField const& order = secp256k1Order();
+  if (v[1] || v[2] || v[3] || (v[0] != 27 && v[0] != 28))
+    return result;
+  if (isZero(r) || !less(r, order.modulus()) || isZero(s) || !less(s, order.modulus()))
+    return result;
+
+  // The point R with x = r and the parity of y given by v.
+  PrimeField const& f = curve.field();
+  Point R{f.fromInt(r), Word{}, f.one()};
+  if (!f.sqrt(curve.rhs(R.x), R.y))
+    return result;
+  if ((f.toInt(R.y)[0] & 1) != v[0] - 27)
+    R.y = f.neg(R.y);
+
+  // Q = -h/r * G + s/r * R.
+  if (!less(h, order.modulus()))
+    subtractFrom(h, order.modulus());
+  Word rInverse = order.inverse(order.fromInt(r));
+  Word u1 = order.toInt(order.neg(order.mul(order.fromInt(h), rInverse)));
+  Word u2 = order.toInt(order.mul(order.fromInt(s), rInverse));
+  static const Point G{
+    f.fromInt(Word{{ 0x59f2815b16f81798, 0x029bfcdb2dce28d9, 0x55a06295ce870b07, 0x79be667ef9dcbbac }}),
+    f.fromInt(Word{{ 0x9c47d08ffb10d4b8, 0xfd17b448a6855419, 0x5da4fbfc0e1108a8, 0x483ada7726a3c465 }}),
+    f.one()
+  };
+  Word x, y;
+  if (!curve.toAffine(curve.mul(u1, G, u2, R), x, y))
+    return result;
+
+  // The address is the last 20 bytes of the hash of the public key.
+  uint8_t key[64];
+  wordToBigEndian(x, key);
+  wordToBigEndian(y, key + 32);
+  evmc_bytes32 hash = keccak256(key, sizeof(key));
+  result.returnValue.assign(12, 0);
+  result.returnValue.insert(result.returnValue.end(), hash.bytes + 12, hash.bytes + 32);
+  return result;
+}
+
+// Multiplication complexity of EIP-198 for operands of @x bytes.
+unsigned __int128 multComplexity(unsigned __int128 x)
+{
+  if (x <= 64)
+    return x * x;
+  if (x <= 1024)
+    return x * x / 4 + 96 * x - 3072;
+  return x * x / 16 + 480 * x - 199680;
+}
+
+ExecutionResult modexpPrecompile(evmc_message const& msg)
+{
+  unsigned __int128 baseLength = readLength(msg, 0);
+  unsigned __int128 expLength = readLength(msg, 32);
+  unsigned __int128 modLength = readLength(msg, 64);
+
+  // Operands of 2^40 bytes or more cost more than any gas.
+  unsigned __int128 maxLength = max(baseLength, modLength);
+  ensureCondition(maxLength < (static_cast<unsigned __int128>(1) << 40), OutOfGas, "Out of gas.");
+
+  // The bit length of the exponent, less one, counting its first 32 bytes
+  // only and every further byte as 8 bits.
+  unsigned __int128 expOffset = 96 + baseLength;
+  uint8_t head[32];
+  size_t headLength = static_cast<size_t>(min<unsigned __int128>(expLength, 32));
+  readInput(msg, expOffset, headLength, head);
+  unsigned __int128 adjustedExpLength = 0;
+  for (size_t i = 0; i < headLength; ++i)
+    if (head[i]) {
+      adjustedExpLength = 8 * (headLength - i) - 1 - static_cast<unsigned>(__builtin_clz(head[i]) - 24);
+      break;
+    }
+  if (expLength > 32)
+    adjustedExpLength += 8 * (expLength - 32);
+
+  // gas = complexity * max(adjusted, 1) / 20, compared without overflowing.
+  unsigned __int128 complexity = multComplexity(maxLength);
+  unsigned __int128 factor = max<unsigned __int128>(adjustedExpLength, 1);
+  unsigned __int128 limit = (static_cast<unsigned __int128>(msg.gas) + 1) * 20 - 1;
+  ensureCondition(complexity == 0 || factor <= limit / complexity, OutOfGas, "Out of gas.");
+  ExecutionResult result = chargeGas(msg, static_cast<int64_t>(complexity * factor / 20));
+
+  size_t modSize = static_cast<size_t>(modLength);
+  if (modSize == 0)
+    return result;
+  size_t baseSize = static_cast<size_t>(baseLength);
+  vector<uint8_t> operand(max(baseSize, modSize));
+  readInput(msg, 96, baseSize, operand.data());
+  Limbs base = limbsFromBigEndian(operand.data(), baseSize);
+  readInput(msg, expOffset + expLength, modSize, operand.data());
+  Limbs mod = limbsFromBigEndian(operand.data(), modSize);
+
+  result.returnValue.assign(modSize, 0);
+  if (mod.empty())
+    return result;
+
+  // The exponent bytes past the end of the input are zeros.
+  size_t expSize = 0;
+  if (expOffset < msg.input_size)
+    expSize = static_cast<size_t>(min<unsigned __int128>(expLength, msg.input_size - expOffset));
+  Limbs power = modExp(base, expSize ? msg.input_data + size_t(expOffset) : nullptr, expSize, expLength - expSize, mod);
+  for (size_t i = 0; i < power.size() * 8 && i < modSize; ++i)
+    result.returnValue[modSize - 1 - i] = uint8_t(power[i / 8] >> (8 * (i % 8)));
+  return result;
+}
+
+// Reads the bn128 point at @offset of the input, where (0, 0) stands for the
+// point at infinity. Input which is not a point on the curve fails the call.
+Point readBn128Point(evmc_message const& msg, size_t offset)
+{
+  uint8_t input[64];
+  readInput(msg, offset, 64, input);
+  Word x = wordFromBigEndian(input);
+  Word y = wordFromBigEndian(input + 32);
+  Curve const& curve = bn128();
+  if (isZero(x) && isZero(y))
+    return curve.infinity();
+  Point point;
+  ensureCondition(curve.fromAffine(x, y, point), VMTrap, "Invalid bn128 point.");
+  return point;
+}
+
+void writeBn128Point(Point const& point, ExecutionResult& result)
+{
+  Word x{}, y{};
+  bn128().toAffine(point, x, y);
+  result.returnValue.resize(64);
+  wordToBigEndian(x, result.returnValue.data());
+  wordToBigEndian(y, result.returnValue.data() + 32);
+}
+
+ExecutionResult bn128AddPrecompile(evmc_message const& msg)
+{
+  ExecutionResult result = chargeGas(msg, 500);
+  Point p = readBn128Point(msg, 0);
+  Point q = readBn128Point(msg, 64);
+  writeBn128Point(bn128().add(p, q), result);
+  return result;
+}
+
+ExecutionResult bn128MulPrecompile(evmc_message const& msg)
+{
+  ExecutionResult result = chargeGas(msg, 40000);
+  Point p = readBn128Point(msg, 0);
+  uint8_t scalar[32];
+  readInput(msg, 64, 32, scalar);
+  Curve const& curve = bn128();
+  writeBn128Point(curve.mul(wordFromBigEndian(scalar), p, Word{}, curve.infinity()), result);
+  return result;
+}
+
+evmc_address precompileAddress(uint8_t index)
+{
+  evmc_address address{};
+  address.bytes[19] = index;
+  return address;
+}
+
+}
+
+map<evmc_address, NativePrecompile> const& builtinNativePrecompiles()
+{
+  // NOTE: the bn128 pairing check (8) needs the extension field tower and
+  // the Miller loop on top of the curve arithmetic here. It is left to a
+  // follow-up and keeps running as Wasm until then.
+  static const map<evmc_address, NativePrecompile> precompiles {
+    { precompileAddress(1), ecrecoverPrecompile },
+    { precompileAddress(2), sha256Precompile },
+    { precompileAddress(3), ripemd160Precompile },
+    { precompileAddress(4), identityPrecompile },
+    { precompileAddress(5), modexpPrecompile },
+    { precompileAddress(6), bn128AddPrecompile },
+    { precompileAddress(7), bn128MulPrecompile },
+  };
+  return precompiles;
+}
+
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+
+#include <evmc/evmc.h>
+#include <evmc/helpers.hpp>
+
+#include "eei.h"
+
+namespace hera {
+
+// A precompile implemented in C++. It charges the same gas as its Wasm
+// counterpart and throws OutOfGas if the message does not carry enough.
+using NativePrecompile = ExecutionResult (*)(evmc_message const& msg);
+
+// The precompiles which have a native implementation, by address.
+std::map<evmc_address, NativePrecompile> const& builtinNativePrecompiles();
+
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "probes.h"
+
+using namespace std;
+
+#if HERA_PROBES
+// Set by tracers while they are attached to a probe.
+#define HERA_PROBE_DEFINE_SEMAPHORE(name) \
+  extern "C" { unsigned short HERA_PROBE_SEMAPHORE(name) __attribute__((section(".probes"))) = 0; }
+HERA_PROBE_LIST(HERA_PROBE_DEFINE_SEMAPHORE)
+#undef HERA_PROBE_DEFINE_SEMAPHORE
+#endif
+
+namespace hera {
+
+thread_local FiberLocal<ProbeScope> ProbeScope::s_current;
+thread_local FiberLocal<PhaseTimes> PhaseTimes::s_current;
+thread_local FiberLocal<PhaseTimer> PhaseTimer::s_current;
+
+namespace {
+
+bool anyProbeEnabled()
+{
+  bool enabled = false;
+#if HERA_PROBES
+#define HERA_PROBE_CHECK_ENABLED(name) enabled = enabled || HERA_PROBE_ENABLED(name);
+  HERA_PROBE_LIST(HERA_PROBE_CHECK_ENABLED)
+#undef HERA_PROBE_CHECK_ENABLED
+#endif
+  return enabled;
+}
+
+}
+
+ProbeScope::ProbeScope(evmc_context* context, evmc_message const& msg):
+  m_previous(s_current.get())
+{
+  s_current.set(this);
+  if (anyProbeEnabled())
+    m_codeHash = context->host->get_code_hash(context, &msg.destination);
+}
+
+uint8_t const* ProbeScope::codeHash()
+{
+  static const evmc_bytes32 none{};
+  ProbeScope const* scope = s_current.get();
+  return scope ? scope->m_codeHash.bytes : none.bytes;
+}
+
+PhaseTimer::PhaseTimer(): m_times(PhaseTimes::current())
+{
+  if (!m_times)
+    return;
+  m_start = chrono::steady_clock::now();
+  m_previous = s_current.get();
+  if (m_previous) {
+    m_previous->m_paused += m_start - m_previous->m_start;
+    m_previous->m_start = m_start;
+  }
+  s_current.set(this);
+}
+
+PhaseTimer::~PhaseTimer()
+{
+  if (!m_times)
+    return;
+  auto now = chrono::steady_clock::now();
+  end(ExecutionPhase::Run, now);
+  ++m_times->m_executions;
+  s_current.set(m_previous);
+  // The caller resumes.
+  if (m_previous)
+    m_previous->m_start = now;
+}
+
+void PhaseTimer::done(ExecutionPhase phase)
+{
+  if (PhaseTimer* timer = s_current.get())
+    timer->end(phase, chrono::steady_clock::now());
+}
+
+void PhaseTimer::end(ExecutionPhase phase, chrono::steady_clock::time_point now)
+{
+  auto elapsed = m_paused + (now - m_start);
+  m_times->m_nanoseconds[static_cast<size_t>(phase)] += static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+  m_paused = chrono::steady_clock::duration::zero();
+  m_start = now;
+}
+
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <evmc/evmc.h>
+
+#include "fiber-local.h"
+
+// USDT probes of the "hera" provider, e.g. for bpftrace:
+//
+//   bpftrace -e 'usdt:libhera.so:hera:execute__done { @[arg2] = count(); }'
+//
+// Every probe has a semaphore, so that its arguments are only evaluated
+// while a tracer is attached. Without HERA_PROBES they compile to nothing.
+//
+//   execute__start    code hash, gas, depth
+//   execute__done     code hash, gas left, status
+//   cache__hit        code hash, code size          (module cache)
+//   cache__miss       code hash, code size
+//   parse__done       code hash, gas, code size
+//   validate__done    code hash, gas
+//   instantiate__done code hash, gas
+//   host__start       code hash, gas left, host function name
+//   host__done        code hash, gas left, host function name
+//   call__start       code hash, gas, call kind
+//   call__done        code hash, gas left, status
+//
+// The code hash is a pointer to the 32 bytes of the hash of the executing
+// code, as reported by the client.
+
+#if HERA_PROBES
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define HERA_PROBE_LIST(X) \
+  X(execute__start) \
+  X(execute__done) \
+  X(cache__hit) \
+  X(cache__miss) \
+  X(parse__done) \
+  X(validate__done) \
+  X(instantiate__done) \
+  X(host__start) \
+  X(host__done) \
+  X(call__start) \
+  X(call__done)
+
+#define HERA_PROBE_SEMAPHORE(name) hera_##name##_semaphore
+#define HERA_PROBE_DECLARE_SEMAPHORE(name) extern "C" unsigned short HERA_PROBE_SEMAPHORE(name);
+HERA_PROBE_LIST(HERA_PROBE_DECLARE_SEMAPHORE)
+#undef HERA_PROBE_DECLARE_SEMAPHORE
+
+#define HERA_PROBE_ENABLED(name) __builtin_expect(HERA_PROBE_SEMAPHORE(name) != 0, 0)
+
+#define HERA_PROBE2(name, a, b) \
+  do { if (HERA_PROBE_ENABLED(name)) STAP_PROBE2(hera, name, a, b); } while (0)
+#define HERA_PROBE3(name, a, b, c) \
+  do { if (HERA_PROBE_ENABLED(name)) STAP_PROBE3(hera, name, a, b, c); } while (0)
+
+// Evaluates the host call expression between host__start and host__done.
+#define HERA_HOST_CALL(name, gasLeft, call) \
+  ([&]() { hera::HostCallProbe heraHostCallProbe(name, gasLeft); return call; }())
+
+#else
+
+#define HERA_PROBE_ENABLED(name) false
+#define HERA_PROBE2(name, a, b) do {} while (0)
+#define HERA_PROBE3(name, a, b, c) do {} while (0)
+#define HERA_HOST_CALL(name, gasLeft, call) (call)
+
+#endif
+
+namespace hera {
+
+// Sets the code hash reported by the probes of the current thread for its
+// lifetime. It is only requested from the host while a probe is enabled.
+class ProbeScope {
+public:
+  ProbeScope(evmc_context* context, evmc_message const& msg);
+  ~ProbeScope() { s_current.set(m_previous); }
+  ProbeScope(ProbeScope const&) = delete;
+  ProbeScope& operator=(ProbeScope const&) = delete;
+
+  // The code hash of the innermost scope, or zeros.
+  static uint8_t const* codeHash();
+
+private:
+  evmc_bytes32 m_codeHash{};
+  ProbeScope* m_previous;
+
+  static thread_local FiberLocal<ProbeScope> s_current;
+};
+
+// Fires host__start and host__done around a call to the host.
+#if HERA_PROBES
+class HostCallProbe {
+public:
+  HostCallProbe(char const* name, int64_t const& gasLeft):
+    m_name(name), m_gasLeft(gasLeft)
+  {
+    HERA_PROBE3(host__start, ProbeScope::codeHash(), m_gasLeft, m_name);
+  }
+  ~HostCallProbe()
+  {
+    HERA_PROBE3(host__done, ProbeScope::codeHash(), m_gasLeft, m_name);
+  }
+  HostCallProbe(HostCallProbe const&) = delete;
+  HostCallProbe& operator=(HostCallProbe const&) = delete;
+
+private:
+  char const* m_name;
+  int64_t const& m_gasLeft;
+};
+#else
+class HostCallProbe {
+public:
+  HostCallProbe(char const*, int64_t const&) {}
+};
+#endif
+
+// The phases of an execution timed with the "phase-times" option, each
+// ending at the probe of the same name: parse__done, validate__done,
+// instantiate__done and, for the run, the end of the execution. A phase an
+// execution skips (validation on a module cache hit, everything but the run
+// for EVM1 and native precompiles) counts towards the next one it reaches.
+enum class ExecutionPhase { Parse, Validate, Instantiate, Run, Count };
+
+// The time the executions of an instance spent in each phase.
+class PhaseTimes {
+public:
+  uint64_t nanoseconds(ExecutionPhase phase) const { return m_nanoseconds[static_cast<size_t>(phase)]; }
+  uint64_t executions() const { return m_executions; }
+
+  // The times of the current thread, if any.
+  static PhaseTimes* current() { return s_current.get(); }
+
+  // Sets the times of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(PhaseTimes* times): m_previous(s_current.get()) { s_current.set(times); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    PhaseTimes* m_previous;
+  };
+
+private:
+  friend class PhaseTimer;
+
+  std::atomic<uint64_t> m_nanoseconds[static_cast<size_t>(ExecutionPhase::Count)]{};
+  std::atomic<uint64_t> m_executions{0};
+
+  static thread_local FiberLocal<PhaseTimes> s_current;
+};
+
+// Times the phases of an execution into the PhaseTimes of the current
+// thread, if any. While a nested execution on the same fiber is timed, the
+// one which called it is paused, so that no time is counted twice.
+class PhaseTimer {
+public:
+  PhaseTimer();
+  ~PhaseTimer();
+  PhaseTimer(PhaseTimer const&) = delete;
+  PhaseTimer& operator=(PhaseTimer const&) = delete;
+
+  // Ends @phase of the innermost execution timed on the current thread.
+  static void done(ExecutionPhase phase);
+
+private:
+  void end(ExecutionPhase phase, std::chrono::steady_clock::time_point now);
+
+  PhaseTimes* m_times;
+  PhaseTimer* m_previous = nullptr;
+  std::chrono::steady_clock::time_point m_start;
+  // Time counted before a nested execution paused this one.
+  std::chrono::steady_clock::duration m_paused{};
+
+  static thread_local FiberLocal<PhaseTimer> s_current;
+};
+
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "profiler.h"
+
+#include <chrono>
+#include <fstream>
+
+#include "exceptions.h"
+
+using namespace std;
+
+namespace hera {
+
+constexpr unsigned Profiler::samplesPerSecond;
+
+thread_local FiberLocal<Profiler> Profiler::s_current;
+thread_local FiberLocal<Profiler::ThreadStack> Profiler::s_stack;
+
+namespace {
+
+// Tells the stacks of successive profilers on a thread apart.
+atomic<uint64_t> nextProfilerId{1};
+
+}
+
+struct Profiler::ThreadStack {
+  uint64_t owner = 0;
+  vector<uint32_t> frames;
+  uint64_t lastTick = 0;
+};
+
+unique_ptr<Profiler> Profiler::create(string const& path)
+{
+  // Fail early rather than when the profile is written.
+  heraAssert(ofstream(path, ios::trunc).is_open(), "Cannot create profile file.");
+  return unique_ptr<Profiler>(new Profiler(path));
+}
+
+Profiler::Profiler(string const& path):
+  m_path(path),
+  m_id(nextProfilerId++)
+{
+  m_ticker = thread([this]() {
+    unique_lock<mutex> lock(m_tickerMutex);
+    auto period = chrono::microseconds(1000000 / samplesPerSecond);
+    while (!m_tickerStop.wait_for(lock, period, [this]() { return m_stopping; }))
+      m_ticks.fetch_add(1, memory_order_relaxed);
+  });
+}
+
+Profiler::~Profiler() noexcept
+{
+  {
+    lock_guard<mutex> lock(m_tickerMutex);
+    m_stopping = true;
+  }
+  m_tickerStop.notify_one();
+  m_ticker.join();
+  write();
+}
+
+uint32_t Profiler::frame(string const& name)
+{
+  lock_guard<mutex> lock(m_mutex);
+  auto it = m_frameIds.find(name);
+  if (it != m_frameIds.end())
+    return it->second;
+
+  // Separators of the folded format cannot appear in names.
+  string folded = name;
+  for (char& c: folded)
+    if (c == ';' || c == ' ' || c == '\n')
+      c = '_';
+
+  uint32_t id = static_cast<uint32_t>(m_frameNames.size());
+  m_frameNames.push_back(folded);
+  m_frameIds.emplace(name, id);
+  return id;
+}
+
+Profiler::ThreadStack* Profiler::threadStack()
+{
+  ThreadStack* stack = s_stack.get();
+  return (stack && stack->owner == m_id) ? stack : nullptr;
+}
+
+void Profiler::sample(ThreadStack& stack)
+{
+  uint64_t now = m_ticks.load(memory_order_relaxed);
+  if (now == stack.lastTick)
+    return;
+  if (!stack.frames.empty()) {
+    lock_guard<mutex> lock(m_mutex);
+    m_samples[stack.frames] += now - stack.lastTick;
+  }
+  stack.lastTick = now;
+}
+
+void Profiler::push(uint32_t frame)
+{
+  ThreadStack* stack = threadStack();
+  if (!stack)
+    return;
+  sample(*stack);
+  stack->frames.push_back(frame);
+}
+
+void Profiler::pop()
+{
+  ThreadStack* stack = threadStack();
+  if (!stack)
+    return;
+  sample(*stack);
+  if (!stack->frames.empty())
+    stack->frames.pop_back();
+}
+
+size_t Profiler::depth()
+{
+  ThreadStack* stack = threadStack();
+  return stack ? stack->frames.size() : 0;
+}
+
+void Profiler::unwind(size_t depth)
+{
+  ThreadStack* stack = threadStack();
+  if (!stack)
+    return;
+  sample(*stack);
+  if (depth < stack->frames.size())
+    stack->frames.resize(depth);
+}
+
+Profiler::Frame::Frame(Profiler* profiler, string const& name):
+  m_profiler(profiler)
+{
+  if (!m_profiler)
+    return;
+  if (!m_profiler->threadStack()) {
+    m_stack.reset(new ThreadStack);
+    m_stack->owner = m_profiler->m_id;
+    m_stack->lastTick = m_profiler->m_ticks.load(memory_order_relaxed);
+    m_previous = s_stack.get();
+    s_stack.set(m_stack.get());
+  }
+  m_depth = m_profiler->depth();
+  m_profiler->push(m_profiler->frame(name));
+}
+
+Profiler::Frame::~Frame() noexcept
+{
+  if (!m_profiler)
+    return;
+  m_profiler->unwind(m_depth);
+  if (m_stack)
+    s_stack.set(m_previous);
+}
+
+void Profiler::write() noexcept
+{
+  try {
+    ofstream out(m_path, ios::trunc);
+    lock_guard<mutex> lock(m_mutex);
+    for (auto const& sample: m_samples) {
+      for (size_t i = 0; i < sample.first.size(); ++i) {
+        if (i)
+          out << ';';
+        out << m_frameNames[sample.first[i]];
+      }
+      out << ' ' << sample.second << '\n';
+    }
+  } catch (...) {
+  }
+}
+
+}
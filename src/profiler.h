@@ -0,0 +1,122 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "fiber-local.h"
+
+namespace hera {
+
+// Samples the stack of contracts and Wasm functions executing on every
+// thread. A ticker thread advances a counter at a fixed rate and each thread
+// charges the ticks that passed to its current stack whenever the stack
+// changes, so between changes nothing but the counter is touched.
+//
+// The samples are written as folded stacks ("a;b;c <count>"), as accepted by
+// flamegraph.pl, when the profiler is destroyed.
+class Profiler {
+public:
+  // The rate of the ticker.
+  static constexpr unsigned samplesPerSecond = 1000;
+
+  // Throws InternalErrorException if the file cannot be created.
+  static std::unique_ptr<Profiler> create(std::string const& path);
+
+  ~Profiler() noexcept;
+
+  // Returns the identifier of a frame name, to be passed to push().
+  uint32_t frame(std::string const& name);
+
+  // Pushes or pops a frame of the current thread.
+  void push(uint32_t frame);
+  void pop();
+
+  // The stack depth of the current thread, to be restored with unwind().
+  size_t depth();
+  void unwind(size_t depth);
+
+  // The profiler used by executions on the current thread, if any.
+  static Profiler* current() { return s_current.get(); }
+
+  // Sets the profiler of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(Profiler* profiler): m_previous(s_current.get()) { s_current.set(profiler); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    Profiler* m_previous;
+  };
+
+  // The frames pushed on a thread or fiber.
+  struct ThreadStack;
+
+  // Pushes a frame for its lifetime, popping any frames left above it. The
+  // outermost frame of a thread or fiber holds the stack the ones within it
+  // push to, so executions interleaving on a thread do not mix their frames.
+  class Frame {
+  public:
+    Frame(Profiler* profiler, std::string const& name);
+    ~Frame() noexcept;
+    Frame(Frame const&) = delete;
+    Frame& operator=(Frame const&) = delete;
+  private:
+    Profiler* m_profiler;
+    size_t m_depth = 0;
+    std::unique_ptr<ThreadStack> m_stack;
+    ThreadStack* m_previous = nullptr;
+  };
+
+private:
+  explicit Profiler(std::string const& path);
+
+  // The stack of the current thread or fiber, if it has one of this profiler.
+  ThreadStack* threadStack();
+  // Charges the ticks since the last change to the stack of the current thread.
+  void sample(ThreadStack& stack);
+  void write() noexcept;
+
+  std::string m_path;
+  uint64_t m_id;
+
+  std::atomic<uint64_t> m_ticks{0};
+  std::mutex m_tickerMutex;
+  std::condition_variable m_tickerStop;
+  bool m_stopping = false;
+  std::thread m_ticker;
+
+  std::mutex m_mutex;
+  std::unordered_map<std::string, uint32_t> m_frameIds;
+  std::vector<std::string> m_frameNames;
+  std::map<std::vector<uint32_t>, uint64_t> m_samples;
+
+  static thread_local FiberLocal<Profiler> s_current;
+  static thread_local FiberLocal<ThreadStack> s_stack;
+};
+
+}
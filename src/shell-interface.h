@@ -24,6 +24,8 @@
 #include <wasm.h>
 #include <wasm-interpreter.h>
 
+#include "huge-pages.h"
+
 namespace wasm {
 
 struct ExitException {};
@@ -40,17 +42,31 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
   class Memory {
     // Use char because it doesn't run afoul of aliasing rules.
     std::vector<char> memory;
+    // Replaces the vector once the memory spans a huge page and huge pages
+    // are enabled, so that it can be backed by them.
+    hera::PageMapping mapping;
+    char* memoryData = nullptr;
+    size_t memorySize = 0;
+    // The most the memory may grow to, which bounds what the mapping reserves
+    // (see hera::PageMapping::reservation()).
+    size_t maxSize = 0;
     template <typename T>
     static bool aligned(const char* address) {
       static_assert(!(sizeof(T) & (sizeof(T) - 1)), "must be a power of 2");
       return 0 == (reinterpret_cast<uintptr_t>(address) & (sizeof(T) - 1));
     }
+    static bool hugePagesEnabled() {
+      hera::HugePages* hugePages = hera::HugePages::current();
+      return hugePages && hugePages->mode() != hera::HugePages::Mode::Off;
+    }
     Memory(Memory&) = delete;
     Memory& operator=(const Memory&) = delete;
 
    public:
     Memory() {}
-    size_t size() const { return memory.size(); }
+    size_t size() const { return memorySize; }
+    char* data() { return memoryData; }
+    void setMaxSize(size_t size) { maxSize = size; }
     void resize(size_t newSize) {
       // Ensure the smallest allocation is large enough that most allocators
       // will provide page-aligned storage. This hopefully allows the
@@ -59,37 +75,99 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
       //
       // The code is optimistic this will work until WG21's p0035r0 happens.
       const size_t minSize = 1 << 12;
-      size_t oldSize = memory.size();
-      memory.resize(std::max(minSize, newSize));
-      if (newSize < oldSize && newSize < minSize) {
-        std::memset(&memory[newSize], 0, minSize - newSize);
+      size_t oldSize = memorySize;
+      size_t allocation = std::max(minSize, newSize);
+      if (mapping.data() || (allocation >= hera::HugePages::pageSize && hugePagesEnabled())) {
+        size_t limit = std::max(allocation, maxSize);
+        if (!mapping.data()) {
+          // Copied from the vector once. The mapping grows in place within
+          // its reservation and is only moved past it.
+          hera::PageMapping grown(allocation, hera::PageMapping::reservation(allocation, limit));
+          std::memcpy(grown.data(), memoryData, oldSize);
+          mapping = std::move(grown);
+          std::vector<char>().swap(memory);
+        } else if (!mapping.resize(allocation, limit)) {
+          throw std::bad_alloc();
+        }
+        memoryData = reinterpret_cast<char*>(mapping.data());
+        if (newSize < oldSize) {
+          std::memset(memoryData + newSize, 0, oldSize - newSize);
+        }
+      } else {
+        memory.resize(allocation);
+        if (newSize < oldSize && newSize < minSize) {
+          std::memset(&memory[newSize], 0, minSize - newSize);
+        }
+        memoryData = memory.data();
       }
+      memorySize = allocation;
     }
     template <typename T>
     void set(size_t address, T value) {
-      if (aligned<T>(&memory[address])) {
-        *reinterpret_cast<T*>(&memory[address]) = value;
+      if (aligned<T>(&memoryData[address])) {
+        *reinterpret_cast<T*>(&memoryData[address]) = value;
       } else {
-        std::memcpy(&memory[address], &value, sizeof(T));
+        std::memcpy(&memoryData[address], &value, sizeof(T));
       }
     }
     template <typename T>
     T get(size_t address) {
-      if (aligned<T>(&memory[address])) {
-        return *reinterpret_cast<T*>(&memory[address]);
+      if (aligned<T>(&memoryData[address])) {
+        return *reinterpret_cast<T*>(&memoryData[address]);
       } else {
         T loaded;
-        std::memcpy(&loaded, &memory[address], sizeof(T));
+        std::memcpy(&loaded, &memoryData[address], sizeof(T));
         return loaded;
       }
     }
   } memory;
 
-  std::vector<Name> table;
+  // Table elements are resolved to their function once, at instantiation,
+  // and called without looking the function up by name again (see
+  // cmake/binaryen.patch). call_indirect passes the name of the type it
+  // expects, which is that of the function when the types match, so that
+  // type checking it takes a single comparison.
+  struct TableEntry {
+    Function* func = nullptr;
+    Name type;
+  };
+
+  std::vector<TableEntry> table;
+
+  // An element of a table resolved by resolveTable() which is empty.
+  enum : Index { noFunction = Index(-1) };
 
   ShellExternalInterface() : memory() {}
 
+  // Resolves the table of @wasm to the index into Module::functions of each
+  // element, so that instances of the module need not look them up by name.
+  // Returns false if a segment offset is not a constant, which makes the
+  // table depend on the instance.
+  static bool resolveTable(Module const& wasm, std::vector<Index>& resolved) {
+    std::map<Name, Index> indices;
+    for (Index i = 0; i < wasm.functions.size(); ++i) {
+      indices[wasm.functions[i]->name] = i;
+    }
+    resolved.assign(wasm.table.initial, noFunction);
+    for (auto const& segment : wasm.table.segments) {
+      auto* offset = segment.offset->dynCast<Const>();
+      if (!offset) return false;
+      size_t start = static_cast<uint32_t>(offset->value.geti32());
+      if (start + segment.data.size() > resolved.size()) return false;
+      for (size_t i = 0; i != segment.data.size(); ++i) {
+        auto it = indices.find(segment.data[i]);
+        resolved[start + i] = it != indices.end() ? it->second : noFunction;
+      }
+    }
+    return true;
+  }
+
+  // Builds the table of the next instance from @resolved, as returned by
+  // resolveTable() for its module.
+  void useResolvedTable(std::vector<Index> const* resolved) { resolvedTable = resolved; }
+
   void init(Module& wasm, ModuleInstance& instance) override {
+    memory.setMaxSize(size_t(wasm.memory.max) * wasm::Memory::kPageSize);
     memory.resize(wasm.memory.initial * wasm::Memory::kPageSize);
     // apply memory segments
     for (auto& segment : wasm.memory.segments) {
@@ -100,12 +178,21 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
       }
     }
 
+    table.clear();
+    if (resolvedTable) {
+      table.resize(resolvedTable->size());
+      for (size_t i = 0; i != table.size(); ++i) {
+        Index index = (*resolvedTable)[i];
+        if (index != noFunction) setTableEntry(table[i], wasm.functions[index].get());
+      }
+      return;
+    }
     table.resize(wasm.table.initial);
     for (auto& segment : wasm.table.segments) {
       Address offset = static_cast<uint32_t>(ConstantExpressionRunner<TrivialGlobalManager>(instance.globals).visit(segment.offset).value.geti32());
       assert(offset + segment.data.size() <= wasm.table.initial);
       for (size_t i = 0; i != segment.data.size(); ++i) {
-        table[offset + i] = segment.data[i];
+        setTableEntry(table[offset + i], wasm.getFunctionOrNull(segment.data[i]));
       }
     }
   }
@@ -123,9 +210,21 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
     return Literal();
   }
 
+  Literal callTable(Index index, Name type, LiteralList& arguments, Type result, ModuleInstance& instance) override {
+    if (index < table.size()) {
+      TableEntry const& entry = table[index];
+      if (entry.func && !entry.type.isNull() && entry.type == type) {
+        return instance.callFunctionInternal(entry.func, arguments);
+      }
+    }
+    // Slow path, only taken on a mismatch or for functions of equal types
+    // declared apart.
+    return callTable(index, arguments, result, instance);
+  }
+
   Literal callTable(Index index, LiteralList& arguments, Type result, ModuleInstance& instance) override {
     if (index >= table.size()) trap("callTable overflow");
-    auto* func = instance.wasm.getFunctionOrNull(table[index]);
+    auto* func = table[index].func;
     if (!func) trap("uninitialized table element");
     if (func->params.size() != arguments.size()) trap("callIndirect: bad # of arguments");
     for (size_t i = 0; i < func->params.size(); i++) {
@@ -136,7 +235,7 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
     if (func->result != result) {
       trap("callIndirect: bad result type");
     }
-    return instance.callFunctionInternal(func->name, arguments);
+    return instance.callFunctionInternal(func, arguments);
   }
 
   int8_t load8s(Address addr) override { return memory.get<int8_t>(addr); }
@@ -161,6 +260,14 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
     std::cerr << "[trap " << why << "]\n";
     throw TrapException();
   }
+
+ private:
+  static void setTableEntry(TableEntry& entry, Function* func) {
+    entry.func = func;
+    entry.type = func ? func->type : Name();
+  }
+
+  std::vector<Index> const* resolvedTable = nullptr;
 };
 
 }
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "static-call-cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "helpers.h"
+
+using namespace std;
+
+namespace hera {
+
+namespace {
+
+template <typename T>
+void appendBytes(vector<uint8_t>& out, T const& value)
+{
+  uint8_t const* bytes = reinterpret_cast<uint8_t const*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+vector<uint8_t> bytesOf(T const& value)
+{
+  vector<uint8_t> ret;
+  appendBytes(ret, value);
+  return ret;
+}
+
+// The fields in the TxContextField mask @fields, one by one, so that struct
+// padding never takes part in a comparison.
+vector<uint8_t> bytesOf(evmc_tx_context const& value, uint32_t fields)
+{
+  vector<uint8_t> ret;
+  if (fields & TxGasPrice)
+    appendBytes(ret, value.tx_gas_price);
+  if (fields & TxOrigin)
+    appendBytes(ret, value.tx_origin);
+  if (fields & BlockCoinbase)
+    appendBytes(ret, value.block_coinbase);
+  if (fields & BlockNumber)
+    appendBytes(ret, value.block_number);
+  if (fields & BlockTimestamp)
+    appendBytes(ret, value.block_timestamp);
+  if (fields & BlockGasLimit)
+    appendBytes(ret, value.block_gas_limit);
+  if (fields & BlockDifficulty)
+    appendBytes(ret, value.block_difficulty);
+  return ret;
+}
+
+// Runs the host query described by @read and returns its value.
+vector<uint8_t> query(evmc_context* context, HostRead const& read)
+{
+  switch (read.kind) {
+  case HostRead::Kind::AccountExists:
+    return bytesOf(context->host->account_exists(context, &read.address));
+  case HostRead::Kind::Storage:
+    return bytesOf(context->host->get_storage(context, &read.address, &read.key));
+  case HostRead::Kind::Balance:
+    return bytesOf(context->host->get_balance(context, &read.address));
+  case HostRead::Kind::CodeSize:
+    return bytesOf(context->host->get_code_size(context, &read.address));
+  case HostRead::Kind::CodeHash:
+    return bytesOf(context->host->get_code_hash(context, &read.address));
+  case HostRead::Kind::Code: {
+    vector<uint8_t> buffer(read.size);
+    size_t copied = context->host->copy_code(context, &read.address, static_cast<size_t>(read.number), buffer.data(), buffer.size());
+    buffer.resize(copied);
+    return buffer;
+  }
+  case HostRead::Kind::TxContext:
+    return bytesOf(context->host->get_tx_context(context), static_cast<uint32_t>(read.number));
+  case HostRead::Kind::BlockHash:
+    return bytesOf(context->host->get_block_hash(context, read.number));
+  }
+  return {};
+}
+
+}
+
+constexpr size_t StaticCallCache::maxEntries;
+
+bool StaticCallCache::collectReads(vector<HostEvent> const& events, uint32_t txContextRead, vector<HostRead>& reads)
+{
+  reads.reserve(events.size());
+  for (HostEvent const& event: events) {
+    switch (event.type) {
+    case HostEventType::AccountExists: {
+      HostRead read(HostRead::Kind::AccountExists);
+      read.address = event.address;
+      read.value = bytesOf(event.status != 0);
+      reads.push_back(move(read));
+      break;
+    }
+    case HostEventType::GetStorage: {
+      HostRead read(HostRead::Kind::Storage);
+      read.address = event.address;
+      read.key = event.key;
+      read.value = bytesOf(event.value);
+      reads.push_back(move(read));
+      break;
+    }
+    case HostEventType::GetBalance: {
+      HostRead read(HostRead::Kind::Balance);
+      read.address = event.address;
+      read.value = bytesOf(event.value);
+      reads.push_back(move(read));
+      break;
+    }
+    case HostEventType::GetCodeSize: {
+      HostRead read(HostRead::Kind::CodeSize);
+      read.address = event.address;
+      read.value = bytesOf(static_cast<size_t>(event.size));
+      reads.push_back(move(read));
+      break;
+    }
+    case HostEventType::GetCodeHash: {
+      HostRead read(HostRead::Kind::CodeHash);
+      read.address = event.address;
+      read.value = bytesOf(event.value);
+      reads.push_back(move(read));
+      break;
+    }
+    case HostEventType::CopyCode: {
+      HostRead read(HostRead::Kind::Code);
+      read.address = event.address;
+      read.number = event.number;
+      read.size = static_cast<size_t>(event.size);
+      read.value = event.data;
+      reads.push_back(move(read));
+      break;
+    }
+    case HostEventType::GetTxContext: {
+      // Once is enough, the context does not change during the execution.
+      if (txContextRead == 0)
+        break;
+      HostRead read(HostRead::Kind::TxContext);
+      read.number = txContextRead;
+      read.value = bytesOf(event.txContext, txContextRead);
+      reads.push_back(move(read));
+      txContextRead = 0;
+      break;
+    }
+    case HostEventType::GetBlockHash: {
+      HostRead read(HostRead::Kind::BlockHash);
+      read.number = event.number;
+      read.value = bytesOf(event.value);
+      reads.push_back(move(read));
+      break;
+    }
+    case HostEventType::SetStorage:
+    case HostEventType::SelfDestruct:
+    case HostEventType::EmitLog:
+    // The reads of the callee are not visible here.
+    case HostEventType::Call:
+      return false;
+    }
+  }
+  return true;
+}
+
+StaticCallCache::Key StaticCallCache::makeKey(evmc_revision rev, evmc_message const& msg, uint8_t const* code, size_t code_size)
+{
+  Key key;
+  key.rev = rev;
+  key.kind = msg.kind;
+  key.destination = msg.destination;
+  key.sender = msg.sender;
+  key.value = msg.value;
+  key.codeHash = hashBytes(code, code_size);
+  key.inputHash = hashBytes(msg.input_data, msg.input_size);
+  return key;
+}
+
+bool StaticCallCache::Key::operator==(Key const& other) const
+{
+  return rev == other.rev && kind == other.kind &&
+    memcmp(destination.bytes, other.destination.bytes, sizeof(destination.bytes)) == 0 &&
+    memcmp(sender.bytes, other.sender.bytes, sizeof(sender.bytes)) == 0 &&
+    memcmp(value.bytes, other.value.bytes, sizeof(value.bytes)) == 0 &&
+    codeHash == other.codeHash && inputHash == other.inputHash;
+}
+
+size_t StaticCallCache::KeyHash::operator()(Key const& key) const
+{
+  // The callee and the caller tell apart most calls to the same contract.
+  uint64_t hash = hashBytes(key.destination.bytes, sizeof(key.destination.bytes), key.codeHash ^ key.inputHash);
+  hash = hashBytes(key.sender.bytes, sizeof(key.sender.bytes), hash);
+  return static_cast<size_t>(hash);
+}
+
+StaticCallCache::StaticCallCache(MemoryBudget* budget):
+  m_account(budget, "static-call-cache", this)
+{
+}
+
+shared_ptr<const StaticCallCache::Entry> StaticCallCache::lookup(Key const& key, evmc_message const& msg, uint8_t const* code, size_t code_size, evmc_context* context)
+{
+  shared_ptr<const Entry> entry;
+  uint64_t id;
+  {
+    lock_guard<mutex> lock(m_mutex);
+    ++m_lookups;
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || !matches(it->second, msg, code, code_size))
+      return nullptr;
+    entry = it->second.entry;
+    if (entry->gasLeftRead ? msg.gas != entry->gas : msg.gas < entry->gasRequired)
+      return nullptr;
+    id = it->second.id;
+  }
+
+  // Validate outside of the lock, this calls back into the host.
+  if (!validate(*entry, context))
+    return nullptr;
+
+  lock_guard<mutex> lock(m_mutex);
+  auto it = m_entries.find(key);
+  if (it != m_entries.end() && it->second.id == id)
+    ++it->second.hits;
+  return entry;
+}
+
+void StaticCallCache::store(Key const& key, evmc_message const& msg, uint8_t const* code, size_t code_size, Entry entry, double nanoseconds)
+{
+  Slot fresh{
+    vector<uint8_t>(code, code + code_size),
+    vector<uint8_t>(msg.input_data, msg.input_data + msg.input_size),
+    make_shared<const Entry>(move(entry)),
+    0, 0, nanoseconds, 0, 0
+  };
+  size_t bytes = footprint(fresh);
+  {
+    lock_guard<mutex> lock(m_mutex);
+    if (m_entries.size() >= maxEntries) {
+      for (auto const& slot: m_entries)
+        m_account.release(slot.second.bytes);
+      m_entries.clear();
+      m_keys.clear();
+    }
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+      m_account.release(it->second.bytes);
+      m_keys.erase(it->second.id);
+      m_entries.erase(it);
+    }
+    uint64_t id = m_nextId++;
+    fresh.id = id;
+    fresh.bytes = bytes;
+    fresh.lookupsBefore = m_lookups;
+    it = m_entries.emplace(key, move(fresh)).first;
+    try {
+      m_keys.emplace(id, key);
+    } catch (...) {
+      m_entries.erase(it);
+      throw;
+    }
+  }
+  // Outside of the lock, this may evict.
+  m_account.charge(bytes);
+}
+
+bool StaticCallCache::matches(Slot const& slot, evmc_message const& msg, uint8_t const* code, size_t code_size)
+{
+  return slot.code.size() == code_size && equal(code, code + code_size, slot.code.begin()) &&
+    slot.input.size() == msg.input_size && equal(msg.input_data, msg.input_data + msg.input_size, slot.input.begin());
+}
+
+size_t StaticCallCache::footprint(Slot const& slot)
+{
+  size_t bytes = sizeof(Key) + sizeof(Slot) + sizeof(Entry) + slot.code.size() + slot.input.size() + slot.entry->output.size();
+  for (auto const& read: slot.entry->reads)
+    bytes += sizeof(HostRead) + read.value.size();
+  return bytes;
+}
+
+void StaticCallCache::candidates(vector<MemoryBudget::Candidate>& out)
+{
+  lock_guard<mutex> lock(m_mutex);
+  for (auto const& entry: m_entries) {
+    Slot const& slot = entry.second;
+    // Counting one hit more keeps the build time of unused entries apart.
+    double hitRate = static_cast<double>(slot.hits + 1) / static_cast<double>(m_lookups - slot.lookupsBefore + 1);
+    out.push_back(MemoryBudget::Candidate{slot.id, slot.bytes, slot.nanoseconds * hitRate});
+  }
+}
+
+void StaticCallCache::evict(uint64_t id) noexcept
+{
+  lock_guard<mutex> lock(m_mutex);
+  auto key = m_keys.find(id);
+  if (key == m_keys.end())
+    return;
+  auto it = m_entries.find(key->second);
+  m_account.release(it->second.bytes);
+  m_entries.erase(it);
+  m_keys.erase(key);
+}
+
+bool StaticCallCache::validate(Entry const& entry, evmc_context* context)
+{
+  for (auto const& read: entry.reads)
+    if (query(context, read) != read.value)
+      return false;
+  return true;
+}
+
+}
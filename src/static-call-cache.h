@@ -0,0 +1,149 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <evmc/evmc.h>
+
+#include "host-recording.h"
+#include "memory-budget.h"
+
+namespace hera {
+
+// A value read from the host, together with the query which produced it.
+struct HostRead {
+  enum class Kind {
+    AccountExists,
+    Storage,
+    Balance,
+    CodeSize,
+    CodeHash,
+    Code,
+    TxContext,
+    BlockHash
+  };
+
+  explicit HostRead(Kind _kind): kind(_kind) {}
+
+  Kind kind;
+  evmc_address address{};
+  evmc_bytes32 key{};
+  // The block number or code offset of the query, or the TxContextField mask
+  // of the transaction context fields read.
+  int64_t number = 0;
+  // The buffer size of a code copy.
+  size_t size = 0;
+  std::vector<uint8_t> value;
+};
+
+// Results of static calls, keyed by everything the execution depends on
+// apart from the host state and the gas. The code and input are only hashed
+// into the key, an entry keeps them to settle collisions. The host state an
+// entry depends on is kept as its read set, which must still hold before the
+// entry is reused. An entry serves any message with at least the gas it
+// requires, unless the execution read the gas left.
+//
+// Entries are accounted as "static-call-cache" in the memory budget, valued
+// by the time the execution took.
+class StaticCallCache : private MemoryBudget::Evictor {
+public:
+  struct Entry {
+    evmc_status_code status;
+    int64_t gasUsed;
+    // The least starting gas with the same outcome.
+    int64_t gasRequired;
+    // If the execution read the gas left, only messages with its gas can
+    // reuse the entry.
+    bool gasLeftRead;
+    int64_t gas;
+    std::vector<uint8_t> output;
+    std::vector<HostRead> reads;
+  };
+
+  struct Key {
+    evmc_revision rev;
+    evmc_call_kind kind;
+    evmc_address destination;
+    evmc_address sender;
+    evmc_uint256be value;
+    uint64_t codeHash;
+    uint64_t inputHash;
+
+    bool operator==(Key const& other) const;
+  };
+
+  explicit StaticCallCache(MemoryBudget* budget = nullptr);
+
+  static Key makeKey(evmc_revision rev, evmc_message const& msg, uint8_t const* code, size_t code_size);
+  // Collects the reads among the host callbacks of an execution, recorded
+  // by a RecordingHost. Returns false if the execution cannot be cached,
+  // because anything had a side effect or ran other code. Of the transaction
+  // context, only the fields in the TxContextField mask @txContextRead are
+  // taken.
+  static bool collectReads(std::vector<HostEvent> const& events, uint32_t txContextRead, std::vector<HostRead>& reads);
+
+  // Returns the entry for the message if it has enough gas and the read set
+  // is unchanged in @context, nullptr otherwise. @key is made from the same arguments.
+  std::shared_ptr<const Entry> lookup(Key const& key, evmc_message const& msg, uint8_t const* code, size_t code_size, evmc_context* context);
+  // @nanoseconds is the time the execution took.
+  void store(Key const& key, evmc_message const& msg, uint8_t const* code, size_t code_size, Entry entry, double nanoseconds);
+
+private:
+  // The cache is cleared once it grows beyond this.
+  static constexpr size_t maxEntries = 4096;
+
+  struct KeyHash {
+    size_t operator()(Key const& key) const;
+  };
+
+  struct Slot {
+    // To settle collisions of the hashes.
+    std::vector<uint8_t> code;
+    std::vector<uint8_t> input;
+    std::shared_ptr<const Entry> entry;
+    uint64_t id;
+    size_t bytes;
+    double nanoseconds;
+    uint64_t hits;
+    // The number of lookups before it was stored.
+    uint64_t lookupsBefore;
+  };
+
+  static bool validate(Entry const& entry, evmc_context* context);
+  static bool matches(Slot const& slot, evmc_message const& msg, uint8_t const* code, size_t code_size);
+  static size_t footprint(Slot const& slot);
+
+  void candidates(std::vector<MemoryBudget::Candidate>& out) override;
+  void evict(uint64_t id) noexcept override;
+
+  std::mutex m_mutex;
+  // Another entry with the same key replaces it.
+  std::unordered_map<Key, Slot, KeyHash> m_entries;
+  // The key of every entry by its id.
+  std::unordered_map<uint64_t, Key> m_keys;
+  uint64_t m_nextId = 0;
+  uint64_t m_lookups = 0;
+
+  // Last, so that the budget stops evicting before the entries go.
+  MemoryBudget::Account m_account;
+};
+
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "uint256.h"
+
+#include <algorithm>
+
+namespace hera {
+
+namespace {
+
+unsigned significantLimbs(uint64_t const* x, unsigned length)
+{
+  while (length > 0 && x[length - 1] == 0)
+    --length;
+  return length;
+}
+
+// Long division of @u (@m limbs) by @v (@n limbs), following Knuth's
+// algorithm D. Requires m >= n >= 1 and v[n - 1] != 0. Writes m - n + 1
+// limbs of quotient to @q (if not null) and n limbs of remainder to @r.
+void divideLimbs(uint64_t const* u, unsigned m, uint64_t const* v, unsigned n, uint64_t* q, uint64_t* r)
+{
+  if (n == 1) {
+    unsigned __int128 rem = 0;
+    for (unsigned i = m; i-- > 0;) {
+      unsigned __int128 cur = (rem << 64) | u[i];
+      if (q)
+        q[i] = static_cast<uint64_t>(cur / v[0]);
+      rem = cur % v[0];
+    }
+    r[0] = static_cast<uint64_t>(rem);
+    return;
+  }
+
+  // Normalise so that the top bit of the divisor is set.
+  unsigned shift = static_cast<unsigned>(__builtin_clzll(v[n - 1]));
+  uint64_t vn[8];
+  uint64_t un[17];
+  for (unsigned i = n - 1; i > 0; --i)
+    vn[i] = (v[i] << shift) | (shift ? v[i - 1] >> (64 - shift) : 0);
+  vn[0] = v[0] << shift;
+  un[m] = shift ? u[m - 1] >> (64 - shift) : 0;
+  for (unsigned i = m - 1; i > 0; --i)
+    un[i] = (u[i] << shift) | (shift ? u[i - 1] >> (64 - shift) : 0);
+  un[0] = u[0] << shift;
+
+  const unsigned __int128 base = static_cast<unsigned __int128>(1) << 64;
+  for (unsigned j = m - n + 1; j-- > 0;) {
+    unsigned __int128 numerator = (static_cast<unsigned __int128>(un[j + n]) << 64) | un[j + n - 1];
+    unsigned __int128 qhat = numerator / vn[n - 1];
+    unsigned __int128 rhat = numerator % vn[n - 1];
+    while (qhat >= base || qhat * vn[n - 2] > ((rhat << 64) | un[j + n - 2])) {
+      --qhat;
+      rhat += vn[n - 1];
+      if (rhat >= base)
+        break;
+    }
+
+    // Multiply and subtract.
+    __int128 borrow = 0;
+    __int128 t;
+    for (unsigned i = 0; i < n; ++i) {
+      unsigned __int128 p = qhat * vn[i];
+      t = static_cast<__int128>(un[i + j]) - borrow - static_cast<__int128>(static_cast<uint64_t>(p));
+      un[i + j] = static_cast<uint64_t>(t);
+      borrow = static_cast<__int128>(p >> 64) - (t >> 64);
+    }
+    t = static_cast<__int128>(un[j + n]) - borrow;
+    un[j + n] = static_cast<uint64_t>(t);
+
+    if (t < 0) {
+      // Subtracted one too many, add it back.
+      --qhat;
+      unsigned __int128 carry = 0;
+      for (unsigned i = 0; i < n; ++i) {
+        carry += static_cast<unsigned __int128>(un[i + j]) + vn[i];
+        un[i + j] = static_cast<uint64_t>(carry);
+        carry >>= 64;
+      }
+      un[j + n] += static_cast<uint64_t>(carry);
+    }
+    if (q)
+      q[j] = static_cast<uint64_t>(qhat);
+  }
+
+  for (unsigned i = 0; i + 1 < n; ++i)
+    r[i] = (un[i] >> shift) | (shift ? un[i + 1] << (64 - shift) : 0);
+  r[n - 1] = un[n - 1] >> shift;
+}
+
+// Reduces the number in @x (@length limbs) modulo @mod, which must not be zero.
+uint256 reduce(uint64_t const* x, unsigned length, uint256 const& mod)
+{
+  unsigned m = significantLimbs(x, length);
+  unsigned n = significantLimbs(mod.w, 4);
+  uint256 r = makeUint256(0);
+  if (m < n) {
+    std::copy_n(x, m, r.w);
+  } else {
+    divideLimbs(x, m, mod.w, n, nullptr, r.w);
+  }
+  return r;
+}
+
+}
+
+uint256 shiftLeft(uint256 const& a, unsigned shift)
+{
+  if (shift >= 256)
+    return makeUint256(0);
+  uint256 ret = makeUint256(0);
+  unsigned limbs = shift / 64;
+  unsigned bits = shift % 64;
+  for (unsigned i = limbs; i < 4; ++i) {
+    ret.w[i] = a.w[i - limbs] << bits;
+    if (bits && i > limbs)
+      ret.w[i] |= a.w[i - limbs - 1] >> (64 - bits);
+  }
+  return ret;
+}
+
+uint256 shiftRight(uint256 const& a, unsigned shift)
+{
+  if (shift >= 256)
+    return makeUint256(0);
+  uint256 ret = makeUint256(0);
+  unsigned limbs = shift / 64;
+  unsigned bits = shift % 64;
+  for (unsigned i = 0; i + limbs < 4; ++i) {
+    ret.w[i] = a.w[i + limbs] >> bits;
+    if (bits && i + limbs + 1 < 4)
+      ret.w[i] |= a.w[i + limbs + 1] << (64 - bits);
+  }
+  return ret;
+}
+
+void divide(uint256 const& a, uint256 const& b, uint256* quotient, uint256* remainder)
+{
+  unsigned m = significantLimbs(a.w, 4);
+  unsigned n = significantLimbs(b.w, 4);
+  uint256 q = makeUint256(0);
+  uint256 r = makeUint256(0);
+  if (m < n) {
+    r = a;
+  } else {
+    divideLimbs(a.w, m, b.w, n, q.w, r.w);
+  }
+  if (quotient)
+    *quotient = q;
+  if (remainder)
+    *remainder = r;
+}
+
+uint256 addMod(uint256 const& a, uint256 const& b, uint256 const& mod)
+{
+  uint64_t sum[5];
+  unsigned __int128 carry = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    carry += static_cast<unsigned __int128>(a.w[i]) + b.w[i];
+    sum[i] = static_cast<uint64_t>(carry);
+    carry >>= 64;
+  }
+  sum[4] = static_cast<uint64_t>(carry);
+  return reduce(sum, 5, mod);
+}
+
+uint256 mulMod(uint256 const& a, uint256 const& b, uint256 const& mod)
+{
+  uint64_t product[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  for (unsigned i = 0; i < 4; ++i) {
+    unsigned __int128 carry = 0;
+    for (unsigned j = 0; j < 4; ++j) {
+      carry += static_cast<unsigned __int128>(a.w[i]) * b.w[j] + product[i + j];
+      product[i + j] = static_cast<uint64_t>(carry);
+      carry >>= 64;
+    }
+    product[i + 4] = static_cast<uint64_t>(carry);
+  }
+  return reduce(product, 8, mod);
+}
+
+uint256 exp(uint256 base, uint256 const& exponent)
+{
+  uint256 ret = makeUint256(1);
+  for (unsigned i = 0; i < 4; ++i) {
+    uint64_t bits = exponent.w[i];
+    for (unsigned j = 0; j < 64; ++j) {
+      if (bits & 1)
+        ret = ret * base;
+      bits >>= 1;
+      if (!bits && significantLimbs(exponent.w, 4) <= i + 1)
+        return ret;
+      base = base * base;
+    }
+  }
+  return ret;
+}
+
+unsigned byteLength(uint256 const& a)
+{
+  unsigned limbs = significantLimbs(a.w, 4);
+  if (limbs == 0)
+    return 0;
+  return (limbs - 1) * 8 + (64 - static_cast<unsigned>(__builtin_clzll(a.w[limbs - 1])) + 7) / 8;
+}
+
+uint256 fromBigEndian(uint8_t const* bytes, size_t length)
+{
+  uint256 ret = makeUint256(0);
+  for (size_t i = 0; i < length; ++i) {
+    size_t bit = 8 * (length - 1 - i);
+    ret.w[bit / 64] |= static_cast<uint64_t>(bytes[i]) << (bit % 64);
+  }
+  return ret;
+}
+
+void toBigEndian(uint256 const& a, uint8_t* bytes)
+{
+  for (size_t i = 0; i < 32; ++i) {
+    size_t bit = 8 * (31 - i);
+    bytes[i] = static_cast<uint8_t>(a.w[bit / 64] >> (bit % 64));
+  }
+}
+
+}
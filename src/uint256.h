@@ -0,0 +1,143 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hera {
+
+// 256-bit arithmetic on EVM words, for the EVM1 interpreter.
+
+// An EVM word, least significant limb first.
+struct uint256 {
+  uint64_t w[4];
+};
+
+inline uint256 makeUint256(uint64_t value) { return uint256{{value, 0, 0, 0}}; }
+
+inline bool isZero(uint256 const& a) { return (a.w[0] | a.w[1] | a.w[2] | a.w[3]) == 0; }
+
+inline bool isNegative(uint256 const& a) { return (a.w[3] >> 63) != 0; }
+
+inline bool fitsUint64(uint256 const& a) { return (a.w[1] | a.w[2] | a.w[3]) == 0; }
+
+inline bool operator==(uint256 const& a, uint256 const& b)
+{
+  return a.w[0] == b.w[0] && a.w[1] == b.w[1] && a.w[2] == b.w[2] && a.w[3] == b.w[3];
+}
+
+inline bool operator<(uint256 const& a, uint256 const& b)
+{
+  for (int i = 3; i >= 0; --i)
+    if (a.w[i] != b.w[i])
+      return a.w[i] < b.w[i];
+  return false;
+}
+
+inline bool signedLess(uint256 a, uint256 b)
+{
+  a.w[3] ^= uint64_t(1) << 63;
+  b.w[3] ^= uint64_t(1) << 63;
+  return a < b;
+}
+
+inline uint256 operator+(uint256 const& a, uint256 const& b)
+{
+  uint256 ret;
+  unsigned __int128 carry = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    carry += static_cast<unsigned __int128>(a.w[i]) + b.w[i];
+    ret.w[i] = static_cast<uint64_t>(carry);
+    carry >>= 64;
+  }
+  return ret;
+}
+
+inline uint256 operator-(uint256 const& a, uint256 const& b)
+{
+  uint256 ret;
+  uint64_t borrow = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    uint64_t d = a.w[i] - b.w[i];
+    uint64_t borrowOut = (a.w[i] < b.w[i]) || (d < borrow);
+    ret.w[i] = d - borrow;
+    borrow = borrowOut;
+  }
+  return ret;
+}
+
+inline uint256 operator*(uint256 const& a, uint256 const& b)
+{
+  uint64_t r[4] = {0, 0, 0, 0};
+  for (unsigned i = 0; i < 4; ++i) {
+    unsigned __int128 carry = 0;
+    for (unsigned j = 0; i + j < 4; ++j) {
+      carry += static_cast<unsigned __int128>(a.w[i]) * b.w[j] + r[i + j];
+      r[i + j] = static_cast<uint64_t>(carry);
+      carry >>= 64;
+    }
+  }
+  return uint256{{r[0], r[1], r[2], r[3]}};
+}
+
+inline uint256 operator&(uint256 const& a, uint256 const& b)
+{
+  return uint256{{a.w[0] & b.w[0], a.w[1] & b.w[1], a.w[2] & b.w[2], a.w[3] & b.w[3]}};
+}
+
+inline uint256 operator|(uint256 const& a, uint256 const& b)
+{
+  return uint256{{a.w[0] | b.w[0], a.w[1] | b.w[1], a.w[2] | b.w[2], a.w[3] | b.w[3]}};
+}
+
+inline uint256 operator^(uint256 const& a, uint256 const& b)
+{
+  return uint256{{a.w[0] ^ b.w[0], a.w[1] ^ b.w[1], a.w[2] ^ b.w[2], a.w[3] ^ b.w[3]}};
+}
+
+inline uint256 operator~(uint256 const& a)
+{
+  return uint256{{~a.w[0], ~a.w[1], ~a.w[2], ~a.w[3]}};
+}
+
+inline uint256 negate(uint256 const& a) { return makeUint256(0) - a; }
+
+// Shifts by @shift bits, zero from 256 on.
+uint256 shiftLeft(uint256 const& a, unsigned shift);
+uint256 shiftRight(uint256 const& a, unsigned shift);
+
+// Divides @a by @b, which must not be zero. Either result may be null.
+void divide(uint256 const& a, uint256 const& b, uint256* quotient, uint256* remainder);
+
+// (@a + @b) % @mod and (@a * @b) % @mod with the intermediate result in full
+// width. @mod must not be zero.
+uint256 addMod(uint256 const& a, uint256 const& b, uint256 const& mod);
+uint256 mulMod(uint256 const& a, uint256 const& b, uint256 const& mod);
+
+// @base to the power of @exponent, modulo 2^256.
+uint256 exp(uint256 base, uint256 const& exponent);
+
+// The number of bytes needed to represent @a.
+unsigned byteLength(uint256 const& a);
+
+// Reads @length bytes, at most 32, most significant first.
+uint256 fromBigEndian(uint8_t const* bytes, size_t length);
+// Writes the 32 bytes of @a, most significant first.
+void toBigEndian(uint256 const& a, uint8_t* bytes);
+
+}
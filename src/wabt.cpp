@@ -34,13 +34,18 @@
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
+#include "memory-budget.h"
+#include "probes.h"
 
 using namespace std;
 using namespace wabt;
 
 namespace hera {
 
-class WabtEthereumInterface : public EthereumInterface {
+template <evmc_revision Revision>
+class WabtEthereumInterface : public EthereumInterface<WabtEthereumInterface<Revision>, Revision> {
+  friend class EthereumInterface<WabtEthereumInterface<Revision>, Revision>;
+
 public:
   explicit WabtEthereumInterface(
     evmc_context* _context,
@@ -49,7 +54,7 @@ public:
     ExecutionResult & _result,
     bool _meterGas
   ):
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface<WabtEthereumInterface<Revision>, Revision>(_context, _code, _msg, _result, _meterGas)
   {}
 
   // TODO: improve this design...
@@ -59,9 +64,8 @@ public:
 
 private:
   // These assume that m_wasmMemory was set prior to execution.
-  size_t memorySize() const override { return m_wasmMemory->data.size(); }
-  void memorySet(size_t offset, uint8_t value) override { m_wasmMemory->data[offset] = static_cast<char>(value); }
-  uint8_t memoryGet(size_t offset) override { return static_cast<uint8_t>(m_wasmMemory->data[offset]); }
+  size_t memorySize() const { return m_wasmMemory->data.size(); }
+  uint8_t* memoryData() { return reinterpret_cast<uint8_t*>(m_wasmMemory->data.data()); }
 
   interp::Memory* m_wasmMemory;
 };
@@ -72,6 +76,23 @@ unique_ptr<WasmEngine> WabtEngine::create()
 }
 
 ExecutionResult WabtEngine::execute(
+  evmc_context* context,
+  evmc_revision rev,
+  vector<uint8_t> const& code,
+  vector<uint8_t> const& state_code,
+  evmc_message const& msg,
+  bool meterInterfaceGas
+) {
+  switch (rev) {
+  case EVMC_BYZANTIUM:
+    return internalExecute<EVMC_BYZANTIUM>(context, code, state_code, msg, meterInterfaceGas);
+  default:
+    heraAssert(false, "Unsupported revision.");
+  }
+}
+
+template <evmc_revision Revision>
+ExecutionResult WabtEngine::internalExecute(
   evmc_context* context,
   vector<uint8_t> const& code,
   vector<uint8_t> const& state_code,
@@ -86,7 +107,7 @@ ExecutionResult WabtEngine::execute(
 
   // Set up interface to eei host functions
   ExecutionResult result;
-  WabtEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas};
+  WabtEthereumInterface<Revision> interface{context, state_code, msg, result, meterInterfaceGas};
 
   // Create host module
   // The lifecycle of this pointer is handled by `env`.
@@ -160,9 +181,9 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      // FIXME: handle host trap here
       interface.eeiFinish(args[0].get_i32(), args[1].get_i32());
-      return interp::Result::Ok;
+      // Stop the interpreter without unwinding it, see halted() below.
+      return interp::Result::TrapHostTrapped;
     }
   );
 
@@ -175,9 +196,9 @@ ExecutionResult WabtEngine::execute(
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      // FIXME: handle host trap here
       interface.eeiRevert(args[0].get_i32(), args[1].get_i32());
-      return interp::Result::Ok;
+      // Stop the interpreter without unwinding it, see halted() below.
+      return interp::Result::TrapHostTrapped;
     }
   );
 
@@ -244,8 +265,13 @@ ExecutionResult WabtEngine::execute(
   );
 
   ensureCondition(Succeeded(loadResult) && module, ContractValidationFailure, "Module failed to load.");
+  // Loading validates as well.
+  HERA_PROBE3(parse__done, ProbeScope::codeHash(), msg.gas, code.size());
+  PhaseTimer::done(ExecutionPhase::Parse);
   ensureCondition(env.GetMemoryCount() == 1, ContractValidationFailure, "Multiple memory sections exported.");
   ensureCondition(module->start_func_index == kInvalidIndex, ContractValidationFailure, "Contract contains start function.");
+  HERA_PROBE2(validate__done, ProbeScope::codeHash(), msg.gas);
+  PhaseTimer::done(ExecutionPhase::Validate);
 
   // Prepare to execute
   interp::Export* mainFunction = module->GetExport("main");
@@ -259,14 +285,18 @@ ExecutionResult WabtEngine::execute(
 
   // FIXME: really bad design
   interface.setWasmMemory(env.GetMemory(0));
+  HERA_PROBE2(instantiate__done, ProbeScope::codeHash(), msg.gas);
+  PhaseTimer::done(ExecutionPhase::Instantiate);
+  // Growth of the memory is not followed.
+  MemoryBudget* budget = MemoryBudget::current();
+  MemoryBudget::Charge instanceCharge(budget ? &budget->instances() : nullptr, code.size() + env.GetMemory(0)->data.size());
 
   // Execute main
-  try {
-    interp::ExecResult wabtResult = executor.RunExport(mainFunction, interp::TypedValues{}); // second arg is empty since no args
-  } catch (EndExecution const&) {
-    // This exception is ignored here because we consider it to be a success.
-    // It is only a clutch for POSIX style exit()
-  }
+  interp::ExecResult wabtResult = executor.RunExport(mainFunction, interp::TypedValues{}); // second arg is empty since no args
+
+  // Terminating through finish or revert is reported as a host trap, which is a success.
+  if (!interface.halted())
+    ensureCondition(wabtResult.result == interp::Result::Ok, VMTrap, interp::ResultToString(wabtResult.result));
 
   return result;
 }
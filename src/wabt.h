@@ -27,6 +27,7 @@ public:
 
   ExecutionResult execute(
     evmc_context* context,
+    evmc_revision rev,
     std::vector<uint8_t> const& code,
     std::vector<uint8_t> const& state_code,
     evmc_message const& msg,
@@ -36,6 +37,16 @@ public:
   void verifyContract(std::vector<uint8_t> const&) override {
     // TODO: implement
   }
+
+private:
+  template <evmc_revision Revision>
+  ExecutionResult internalExecute(
+    evmc_context* context,
+    std::vector<uint8_t> const& code,
+    std::vector<uint8_t> const& state_code,
+    evmc_message const& msg,
+    bool meterInterfaceGas
+  );
 };
 
 }
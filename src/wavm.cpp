@@ -15,6 +15,7 @@
  * limitations under the License.
  */
 
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <stack>
@@ -30,9 +31,13 @@
 #include "Runtime/Runtime.h"
 #include "WASM/WASM.h"
 
+#include "binaryen.h"
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
+#include "memory-budget.h"
+#include "module-cache.h"
+#include "probes.h"
 
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #pragma GCC diagnostic ignored "-Wunused-variable"
@@ -41,7 +46,46 @@ using namespace std;
 
 namespace hera {
 
-class WavmEthereumInterface : public EthereumInterface {
+// A contract rewritten by BinaryenEngine::instrumentHalting(), which WAVM
+// parsed and validated once. Rewriting takes a full parse and serialisation
+// with Binaryen, so it is done once per contract and not per execution.
+class WavmModule : public CachedModule {
+public:
+  explicit WavmModule(vector<uint8_t> _instrumented): instrumented(move(_instrumented)) {}
+
+  size_t footprint() const override { return sizeof(*this) + instrumented.capacity(); }
+
+  vector<uint8_t> const instrumented;
+};
+
+// The intrinsics below are plain functions shared by every revision, so they
+// reach the revision specific interface through this thin virtual layer.
+class WavmHost {
+public:
+  virtual ~WavmHost() = default;
+
+  virtual void setWasmMemory(Runtime::MemoryInstance* _wasmMemory) = 0;
+
+  virtual void useGas(int64_t gas) = 0;
+  virtual int64_t getGasLeft() = 0;
+  virtual void getAddress(uint32_t resultOffset) = 0;
+  virtual uint32_t call(int64_t gas, uint32_t addressOffset, uint32_t valueOffset, uint32_t dataOffset, uint32_t dataLength) = 0;
+  virtual void callDataCopy(uint32_t resultOffset, uint32_t dataOffset, uint32_t length) = 0;
+  virtual uint32_t getCallDataSize() = 0;
+  virtual void storageStore(uint32_t pathOffset, uint32_t valueOffset) = 0;
+  virtual void storageLoad(uint32_t pathOffset, uint32_t resultOffset) = 0;
+  virtual void codeCopy(uint32_t resultOffset, uint32_t codeOffset, uint32_t length) = 0;
+  virtual uint32_t getCodeSize() = 0;
+  virtual void finish(uint32_t offset, uint32_t size) = 0;
+  virtual void revert(uint32_t offset, uint32_t size) = 0;
+  virtual uint32_t getReturnDataSize() = 0;
+  virtual void returnDataCopy(uint32_t dataOffset, uint32_t offset, uint32_t size) = 0;
+};
+
+template <evmc_revision Revision>
+class WavmEthereumInterface : public WavmHost, EthereumInterface<WavmEthereumInterface<Revision>, Revision> {
+  friend class EthereumInterface<WavmEthereumInterface<Revision>, Revision>;
+
 public:
   explicit WavmEthereumInterface(
     evmc_context* _context,
@@ -50,18 +94,34 @@ public:
     ExecutionResult & _result,
     bool _meterGas
   ):
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
+    EthereumInterface<WavmEthereumInterface<Revision>, Revision>(_context, _code, _msg, _result, _meterGas)
   {}
 
-  void setWasmMemory(Runtime::MemoryInstance* _wasmMemory) {
+  void setWasmMemory(Runtime::MemoryInstance* _wasmMemory) override {
     m_wasmMemory = _wasmMemory;
   }
 
+  void useGas(int64_t gas) override { this->eeiUseGas(gas); }
+  int64_t getGasLeft() override { return this->eeiGetGasLeft(); }
+  void getAddress(uint32_t resultOffset) override { this->eeiGetAddress(resultOffset); }
+  uint32_t call(int64_t gas, uint32_t addressOffset, uint32_t valueOffset, uint32_t dataOffset, uint32_t dataLength) override {
+    return this->eeiCall(EEICallKind::Call, gas, addressOffset, valueOffset, dataOffset, dataLength);
+  }
+  void callDataCopy(uint32_t resultOffset, uint32_t dataOffset, uint32_t length) override { this->eeiCallDataCopy(resultOffset, dataOffset, length); }
+  uint32_t getCallDataSize() override { return this->eeiGetCallDataSize(); }
+  void storageStore(uint32_t pathOffset, uint32_t valueOffset) override { this->eeiStorageStore(pathOffset, valueOffset); }
+  void storageLoad(uint32_t pathOffset, uint32_t resultOffset) override { this->eeiStorageLoad(pathOffset, resultOffset); }
+  void codeCopy(uint32_t resultOffset, uint32_t codeOffset, uint32_t length) override { this->eeiCodeCopy(resultOffset, codeOffset, length); }
+  uint32_t getCodeSize() override { return this->eeiGetCodeSize(); }
+  void finish(uint32_t offset, uint32_t size) override { this->eeiFinish(offset, size); }
+  void revert(uint32_t offset, uint32_t size) override { this->eeiRevert(offset, size); }
+  uint32_t getReturnDataSize() override { return this->eeiGetReturnDataSize(); }
+  void returnDataCopy(uint32_t dataOffset, uint32_t offset, uint32_t size) override { this->eeiReturnDataCopy(dataOffset, offset, size); }
+
 private:
   // These assume that m_wasmMemory was set prior to execution.
-  size_t memorySize() const override { return Runtime::getMemoryNumPages(m_wasmMemory) * 65536; }
-  void memorySet(size_t offset, uint8_t value) override { (Runtime::memoryArrayPtr<U8>(m_wasmMemory, offset, 1))[0] = value; }
-  uint8_t memoryGet(size_t offset) override { return (Runtime::memoryArrayPtr<U8>(m_wasmMemory, offset, 1))[0]; }
+  size_t memorySize() const { return Runtime::getMemoryNumPages(m_wasmMemory) * 65536; }
+  uint8_t* memoryData() { return Runtime::getMemoryBaseAddress(m_wasmMemory); }
 
   Runtime::MemoryInstance* m_wasmMemory;
 };
@@ -71,9 +131,53 @@ unique_ptr<WasmEngine> WavmEngine::create()
   return unique_ptr<WasmEngine>{new WavmEngine};
 }
 
+namespace {
+
+// Deserialising validates as well.
+void parseModule(vector<uint8_t> const& code, IR::Module& module)
+{
+  try {
+    // NOTE: this expects U8, which is a typedef over uint8_t
+    Serialization::MemoryInputStream input(code.data(), code.size());
+    WASM::serialize(input, module);
+  } catch (Serialization::FatalSerializationException const& e) {
+    ensureCondition(false, ContractValidationFailure, "Failed to deserialise contract: " + e.message);
+  } catch (IR::ValidationException const& e) {
+    ensureCondition(false, ContractValidationFailure, "Failed to validate contract: " + e.message);
+  } catch (std::bad_alloc const&) {
+    // Catching this here because apparently wavm doesn't necessarily checks bounds before allocation
+    ensureCondition(false, ContractValidationFailure, "Bug in wavm: didn't check bounds before allocation");
+  }
+}
+
+}
+
+void WavmEngine::verifyContract(vector<uint8_t> const& code)
+{
+  instrument(code);
+}
+
+shared_ptr<const WavmModule> WavmEngine::instrument(vector<uint8_t> const& code)
+{
+  ModuleCache* moduleCache = ModuleCache::current();
+  if (!moduleCache)
+    moduleCache = &m_instrumented;
+  if (shared_ptr<const WavmModule> cached = moduleCache->lookup<WavmModule>(code))
+    return cached;
+
+  auto start = chrono::steady_clock::now();
+  shared_ptr<const WavmModule> module = make_shared<WavmModule>(BinaryenEngine::instrumentHalting(code));
+  // Only contracts which WAVM accepts are kept.
+  IR::Module moduleAST;
+  parseModule(module->instrumented, moduleAST);
+  double nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+  moduleCache->store(code, module, nanoseconds);
+  return module;
+}
+
 namespace wavm_host_module {
   // first the ethereum interface(s), the top of the stack is used in host functions
-  stack<WavmEthereumInterface*> interface;
+  stack<WavmHost*> interface;
 
 
   // the host module is called 'ethereum'
@@ -83,85 +187,87 @@ namespace wavm_host_module {
   // host functions follow
   DEFINE_INTRINSIC_FUNCTION(ethereum, "useGas", void, useGas, I64 amount)
   {
-    interface.top()->eeiUseGas(amount);
+    interface.top()->useGas(amount);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "getAddress", void, getAddress, U32 resultOffset)
   {
-    interface.top()->eeiGetAddress(resultOffset);
+    interface.top()->getAddress(resultOffset);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "call", U32, call, I64 gas, U32 addressOffset, U32 valueOffset, U32 dataOffset, U32 dataLength)
   {
-    return interface.top()->eeiCall(EthereumInterface::EEICallKind::Call, gas, addressOffset, valueOffset, dataOffset, dataLength);
+    return interface.top()->call(gas, addressOffset, valueOffset, dataOffset, dataLength);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "callDataCopy", void, callDataCopy, U32 resultOffset, U32 dataOffset, U32 length)
   {
-    interface.top()->eeiCallDataCopy(resultOffset, dataOffset, length);
+    interface.top()->callDataCopy(resultOffset, dataOffset, length);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "getCallDataSize", U32, getCallDataSize)
   {
-    return interface.top()->eeiGetCallDataSize();
+    return interface.top()->getCallDataSize();
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "getGasLeft", U64, getGasLeft)
   {
-    return static_cast<U64>(interface.top()->eeiGetGasLeft());
+    return static_cast<U64>(interface.top()->getGasLeft());
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "storageStore", void, storageStore, U32 pathOffset, U32 valueOffset)
   {
-    interface.top()->eeiStorageStore(pathOffset, valueOffset);
+    interface.top()->storageStore(pathOffset, valueOffset);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "storageLoad", void, storageLoad, U32 pathOffset, U32 valueOffset)
   {
-    interface.top()->eeiStorageLoad(pathOffset, valueOffset);
+    interface.top()->storageLoad(pathOffset, valueOffset);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "codeCopy", void, codeCopy, U32 resultOffset, U32 codeOffset, U32 length)
   {
-    interface.top()->eeiCodeCopy(resultOffset, codeOffset, length);
+    interface.top()->codeCopy(resultOffset, codeOffset, length);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "getCodeSize", U32, getCodeSize)
   {
-    return interface.top()->eeiGetCodeSize();
+    return interface.top()->getCodeSize();
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "finish", void, finish, U32 dataOffset, U32 length)
   {
-    interface.top()->eeiFinish(dataOffset, length);
+    // The contract was instrumented to return once halted.
+    interface.top()->finish(dataOffset, length);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "revert", void, revert, U32 dataOffset, U32 length)
   {
-    interface.top()->eeiRevert(dataOffset, length);
+    // The contract was instrumented to return once halted.
+    interface.top()->revert(dataOffset, length);
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "getReturnDataSize", U32, getReturnDataSize)
   {
-    return interface.top()->eeiGetReturnDataSize();
+    return interface.top()->getReturnDataSize();
   }
 
 
   DEFINE_INTRINSIC_FUNCTION(ethereum, "returnDataCopy", void, returnDataCopy, U32 resultOffset, U32 dataOffset, U32 length)
   {
-    return interface.top()->eeiReturnDataCopy(resultOffset, dataOffset, length);
+    return interface.top()->returnDataCopy(resultOffset, dataOffset, length);
   }
 
 
@@ -188,17 +294,26 @@ namespace wavm_host_module {
 
 ExecutionResult WavmEngine::execute(
   evmc_context* context,
+  evmc_revision rev,
   vector<uint8_t> const& code,
   vector<uint8_t> const& state_code,
   evmc_message const& msg,
   bool meterInterfaceGas
 ) {
-  ExecutionResult result = internalExecute(context, code, state_code, msg, meterInterfaceGas);
+  ExecutionResult result;
+  switch (rev) {
+  case EVMC_BYZANTIUM:
+    result = internalExecute<EVMC_BYZANTIUM>(context, code, state_code, msg, meterInterfaceGas);
+    break;
+  default:
+    heraAssert(false, "Unsupported revision.");
+  }
   // And clean up mess left by this run.
   Runtime::collectGarbage();
   return result;
 }
 
+template <evmc_revision Revision>
 ExecutionResult WavmEngine::internalExecute(
   evmc_context* context,
   vector<uint8_t> const& code,
@@ -208,25 +323,22 @@ ExecutionResult WavmEngine::internalExecute(
 ) {
   HERA_DEBUG << "Executing with wavm...\n";
 
+  // WAVM can only unwind compiled code by an exception, so the contract
+  // returns by itself once finish or revert was called instead.
+  shared_ptr<const WavmModule> module = instrument(code);
+
   // set up a new ethereum interface just for this contract invocation
   ExecutionResult result;
-  WavmEthereumInterface interface{context, state_code, msg, result, meterInterfaceGas};
+  WavmEthereumInterface<Revision> interface{context, state_code, msg, result, meterInterfaceGas};
   wavm_host_module::interface.push(&interface);
 
   // first parse module
   IR::Module moduleAST;
-  try {
-    // NOTE: this expects U8, which is a typedef over uint8_t
-    Serialization::MemoryInputStream input(code.data(), code.size());
-    WASM::serialize(input, moduleAST);
-  } catch (Serialization::FatalSerializationException const& e) {
-    ensureCondition(false, ContractValidationFailure, "Failed to deserialise contract: " + e.message);
-  } catch (IR::ValidationException const& e) {
-    ensureCondition(false, ContractValidationFailure, "Failed to validate contract: " + e.message);
-  } catch (std::bad_alloc const&) {
-    // Catching this here because apparently wavm doesn't necessarily checks bounds before allocation
-    ensureCondition(false, ContractValidationFailure, "Bug in wavm: didn't check bounds before allocation");
-  }
+  parseModule(module->instrumented, moduleAST);
+  HERA_PROBE3(parse__done, ProbeScope::codeHash(), msg.gas, code.size());
+  PhaseTimer::done(ExecutionPhase::Parse);
+  HERA_PROBE2(validate__done, ProbeScope::codeHash(), msg.gas);
+  PhaseTimer::done(ExecutionPhase::Validate);
 
   // next set up the host module.
   // Note: in ewasm, we create a new VM for each call to a module, so we must instantiate a new host module for each of these VMs, this is inefficient, but OK for prototyping.
@@ -247,34 +359,42 @@ ExecutionResult WavmEngine::internalExecute(
   // instantiate contract module
   Runtime::GCPointer<Runtime::ModuleInstance> moduleInstance = Runtime::instantiateModule(compartment, moduleAST, move(linkResult.resolvedImports), "<ewasmcontract>");
   heraAssert(moduleInstance, "Couldn't instantiate contact module.");
+  HERA_PROBE2(instantiate__done, ProbeScope::codeHash(), msg.gas);
+  PhaseTimer::done(ExecutionPhase::Instantiate);
 
   // get memory for easy access in host functions
   wavm_host_module::interface.top()->setWasmMemory(asMemory(Runtime::getInstanceExport(moduleInstance, "memory")));
+  // Growth of the memory is not followed.
+  MemoryBudget* budget = MemoryBudget::current();
+  MemoryBudget::Charge instanceCharge(budget ? &budget->instances() : nullptr,
+    code.size() + Runtime::getMemoryNumPages(asMemory(Runtime::getInstanceExport(moduleInstance, "memory"))) * 65536);
 
   // invoke the main function
   Runtime::GCPointer<Runtime::FunctionInstance> mainFunction = asFunctionNullable(Runtime::getInstanceExport(moduleInstance, "main"));
   ensureCondition(mainFunction, ContractValidationFailure, "\"main\" not found");
 
   // this is how WAVM's try/catch for exceptions
+  // NOTE: the trap is only recorded here and reported once WAVM has returned,
+  // instead of throwing a second exception from within its handler.
+  bool trapped = false;
+  string trapDescription;
   Runtime::catchRuntimeExceptions(
     [&] {
-      try {
-        vector<IR::Value> invokeArgs;
-        Runtime::invokeFunctionChecked(wavm_context, mainFunction, invokeArgs);
-      } catch (EndExecution const&) {
-        // This exception is ignored here because we consider it to be a success.
-        // It is only a clutch for POSIX style exit()
-      }
+      vector<IR::Value> invokeArgs;
+      Runtime::invokeFunctionChecked(wavm_context, mainFunction, invokeArgs);
     },
     [&](Runtime::Exception&& exception) {
-      // FIXME: decide if each of the exception fit into VMTrap/InternalError
-      ensureCondition(false, VMTrap, Runtime::describeException(exception));
+      trapped = true;
+      trapDescription = Runtime::describeException(exception);
     }
   );
 
   // clean up
   wavm_host_module::interface.pop();
 
+  // FIXME: decide if each of the exception fit into VMTrap/InternalError
+  ensureCondition(!trapped, VMTrap, trapDescription);
+
   return result;
 }
 
@@ -17,10 +17,15 @@
 
 #pragma once
 
+#include <memory>
+
 #include "eei.h"
+#include "module-cache.h"
 
 namespace hera {
 
+class WavmModule;
+
 class WavmEngine : public WasmEngine {
 public:
   /// Factory method to create the WAVM Wasm Engine.
@@ -28,17 +33,22 @@ public:
 
   ExecutionResult execute(
     evmc_context* context,
+    evmc_revision rev,
     std::vector<uint8_t> const& code,
     std::vector<uint8_t> const& state_code,
     evmc_message const& msg,
     bool meterInterfaceGas
   ) override;
 
-  void verifyContract(std::vector<uint8_t> const&) override {
-    // TODO: implement
-  }
+  /// Checks that WAVM accepts the contract and instruments it, so that its
+  /// executions need not.
+  void verifyContract(std::vector<uint8_t> const& code) override;
+
+  // The host functions reach the interface through a global stack.
+  bool supportsConcurrentExecution() const override { return false; }
 
 private:
+  template <evmc_revision Revision>
   ExecutionResult internalExecute(
     evmc_context* context,
     std::vector<uint8_t> const& code,
@@ -46,6 +56,14 @@ private:
     evmc_message const& msg,
     bool meterInterfaceGas
   );
+
+  /// The contract rewritten by BinaryenEngine::instrumentHalting() and
+  /// accepted by WAVM, built once and kept in the module cache, or in the
+  /// engine's own without one.
+  std::shared_ptr<const WavmModule> instrument(std::vector<uint8_t> const& code);
+
+  /// Holds the instrumented contracts if there is no module cache.
+  ModuleCache m_instrumented;
 };
 
 } // namespace hera
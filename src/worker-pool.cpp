@@ -0,0 +1,95 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "worker-pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace hera {
+
+thread_local FiberLocal<WorkerPool> WorkerPool::s_current;
+
+WorkerPool::~WorkerPool()
+{
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for (auto& t: m_threads)
+    t.join();
+}
+
+void WorkerPool::run(unsigned threads, function<void()> const& task)
+{
+  Job job{&task, threads > 1 ? threads - 1 : 0, 0};
+  bool queued = false;
+  if (job.unclaimed) {
+    lock_guard<mutex> lock(m_mutex);
+    // Busy threads are left to their jobs, which may take long.
+    try {
+      while (m_idle < job.unclaimed) {
+        m_threads.emplace_back([this]() { loop(); });
+        ++m_idle;
+      }
+    } catch (...) {
+      // Carry on with the threads which could be started.
+    }
+    job.unclaimed = static_cast<unsigned>(min<size_t>(job.unclaimed, m_idle));
+    if (job.unclaimed) {
+      m_jobs.push_back(&job);
+      queued = true;
+    }
+  }
+  if (queued)
+    m_wake.notify_all();
+
+  task();
+
+  unique_lock<mutex> lock(m_mutex);
+  // Runs which did not start are not needed anymore.
+  if (job.unclaimed)
+    m_jobs.erase(find(m_jobs.begin(), m_jobs.end(), &job));
+  m_done.wait(lock, [&]() { return job.active == 0; });
+}
+
+void WorkerPool::loop()
+{
+  unique_lock<mutex> lock(m_mutex);
+  for (;;) {
+    m_wake.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+    if (m_stopping)
+      return;
+
+    Job* job = m_jobs.front();
+    if (--job->unclaimed == 0)
+      m_jobs.pop_front();
+    ++job->active;
+    --m_idle;
+
+    lock.unlock();
+    (*job->task)();
+    lock.lock();
+
+    ++m_idle;
+    if (--job->active == 0)
+      m_done.notify_all();
+  }
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fiber-local.h"
+
+namespace hera {
+
+// Threads kept for running a task on several threads at once, so that jobs
+// such as validating a large module or executing a batch do not start
+// threads of their own. Threads are started as jobs first ask for them and
+// kept until the pool is destroyed.
+//
+// A task is expected to take its work from a queue shared by all of its
+// runs until the queue is empty. The calling thread runs it as well, so the
+// job completes even if the pool's threads are busy with other jobs, and
+// runs which have not started once the calling thread's run returned are
+// dropped.
+class WorkerPool {
+public:
+  WorkerPool() = default;
+  ~WorkerPool();
+
+  WorkerPool(WorkerPool const&) = delete;
+  WorkerPool& operator=(WorkerPool const&) = delete;
+
+  // Runs @task on the calling thread and on up to @threads - 1 threads of
+  // the pool at once, and returns once every run returned. @task must not
+  // throw.
+  void run(unsigned threads, std::function<void()> const& task);
+
+  // The pool of the current thread, if any.
+  static WorkerPool* current() { return s_current.get(); }
+
+  // Sets the pool of the current thread for its lifetime.
+  class Scope {
+  public:
+    explicit Scope(WorkerPool* pool): m_previous(s_current.get()) { s_current.set(pool); }
+    ~Scope() { s_current.set(m_previous); }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+  private:
+    WorkerPool* m_previous;
+  };
+
+private:
+  struct Job {
+    std::function<void()> const* task;
+    // The runs no thread has taken yet.
+    unsigned unclaimed;
+    // The runs taken by threads of the pool which have not returned.
+    unsigned active;
+  };
+
+  void loop();
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  // Jobs with unclaimed runs, oldest first.
+  std::deque<Job*> m_jobs;
+  std::vector<std::thread> m_threads;
+  // The threads not running a task.
+  size_t m_idle = 0;
+  bool m_stopping = false;
+
+  static thread_local FiberLocal<WorkerPool> s_current;
+};
+
+}
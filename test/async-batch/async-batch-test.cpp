@@ -0,0 +1,152 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Executes a batch of messages each reading a storage slot which is not
+// loaded yet, and checks that they wait for it together rather than one
+// after the other, and that every result equals that of executing the
+// message on its own.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "benchmark-host.h"
+
+using namespace hera;
+
+namespace
+{
+const size_t batchSize = 16;
+
+// Returns the sum of the storage value at the key passed as input and the
+// key.
+const uint8_t code[] = {0x60, 0x00, 0x35, 0x54, 0x60, 0x00, 0x35, 0x01, 0x60, 0x00, 0x52, 0x60,
+    0x20, 0x60, 0x00, 0xf3};
+
+// Whose storage values derive from their key.
+class Host : public BenchmarkHost
+{
+protected:
+    evmc_bytes32 getStorage(evmc_address const&, evmc_bytes32 const& key) override
+    {
+        evmc_bytes32 ret = key;
+        for (auto& byte : ret.bytes)
+            byte ^= 0x5a;
+        return ret;
+    }
+};
+
+// Loads the slots asked for only once wait() is called, as a client fetching
+// them from disk would.
+struct AsyncHost : hera_async_host
+{
+    AsyncHost() : hera_async_host{storageReady, ready, ready, wait}, loaded(256, false) {}
+
+    static bool storageReady(hera_async_host* host, const evmc_address*, const evmc_bytes32* key)
+    {
+        AsyncHost& self = *static_cast<AsyncHost*>(host);
+        if (self.loaded[key->bytes[31]])
+            return true;
+        self.pending.push_back(key->bytes[31]);
+        ++self.misses;
+        return false;
+    }
+
+    static bool ready(hera_async_host*, const evmc_address*) { return true; }
+
+    static void wait(hera_async_host* host)
+    {
+        AsyncHost& self = *static_cast<AsyncHost*>(host);
+        for (uint8_t slot : self.pending)
+            self.loaded[slot] = true;
+        self.pending.clear();
+        ++self.waits;
+    }
+
+    std::vector<bool> loaded;
+    std::vector<uint8_t> pending;
+    unsigned misses = 0;
+    unsigned waits = 0;
+};
+}  // namespace
+
+int main()
+{
+    evmc_instance* hera = evmc_create_hera();
+    if (evmc_set_option(hera, "evm1mode", "interpret") != EVMC_SET_OPTION_SUCCESS)
+    {
+        fprintf(stderr, "Cannot set the EVM1 mode\n");
+        return 1;
+    }
+
+    Host host;
+    std::vector<evmc_bytes32> inputs(batchSize);
+    std::vector<evmc_message> messages(batchSize);
+    std::vector<hera_batch_item> items(batchSize);
+    for (size_t i = 0; i < batchSize; ++i)
+    {
+        memset(&inputs[i], 0, sizeof(inputs[i]));
+        inputs[i].bytes[31] = static_cast<uint8_t>(i);
+        evmc_message& msg = messages[i];
+        memset(&msg, 0, sizeof(msg));
+        msg.kind = EVMC_CALL;
+        msg.gas = 100000;
+        msg.input_data = inputs[i].bytes;
+        msg.input_size = sizeof(inputs[i].bytes);
+        items[i] = hera_batch_item{&host, EVMC_BYZANTIUM, &messages[i], code, sizeof(code)};
+    }
+
+    int failures = 0;
+    AsyncHost async;
+    std::vector<evmc_result> results(batchSize);
+    hera_batch_arena* arena = hera_execute_async_batch(hera, &async, items.data(), results.data(), batchSize);
+    if (!arena)
+    {
+        fprintf(stderr, "No arena\n");
+        hera->destroy(hera);
+        return 1;
+    }
+
+    for (size_t i = 0; i < batchSize; ++i)
+    {
+        evmc_result expected = hera->execute(hera, &host, EVMC_BYZANTIUM, &messages[i], code, sizeof(code));
+        if (expected.status_code != EVMC_SUCCESS || results[i].status_code != expected.status_code ||
+            results[i].gas_left != expected.gas_left || results[i].output_size != expected.output_size ||
+            memcmp(results[i].output_data, expected.output_data, expected.output_size) != 0)
+        {
+            fprintf(stderr, "message %zu: status %d, gas left %lld, expected %d, %lld\n", i,
+                static_cast<int>(results[i].status_code), static_cast<long long>(results[i].gas_left),
+                static_cast<int>(expected.status_code), static_cast<long long>(expected.gas_left));
+            ++failures;
+        }
+        if (expected.release)
+            expected.release(&expected);
+    }
+    hera_release_batch(arena);
+
+    // Every message found its slot missing, and they waited for them together.
+    if (async.misses != batchSize || async.waits == 0 || async.waits >= batchSize)
+    {
+        fprintf(stderr, "%u slots missing, %u waits\n", async.misses, async.waits);
+        ++failures;
+    }
+
+    hera->destroy(hera);
+    return failures ? 1 : 0;
+}
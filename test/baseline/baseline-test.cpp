@@ -0,0 +1,403 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs contracts with the baseline compiler, checking the code it generates
+// for control flow, calls, traps, the memory and the native stack.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark-host.h"
+#include "contract-builder.h"
+
+using namespace hera;
+
+namespace
+{
+// The function types of the contracts, by index.
+enum Type : uint8_t
+{
+    TypeUseGas,  // (i64) -> ()
+    TypeFinish,  // (i32, i32) -> ()
+    TypeVoid,    // () -> ()
+    TypeUnary,   // (i32) -> i32
+    TypeResult,  // () -> i32
+};
+
+// The imports are useGas and finish, so "main" is function 2.
+const uint32_t useGas = 0;
+const uint32_t finish = 1;
+const uint32_t firstFunction = 3;
+
+// A function body.
+class Code
+{
+public:
+    // Without locals, or with @count locals of @type.
+    explicit Code(uint32_t count = 0, uint8_t type = I32)
+    {
+        if (count == 0)
+            appendUnsigned(m_bytes, 0);
+        else
+        {
+            appendUnsigned(m_bytes, 1);
+            appendUnsigned(m_bytes, count);
+            m_bytes.push_back(type);
+        }
+    }
+
+    Code& op(std::initializer_list<uint8_t> bytes)
+    {
+        m_bytes.insert(m_bytes.end(), bytes);
+        return *this;
+    }
+    Code& i32(int32_t value)
+    {
+        m_bytes.push_back(0x41);
+        appendSigned(m_bytes, value);
+        return *this;
+    }
+    Code& i64(int64_t value)
+    {
+        m_bytes.push_back(0x42);
+        appendSigned(m_bytes, value);
+        return *this;
+    }
+    Code& call(uint32_t function)
+    {
+        m_bytes.push_back(0x10);
+        appendUnsigned(m_bytes, function);
+        return *this;
+    }
+    Code& load() { return op({0x28, 0x02, 0x00}); }
+    Code& store() { return op({0x36, 0x02, 0x00}); }
+    // Finishes with the first @size bytes of the memory.
+    Code& finishWith(int32_t size) { return i32(0).i32(size).call(finish); }
+    Code& end() { return op({0x0b}); }
+
+    Bytes const& bytes() const { return m_bytes; }
+
+private:
+    Bytes m_bytes;
+};
+
+struct Contract
+{
+    explicit Contract(std::vector<std::pair<Type, Code>> _functions): functions(std::move(_functions)) {}
+
+    // "main", followed by the other functions.
+    std::vector<std::pair<Type, Code>> functions;
+    uint32_t memoryPages = 1;
+    // Unlimited if 0.
+    uint32_t memoryMaxPages = 0;
+    // The table, empty without one.
+    std::vector<uint32_t> elements;
+};
+
+Bytes build(Contract const& contract)
+{
+    Bytes wasm = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+
+    Bytes types;
+    appendUnsigned(types, 5);
+    types.insert(types.end(), {0x60, 0x01, I64, 0x00});
+    types.insert(types.end(), {0x60, 0x02, I32, I32, 0x00});
+    types.insert(types.end(), {0x60, 0x00, 0x00});
+    types.insert(types.end(), {0x60, 0x01, I32, 0x01, I32});
+    types.insert(types.end(), {0x60, 0x00, 0x01, I32});
+    appendSection(wasm, 1, types);
+
+    Bytes imports;
+    appendUnsigned(imports, 2);
+    appendName(imports, "ethereum");
+    appendName(imports, "useGas");
+    imports.insert(imports.end(), {0x00, TypeUseGas});
+    appendName(imports, "ethereum");
+    appendName(imports, "finish");
+    imports.insert(imports.end(), {0x00, TypeFinish});
+    appendSection(wasm, 2, imports);
+
+    Bytes functions;
+    appendUnsigned(functions, contract.functions.size());
+    for (auto const& function : contract.functions)
+        functions.push_back(function.first);
+    appendSection(wasm, 3, functions);
+
+    if (!contract.elements.empty())
+    {
+        Bytes table = {0x01, 0x70, 0x00};
+        appendUnsigned(table, contract.elements.size());
+        appendSection(wasm, 4, table);
+    }
+
+    Bytes memory = {0x01};
+    memory.push_back(contract.memoryMaxPages ? 0x01 : 0x00);
+    appendUnsigned(memory, contract.memoryPages);
+    if (contract.memoryMaxPages)
+        appendUnsigned(memory, contract.memoryMaxPages);
+    appendSection(wasm, 5, memory);
+
+    Bytes exports;
+    appendUnsigned(exports, 2);
+    appendName(exports, "main");
+    exports.push_back(0x00);
+    appendUnsigned(exports, 2);
+    appendName(exports, "memory");
+    exports.push_back(0x02);
+    appendUnsigned(exports, 0);
+    appendSection(wasm, 7, exports);
+
+    if (!contract.elements.empty())
+    {
+        Bytes elements = {0x01, 0x00, 0x41, 0x00, 0x0b};
+        appendUnsigned(elements, contract.elements.size());
+        for (uint32_t function : contract.elements)
+            appendUnsigned(elements, function);
+        appendSection(wasm, 9, elements);
+    }
+
+    Bytes code;
+    appendUnsigned(code, contract.functions.size());
+    for (auto const& function : contract.functions)
+    {
+        Bytes const& body = function.second.bytes();
+        appendUnsigned(code, body.size());
+        code.insert(code.end(), body.begin(), body.end());
+    }
+    appendSection(wasm, 10, code);
+    return wasm;
+}
+
+struct Case
+{
+    const char* name;
+    Contract contract;
+    int64_t gas;
+    evmc_status_code status;
+    // Ignored if negative.
+    int64_t gasLeft;
+    std::string output;
+};
+
+std::string toHex(uint8_t const* data, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string ret;
+    for (size_t i = 0; i < size; ++i)
+    {
+        ret += digits[data[i] >> 4];
+        ret += digits[data[i] & 0xf];
+    }
+    return ret;
+}
+
+// Sums 1 to 10 in a loop, checks the sum in an if and finishes from a
+// nested call, after which "main" would trap.
+Contract controlFlow()
+{
+    Code main(2);
+    main.op({0x02, 0x40, 0x03, 0x40})
+        .op({0x20, 0x00}).i32(1).op({0x6a, 0x22, 0x00})
+        .op({0x20, 0x01, 0x6a, 0x21, 0x01})
+        .op({0x20, 0x00}).i32(10).op({0x48, 0x0d, 0x00})
+        .end().end()
+        .i32(0).op({0x20, 0x01}).store()
+        .i32(4).op({0x20, 0x01}).i32(55).op({0x46, 0x04, I32}).i32(1).op({0x05}).i32(2).end().store()
+        .call(firstFunction).op({0x00}).end();
+    Code done;
+    done.finishWith(8).end();
+    return Contract({{TypeVoid, main}, {TypeVoid, done}});
+}
+
+// Selects 10, 20 or 30 for the indices 0, 1 and any other.
+Contract brTable()
+{
+    Code main;
+    int32_t indices[] = {0, 1, 2, 7};
+    for (int32_t i = 0; i < 4; ++i)
+        main.i32(4 * i).i32(indices[i]).call(firstFunction).store();
+    main.finishWith(16).end();
+    Code select;
+    select.op({0x02, 0x40, 0x02, 0x40, 0x02, 0x40})
+        .op({0x20, 0x00, 0x0e, 0x02, 0x00, 0x01, 0x02})
+        .end().i32(10).op({0x0f})
+        .end().i32(20).op({0x0f})
+        .end().i32(30).end();
+    return Contract({{TypeVoid, main}, {TypeUnary, select}});
+}
+
+// Calls element @index of a table of an increment and a constant, as an
+// increment.
+Contract callIndirect(int32_t index)
+{
+    Code main;
+    main.i32(0).i32(41).i32(index).op({0x11, TypeUnary, 0x00}).store().finishWith(4).end();
+    Code increment;
+    increment.op({0x20, 0x00}).i32(1).op({0x6a}).end();
+    Code constant;
+    constant.i32(5).end();
+    Contract contract({{TypeVoid, main}, {TypeUnary, increment}, {TypeResult, constant}});
+    contract.elements = {firstFunction, firstFunction + 1};
+    return contract;
+}
+
+// Stores the result of the i32 operation @opcode on @a and @b.
+Contract binary(int32_t a, int32_t b, uint8_t opcode)
+{
+    Code main;
+    main.i32(0).i32(a).i32(b).op({opcode}).store().finishWith(4).end();
+    return Contract({{TypeVoid, main}});
+}
+
+// Stores whether the remainder of the smallest i64 by -1 is 0, which must
+// not trap.
+Contract remainderOverflow()
+{
+    Code main;
+    main.i32(0).i64(std::numeric_limits<int64_t>::min()).i64(-1).op({0x81, 0x50}).store().finishWith(4).end();
+    return Contract({{TypeVoid, main}});
+}
+
+// Loads the i32 at @address of a single page.
+Contract load(int32_t address)
+{
+    Code main;
+    main.i32(0).i32(address).load().store().finishWith(4).end();
+    return Contract({{TypeVoid, main}});
+}
+
+// Grows a memory of at most 3 pages by 1 and 5 pages, then stores its size
+// and a value written to the new page.
+Contract growLimited()
+{
+    Code main;
+    main.i32(0).i32(1).op({0x40, 0x00}).store()
+        .i32(4).i32(5).op({0x40, 0x00}).store()
+        .i32(8).op({0x3f, 0x00}).store()
+        .i32(65536).i32(7).store()
+        .i32(12).i32(65536).load().store()
+        .finishWith(16).end();
+    Contract contract({{TypeVoid, main}});
+    contract.memoryMaxPages = 3;
+    return contract;
+}
+
+// Grows an unlimited memory past its reservation, which moves it, and
+// checks that it kept its contents and is usable up to its end.
+Contract growPastReservation()
+{
+    int32_t last = 301 * 65536 - 4;
+    Code main;
+    main.i32(0).i32(0x12345678).store()
+        .i32(300).op({0x40, 0x00, 0x1a})
+        .i32(4).i32(0).load().store()
+        .i32(last).i32(9).store()
+        .i32(8).i32(last).load().store()
+        .finishWith(12).end();
+    return Contract({{TypeVoid, main}});
+}
+
+// Recurses until the native stack is exhausted.
+Contract recursion()
+{
+    Code main;
+    main.call(firstFunction).end();
+    Code recurse;
+    recurse.call(firstFunction).end();
+    return Contract({{TypeVoid, main}, {TypeVoid, recurse}});
+}
+
+// Charges 7 gas at the start of each of 10 iterations of a loop, as the
+// metering of contracts does at block boundaries.
+Contract meteredLoop()
+{
+    Code main(1);
+    main.op({0x03, 0x40})
+        .i64(7).call(useGas)
+        .op({0x20, 0x00}).i32(1).op({0x6a, 0x22, 0x00})
+        .i32(10).op({0x48, 0x0d, 0x00})
+        .end().finishWith(0).end();
+    return Contract({{TypeVoid, main}});
+}
+
+const int32_t int32Min = std::numeric_limits<int32_t>::min();
+
+const Case cases[] = {
+    {"control flow", controlFlow(), 1000, EVMC_SUCCESS, 1000, "3700000001000000"},
+    {"br_table", brTable(), 1000, EVMC_SUCCESS, 1000, "0a000000140000001e0000001e000000"},
+    {"call_indirect", callIndirect(0), 1000, EVMC_SUCCESS, 1000, "2a000000"},
+    {"call_indirect type mismatch", callIndirect(1), 1000, EVMC_FAILURE, 0, ""},
+    {"call_indirect undefined element", callIndirect(2), 1000, EVMC_FAILURE, 0, ""},
+    {"division", binary(-7, 2, 0x6d), 1000, EVMC_SUCCESS, 1000, "fdffffff"},
+    {"division by zero", binary(1, 0, 0x6e), 1000, EVMC_FAILURE, 0, ""},
+    {"remainder by zero", binary(1, 0, 0x6f), 1000, EVMC_FAILURE, 0, ""},
+    {"division overflow", binary(int32Min, -1, 0x6d), 1000, EVMC_FAILURE, 0, ""},
+    {"remainder overflow", remainderOverflow(), 1000, EVMC_SUCCESS, 1000, "01000000"},
+    {"load at the end", load(65532), 1000, EVMC_SUCCESS, 1000, "00000000"},
+    {"load out of bounds", load(65533), 1000, EVMC_FAILURE, 0, ""},
+    {"memory.grow", growLimited(), 1000, EVMC_SUCCESS, 1000, "01000000ffffffff0200000007000000"},
+    {"memory.grow past the reservation", growPastReservation(), 1000, EVMC_SUCCESS, 1000,
+        "785634127856341209000000"},
+    {"stack exhausted", recursion(), 1000, EVMC_FAILURE, 0, ""},
+    // Runs after the stack was exhausted.
+    {"metered loop", meteredLoop(), 100, EVMC_SUCCESS, 30, ""},
+    {"metered loop out of gas", meteredLoop(), 69, EVMC_OUT_OF_GAS, 0, ""},
+};
+}  // namespace
+
+int main()
+{
+    evmc_instance* hera = evmc_create_hera();
+    if (evmc_set_option(hera, "engine", "baseline") != EVMC_SET_OPTION_SUCCESS)
+    {
+        fprintf(stderr, "Cannot select the baseline compiler\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (auto const& c : cases)
+    {
+        Bytes code = build(c.contract);
+        BenchmarkHost host;
+        evmc_message msg{};
+        msg.kind = EVMC_CALL;
+        msg.gas = c.gas;
+
+        evmc_result result =
+            hera->execute(hera, &host, EVMC_BYZANTIUM, &msg, code.data(), code.size());
+        std::string output = toHex(result.output_data, result.output_size);
+        if (result.status_code != c.status || (c.gasLeft >= 0 && result.gas_left != c.gasLeft) ||
+            output != c.output)
+        {
+            fprintf(stderr, "%s: status %d, gas left %lld, output %s\n", c.name,
+                static_cast<int>(result.status_code), static_cast<long long>(result.gas_left),
+                output.c_str());
+            ++failures;
+        }
+        if (result.release)
+            result.release(&result);
+    }
+
+    hera->destroy(hera);
+    return failures ? 1 : 0;
+}
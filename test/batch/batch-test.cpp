@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Executes a batch of messages reading storage, on the calling thread and on
+// several, and checks that every result equals that of executing the message
+// on its own.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "benchmark-host.h"
+
+using namespace hera;
+
+namespace
+{
+const size_t batchSize = 64;
+
+// Returns the sum of the storage value at the key passed as input and the
+// key.
+const uint8_t loadCode[] = {0x60, 0x00, 0x35, 0x54, 0x60, 0x00, 0x35, 0x01, 0x60, 0x00, 0x52,
+    0x60, 0x20, 0x60, 0x00, 0xf3};
+// Reverts with 32 zero bytes.
+const uint8_t revertCode[] = {0x60, 0x20, 0x60, 0x00, 0xfd};
+// An invalid instruction.
+const uint8_t invalidCode[] = {0xfe};
+
+// Whose storage values derive from their key, so that it can be read from
+// several threads at once.
+class Host : public BenchmarkHost
+{
+protected:
+    evmc_bytes32 getStorage(evmc_address const&, evmc_bytes32 const& key) override
+    {
+        evmc_bytes32 ret = key;
+        for (auto& byte : ret.bytes)
+            byte ^= 0x5a;
+        return ret;
+    }
+};
+
+bool sameResult(evmc_result const& a, evmc_result const& b)
+{
+    return a.status_code == b.status_code && a.gas_left == b.gas_left &&
+           a.output_size == b.output_size &&
+           (a.output_size == 0 || memcmp(a.output_data, b.output_data, a.output_size) == 0);
+}
+}  // namespace
+
+int main()
+{
+    evmc_instance* hera = evmc_create_hera();
+    if (evmc_set_option(hera, "evm1mode", "interpret") != EVMC_SET_OPTION_SUCCESS)
+    {
+        fprintf(stderr, "Cannot set the EVM1 mode\n");
+        return 1;
+    }
+
+    Host host;
+    std::vector<evmc_bytes32> inputs(batchSize);
+    std::vector<evmc_message> messages(batchSize);
+    std::vector<hera_batch_item> items(batchSize);
+    for (size_t i = 0; i < batchSize; ++i)
+    {
+        memset(&inputs[i], 0, sizeof(inputs[i]));
+        inputs[i].bytes[31] = static_cast<uint8_t>(i);
+        evmc_message& msg = messages[i];
+        memset(&msg, 0, sizeof(msg));
+        msg.kind = EVMC_CALL;
+        msg.gas = 100000 + static_cast<int64_t>(i);
+        msg.input_data = inputs[i].bytes;
+        msg.input_size = sizeof(inputs[i].bytes);
+
+        hera_batch_item& item = items[i];
+        item.context = &host;
+        item.rev = EVMC_BYZANTIUM;
+        item.msg = &messages[i];
+        switch (i % 8)
+        {
+        case 6:
+            item.code = revertCode;
+            item.code_size = sizeof(revertCode);
+            break;
+        case 7:
+            item.code = invalidCode;
+            item.code_size = sizeof(invalidCode);
+            break;
+        default:
+            item.code = loadCode;
+            item.code_size = sizeof(loadCode);
+            break;
+        }
+    }
+
+    int failures = 0;
+    std::vector<evmc_result> expected(batchSize);
+    for (size_t i = 0; i < batchSize; ++i)
+    {
+        expected[i] = hera->execute(hera, &host, EVMC_BYZANTIUM, &messages[i], items[i].code, items[i].code_size);
+        evmc_status_code status = i % 8 == 6 ? EVMC_REVERT : EVMC_SUCCESS;
+        if (i % 8 != 7 && (expected[i].status_code != status || expected[i].output_size != 32))
+        {
+            fprintf(stderr, "message %zu: status %d on its own\n", i, static_cast<int>(expected[i].status_code));
+            ++failures;
+        }
+    }
+
+    for (unsigned threads : {0u, 1u, 4u})
+    {
+        std::vector<evmc_result> results(batchSize);
+        hera_batch_arena* arena = hera_execute_batch(hera, items.data(), results.data(), batchSize, threads);
+        if (!arena)
+        {
+            fprintf(stderr, "%u threads: no arena\n", threads);
+            ++failures;
+            continue;
+        }
+        for (size_t i = 0; i < batchSize; ++i)
+        {
+            if (!sameResult(results[i], expected[i]))
+            {
+                fprintf(stderr, "%u threads: message %zu: status %d, gas left %lld, expected %d, %lld\n",
+                    threads, i, static_cast<int>(results[i].status_code),
+                    static_cast<long long>(results[i].gas_left),
+                    static_cast<int>(expected[i].status_code),
+                    static_cast<long long>(expected[i].gas_left));
+                ++failures;
+            }
+        }
+        hera_release_batch(arena);
+    }
+
+    for (auto& result : expected)
+        if (result.release)
+            result.release(&result);
+    hera->destroy(hera);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs a contract calling itself until a mock host stops the recursion, on a
+// thread with a small stack, with fibers of the default and of the smallest
+// size. The calls must all complete and hand the depth reached back up.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <pthread.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark-host.h"
+
+using namespace hera;
+
+namespace
+{
+// Far more than the stack of the thread holds without fibers.
+const int32_t maxDepth = 256;
+const size_t threadStackSize = 128 * 1024;
+
+// Calls itself with all gas, placing the output at 0, and returns it.
+const uint8_t code[] = {0x60, 0x20, 0x60, 0x00, 0x60, 0x00, 0x60, 0x00, 0x60, 0x00, 0x30, 0x5a,
+    0xf1, 0x50, 0x60, 0x20, 0x60, 0x00, 0xf3};
+
+// Executes the calls with Hera again, up to maxDepth, where it returns the
+// depth.
+class Host : public BenchmarkHost
+{
+public:
+    explicit Host(evmc_instance* hera) : m_hera(hera) {}
+
+protected:
+    evmc_result call(evmc_message const& msg) override
+    {
+        if (msg.depth < maxDepth)
+            return m_hera->execute(m_hera, this, EVMC_BYZANTIUM, &msg, code, sizeof(code));
+
+        static uint8_t output[32];
+        memset(output, 0, sizeof(output));
+        output[30] = static_cast<uint8_t>(msg.depth >> 8);
+        output[31] = static_cast<uint8_t>(msg.depth);
+        evmc_result ret;
+        memset(&ret, 0, sizeof(ret));
+        ret.status_code = EVMC_SUCCESS;
+        ret.output_data = output;
+        ret.output_size = sizeof(output);
+        return ret;
+    }
+
+private:
+    evmc_instance* m_hera;
+};
+
+struct Run
+{
+    evmc_instance* hera;
+    evmc_result result;
+};
+
+void* execute(void* argument)
+{
+    Run& run = *static_cast<Run*>(argument);
+    Host host(run.hera);
+    evmc_message msg{};
+    msg.kind = EVMC_CALL;
+    msg.gas = gasLimit;
+    run.result = run.hera->execute(run.hera, &host, EVMC_BYZANTIUM, &msg, code, sizeof(code));
+    return nullptr;
+}
+
+// With @option set, if any.
+bool test(const char* option, const char* value)
+{
+    evmc_instance* hera = evmc_create_hera();
+    if (evmc_set_option(hera, "evm1mode", "interpret") != EVMC_SET_OPTION_SUCCESS ||
+        evmc_set_option(hera, option, value) != EVMC_SET_OPTION_SUCCESS)
+    {
+        fprintf(stderr, "Cannot set %s=%s\n", option, value);
+        return false;
+    }
+
+    Run run{hera, {}};
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, threadStackSize);
+    pthread_t thread;
+    bool ok = pthread_create(&thread, &attributes, execute, &run) == 0;
+    pthread_attr_destroy(&attributes);
+    if (!ok)
+    {
+        fprintf(stderr, "Cannot create a thread\n");
+        hera->destroy(hera);
+        return false;
+    }
+    pthread_join(thread, nullptr);
+
+    evmc_result& result = run.result;
+    ok = result.status_code == EVMC_SUCCESS && result.output_size == 32 &&
+         result.output_data[30] == (maxDepth >> 8) && result.output_data[31] == (maxDepth & 0xff);
+    if (!ok)
+        fprintf(stderr, "%s=%s: status %d, output size %zu\n", option, value,
+            static_cast<int>(result.status_code), result.output_size);
+    if (result.release)
+        result.release(&result);
+
+    hera_memory_usage usage;
+    hera_get_memory_usage(hera, &usage);
+    if (usage.fiber_stacks == 0)
+    {
+        fprintf(stderr, "%s=%s: no fiber stacks kept\n", option, value);
+        ok = false;
+    }
+
+    hera->destroy(hera);
+    return ok;
+}
+}  // namespace
+
+int main()
+{
+    int failures = 0;
+    if (!test("fibers", "true"))
+        ++failures;
+    if (!test("fiber-stack-size", "65536"))
+        ++failures;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs contracts whose required gas is known and checks the figure returned
+// by hera_get_required_gas().
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark-host.h"
+#include "contract-builder.h"
+
+using namespace hera;
+
+namespace
+{
+// The gas used by the callee of the contracts which make a call.
+const int64_t calleeGasUsed = 6300;
+
+enum class Ending
+{
+    Finish,
+    Revert,
+    Call
+};
+
+struct Case
+{
+    const char* name;
+    bool estimation;
+    int64_t gasUsed;
+    Ending ending;
+    evmc_status_code status;
+    int64_t gasLeft;
+    int64_t gasRequired;
+};
+
+// Which calls useGas(@gasUsed) and then ends as per @ending. Its imports are
+// useGas, revert and call, followed by main.
+Bytes buildContract(int64_t gasUsed, Ending ending)
+{
+    Bytes wasm = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+
+    Bytes types;
+    appendUnsigned(types, 4);
+    types.insert(types.end(), {0x60, 0x01, I64, 0x00});
+    types.insert(types.end(), {0x60, 0x02, I32, I32, 0x00});
+    types.insert(types.end(), {0x60, 0x05, I64, I32, I32, I32, I32, 0x01, I32});
+    types.insert(types.end(), {0x60, 0x00, 0x00});
+    appendSection(wasm, 1, types);
+
+    Bytes imports;
+    appendUnsigned(imports, 3);
+    char const* names[] = {"useGas", "revert", "call"};
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        appendName(imports, "ethereum");
+        appendName(imports, names[i]);
+        imports.push_back(0x00);
+        appendUnsigned(imports, i);
+    }
+    appendSection(wasm, 2, imports);
+
+    appendSection(wasm, 3, {0x01, 0x03});
+    appendSection(wasm, 5, {0x01, 0x00, 0x01});
+
+    Bytes exports;
+    appendUnsigned(exports, 2);
+    appendName(exports, "main");
+    exports.push_back(0x00);
+    appendUnsigned(exports, 3);
+    appendName(exports, "memory");
+    exports.push_back(0x02);
+    appendUnsigned(exports, 0);
+    appendSection(wasm, 7, exports);
+
+    Bytes body = {0x00, 0x42};
+    appendSigned(body, gasUsed);
+    body.insert(body.end(), {0x10, 0x00});
+    switch (ending)
+    {
+    case Ending::Finish:
+        break;
+    case Ending::Revert:
+        body.insert(body.end(), {0x41, 0x00, 0x41, 0x00, 0x10, 0x01});
+        break;
+    case Ending::Call:
+        // Calls the zero address, with the zero value and no input, found at
+        // the start of the memory.
+        body.push_back(0x42);
+        appendSigned(body, calleeGasUsed);
+        body.insert(body.end(), {0x41, 0x00, 0x41, 0x00, 0x41, 0x00, 0x41, 0x00, 0x10, 0x02, 0x1a});
+        break;
+    }
+    body.push_back(0x0b);
+
+    Bytes code;
+    appendUnsigned(code, 1);
+    appendUnsigned(code, body.size());
+    code.insert(code.end(), body.begin(), body.end());
+    appendSection(wasm, 10, code);
+    return wasm;
+}
+
+// Whose callees use all the gas forwarded to them.
+class Host : public BenchmarkHost
+{
+protected:
+    evmc_result call(evmc_message const&) override
+    {
+        evmc_result ret;
+        memset(&ret, 0, sizeof(ret));
+        ret.status_code = EVMC_SUCCESS;
+        return ret;
+    }
+};
+
+// The call costs 700 and forwards 6300, which needs 6400 before the call as
+// one 64th is retained: 100 + 700 + 6400.
+const Case cases[] = {
+    {"finish", true, 1000, Ending::Finish, EVMC_SUCCESS, 99000, 1000},
+    {"revert", true, 500, Ending::Revert, EVMC_REVERT, 99500, 500},
+    {"call", true, 100, Ending::Call, EVMC_SUCCESS, 92900, 7200},
+    {"call without estimation", false, 100, Ending::Call, EVMC_SUCCESS, 92900, 0},
+};
+}  // namespace
+
+int main()
+{
+    int failures = 0;
+    for (auto const& c : cases)
+    {
+        evmc_instance* hera = evmc_create_hera();
+        if (evmc_set_option(hera, "gas-estimation", c.estimation ? "true" : "false") !=
+            EVMC_SET_OPTION_SUCCESS)
+        {
+            fprintf(stderr, "Cannot set the gas estimation\n");
+            return 1;
+        }
+
+        Bytes code = buildContract(c.gasUsed, c.ending);
+        Host host;
+        evmc_message msg{};
+        msg.kind = EVMC_CALL;
+        msg.gas = 100000;
+
+        evmc_result result =
+            hera->execute(hera, &host, EVMC_BYZANTIUM, &msg, code.data(), code.size());
+        int64_t gasRequired = hera_get_required_gas(&result);
+        if (result.status_code != c.status || result.gas_left != c.gasLeft ||
+            gasRequired != c.gasRequired)
+        {
+            fprintf(stderr, "%s: status %d, gas left %lld, required gas %lld\n", c.name,
+                static_cast<int>(result.status_code), static_cast<long long>(result.gas_left),
+                static_cast<long long>(gasRequired));
+            ++failures;
+        }
+        if (result.release)
+            result.release(&result);
+
+        hera->destroy(hera);
+    }
+    return failures ? 1 : 0;
+}
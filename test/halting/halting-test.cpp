@@ -0,0 +1,182 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs contracts which call finish, revert or selfDestruct from a function
+// called by main, directly or through the table, and checks that execution
+// stops there under each engine Hera is built with.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark-host.h"
+#include "contract-builder.h"
+
+using namespace hera;
+
+namespace
+{
+const char* const engines[] = {"binaryen", "wavm"};
+
+enum class Ending
+{
+    Finish,
+    Revert,
+    SelfDestruct
+};
+
+struct Case
+{
+    const char* name;
+    Ending ending;
+    bool indirect;
+    evmc_status_code status;
+    const char* output;
+};
+
+// Whose main calls a function which ends as per @ending and traps otherwise,
+// and traps itself once that function returns. Its imports are finish, revert
+// and selfDestruct, followed by main and the function, which is the only
+// element of the table. The memory starts with "hera", which finish and
+// revert return.
+Bytes buildContract(Ending ending, bool indirect)
+{
+    Bytes wasm = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+
+    Bytes types;
+    appendUnsigned(types, 4);
+    types.insert(types.end(), {0x60, 0x02, I32, I32, 0x00});
+    types.insert(types.end(), {0x60, 0x01, I32, 0x00});
+    types.insert(types.end(), {0x60, 0x00, 0x01, I32});
+    types.insert(types.end(), {0x60, 0x00, 0x00});
+    appendSection(wasm, 1, types);
+
+    Bytes imports;
+    appendUnsigned(imports, 3);
+    char const* names[] = {"finish", "revert", "selfDestruct"};
+    unsigned const importTypes[] = {0, 0, 1};
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        appendName(imports, "ethereum");
+        appendName(imports, names[i]);
+        imports.push_back(0x00);
+        appendUnsigned(imports, importTypes[i]);
+    }
+    appendSection(wasm, 2, imports);
+
+    appendSection(wasm, 3, {0x02, 0x03, 0x02});
+    appendSection(wasm, 4, {0x01, 0x70, 0x00, 0x01});
+    appendSection(wasm, 5, {0x01, 0x00, 0x01});
+
+    Bytes exports;
+    appendUnsigned(exports, 2);
+    appendName(exports, "main");
+    exports.push_back(0x00);
+    appendUnsigned(exports, 3);
+    appendName(exports, "memory");
+    exports.push_back(0x02);
+    appendUnsigned(exports, 0);
+    appendSection(wasm, 7, exports);
+
+    appendSection(wasm, 9, {0x01, 0x00, 0x41, 0x00, 0x0b, 0x01, 0x04});
+
+    Bytes main = {0x00};
+    if (indirect)
+        main.insert(main.end(), {0x41, 0x00, 0x11, 0x02, 0x00});
+    else
+        main.insert(main.end(), {0x10, 0x04});
+    main.insert(main.end(), {0x1a, 0x00, 0x0b});
+
+    Bytes callee = {0x00};
+    switch (ending)
+    {
+    case Ending::Finish:
+        callee.insert(callee.end(), {0x41, 0x00, 0x41, 0x04, 0x10, 0x00});
+        break;
+    case Ending::Revert:
+        callee.insert(callee.end(), {0x41, 0x00, 0x41, 0x04, 0x10, 0x01});
+        break;
+    case Ending::SelfDestruct:
+        // The beneficiary is the zero address, found past "hera".
+        callee.insert(callee.end(), {0x41, 0x20, 0x10, 0x02});
+        break;
+    }
+    callee.insert(callee.end(), {0x00, 0x0b});
+
+    Bytes code;
+    appendUnsigned(code, 2);
+    for (Bytes const* body : {&main, &callee})
+    {
+        appendUnsigned(code, body->size());
+        code.insert(code.end(), body->begin(), body->end());
+    }
+    appendSection(wasm, 10, code);
+
+    appendSection(wasm, 11, {0x01, 0x00, 0x41, 0x00, 0x0b, 0x04, 'h', 'e', 'r', 'a'});
+    return wasm;
+}
+
+const Case cases[] = {
+    {"finish", Ending::Finish, false, EVMC_SUCCESS, "hera"},
+    {"revert", Ending::Revert, false, EVMC_REVERT, "hera"},
+    {"selfDestruct", Ending::SelfDestruct, false, EVMC_SUCCESS, ""},
+    {"finish through the table", Ending::Finish, true, EVMC_SUCCESS, "hera"},
+    {"revert through the table", Ending::Revert, true, EVMC_REVERT, "hera"},
+    {"selfDestruct through the table", Ending::SelfDestruct, true, EVMC_SUCCESS, ""},
+};
+}  // namespace
+
+int main()
+{
+    int failures = 0;
+    for (const char* engine : engines)
+    {
+        for (auto const& c : cases)
+        {
+            evmc_instance* hera = evmc_create_hera();
+            // Engines Hera is not built with are skipped.
+            if (evmc_set_option(hera, "engine", engine) != EVMC_SET_OPTION_SUCCESS)
+            {
+                hera->destroy(hera);
+                break;
+            }
+
+            Bytes code = buildContract(c.ending, c.indirect);
+            BenchmarkHost host;
+            evmc_message msg{};
+            msg.kind = EVMC_CALL;
+            msg.gas = 100000;
+
+            evmc_result result =
+                hera->execute(hera, &host, EVMC_BYZANTIUM, &msg, code.data(), code.size());
+            size_t outputSize = strlen(c.output);
+            if (result.status_code != c.status || result.output_size != outputSize ||
+                (outputSize && memcmp(result.output_data, c.output, outputSize) != 0))
+            {
+                fprintf(stderr, "%s: %s: status %d, output size %zu\n", engine, c.name,
+                    static_cast<int>(result.status_code), result.output_size);
+                ++failures;
+            }
+            if (result.release)
+                result.release(&result);
+
+            hera->destroy(hera);
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fills a budget with the entries of caches whose values are known and
+// checks the order they are evicted in, and that the module cache evicts its
+// cheapest entry once full.
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "memory-budget.h"
+#include "module-cache.h"
+
+using namespace hera;
+
+namespace
+{
+// Records the entries it evicts in a list shared with other caches.
+class Cache : private MemoryBudget::Evictor
+{
+public:
+    Cache(MemoryBudget& budget, std::vector<uint64_t>& evicted)
+      : m_evicted(evicted), m_account(&budget, "cache", this)
+    {}
+
+    void add(uint64_t id, size_t bytes, double value)
+    {
+        m_entries[id] = MemoryBudget::Candidate{id, bytes, value};
+        m_account.charge(bytes);
+    }
+
+private:
+    void candidates(std::vector<MemoryBudget::Candidate>& out) override
+    {
+        for (auto const& entry : m_entries)
+            out.push_back(entry.second);
+    }
+
+    void evict(uint64_t id) noexcept override
+    {
+        auto it = m_entries.find(id);
+        if (it == m_entries.end())
+            return;
+        m_account.release(it->second.bytes);
+        m_entries.erase(it);
+        m_evicted.push_back(id);
+    }
+
+    std::vector<uint64_t>& m_evicted;
+    std::map<uint64_t, MemoryBudget::Candidate> m_entries;
+    MemoryBudget::Account m_account;
+};
+
+class Module : public CachedModule
+{
+public:
+    size_t footprint() const override { return 100; }
+};
+
+int check(char const* name, bool passed)
+{
+    if (passed)
+        return 0;
+    fprintf(stderr, "%s\n", name);
+    return 1;
+}
+
+int testBudget()
+{
+    MemoryBudget budget;
+    std::vector<uint64_t> evicted;
+    Cache first(budget, evicted);
+    Cache second(budget, evicted);
+
+    // Values per byte of 10, 1, 2 and 50.
+    first.add(1, 100, 1000);
+    first.add(2, 100, 100);
+    second.add(3, 200, 400);
+    second.add(4, 100, 5000);
+    MemoryBudget::Charge instance(&budget.instances(), 300);
+
+    int failures = 0;
+    // 800 bytes above a limit of 700 go down to 612 at most: 2 and 3 make
+    // room for 300.
+    budget.setLimit(700);
+    failures += check("lowest value per byte first",
+        evicted == std::vector<uint64_t>{2, 3} && budget.total() == 500 && budget.evictions() == 2);
+
+    // Evicting every entry is not enough, the instance stays.
+    instance.update(700);
+    failures += check("instances are not evicted",
+        evicted == std::vector<uint64_t>{2, 3, 1, 4} && budget.total() == 700 &&
+            budget.instances().bytes() == 700);
+
+    instance.update(0);
+    failures += check("released", budget.total() == 0);
+    return failures;
+}
+
+int testModuleCache()
+{
+    ModuleCache cache;
+    const unsigned entries = 1024;
+    auto code = [](unsigned i) {
+        return std::vector<uint8_t>{static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8), 0xfe};
+    };
+    // The first took the least time to build.
+    for (unsigned i = 0; i < entries; ++i)
+        cache.store(code(i), std::make_shared<Module>(), i == 0 ? 1 : 1000);
+
+    int failures = check("filled", cache.lookup<Module>(code(0)) != nullptr);
+    cache.store(code(entries), std::make_shared<Module>(), 1000);
+    failures += check("cheapest module evicted when full",
+        !cache.lookup<Module>(code(0)) && cache.lookup<Module>(code(1)) &&
+            cache.lookup<Module>(code(entries)));
+    return failures;
+}
+}  // namespace
+
+int main()
+{
+    int failures = testBudget() + testModuleCache();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stores and looks up modules of the module cache from every NUMA node and
+// checks which node's module is returned. On a single node only the local
+// lookups are checked.
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "memory-budget.h"
+#include "module-cache.h"
+#include "numa.h"
+
+using namespace hera;
+
+namespace
+{
+class Module : public CachedModule
+{
+public:
+    size_t footprint() const override { return 100; }
+};
+
+int check(char const* name, bool passed)
+{
+    if (passed)
+        return 0;
+    fprintf(stderr, "%s\n", name);
+    return 1;
+}
+
+// The nodes which have CPUs to run on.
+std::vector<unsigned> nodesWithCpus()
+{
+    std::vector<unsigned> ret;
+    for (unsigned node = 0; node < Numa::nodeCount(); ++node)
+        if (Numa::cpuCount(node) > 0)
+            ret.push_back(node);
+    return ret;
+}
+}  // namespace
+
+int main()
+{
+    const std::vector<uint8_t> code{0x60, 0x00, 0x60, 0x00, 0xfd};
+    std::vector<unsigned> nodes = nodesWithCpus();
+    if (nodes.empty())
+    {
+        fprintf(stderr, "No node has CPUs\n");
+        return 1;
+    }
+
+    MemoryBudget budget;
+    ModuleCache cache(&budget);
+    int failures = 0;
+
+    auto first = std::make_shared<Module>();
+    {
+        Numa::Binding binding(nodes[0]);
+        cache.store(code, first, 1000);
+        size_t usage = budget.usage()["module-cache"];
+
+        bool remote = true;
+        auto found = cache.lookup<Module>(code, &remote);
+        failures += check("local lookup", found == first && !remote);
+
+        // The node has its module already.
+        cache.store(code, std::make_shared<Module>(), 1000);
+        failures += check("stored again on the same node",
+            cache.lookup<Module>(code) == first && budget.usage()["module-cache"] == usage);
+    }
+
+    if (nodes.size() < 2)
+    {
+        printf("A single NUMA node, lookups from other nodes not tested\n");
+        return failures ? 1 : 0;
+    }
+
+    Numa::Binding binding(nodes[1]);
+    size_t usage = budget.usage()["module-cache"];
+    bool remote = false;
+    auto found = cache.lookup<Module>(code, &remote);
+    failures += check("remote lookup", found == first && remote && cache.remoteHits() == 1);
+
+    auto second = std::make_shared<Module>();
+    cache.store(code, second, 1000);
+    failures += check("replica charged", budget.usage()["module-cache"] == usage + second->footprint());
+
+    remote = true;
+    found = cache.lookup<Module>(code, &remote);
+    failures += check("replica lookup", found == second && !remote && cache.remoteHits() == 1);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the native precompiles on known vectors, checking their output and
+// the gas they charge.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Vector
+{
+    const char* name;
+    uint8_t address;
+    int64_t gas;
+    std::string input;
+    evmc_status_code status;
+    int64_t gasLeft;
+    std::string output;
+};
+
+std::vector<uint8_t> fromHex(std::string const& hex)
+{
+    std::vector<uint8_t> ret;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        ret.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+    return ret;
+}
+
+std::string toHex(uint8_t const* data, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string ret;
+    for (size_t i = 0; i < size; ++i)
+    {
+        ret += digits[data[i] >> 4];
+        ret += digits[data[i] & 0xf];
+    }
+    return ret;
+}
+
+std::string word(unsigned value)
+{
+    char hex[65];
+    snprintf(hex, sizeof(hex), "%064x", value);
+    return hex;
+}
+
+// The secp256k1 field prime, the modulus of the EIP-198 examples.
+const std::string secp256k1P = "fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f";
+const std::string secp256k1PMinus1 = "fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2e";
+
+const std::string bn128Point1 =
+    "18b18acfb4c2c30276db5411368e7185b311dd124691610c5d3b74034e093dc9"
+    "063c909c4720840cb5134cb9f59fa749755796819658d32efc0d288198f37266";
+const std::string bn128Point2 =
+    "07c2b7f58a84bd6145f00c9c2bc0bb1a187f20ff2c92963a88019e7c6a014eed"
+    "06614e20c147e940f2d70da3f74c9a17df361706a4485c742bd6788478fa17d7";
+
+const Vector vectors[] = {
+    {"sha256 empty", 2, 100, "", EVMC_SUCCESS, 40,
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {"sha256 abc", 2, 100, "616263", EVMC_SUCCESS, 28,
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"sha256 out of gas", 2, 71, "616263", EVMC_OUT_OF_GAS, 0, ""},
+    {"ripemd160 empty", 3, 1000, "", EVMC_SUCCESS, 400,
+        "0000000000000000000000009c1185a5c5e9fc54612808977ee8f548b2258d31"},
+    {"ripemd160 abc", 3, 1000, "616263", EVMC_SUCCESS, 280,
+        "0000000000000000000000008eb208f7e05d987a9b044a8e98c6b087f15a0bfc"},
+    {"identity", 4, 100, "616263", EVMC_SUCCESS, 82, "616263"},
+    {"ecrecover", 1, 5000,
+        "456e9aea5e197a1f1af7a3e85a3212fa4049a3ba34c2289b4c860fc0b0c64ef3" + word(28) +
+            "9242685bf161793cc25603c231bc2f568eb630ea16aa137d2664ac8038825608"
+            "4f8ae3bd7535248d0bd448298cc2e2071e56992d0774dc340c368ae950852ada",
+        EVMC_SUCCESS, 2000, "0000000000000000000000007156526fbd7a3c72969b54f64e42c10fbb768c8a"},
+    {"ecrecover invalid v", 1, 5000,
+        "456e9aea5e197a1f1af7a3e85a3212fa4049a3ba34c2289b4c860fc0b0c64ef3" + word(29) +
+            "9242685bf161793cc25603c231bc2f568eb630ea16aa137d2664ac8038825608"
+            "4f8ae3bd7535248d0bd448298cc2e2071e56992d0774dc340c368ae950852ada",
+        EVMC_SUCCESS, 2000, ""},
+    {"ecrecover out of gas", 1, 2999, "", EVMC_OUT_OF_GAS, 0, ""},
+    {"modexp eip198 example 1", 5, 20000,
+        word(1) + word(32) + word(32) + "03" + secp256k1PMinus1 + secp256k1P, EVMC_SUCCESS, 6944,
+        word(1)},
+    {"modexp eip198 example 2", 5, 20000,
+        word(0) + word(32) + word(32) + secp256k1PMinus1 + secp256k1P, EVMC_SUCCESS, 6944, word(0)},
+    {"modexp zero modulus length", 5, 100, word(1) + word(1) + word(0) + "0203", EVMC_SUCCESS, 100,
+        ""},
+    {"modexp zero modulus", 5, 100, word(1) + word(1) + word(2) + "0203", EVMC_SUCCESS, 100,
+        "0000"},
+    {"modexp out of gas", 5, 13055,
+        word(1) + word(32) + word(32) + "03" + secp256k1PMinus1 + secp256k1P, EVMC_OUT_OF_GAS, 0,
+        ""},
+    {"bn128 add", 6, 1000, bn128Point1 + bn128Point2, EVMC_SUCCESS, 500,
+        "2243525c5efd4b9c3d3c45ac0ca3fe4dd85e830a4ce6b65fa1eeaee202839703"
+        "301d1d33be6da8e509df21cc35964723180eed7532537db9ae5e7d48f195c915"},
+    {"bn128 add infinity", 6, 1000, "", EVMC_SUCCESS, 500, word(0) + word(0)},
+    {"bn128 add invalid point", 6, 1000, word(1) + word(3), EVMC_FAILURE, 0, ""},
+    {"bn128 mul", 7, 50000,
+        "2bd3e6d0f3b142924f5ca7b49ce5b9d54c4703d7ae5648e61d02268b1a0a9fb7"
+        "21611ce0a6af85915e2f1d70300909ce2e49dfad4a4619c8390cae66cefdb204"
+        "00000000000000000000000000000000000000000000000011138ce750fa15c2",
+        EVMC_SUCCESS, 10000,
+        "070a8d6a982153cae4be29d434e8faef8a47b274a053f5a4ee2a6c9c13c31e5c"
+        "031b8ce914eba3a9ffb989f9cdd5b0f01943074bf4f0f315690ec3cec6981afc"},
+    {"bn128 mul out of gas", 7, 39999, "", EVMC_OUT_OF_GAS, 0, ""},
+};
+}  // namespace
+
+int main()
+{
+    evmc_instance* hera = evmc_create_hera();
+    if (evmc_set_option(hera, "native-precompiles", "true") != EVMC_SET_OPTION_SUCCESS)
+    {
+        fprintf(stderr, "Cannot enable the native precompiles\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (auto const& vector : vectors)
+    {
+        std::vector<uint8_t> input = fromHex(vector.input);
+        evmc_message msg{};
+        msg.kind = EVMC_CALL;
+        msg.destination.bytes[19] = vector.address;
+        msg.gas = vector.gas;
+        msg.input_data = input.data();
+        msg.input_size = input.size();
+
+        // Precompiles have no code.
+        evmc_result result = hera->execute(hera, nullptr, EVMC_BYZANTIUM, &msg, nullptr, 0);
+        std::string output = toHex(result.output_data, result.output_size);
+        if (result.status_code != vector.status || result.gas_left != vector.gasLeft ||
+            output != vector.output)
+        {
+            fprintf(stderr, "%s: status %d, gas left %lld, output %s\n", vector.name,
+                static_cast<int>(result.status_code), static_cast<long long>(result.gas_left),
+                output.c_str());
+            ++failures;
+        }
+        if (result.release)
+            result.release(&result);
+    }
+
+    hera->destroy(hera);
+    return failures ? 1 : 0;
+}
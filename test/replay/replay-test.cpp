@@ -0,0 +1,120 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Records messages which read storage, the balance and the transaction
+// context, log and make a call against a mock host, into the file given as
+// the argument. The replay test then runs hera-replay on it, which must
+// reproduce every result and host callback.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark-host.h"
+
+using namespace hera;
+
+namespace
+{
+// Stores the sum of the storage slot 0, the timestamp and its balance at 0
+// and logs it, places the output of a static call to the address 0x42 at 32,
+// and returns both words.
+const uint8_t code[] = {
+    0x60, 0x00, 0x54, 0x42, 0x01, 0x30, 0x31, 0x01, 0x60, 0x00, 0x52,
+    0x60, 0x20, 0x60, 0x00, 0xa0,
+    0x60, 0x20, 0x60, 0x20, 0x60, 0x20, 0x60, 0x00, 0x60, 0x42, 0x5a, 0xfa, 0x50,
+    0x60, 0x40, 0x60, 0x00, 0xf3};
+// Reverts with the storage slot 1.
+const uint8_t revertCode[] = {0x60, 0x01, 0x54, 0x60, 0x00, 0x52, 0x60, 0x20, 0x60, 0x00, 0xfd};
+
+const uint8_t slotValue = 5;
+const uint8_t callOutput = 0xab;
+
+class Host : public BenchmarkHost
+{
+protected:
+    evmc_bytes32 getStorage(evmc_address const&, evmc_bytes32 const& key) override
+    {
+        evmc_bytes32 ret{};
+        ret.bytes[31] = static_cast<uint8_t>(slotValue + key.bytes[31]);
+        return ret;
+    }
+
+    evmc_result call(evmc_message const&) override
+    {
+        static uint8_t output[32];
+        memset(output, callOutput, sizeof(output));
+        evmc_result ret;
+        memset(&ret, 0, sizeof(ret));
+        ret.status_code = EVMC_SUCCESS;
+        ret.output_data = output;
+        ret.output_size = sizeof(output);
+        return ret;
+    }
+};
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <recording>\n", argv[0]);
+        return 2;
+    }
+
+    evmc_instance* hera = evmc_create_hera();
+    if (evmc_set_option(hera, "evm1mode", "interpret") != EVMC_SET_OPTION_SUCCESS ||
+        evmc_set_option(hera, "record", argv[1]) != EVMC_SET_OPTION_SUCCESS)
+    {
+        fprintf(stderr, "Cannot record to %s\n", argv[1]);
+        return 1;
+    }
+
+    int failures = 0;
+    Host host;
+    evmc_message msg{};
+    msg.kind = EVMC_CALL;
+    msg.gas = 100000;
+    msg.destination.bytes[19] = 2;
+
+    evmc_result result = hera->execute(hera, &host, EVMC_BYZANTIUM, &msg, code, sizeof(code));
+    if (result.status_code != EVMC_SUCCESS || result.output_size != 64 ||
+        result.output_data[31] != slotValue || result.output_data[63] != callOutput)
+    {
+        fprintf(stderr, "call: status %d, output size %zu\n", static_cast<int>(result.status_code),
+            result.output_size);
+        ++failures;
+    }
+    if (result.release)
+        result.release(&result);
+
+    result = hera->execute(hera, &host, EVMC_BYZANTIUM, &msg, revertCode, sizeof(revertCode));
+    if (result.status_code != EVMC_REVERT || result.output_size != 32 ||
+        result.output_data[31] != slotValue + 1)
+    {
+        fprintf(stderr, "revert: status %d, output size %zu\n",
+            static_cast<int>(result.status_code), result.output_size);
+        ++failures;
+    }
+    if (result.release)
+        result.release(&result);
+
+    // Closes the recording.
+    hera->destroy(hera);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Repeats a static call reading a storage slot while changing the storage,
+// and checks from the phase times that it only runs again once the slot it
+// read changed, returning the new value.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark-host.h"
+
+using namespace hera;
+
+namespace
+{
+// Returns the value of the storage slot 0.
+const uint8_t code[] = {0x60, 0x00, 0x54, 0x60, 0x00, 0x52, 0x60, 0x20, 0x60, 0x00, 0xf3};
+
+// Of two storage slots, 0 and 1.
+class Host : public BenchmarkHost
+{
+public:
+    Host() { memset(m_slots, 0, sizeof(m_slots)); }
+
+    void set(unsigned slot, uint8_t value) { m_slots[slot].bytes[31] = value; }
+
+protected:
+    evmc_bytes32 getStorage(evmc_address const&, evmc_bytes32 const& key) override
+    {
+        return m_slots[key.bytes[31] & 1];
+    }
+
+private:
+    evmc_bytes32 m_slots[2];
+};
+
+struct Step
+{
+    const char* name;
+    // The slot changed before the call and its new value.
+    unsigned slot;
+    uint8_t value;
+    bool isStatic;
+    int64_t gas;
+    // The value returned and the executions which ran so far.
+    uint8_t output;
+    uint64_t executions;
+};
+
+const Step steps[] = {
+    {"first call", 0, 1, true, 100000, 1, 1},
+    {"repeated", 0, 1, true, 100000, 1, 1},
+    {"more gas", 0, 1, true, 200000, 1, 1},
+    {"other slot changed", 1, 7, true, 100000, 1, 1},
+    {"read slot changed", 0, 2, true, 100000, 2, 2},
+    {"repeated after the change", 0, 2, true, 100000, 2, 2},
+    {"not static", 0, 2, false, 100000, 2, 3},
+    {"read slot changed back", 0, 1, true, 100000, 1, 4},
+};
+}  // namespace
+
+int main()
+{
+    evmc_instance* hera = evmc_create_hera();
+    if (evmc_set_option(hera, "evm1mode", "interpret") != EVMC_SET_OPTION_SUCCESS ||
+        evmc_set_option(hera, "static-call-cache", "true") != EVMC_SET_OPTION_SUCCESS ||
+        evmc_set_option(hera, "phase-times", "true") != EVMC_SET_OPTION_SUCCESS)
+    {
+        fprintf(stderr, "Cannot set the options\n");
+        return 1;
+    }
+
+    int failures = 0;
+    Host host;
+    int64_t gasUsed = -1;
+    for (auto const& step : steps)
+    {
+        host.set(step.slot, step.value);
+
+        evmc_message msg{};
+        msg.kind = EVMC_CALL;
+        msg.flags = step.isStatic ? EVMC_STATIC : 0;
+        msg.gas = step.gas;
+        evmc_result result = hera->execute(hera, &host, EVMC_BYZANTIUM, &msg, code, sizeof(code));
+
+        hera_phase_times times;
+        hera_get_phase_times(hera, &times);
+        // Reusing a result charges the gas the call used.
+        if (gasUsed < 0)
+            gasUsed = msg.gas - result.gas_left;
+        if (result.status_code != EVMC_SUCCESS || result.output_size != 32 ||
+            result.output_data[31] != step.output || msg.gas - result.gas_left != gasUsed ||
+            times.executions != step.executions)
+        {
+            fprintf(stderr, "%s: status %d, output %u, gas used %lld, executions %llu\n", step.name,
+                static_cast<int>(result.status_code),
+                result.output_size == 32 ? result.output_data[31] : 0u,
+                static_cast<long long>(msg.gas - result.gas_left),
+                static_cast<unsigned long long>(times.executions));
+            ++failures;
+        }
+        if (result.release)
+            result.release(&result);
+    }
+
+    hera_memory_usage usage;
+    hera_get_memory_usage(hera, &usage);
+    if (usage.static_call_cache == 0)
+    {
+        fprintf(stderr, "Nothing accounted to the static call cache\n");
+        ++failures;
+    }
+
+    hera->destroy(hera);
+    return failures ? 1 : 0;
+}
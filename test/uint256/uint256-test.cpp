@@ -0,0 +1,163 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the 256-bit division and modular arithmetic of the EVM1
+// interpreter against results computed with arbitrary precision, including
+// divisions which take the rare correction steps of Knuth's algorithm D.
+
+#include <cstdio>
+#include <cstring>
+
+#include "uint256.h"
+
+using namespace hera;
+
+namespace
+{
+uint256 parse(const char* hex)
+{
+    uint256 ret = makeUint256(0);
+    size_t length = strlen(hex);
+    for (size_t i = 2; i < length; ++i)
+    {
+        char c = hex[i];
+        uint64_t digit = c <= '9' ? uint64_t(c - '0') : uint64_t(c - 'a' + 10);
+        size_t bit = 4 * (length - 1 - i);
+        ret.w[bit / 64] |= digit << (bit % 64);
+    }
+    return ret;
+}
+
+void print(uint256 const& a)
+{
+    fprintf(stderr, "0x%016llx%016llx%016llx%016llx", static_cast<unsigned long long>(a.w[3]),
+        static_cast<unsigned long long>(a.w[2]), static_cast<unsigned long long>(a.w[1]),
+        static_cast<unsigned long long>(a.w[0]));
+}
+
+int failures = 0;
+
+void check(const char* name, uint256 const& actual, const char* expected)
+{
+    if (actual == parse(expected))
+        return;
+    fprintf(stderr, "%s: ", name);
+    print(actual);
+    fprintf(stderr, " instead of %s\n", expected);
+    ++failures;
+}
+
+// a, b, a / b, a % b
+const char* const divisions[][4] = {
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x1", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x0"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x1", "0x0"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x10000000000000000", "0xffffffffffffffffffffffffffffffffffffffffffffffff", "0xffffffffffffffff"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x100000000000000000000000000000001", "0xffffffffffffffffffffffffffffffff", "0x0"},
+    {"0x8000000000000000000000000000000000000000000000000000000000000000", "0x3", "0x2aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", "0x2"},
+    {"0x27e41b3246bec9b16e398115", "0x3ade68b1", "0xad78ebab718c0b66", "0x9502f8f"},
+    {"0x1ffffffffffffffff80000000000000017fffffffffffffff", "0x10000000080000000000000000000000100000000", "0x1fffffffe", "0x1000000007fffffffffffffff80000001ffffffff"},
+    {"0xffffffffffffffff00000001000000007fffffffffffffff8000000000000001", "0xffffffffffffffff0000000100000000ffffffffffffffff0000000000000002", "0x0", "0xffffffffffffffff00000001000000007fffffffffffffff8000000000000001"},
+    {"0x5", "0x7", "0x0", "0x5"},
+    {"0x0", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x0", "0x0"},
+};
+
+// a, b, mod, (a + b) % mod
+const char* const addMods[][4] = {
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x0"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x3", "0x0"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x1", "0xfffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffe", "0x2"},
+    {"0x8000000000000000000000000000000000000000000000000000000000000000", "0x8000000000000000000000000000000000000000000000000000000000000000", "0x8000000000000000000000000000000000000000000000000000000000000001", "0x7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"},
+    {"0xa", "0x14", "0x7", "0x2"},
+};
+
+// a, b, mod, (a * b) % mod
+const char* const mulMods[][4] = {
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0xfffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffe", "0x1"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x7", "0x1"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x2", "0x3", "0x0"},
+    {"0x100000000000000000000000000000000000000000000000000", "0x100000000000000000000000000000000000000000000000000", "0x7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffed", "0x26000000000000000000000000000000000000"},
+    {"0xffffffffffffffff00000000ffffffff80000000000000008000000000000000", "0xfffffffffffffffeffffffffffffffff8000000000000000ffffffffffffffff", "0xfffffffffffffffe00000000ffffffffffffffffffffffff8000000000000001", "0xbffffff900000008bffffffb800000027fffffffbffffffe000000027ffffffd"},
+    {"0x3", "0x4", "0x1", "0x0"},
+};
+
+// base, exponent, base ** exponent % 2**256
+const char* const exps[][3] = {
+    {"0x2", "0xff", "0x8000000000000000000000000000000000000000000000000000000000000000"},
+    {"0x2", "0x100", "0x0"},
+    {"0x3", "0x0", "0x1"},
+    {"0x0", "0x0", "0x1"},
+    {"0x0", "0x5", "0x0"},
+    {"0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x2", "0x1"},
+    {"0x7", "0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", "0x6db6db6db6db6db6db6db6db6db6db6db6db6db6db6db6db6db6db6db6db6db7"},
+    {"0x3", "0x3e8", "0xce065bd2a048f32939dc42ec08348318c4940c56f7867dbe5616937bd3b85b21"},
+};
+
+// Limbs which make the estimates of the quotient digits go wrong.
+const uint64_t limbs[] = {0, 1, 2, 0xffffffffffffffff, 0xfffffffffffffffe, 0x8000000000000000,
+    0x7fffffffffffffff, 0x8000000000000001, 0x100000000, 0xffffffff};
+}  // namespace
+
+int main()
+{
+    for (auto const& c : divisions)
+    {
+        uint256 q;
+        uint256 r;
+        divide(parse(c[0]), parse(c[1]), &q, &r);
+        check("quotient", q, c[2]);
+        check("remainder", r, c[3]);
+    }
+    for (auto const& c : addMods)
+        check("addMod", addMod(parse(c[0]), parse(c[1]), parse(c[2])), c[3]);
+    for (auto const& c : mulMods)
+        check("mulMod", mulMod(parse(c[0]), parse(c[1]), parse(c[2])), c[3]);
+    for (auto const& c : exps)
+        check("exp", exp(parse(c[0]), parse(c[1])), c[2]);
+
+    // Every quotient and remainder of words made of these limbs recombine to
+    // the dividend.
+    const unsigned count = sizeof(limbs) / sizeof(limbs[0]);
+    uint64_t state = 1;
+    for (unsigned i = 0; i < 100000; ++i)
+    {
+        uint256 a;
+        uint256 b;
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            a.w[j] = limbs[(state >> 33) % count];
+            b.w[j] = limbs[(state >> 45) % count];
+        }
+        // Divisors of every length.
+        for (unsigned j = (state >> 60) % 4 + 1; j < 4; ++j)
+            b.w[j] = 0;
+        if (isZero(b))
+            continue;
+        uint256 q;
+        uint256 r;
+        divide(a, b, &q, &r);
+        if (!(q * b + r == a) || !(r < b))
+        {
+            fprintf(stderr, "divide: ");
+            print(a);
+            fprintf(stderr, " by ");
+            print(b);
+            fprintf(stderr, "\n");
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}
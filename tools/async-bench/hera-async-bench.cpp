@@ -0,0 +1,285 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Compares the throughput of a batch of storage bound transactions executed
+// one after the other with blocking storage loads, as a client without an
+// async host would, against hera_execute_async_batch().
+//
+// Every transaction runs a generated contract loading a number of storage
+// slots of its own account, none of which are cached. The simulated store
+// completes a load a fixed latency after it was requested and serves any
+// number of loads in parallel, like a disk with a deep queue or a remote
+// state service.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+#include <evmc/helpers.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "benchmark-host.h"
+#include "contract-builder.h"
+
+using namespace std;
+using namespace hera;
+
+namespace {
+
+/*
+ * Contract generation
+ */
+
+// Builds a contract loading the storage slots reads..1 of its account.
+Bytes buildContract(uint32_t reads)
+{
+  Bytes module = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+
+  // Type 0 is () -> (), type 1 is storageLoad(i32, i32).
+  appendSection(module, 1, { 0x02, 0x60, 0x00, 0x00, 0x60, 0x02, I32, I32, 0x00 });
+
+  Bytes imports = { 0x01 };
+  appendName(imports, "ethereum");
+  appendName(imports, "storageLoad");
+  imports.insert(imports.end(), { 0x00, 0x01 });
+  appendSection(module, 2, imports);
+
+  appendSection(module, 3, { 0x01, 0x00 });
+  appendSection(module, 5, { 0x01, 0x00, 0x01 });
+
+  Bytes exports = { 0x02 };
+  appendName(exports, "main");
+  exports.insert(exports.end(), { 0x00, 0x01 });
+  appendName(exports, "memory");
+  exports.insert(exports.end(), { 0x02, 0x00 });
+  appendSection(module, 7, exports);
+
+  // The key is the counter at offset 0, the value is stored at offset 32.
+  Bytes main = { 0x01, 0x01, I32 };
+  main.push_back(0x41);
+  appendSigned(main, static_cast<int32_t>(reads));
+  main.insert(main.end(), { 0x21, 0x00, 0x03, 0x40 });
+  main.insert(main.end(), { 0x41, 0x00, 0x20, 0x00, 0x36, 0x02, 0x00 });
+  main.insert(main.end(), { 0x41, 0x00, 0x41, 0x20, 0x10, 0x00 });
+  // counter -= 1, loop while non-zero
+  main.insert(main.end(), { 0x20, 0x00, 0x41, 0x01, 0x6b, 0x22, 0x00, 0x0d, 0x00, 0x0b, 0x0b });
+
+  Bytes code = { 0x01 };
+  appendUnsigned(code, main.size());
+  code.insert(code.end(), main.begin(), main.end());
+  appendSection(module, 10, code);
+
+  return module;
+}
+
+/*
+ * Simulated store
+ */
+
+using Clock = chrono::steady_clock;
+
+// Storage slots which become available a fixed latency after they were
+// first requested. All slots hold zero.
+class SimulatedStore {
+public:
+  explicit SimulatedStore(chrono::microseconds latency): m_latency(latency) {}
+
+  // Starts loading the slot if needed and returns whether it is loaded.
+  bool ready(evmc_address const& address, evmc_bytes32 const& key)
+  {
+    auto it = m_slots.find(make_pair(address, key));
+    if (it == m_slots.end()) {
+      m_slots.emplace(make_pair(address, key), Clock::now() + m_latency);
+      return false;
+    }
+    return it->second <= Clock::now();
+  }
+
+  // Blocks until the slot is loaded, as a synchronous client would.
+  void load(evmc_address const& address, evmc_bytes32 const& key)
+  {
+    if (!ready(address, key))
+      this_thread::sleep_until(m_slots[make_pair(address, key)]);
+  }
+
+  // Blocks until the next pending load completed.
+  void wait()
+  {
+    Clock::time_point now = Clock::now();
+    Clock::time_point next = Clock::time_point::max();
+    for (auto const& slot: m_slots)
+      if (slot.second > now)
+        next = min(next, slot.second);
+    if (next != Clock::time_point::max())
+      this_thread::sleep_until(next);
+  }
+
+  size_t loads() const { return m_slots.size(); }
+
+private:
+  chrono::microseconds m_latency;
+  // When each requested slot is loaded.
+  map<pair<evmc_address, evmc_bytes32>, Clock::time_point> m_slots;
+};
+
+// The async host, reporting the state of the store.
+class AsyncHost : public hera_async_host {
+public:
+  explicit AsyncHost(SimulatedStore& store):
+    hera_async_host{storageReady, alwaysReady, alwaysReady, wait},
+    m_store(store)
+  {}
+
+private:
+  static SimulatedStore& store(hera_async_host* host) { return static_cast<AsyncHost*>(host)->m_store; }
+
+  static bool storageReady(hera_async_host* host, evmc_address const* address, evmc_bytes32 const* key)
+  {
+    return store(host).ready(*address, *key);
+  }
+
+  static bool alwaysReady(hera_async_host*, evmc_address const*) { return true; }
+  static void wait(hera_async_host* host) { store(host).wait(); }
+
+  SimulatedStore& m_store;
+};
+
+// Serves storage from the store, waiting for loads which are not complete.
+class BlockingHost : public BenchmarkHost {
+public:
+  explicit BlockingHost(SimulatedStore& store): m_store(store) {}
+
+protected:
+  evmc_bytes32 getStorage(evmc_address const& address, evmc_bytes32 const& key) override
+  {
+    m_store.load(address, key);
+    return {};
+  }
+
+private:
+  SimulatedStore& m_store;
+};
+
+/*
+ * Measurement
+ */
+
+// Runs a batch of transactions, each against an account of its own, and
+// returns the seconds taken or a negative value if any failed.
+double runBatch(evmc_instance* vm, Bytes const& code, size_t transactions, chrono::microseconds latency, bool async)
+{
+  SimulatedStore store(latency);
+  BlockingHost host(store);
+  AsyncHost asyncHost(store);
+
+  vector<evmc_message> messages(transactions);
+  vector<hera_batch_item> items(transactions);
+  for (size_t i = 0; i < transactions; ++i) {
+    evmc_message& msg = messages[i];
+    memset(&msg, 0, sizeof(msg));
+    msg.kind = EVMC_CALL;
+    msg.gas = gasLimit;
+    for (size_t byte = 0; byte < sizeof(size_t); ++byte)
+      msg.destination.bytes[sizeof(msg.destination.bytes) - 1 - byte] = static_cast<uint8_t>(i >> (8 * byte));
+    items[i] = hera_batch_item{&host, EVMC_BYZANTIUM, &msg, code.data(), code.size()};
+  }
+
+  vector<evmc_result> results(transactions);
+  auto start = Clock::now();
+  hera_batch_arena* arena = async ?
+    hera_execute_async_batch(vm, &asyncHost, items.data(), results.data(), transactions) :
+    hera_execute_batch(vm, items.data(), results.data(), transactions, 1);
+  double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+  bool success = arena != nullptr;
+  for (auto const& result: results)
+    success = success && result.status_code == EVMC_SUCCESS;
+  hera_release_batch(arena);
+  return success ? seconds : -1;
+}
+
+int usage(char const* name)
+{
+  cerr << "Usage: " << name << " [options] [<hera option>=<value>...]\n"
+       << "\n"
+       << "  --transactions <n>   transactions per batch (default 1000)\n"
+       << "  --reads <n>          storage loads per transaction (default 4)\n"
+       << "  --latency <us>       latency of every load in microseconds (default 100)\n"
+       << "\n"
+       << "Hera options are passed to set_option, e.g. engine=wabt.\n";
+  return 2;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  size_t transactions = 1000;
+  uint32_t reads = 4;
+  chrono::microseconds latency(100);
+  vector<pair<string, string>> options;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--transactions" && hasValue)
+      transactions = static_cast<size_t>(max(1, atoi(argv[++i])));
+    else if (arg == "--reads" && hasValue)
+      reads = static_cast<uint32_t>(max(1, atoi(argv[++i])));
+    else if (arg == "--latency" && hasValue)
+      latency = chrono::microseconds(max(0, atoi(argv[++i])));
+    else if (arg.find('=') != string::npos && arg[0] != '-')
+      options.emplace_back(arg.substr(0, arg.find('=')), arg.substr(arg.find('=') + 1));
+    else
+      return usage(argv[0]);
+  }
+
+  evmc_instance* vm = evmc_create_hera();
+  for (auto const& option: options) {
+    if (evmc_set_option(vm, option.first.c_str(), option.second.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+      cerr << "Invalid option: " << option.first << "=" << option.second << "\n";
+      vm->destroy(vm);
+      return 2;
+    }
+  }
+
+  Bytes code = buildContract(reads);
+  double blocking = runBatch(vm, code, transactions, latency, false);
+  double async = blocking < 0 ? -1 : runBatch(vm, code, transactions, latency, true);
+  vm->destroy(vm);
+  if (blocking < 0 || async < 0) {
+    cerr << "A transaction failed\n";
+    return 1;
+  }
+
+  cout << transactions << " transactions, " << reads << " loads each, " << latency.count() << " us per load\n"
+       << fixed << setprecision(0)
+       << left << setw(10) << "blocking" << right << setw(12) << transactions / blocking << " tx/s\n"
+       << left << setw(10) << "async" << right << setw(12) << transactions / async << " tx/s\n"
+       << setprecision(2) << "speedup " << blocking / async << "x\n";
+  return 0;
+}
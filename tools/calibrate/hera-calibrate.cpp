@@ -0,0 +1,470 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of every class of Wasm instructions and of every EEI
+// method, to calibrate gas schedules against.
+//
+// Each benchmark is a generated contract repeating a short pattern in a
+// loop. The executed instructions and EEI calls are counted once with the
+// "instrument" option, then the contract is timed without it. Costs are
+// reported relative to the empty loop, so the time of a pattern's operands
+// (e.g. the local.get feeding an i64.clz) is included in its class.
+//
+// Instruction gas follows a flat schedule of one gas per instruction unless
+// a file with "<class> <gas>" lines is passed with --schedule. EEI gas is
+// what Hera charges.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+#include <evmc/helpers.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "benchmark-host.h"
+#include "contract-builder.h"
+
+using namespace std;
+using namespace hera;
+
+namespace {
+
+/*
+ * Contract generation
+ */
+
+struct Signature {
+  vector<uint8_t> params;
+  vector<uint8_t> results;
+};
+
+struct Benchmark {
+  // The instruction class or EEI method measured.
+  string target;
+  bool eei;
+  // A stack neutral instruction sequence, repeated in the loop.
+  Bytes pattern;
+  // The EEI method the pattern may call as function 0.
+  Signature import;
+};
+
+// Local indices of the generated main function.
+const uint8_t counterLocal = 0;
+const uint8_t aLocal = 1;
+const uint8_t bLocal = 2;
+
+// Builds a contract running benchmark.pattern unroll times per iteration.
+// Function "nop" (also at table index 0) can be called by the pattern.
+Bytes buildContract(Benchmark const& benchmark, uint32_t iterations, unsigned unroll)
+{
+  bool hasImport = benchmark.eei;
+  uint32_t imports = hasImport ? 1 : 0;
+
+  Bytes module = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+
+  // Type 0 is () -> (), type 1 is the imported signature.
+  Bytes types;
+  appendUnsigned(types, hasImport ? 2 : 1);
+  types.insert(types.end(), { 0x60, 0x00, 0x00 });
+  if (hasImport) {
+    types.push_back(0x60);
+    appendUnsigned(types, benchmark.import.params.size());
+    types.insert(types.end(), benchmark.import.params.begin(), benchmark.import.params.end());
+    appendUnsigned(types, benchmark.import.results.size());
+    types.insert(types.end(), benchmark.import.results.begin(), benchmark.import.results.end());
+  }
+  appendSection(module, 1, types);
+
+  if (hasImport) {
+    Bytes importSection = { 0x01 };
+    appendName(importSection, "ethereum");
+    appendName(importSection, benchmark.target);
+    importSection.insert(importSection.end(), { 0x00, 0x01 });
+    appendSection(module, 2, importSection);
+  }
+
+  appendSection(module, 3, { 0x02, 0x00, 0x00 });
+  // A table and memory of minimum size 1.
+  appendSection(module, 4, { 0x01, 0x70, 0x00, 0x01 });
+  appendSection(module, 5, { 0x01, 0x00, 0x01 });
+  // A mutable i64 global initialised to zero.
+  appendSection(module, 6, { 0x01, I64, 0x01, 0x42, 0x00, 0x0b });
+
+  Bytes exports = { 0x02 };
+  appendName(exports, "main");
+  exports.push_back(0x00);
+  appendUnsigned(exports, imports);
+  appendName(exports, "memory");
+  exports.insert(exports.end(), { 0x02, 0x00 });
+  appendSection(module, 7, exports);
+
+  Bytes elements = { 0x01, 0x00, 0x41, 0x00, 0x0b, 0x01 };
+  appendUnsigned(elements, imports + 1);
+  appendSection(module, 9, elements);
+
+  Bytes main = { 0x02, 0x01, I32, 0x02, I64 };
+  main.push_back(0x41);
+  appendSigned(main, static_cast<int32_t>(iterations));
+  main.insert(main.end(), { 0x21, counterLocal });
+  main.insert(main.end(), { 0x42, 0x07, 0x21, aLocal });
+  main.insert(main.end(), { 0x42, 0x03, 0x21, bLocal });
+  main.insert(main.end(), { 0x03, 0x40 });
+  for (unsigned i = 0; i < unroll; ++i)
+    main.insert(main.end(), benchmark.pattern.begin(), benchmark.pattern.end());
+  // counter -= 1, loop while non-zero
+  main.insert(main.end(), { 0x20, counterLocal, 0x41, 0x01, 0x6b, 0x22, counterLocal, 0x0d, 0x00, 0x0b, 0x0b });
+
+  Bytes code = { 0x02 };
+  appendUnsigned(code, main.size());
+  code.insert(code.end(), main.begin(), main.end());
+  code.insert(code.end(), { 0x02, 0x00, 0x0b });
+  appendSection(module, 10, code);
+
+  return module;
+}
+
+vector<Benchmark> instructionBenchmarks(uint8_t nop)
+{
+  return {
+    { "loop", false, {}, {} },
+    { "local", false, { 0x20, aLocal, 0x21, bLocal }, {} },
+    { "global", false, { 0x23, 0x00, 0x24, 0x00 }, {} },
+    { "const", false, { 0x42, 0x05, 0x21, bLocal }, {} },
+    { "unary", false, { 0x20, aLocal, 0x79, 0x21, aLocal }, {} },
+    { "binary", false, { 0x20, aLocal, 0x20, bLocal, 0x7c, 0x21, aLocal }, {} },
+    { "multiply", false, { 0x20, aLocal, 0x20, bLocal, 0x7e, 0x21, aLocal }, {} },
+    { "divide", false, { 0x20, aLocal, 0x20, bLocal, 0x80, 0x21, aLocal }, {} },
+    { "load", false, { 0x41, 0x00, 0x29, 0x03, 0x00, 0x21, aLocal }, {} },
+    { "store", false, { 0x41, 0x00, 0x20, aLocal, 0x37, 0x03, 0x00 }, {} },
+    { "call", false, { 0x10, nop }, {} },
+    { "callIndirect", false, { 0x41, 0x00, 0x11, 0x00, 0x00 }, {} },
+    { "control", false, { 0x02, 0x40, 0x0c, 0x00, 0x0b }, {} },
+    { "memory", false, { 0x3f, 0x00, 0x1a }, {} },
+  };
+}
+
+vector<Benchmark> eeiBenchmarks()
+{
+  // Arguments are offsets of zeroed memory, or a length of 32.
+  Bytes zero = { 0x41, 0x00 };
+  Bytes length = { 0x41, 0x20 };
+  auto call = [](Bytes arguments, bool drop) {
+    arguments.insert(arguments.end(), { 0x10, 0x00 });
+    if (drop)
+      arguments.push_back(0x1a);
+    return arguments;
+  };
+  auto concat = [](vector<Bytes> const& parts) {
+    Bytes ret;
+    for (auto const& part: parts)
+      ret.insert(ret.end(), part.begin(), part.end());
+    return ret;
+  };
+
+  vector<Benchmark> ret;
+  for (char const* name: { "getAddress", "getCaller", "getCallValue", "getTxOrigin", "getBlockCoinbase", "getBlockDifficulty", "getTxGasPrice" })
+    ret.push_back({ name, true, call(zero, false), { { I32 }, {} } });
+  for (char const* name: { "getCallDataSize", "getCodeSize", "getReturnDataSize" })
+    ret.push_back({ name, true, call({}, true), { {}, { I32 } } });
+  for (char const* name: { "getGasLeft", "getBlockNumber", "getBlockTimestamp", "getBlockGasLimit" })
+    ret.push_back({ name, true, call({}, true), { {}, { I64 } } });
+  ret.push_back({ "getExternalCodeSize", true, call(zero, true), { { I32 }, { I32 } } });
+  ret.push_back({ "getExternalBalance", true, call(concat({ zero, zero }), false), { { I32, I32 }, {} } });
+  ret.push_back({ "getBlockHash", true, call({ 0x42, 0x00, 0x41, 0x00 }, true), { { I64, I32 }, { I32 } } });
+  ret.push_back({ "storageLoad", true, call(concat({ zero, length }), false), { { I32, I32 }, {} } });
+  ret.push_back({ "storageStore", true, call(concat({ zero, length }), false), { { I32, I32 }, {} } });
+  ret.push_back({ "callDataCopy", true, call(concat({ zero, zero, length }), false), { { I32, I32, I32 }, {} } });
+  ret.push_back({ "codeCopy", true, call(concat({ zero, zero, length }), false), { { I32, I32, I32 }, {} } });
+  ret.push_back({ "useGas", true, call({ 0x42, 0x01 }, false), { { I64 }, {} } });
+  ret.push_back({ "log", true, call(concat({ zero, length, zero, zero, zero, zero, zero }), false), { { I32, I32, I32, I32, I32, I32, I32 }, {} } });
+  return ret;
+}
+
+/*
+ * Host
+ */
+
+// Serves a single account with empty state, except for its storage.
+class CalibrationHost : public BenchmarkHost {
+protected:
+  evmc_bytes32 getStorage(evmc_address const&, evmc_bytes32 const& key) override
+  {
+    auto it = m_storage.find(key);
+    return it != m_storage.end() ? it->second : evmc_bytes32{};
+  }
+
+  evmc_storage_status setStorage(evmc_address const&, evmc_bytes32 const& key, evmc_bytes32 const& value) override
+  {
+    evmc_bytes32& current = m_storage[key];
+    if (current == value)
+      return EVMC_STORAGE_UNCHANGED;
+    current = value;
+    return EVMC_STORAGE_MODIFIED;
+  }
+
+private:
+  map<evmc_bytes32, evmc_bytes32> m_storage;
+};
+
+/*
+ * Measurement
+ */
+
+struct Measurement {
+  // Per execution.
+  double nanoseconds = 0;
+  int64_t gasUsed = 0;
+  // By instruction class and EEI method.
+  map<string, uint64_t> instructions;
+  map<string, uint64_t> eeiCalls;
+};
+
+const uint8_t callData[32] = {};
+
+evmc_message benchmarkMessage()
+{
+  evmc_message msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.kind = EVMC_CALL;
+  msg.gas = gasLimit;
+  msg.input_data = callData;
+  msg.input_size = sizeof(callData);
+  return msg;
+}
+
+// Reads the counters of an object of a line written by the "instrument" option.
+map<string, uint64_t> parseCounts(string const& line, string const& object)
+{
+  map<string, uint64_t> ret;
+  size_t pos = line.find("\"" + object + "\":{");
+  if (pos == string::npos)
+    return ret;
+  size_t end = line.find('}', pos);
+  pos = line.find('{', pos);
+  while ((pos = line.find('"', pos + 1)) < end) {
+    size_t close = line.find('"', pos + 1);
+    ret[line.substr(pos + 1, close - pos - 1)] = strtoull(line.c_str() + close + 2, nullptr, 10);
+    pos = close;
+  }
+  return ret;
+}
+
+bool execute(evmc_instance* vm, Bytes const& code, int64_t& gasUsed, double& nanoseconds)
+{
+  CalibrationHost host;
+  evmc_message msg = benchmarkMessage();
+  auto start = chrono::steady_clock::now();
+  evmc_result result = vm->execute(vm, &host, EVMC_BYZANTIUM, &msg, code.data(), code.size());
+  nanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+  gasUsed = gasLimit - result.gas_left;
+  bool success = result.status_code == EVMC_SUCCESS;
+  evmc_release_result(&result);
+  return success;
+}
+
+bool measure(evmc_instance* vm, evmc_instance* counter, string const& statsPath, Bytes const& code, unsigned repeat, Measurement& out)
+{
+  double nanoseconds;
+  if (!execute(counter, code, out.gasUsed, nanoseconds))
+    return false;
+  ifstream in(statsPath);
+  string line;
+  string last;
+  while (getline(in, line))
+    if (!line.empty())
+      last = line;
+  out.instructions = parseCounts(last, "wasm");
+  out.eeiCalls = parseCounts(last, "eei");
+
+  out.nanoseconds = numeric_limits<double>::max();
+  for (unsigned run = 0; run < repeat; ++run) {
+    if (!execute(vm, code, out.gasUsed, nanoseconds))
+      return false;
+    out.nanoseconds = min(out.nanoseconds, nanoseconds);
+  }
+  return true;
+}
+
+uint64_t countDelta(map<string, uint64_t> const& counts, map<string, uint64_t> const& baseline, string const& key)
+{
+  auto it = counts.find(key);
+  uint64_t count = it != counts.end() ? it->second : 0;
+  it = baseline.find(key);
+  uint64_t base = it != baseline.end() ? it->second : 0;
+  return count > base ? count - base : 0;
+}
+
+int usage(char const* name)
+{
+  cerr << "Usage: " << name << " [options] [<hera option>=<value>...]\n"
+       << "\n"
+       << "  --iterations <n>     loop iterations per benchmark (default 10000)\n"
+       << "  --unroll <n>         pattern repetitions per iteration (default 16)\n"
+       << "  --repeat <n>         timed executions per benchmark, the fastest counts (default 5)\n"
+       << "  --schedule <file>    gas per instruction class, as \"<class> <gas>\" lines\n"
+       << "  --only <name>        run the named benchmark only\n"
+       << "\n"
+       << "Hera options are passed to set_option of the timed instance, e.g. engine=wabt.\n";
+  return 2;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t iterations = 10000;
+  unsigned unroll = 16;
+  unsigned repeat = 5;
+  string schedulePath;
+  string only;
+  vector<pair<string, string>> options;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--iterations" && hasValue)
+      iterations = static_cast<uint32_t>(max(1, atoi(argv[++i])));
+    else if (arg == "--unroll" && hasValue)
+      unroll = static_cast<unsigned>(max(1, atoi(argv[++i])));
+    else if (arg == "--repeat" && hasValue)
+      repeat = static_cast<unsigned>(max(1, atoi(argv[++i])));
+    else if (arg == "--schedule" && hasValue)
+      schedulePath = argv[++i];
+    else if (arg == "--only" && hasValue)
+      only = argv[++i];
+    else if (arg.find('=') != string::npos && arg[0] != '-')
+      options.emplace_back(arg.substr(0, arg.find('=')), arg.substr(arg.find('=') + 1));
+    else
+      return usage(argv[0]);
+  }
+
+  map<string, double> schedule;
+  if (!schedulePath.empty()) {
+    ifstream in(schedulePath);
+    if (!in) {
+      cerr << "Cannot open " << schedulePath << "\n";
+      return 2;
+    }
+    string opClass;
+    double gas;
+    while (in >> opClass >> gas)
+      schedule[opClass] = gas;
+  }
+
+  char statsPath[] = "/tmp/hera-calibrate-XXXXXX";
+  int fd = mkstemp(statsPath);
+  if (fd < 0) {
+    cerr << "Cannot create a temporary file\n";
+    return 2;
+  }
+  close(fd);
+
+  evmc_instance* vm = evmc_create_hera();
+  for (auto const& option: options) {
+    if (evmc_set_option(vm, option.first.c_str(), option.second.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+      cerr << "Invalid option: " << option.first << "=" << option.second << "\n";
+      vm->destroy(vm);
+      unlink(statsPath);
+      return 2;
+    }
+  }
+  // Counting is only supported by Binaryen, the counts are the same for every engine.
+  evmc_instance* counter = evmc_create_hera();
+  evmc_set_option(counter, "instrument", statsPath);
+
+  vector<Benchmark> benchmarks = instructionBenchmarks(1);
+  vector<Benchmark> eei = eeiBenchmarks();
+  benchmarks.insert(benchmarks.end(), eei.begin(), eei.end());
+
+  int ret = 0;
+  Measurement baseline;
+  Measurement baselineWithImport;
+  if (!measure(vm, counter, statsPath, buildContract(benchmarks[0], iterations, unroll), repeat, baseline)) {
+    cerr << "The baseline benchmark failed\n";
+    ret = 1;
+  }
+  // The call and table indices shift by one with an import.
+  Benchmark importBaseline = benchmarks[0];
+  importBaseline.eei = true;
+  importBaseline.target = "getGasLeft";
+  importBaseline.import = { {}, { I64 } };
+  if (ret == 0 && !measure(vm, counter, statsPath, buildContract(importBaseline, iterations, unroll), repeat, baselineWithImport)) {
+    cerr << "The baseline benchmark failed\n";
+    ret = 1;
+  }
+
+  if (ret == 0) {
+    cout << left << setw(22) << "benchmark" << right
+         << setw(14) << "count" << setw(12) << "ns/op" << setw(12) << "gas/op" << setw(12) << "ns/gas" << "\n"
+         << fixed;
+  }
+
+  for (size_t i = 1; ret == 0 && i < benchmarks.size(); ++i) {
+    Benchmark const& benchmark = benchmarks[i];
+    if (!only.empty() && benchmark.target != only)
+      continue;
+
+    Measurement measurement;
+    if (!measure(vm, counter, statsPath, buildContract(benchmark, iterations, unroll), repeat, measurement)) {
+      cout << left << setw(22) << benchmark.target << right << setw(14) << "failed" << "\n";
+      ret = 1;
+      continue;
+    }
+
+    Measurement const& base = benchmark.eei ? baselineWithImport : baseline;
+    uint64_t count = benchmark.eei ?
+      countDelta(measurement.eeiCalls, base.eeiCalls, benchmark.target) :
+      countDelta(measurement.instructions, base.instructions, benchmark.target);
+    double gas = 0;
+    if (benchmark.eei)
+      gas = static_cast<double>(measurement.gasUsed - base.gasUsed);
+    else {
+      for (auto const& entry: measurement.instructions) {
+        auto cost = schedule.find(entry.first);
+        gas += static_cast<double>(countDelta(measurement.instructions, base.instructions, entry.first)) * (cost != schedule.end() ? cost->second : 1.0);
+      }
+    }
+    double nanoseconds = max(0.0, measurement.nanoseconds - base.nanoseconds);
+
+    cout << left << setw(22) << benchmark.target << right << setw(14) << count;
+    if (count == 0) {
+      cout << "\n";
+      continue;
+    }
+    cout << setprecision(2) << setw(12) << nanoseconds / count << setw(12) << gas / count;
+    if (gas > 0)
+      cout << setprecision(3) << setw(12) << nanoseconds / gas;
+    cout << "\n";
+  }
+
+  counter->destroy(counter);
+  vm->destroy(vm);
+  unlink(statsPath);
+  return ret;
+}
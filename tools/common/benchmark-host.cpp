@@ -0,0 +1,81 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark-host.h"
+
+#include <cstring>
+
+namespace hera {
+
+namespace {
+
+BenchmarkHost& self(evmc_context* context) { return *static_cast<BenchmarkHost*>(context); }
+
+}
+
+BenchmarkHost::BenchmarkHost(): evmc_context{&interface} {}
+
+bool BenchmarkHost::accountExists(evmc_address const&)
+{
+  return true;
+}
+
+evmc_bytes32 BenchmarkHost::getStorage(evmc_address const&, evmc_bytes32 const&)
+{
+  return {};
+}
+
+evmc_storage_status BenchmarkHost::setStorage(evmc_address const&, evmc_bytes32 const&, evmc_bytes32 const&)
+{
+  return EVMC_STORAGE_UNCHANGED;
+}
+
+evmc_result BenchmarkHost::call(evmc_message const&)
+{
+  evmc_result ret;
+  memset(&ret, 0, sizeof(ret));
+  ret.status_code = EVMC_FAILURE;
+  return ret;
+}
+
+const evmc_host_interface BenchmarkHost::interface = {
+  [](evmc_context* context, evmc_address const* address) {
+    return self(context).accountExists(*address);
+  },
+  [](evmc_context* context, evmc_address const* address, evmc_bytes32 const* key) {
+    return self(context).getStorage(*address, *key);
+  },
+  [](evmc_context* context, evmc_address const* address, evmc_bytes32 const* key, evmc_bytes32 const* value) {
+    return self(context).setStorage(*address, *key, *value);
+  },
+  [](evmc_context*, evmc_address const*) { return evmc_uint256be{}; },
+  [](evmc_context*, evmc_address const*) { return size_t(0); },
+  [](evmc_context*, evmc_address const*) { return evmc_bytes32{}; },
+  [](evmc_context*, evmc_address const*, size_t, uint8_t*, size_t) { return size_t(0); },
+  [](evmc_context*, evmc_address const*, evmc_address const*) {},
+  [](evmc_context* context, evmc_message const* msg) {
+    return self(context).call(*msg);
+  },
+  [](evmc_context*) {
+    evmc_tx_context ret;
+    memset(&ret, 0, sizeof(ret));
+    return ret;
+  },
+  [](evmc_context*, int64_t) { return evmc_bytes32{}; },
+  [](evmc_context*, evmc_address const*, uint8_t const*, size_t, evmc_bytes32 const[], size_t) {},
+};
+
+}
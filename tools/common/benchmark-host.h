@@ -0,0 +1,52 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include <evmc/evmc.h>
+
+namespace hera {
+
+// The gas of benchmark messages, which never runs out.
+const int64_t gasLimit = std::numeric_limits<int64_t>::max() / 2;
+
+// A host of accounts with empty state, which the tools override the parts
+// they need of.
+class BenchmarkHost : public evmc_context {
+public:
+  BenchmarkHost();
+  virtual ~BenchmarkHost() = default;
+
+  BenchmarkHost(BenchmarkHost const&) = delete;
+  BenchmarkHost& operator=(BenchmarkHost const&) = delete;
+
+protected:
+  // Every account exists by default.
+  virtual bool accountExists(evmc_address const& address);
+  virtual evmc_bytes32 getStorage(evmc_address const& address, evmc_bytes32 const& key);
+  // Stores nothing by default.
+  virtual evmc_storage_status setStorage(evmc_address const& address, evmc_bytes32 const& key, evmc_bytes32 const& value);
+  // Calls and creates fail by default.
+  virtual evmc_result call(evmc_message const& msg);
+
+private:
+  static const evmc_host_interface interface;
+};
+
+}
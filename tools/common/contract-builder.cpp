@@ -0,0 +1,60 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "contract-builder.h"
+
+using namespace std;
+
+namespace hera {
+
+void appendUnsigned(Bytes& out, uint64_t value)
+{
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0)
+      byte |= 0x80;
+    out.push_back(byte);
+  } while (value != 0);
+}
+
+void appendSigned(Bytes& out, int64_t value)
+{
+  bool more = true;
+  while (more) {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    more = !((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)));
+    if (more)
+      byte |= 0x80;
+    out.push_back(byte);
+  }
+}
+
+void appendName(Bytes& out, string const& name)
+{
+  appendUnsigned(out, name.size());
+  out.insert(out.end(), name.begin(), name.end());
+}
+
+void appendSection(Bytes& out, uint8_t id, Bytes const& payload)
+{
+  out.push_back(id);
+  appendUnsigned(out, payload.size());
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+}
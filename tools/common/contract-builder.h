@@ -0,0 +1,43 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Helpers for generating the contracts the benchmark tools run.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hera {
+
+using Bytes = std::vector<uint8_t>;
+
+// Wasm value types.
+const uint8_t I32 = 0x7f;
+const uint8_t I64 = 0x7e;
+
+// Appends @value in LEB128.
+void appendUnsigned(Bytes& out, uint64_t value);
+void appendSigned(Bytes& out, int64_t value);
+
+// Appends @name, prefixed by its length.
+void appendName(Bytes& out, std::string const& name);
+
+// Appends the section @id with @payload, prefixed by its length.
+void appendSection(Bytes& out, uint8_t id, Bytes const& payload);
+
+}
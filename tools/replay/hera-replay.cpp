@@ -0,0 +1,343 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a recording made with the "record" option. Every message is
+// executed again with a synthetic host, which answers each callback from the
+// recording and reports where the execution diverges from it.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "exceptions.h"
+#include "host-recording.h"
+
+using namespace std;
+using namespace hera;
+
+namespace {
+
+// Answers the host callbacks of a single frame, in recorded order.
+class ReplayHost : public evmc_context {
+public:
+  explicit ReplayHost(vector<HostEvent> const& events):
+    evmc_context{&interface},
+    m_events(events)
+  {}
+
+  // Empty if the execution issued exactly the recorded callbacks.
+  string divergence() const
+  {
+    if (m_divergence.empty() && m_position != m_events.size())
+      return "only " + to_string(m_position) + " of " + to_string(m_events.size()) + " host callbacks were issued";
+    return m_divergence;
+  }
+
+private:
+  static ReplayHost& self(evmc_context* context) { return *static_cast<ReplayHost*>(context); }
+
+  // Returns the next recorded event if it is of @type and @matches its arguments.
+  template <typename Predicate>
+  HostEvent const* next(HostEventType type, char const* name, Predicate matches)
+  {
+    if (!m_divergence.empty())
+      return nullptr;
+    if (m_position >= m_events.size()) {
+      m_divergence = string("unexpected ") + name + " after the last recorded callback";
+      return nullptr;
+    }
+    HostEvent const& event = m_events[m_position];
+    if (event.type != type || !matches(event)) {
+      m_divergence = string("callback ") + to_string(m_position) + " is " + name + ", which does not match the recording";
+      return nullptr;
+    }
+    ++m_position;
+    return &event;
+  }
+
+  static bool same(evmc_address const& a, evmc_address const& b) { return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0; }
+  static bool same(evmc_bytes32 const& a, evmc_bytes32 const& b) { return memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0; }
+
+  static bool accountExists(evmc_context* context, evmc_address const* address)
+  {
+    HostEvent const* event = self(context).next(HostEventType::AccountExists, "account_exists", [&](HostEvent const& e) {
+      return same(e.address, *address);
+    });
+    return event && event->status;
+  }
+
+  static evmc_bytes32 getStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key)
+  {
+    HostEvent const* event = self(context).next(HostEventType::GetStorage, "get_storage", [&](HostEvent const& e) {
+      return same(e.address, *address) && same(e.key, *key);
+    });
+    return event ? event->value : evmc_bytes32{};
+  }
+
+  static evmc_storage_status setStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key, evmc_bytes32 const* value)
+  {
+    HostEvent const* event = self(context).next(HostEventType::SetStorage, "set_storage", [&](HostEvent const& e) {
+      return same(e.address, *address) && same(e.key, *key) && same(e.value, *value);
+    });
+    return event ? static_cast<evmc_storage_status>(event->status) : EVMC_STORAGE_UNCHANGED;
+  }
+
+  static evmc_uint256be getBalance(evmc_context* context, evmc_address const* address)
+  {
+    HostEvent const* event = self(context).next(HostEventType::GetBalance, "get_balance", [&](HostEvent const& e) {
+      return same(e.address, *address);
+    });
+    return event ? event->value : evmc_uint256be{};
+  }
+
+  static size_t getCodeSize(evmc_context* context, evmc_address const* address)
+  {
+    HostEvent const* event = self(context).next(HostEventType::GetCodeSize, "get_code_size", [&](HostEvent const& e) {
+      return same(e.address, *address);
+    });
+    return event ? static_cast<size_t>(event->size) : 0;
+  }
+
+  static evmc_bytes32 getCodeHash(evmc_context* context, evmc_address const* address)
+  {
+    HostEvent const* event = self(context).next(HostEventType::GetCodeHash, "get_code_hash", [&](HostEvent const& e) {
+      return same(e.address, *address);
+    });
+    return event ? event->value : evmc_bytes32{};
+  }
+
+  static size_t copyCode(evmc_context* context, evmc_address const* address, size_t code_offset, uint8_t* buffer_data, size_t buffer_size)
+  {
+    HostEvent const* event = self(context).next(HostEventType::CopyCode, "copy_code", [&](HostEvent const& e) {
+      return same(e.address, *address) && e.number == static_cast<int64_t>(code_offset) && e.size == buffer_size;
+    });
+    if (!event)
+      return 0;
+    copy(event->data.begin(), event->data.end(), buffer_data);
+    return event->data.size();
+  }
+
+  static void selfDestruct(evmc_context* context, evmc_address const* address, evmc_address const* beneficiary)
+  {
+    self(context).next(HostEventType::SelfDestruct, "selfdestruct", [&](HostEvent const& e) {
+      return same(e.address, *address) && same(e.beneficiary, *beneficiary);
+    });
+  }
+
+  static evmc_result call(evmc_context* context, evmc_message const* msg)
+  {
+    HostEvent const* event = self(context).next(HostEventType::Call, "call", [&](HostEvent const& e) {
+      RecordedMessage const& m = e.message;
+      return m.kind == msg->kind && m.flags == msg->flags && m.depth == msg->depth && m.gas == msg->gas &&
+        same(m.destination, msg->destination) && same(m.sender, msg->sender) && same(m.value, msg->value) &&
+        m.input.size() == msg->input_size && equal(m.input.begin(), m.input.end(), msg->input_data);
+    });
+
+    evmc_result ret;
+    memset(&ret, 0, sizeof(ret));
+    if (!event) {
+      ret.status_code = EVMC_FAILURE;
+      return ret;
+    }
+    ret.status_code = event->result.status;
+    ret.gas_left = event->result.gasLeft;
+    ret.create_address = event->result.createAddress;
+    if (!event->result.output.empty()) {
+      uint8_t* output = new uint8_t[event->result.output.size()];
+      copy(event->result.output.begin(), event->result.output.end(), output);
+      ret.output_data = output;
+      ret.output_size = event->result.output.size();
+      ret.release = [](evmc_result const* result) { delete[] result->output_data; };
+    }
+    return ret;
+  }
+
+  static evmc_tx_context getTxContext(evmc_context* context)
+  {
+    HostEvent const* event = self(context).next(HostEventType::GetTxContext, "get_tx_context", [](HostEvent const&) {
+      return true;
+    });
+    return event ? event->txContext : evmc_tx_context{};
+  }
+
+  static evmc_bytes32 getBlockHash(evmc_context* context, int64_t number)
+  {
+    HostEvent const* event = self(context).next(HostEventType::GetBlockHash, "get_block_hash", [&](HostEvent const& e) {
+      return e.number == number;
+    });
+    return event ? event->value : evmc_bytes32{};
+  }
+
+  static void emitLog(evmc_context* context, evmc_address const* address, uint8_t const* data, size_t data_size, evmc_bytes32 const topics[], size_t topics_count)
+  {
+    self(context).next(HostEventType::EmitLog, "emit_log", [&](HostEvent const& e) {
+      if (!same(e.address, *address) || e.data.size() != data_size || e.topics.size() != topics_count)
+        return false;
+      if (data_size && !equal(e.data.begin(), e.data.end(), data))
+        return false;
+      for (size_t i = 0; i < topics_count; ++i)
+        if (!same(e.topics[i], topics[i]))
+          return false;
+      return true;
+    });
+  }
+
+  static const evmc_host_interface interface;
+
+  vector<HostEvent> const& m_events;
+  size_t m_position = 0;
+  string m_divergence;
+};
+
+const evmc_host_interface ReplayHost::interface = {
+  ReplayHost::accountExists,
+  ReplayHost::getStorage,
+  ReplayHost::setStorage,
+  ReplayHost::getBalance,
+  ReplayHost::getCodeSize,
+  ReplayHost::getCodeHash,
+  ReplayHost::copyCode,
+  ReplayHost::selfDestruct,
+  ReplayHost::call,
+  ReplayHost::getTxContext,
+  ReplayHost::getBlockHash,
+  ReplayHost::emitLog,
+};
+
+char const* kindName(evmc_call_kind kind)
+{
+  switch (kind) {
+  case EVMC_CALL: return "CALL";
+  case EVMC_DELEGATECALL: return "DELEGATECALL";
+  case EVMC_CALLCODE: return "CALLCODE";
+  case EVMC_CREATE: return "CREATE";
+  case EVMC_CREATE2: return "CREATE2";
+  }
+  return "?";
+}
+
+int usage(char const* name)
+{
+  cerr << "Usage: " << name << " [--repeat N] [<option>=<value>...] <recording>\n"
+       << "\n"
+       << "Options are passed to Hera, e.g. engine=wabt or evm1mode=evm2wasm.\n";
+  return 2;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  unsigned repeat = 1;
+  vector<pair<string, string>> options;
+  string path;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--repeat" && i + 1 < argc) {
+      repeat = max(1, atoi(argv[++i]));
+    } else if (arg.find('=') != string::npos) {
+      size_t eq = arg.find('=');
+      options.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+    } else if (path.empty() && arg[0] != '-') {
+      path = arg;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (path.empty())
+    return usage(argv[0]);
+
+  evmc_instance* instance = evmc_create_hera();
+  for (auto const& option: options) {
+    if (evmc_set_option(instance, option.first.c_str(), option.second.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+      cerr << "Invalid option: " << option.first << "=" << option.second << "\n";
+      instance->destroy(instance);
+      return 2;
+    }
+  }
+
+  ifstream in(path, ios::binary);
+  if (!in) {
+    cerr << "Cannot open " << path << "\n";
+    instance->destroy(instance);
+    return 2;
+  }
+
+  unsigned frames = 0;
+  unsigned mismatches = 0;
+  double total = 0;
+
+  try {
+    readRecordingHeader(in);
+
+    RecordedFrame frame;
+    while (readFrame(in, frame)) {
+      evmc_message msg = frame.message.get();
+      string problem;
+      double best = 0;
+
+      for (unsigned run = 0; run < repeat; ++run) {
+        ReplayHost host(frame.events);
+        auto start = chrono::steady_clock::now();
+        evmc_result result = instance->execute(instance, &host, frame.rev, &msg, frame.code.data(), frame.code.size());
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        best = run == 0 ? elapsed : min(best, elapsed);
+
+        if (problem.empty()) {
+          ostringstream error;
+          if (!host.divergence().empty())
+            error << host.divergence();
+          else if (result.status_code != frame.result.status)
+            error << "status " << result.status_code << ", recorded " << frame.result.status;
+          else if (result.gas_left != frame.result.gasLeft)
+            error << "gas left " << result.gas_left << ", recorded " << frame.result.gasLeft;
+          else if (result.output_size != frame.result.output.size() ||
+                   !equal(frame.result.output.begin(), frame.result.output.end(), result.output_data))
+            error << "output differs";
+          problem = error.str();
+        }
+        evmc_release_result(&result);
+      }
+
+      cout << "frame " << frames << ": " << kindName(frame.message.kind) << " depth " << frame.message.depth
+           << " gas " << frame.message.gas << " -> " << frame.result.status << " gas left " << frame.result.gasLeft
+           << " (" << best << " ms) " << (problem.empty() ? "ok" : "MISMATCH: " + problem) << "\n";
+
+      ++frames;
+      total += best;
+      if (!problem.empty())
+        ++mismatches;
+    }
+  } catch (HeraException const& e) {
+    cerr << path << ": " << e.what() << "\n";
+    instance->destroy(instance);
+    return 2;
+  }
+
+  cout << frames << " frames, " << mismatches << " mismatches, " << total << " ms\n";
+  instance->destroy(instance);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,687 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs a single contract through Hera, with the state served from memory.
+//
+// The pre-state is a JSON fixture of the form
+//
+//   {
+//     "accounts": {
+//       "0x<address>": {
+//         "balance": "0x...",
+//         "code": "0x...",
+//         "storage": { "0x<key>": "0x<value>" }
+//       }
+//     },
+//     "block": {
+//       "coinbase": "0x...", "number": 1, "timestamp": 1, "gasLimit": 1, "difficulty": "0x..."
+//     },
+//     "tx": { "origin": "0x...", "gasPrice": "0x..." }
+//   }
+//
+// where every section and field is optional. Calls to accounts with code
+// are executed by the same Hera instance.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+#include <evmc/helpers.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+/*
+ * JSON
+ */
+
+struct JsonValue {
+  enum class Type { Null, Bool, Number, String, Array, Object };
+
+  Type type = Type::Null;
+  bool boolean = false;
+  // The literal of a number, or the contents of a string.
+  string text;
+  vector<JsonValue> array;
+  vector<pair<string, JsonValue>> object;
+
+  JsonValue const* find(string const& key) const
+  {
+    for (auto const& member: object)
+      if (member.first == key)
+        return &member.second;
+    return nullptr;
+  }
+};
+
+class JsonParser {
+public:
+  explicit JsonParser(string const& input): m_input(input) {}
+
+  JsonValue parse()
+  {
+    JsonValue ret = value();
+    skipSpace();
+    if (m_pos != m_input.size())
+      fail("trailing characters");
+    return ret;
+  }
+
+private:
+  [[noreturn]] void fail(string const& what)
+  {
+    throw runtime_error("JSON: " + what + " at offset " + to_string(m_pos));
+  }
+
+  void skipSpace()
+  {
+    while (m_pos < m_input.size() && isspace(static_cast<unsigned char>(m_input[m_pos])))
+      ++m_pos;
+  }
+
+  bool consume(char c)
+  {
+    skipSpace();
+    if (m_pos < m_input.size() && m_input[m_pos] == c) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c)
+  {
+    if (!consume(c))
+      fail(string("expected '") + c + "'");
+  }
+
+  bool literal(char const* word)
+  {
+    size_t length = strlen(word);
+    if (m_input.compare(m_pos, length, word) != 0)
+      return false;
+    m_pos += length;
+    return true;
+  }
+
+  string stringLiteral()
+  {
+    expect('"');
+    string ret;
+    while (m_pos < m_input.size() && m_input[m_pos] != '"') {
+      char c = m_input[m_pos++];
+      if (c == '\\') {
+        if (m_pos >= m_input.size())
+          break;
+        char escaped = m_input[m_pos++];
+        switch (escaped) {
+        case 'n': ret += '\n'; break;
+        case 't': ret += '\t'; break;
+        case 'r': ret += '\r'; break;
+        case 'b': ret += '\b'; break;
+        case 'f': ret += '\f'; break;
+        case 'u': fail("unicode escapes are not supported");
+        default: ret += escaped; break;
+        }
+      } else {
+        ret += c;
+      }
+    }
+    expect('"');
+    return ret;
+  }
+
+  JsonValue value()
+  {
+    skipSpace();
+    if (m_pos >= m_input.size())
+      fail("unexpected end of input");
+
+    JsonValue ret;
+    char c = m_input[m_pos];
+    if (c == '{') {
+      ++m_pos;
+      ret.type = JsonValue::Type::Object;
+      if (consume('}'))
+        return ret;
+      do {
+        skipSpace();
+        string key = stringLiteral();
+        expect(':');
+        ret.object.emplace_back(move(key), value());
+      } while (consume(','));
+      expect('}');
+    } else if (c == '[') {
+      ++m_pos;
+      ret.type = JsonValue::Type::Array;
+      if (consume(']'))
+        return ret;
+      do {
+        ret.array.push_back(value());
+      } while (consume(','));
+      expect(']');
+    } else if (c == '"') {
+      ret.type = JsonValue::Type::String;
+      ret.text = stringLiteral();
+    } else if (literal("true")) {
+      ret.type = JsonValue::Type::Bool;
+      ret.boolean = true;
+    } else if (literal("false")) {
+      ret.type = JsonValue::Type::Bool;
+    } else if (literal("null")) {
+      ret.type = JsonValue::Type::Null;
+    } else if (c == '-' || isdigit(static_cast<unsigned char>(c))) {
+      ret.type = JsonValue::Type::Number;
+      size_t start = m_pos++;
+      while (m_pos < m_input.size() && (isalnum(static_cast<unsigned char>(m_input[m_pos])) || m_input[m_pos] == '.'))
+        ++m_pos;
+      ret.text = m_input.substr(start, m_pos - start);
+    } else {
+      fail("unexpected character");
+    }
+    return ret;
+  }
+
+  string const& m_input;
+  size_t m_pos = 0;
+};
+
+/*
+ * Values
+ */
+
+vector<uint8_t> parseHex(string const& text)
+{
+  string digits = text.compare(0, 2, "0x") == 0 ? text.substr(2) : text;
+  if (digits.size() % 2)
+    digits = "0" + digits;
+  vector<uint8_t> ret;
+  ret.reserve(digits.size() / 2);
+  for (size_t i = 0; i < digits.size(); i += 2) {
+    if (!isxdigit(static_cast<unsigned char>(digits[i])) || !isxdigit(static_cast<unsigned char>(digits[i + 1])))
+      throw runtime_error("Invalid hex string: " + text);
+    ret.push_back(static_cast<uint8_t>(stoul(digits.substr(i, 2), nullptr, 16)));
+  }
+  return ret;
+}
+
+// Parses a hex string into @size bytes, right aligned.
+void parseFixedHex(string const& text, uint8_t* out, size_t size)
+{
+  vector<uint8_t> bytes = parseHex(text);
+  if (bytes.size() > size)
+    throw runtime_error("Value too long: " + text);
+  fill_n(out, size, 0);
+  copy(bytes.begin(), bytes.end(), out + size - bytes.size());
+}
+
+evmc_address parseAddress(string const& text)
+{
+  evmc_address ret;
+  parseFixedHex(text, ret.bytes, sizeof(ret.bytes));
+  return ret;
+}
+
+// Accepts JSON numbers and decimal or hex strings.
+evmc_bytes32 parseWord(JsonValue const& value)
+{
+  evmc_bytes32 ret = {};
+  if (value.text.compare(0, 2, "0x") == 0) {
+    parseFixedHex(value.text, ret.bytes, sizeof(ret.bytes));
+  } else {
+    uint64_t number = stoull(value.text, nullptr, 10);
+    for (unsigned i = 0; i < 8; ++i)
+      ret.bytes[31 - i] = static_cast<uint8_t>(number >> (8 * i));
+  }
+  return ret;
+}
+
+int64_t parseInt64(JsonValue const& value)
+{
+  return static_cast<int64_t>(stoll(value.text, nullptr, 0));
+}
+
+string toHex(uint8_t const* data, size_t size)
+{
+  ostringstream out;
+  out << "0x" << hex << setfill('0');
+  for (size_t i = 0; i < size; ++i)
+    out << setw(2) << static_cast<unsigned>(data[i]);
+  return out.str();
+}
+
+bool isZero(evmc_bytes32 const& value)
+{
+  return all_of(begin(value.bytes), end(value.bytes), [](uint8_t b) { return b == 0; });
+}
+
+/*
+ * State
+ */
+
+struct Account {
+  evmc_uint256be balance = {};
+  vector<uint8_t> code;
+  map<evmc_bytes32, evmc_bytes32> storage;
+};
+
+struct State {
+  map<evmc_address, Account> accounts;
+  evmc_tx_context tx = {};
+};
+
+State loadState(string const& path)
+{
+  ifstream in(path);
+  if (!in)
+    throw runtime_error("Cannot open " + path);
+  string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+  JsonValue root = JsonParser(text).parse();
+
+  State state;
+  if (JsonValue const* accounts = root.find("accounts")) {
+    for (auto const& entry: accounts->object) {
+      Account& account = state.accounts[parseAddress(entry.first)];
+      if (JsonValue const* balance = entry.second.find("balance"))
+        account.balance = parseWord(*balance);
+      if (JsonValue const* code = entry.second.find("code"))
+        account.code = parseHex(code->text);
+      if (JsonValue const* storage = entry.second.find("storage"))
+        for (auto const& slot: storage->object) {
+          JsonValue key;
+          key.text = slot.first;
+          account.storage[parseWord(key)] = parseWord(slot.second);
+        }
+    }
+  }
+  if (JsonValue const* block = root.find("block")) {
+    if (JsonValue const* value = block->find("coinbase"))
+      state.tx.block_coinbase = parseAddress(value->text);
+    if (JsonValue const* value = block->find("number"))
+      state.tx.block_number = parseInt64(*value);
+    if (JsonValue const* value = block->find("timestamp"))
+      state.tx.block_timestamp = parseInt64(*value);
+    if (JsonValue const* value = block->find("gasLimit"))
+      state.tx.block_gas_limit = parseInt64(*value);
+    if (JsonValue const* value = block->find("difficulty"))
+      state.tx.block_difficulty = parseWord(*value);
+  }
+  if (JsonValue const* tx = root.find("tx")) {
+    if (JsonValue const* value = tx->find("origin"))
+      state.tx.tx_origin = parseAddress(value->text);
+    if (JsonValue const* value = tx->find("gasPrice"))
+      state.tx.tx_gas_price = parseWord(*value);
+  }
+  return state;
+}
+
+/*
+ * Host
+ */
+
+// Serves the host interface from a State, executing calls with @vm.
+class MemoryHost : public evmc_context {
+public:
+  MemoryHost(State& state, evmc_instance* vm, evmc_revision rev):
+    evmc_context{&interface},
+    m_state(state),
+    m_vm(vm),
+    m_rev(rev)
+  {}
+
+  size_t logCount() const { return m_logCount; }
+
+private:
+  static MemoryHost& self(evmc_context* context) { return *static_cast<MemoryHost*>(context); }
+
+  Account* find(evmc_address const& address)
+  {
+    auto it = m_state.accounts.find(address);
+    return it != m_state.accounts.end() ? &it->second : nullptr;
+  }
+
+  static bool accountExists(evmc_context* context, evmc_address const* address)
+  {
+    return self(context).find(*address) != nullptr;
+  }
+
+  static evmc_bytes32 getStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key)
+  {
+    Account* account = self(context).find(*address);
+    if (!account)
+      return {};
+    auto it = account->storage.find(*key);
+    return it != account->storage.end() ? it->second : evmc_bytes32{};
+  }
+
+  static evmc_storage_status setStorage(evmc_context* context, evmc_address const* address, evmc_bytes32 const* key, evmc_bytes32 const* value)
+  {
+    MemoryHost& host = self(context);
+    evmc_bytes32 current = getStorage(context, address, key);
+    if (current == *value)
+      return EVMC_STORAGE_UNCHANGED;
+
+    // The value before this execution, to tell first modifications apart.
+    auto& originals = host.m_original[*address];
+    if (!originals.count(*key))
+      originals[*key] = current;
+    bool first = originals[*key] == current;
+
+    host.m_state.accounts[*address].storage[*key] = *value;
+    if (!first)
+      return EVMC_STORAGE_MODIFIED_AGAIN;
+    if (isZero(current))
+      return EVMC_STORAGE_ADDED;
+    if (isZero(*value))
+      return EVMC_STORAGE_DELETED;
+    return EVMC_STORAGE_MODIFIED;
+  }
+
+  static evmc_uint256be getBalance(evmc_context* context, evmc_address const* address)
+  {
+    Account* account = self(context).find(*address);
+    return account ? account->balance : evmc_uint256be{};
+  }
+
+  static size_t getCodeSize(evmc_context* context, evmc_address const* address)
+  {
+    Account* account = self(context).find(*address);
+    return account ? account->code.size() : 0;
+  }
+
+  static evmc_bytes32 getCodeHash(evmc_context*, evmc_address const*)
+  {
+    // Code is not hashed by this host.
+    return {};
+  }
+
+  static size_t copyCode(evmc_context* context, evmc_address const* address, size_t code_offset, uint8_t* buffer_data, size_t buffer_size)
+  {
+    Account* account = self(context).find(*address);
+    if (!account || code_offset >= account->code.size())
+      return 0;
+    size_t length = min(buffer_size, account->code.size() - code_offset);
+    copy_n(account->code.begin() + static_cast<ptrdiff_t>(code_offset), length, buffer_data);
+    return length;
+  }
+
+  static void selfDestruct(evmc_context* context, evmc_address const* address, evmc_address const*)
+  {
+    self(context).m_state.accounts.erase(*address);
+  }
+
+  static evmc_result call(evmc_context* context, evmc_message const* msg)
+  {
+    MemoryHost& host = self(context);
+    evmc_result ret;
+    memset(&ret, 0, sizeof(ret));
+
+    if (msg->kind == EVMC_CREATE || msg->kind == EVMC_CREATE2) {
+      // Contract creation is not supported by this host.
+      ret.status_code = EVMC_FAILURE;
+      return ret;
+    }
+
+    Account* account = host.find(msg->destination);
+    if (!account || account->code.empty()) {
+      ret.status_code = EVMC_SUCCESS;
+      ret.gas_left = msg->gas;
+      return ret;
+    }
+
+    // Copied, as the callee may modify the state.
+    vector<uint8_t> code = account->code;
+    return host.m_vm->execute(host.m_vm, context, host.m_rev, msg, code.data(), code.size());
+  }
+
+  static evmc_tx_context getTxContext(evmc_context* context)
+  {
+    return self(context).m_state.tx;
+  }
+
+  static evmc_bytes32 getBlockHash(evmc_context*, int64_t)
+  {
+    return {};
+  }
+
+  static void emitLog(evmc_context* context, evmc_address const*, uint8_t const*, size_t, evmc_bytes32 const[], size_t)
+  {
+    ++self(context).m_logCount;
+  }
+
+  static const evmc_host_interface interface;
+
+  State& m_state;
+  evmc_instance* m_vm;
+  evmc_revision m_rev;
+  map<evmc_address, map<evmc_bytes32, evmc_bytes32>> m_original;
+  size_t m_logCount = 0;
+};
+
+const evmc_host_interface MemoryHost::interface = {
+  MemoryHost::accountExists,
+  MemoryHost::getStorage,
+  MemoryHost::setStorage,
+  MemoryHost::getBalance,
+  MemoryHost::getCodeSize,
+  MemoryHost::getCodeHash,
+  MemoryHost::copyCode,
+  MemoryHost::selfDestruct,
+  MemoryHost::call,
+  MemoryHost::getTxContext,
+  MemoryHost::getBlockHash,
+  MemoryHost::emitLog,
+};
+
+char const* statusName(evmc_status_code status)
+{
+  switch (status) {
+  case EVMC_SUCCESS: return "success";
+  case EVMC_FAILURE: return "failure";
+  case EVMC_REVERT: return "revert";
+  case EVMC_OUT_OF_GAS: return "out of gas";
+  case EVMC_STATIC_MODE_VIOLATION: return "static mode violation";
+  case EVMC_INVALID_MEMORY_ACCESS: return "invalid memory access";
+  case EVMC_CONTRACT_VALIDATION_FAILURE: return "contract validation failure";
+  case EVMC_ARGUMENT_OUT_OF_RANGE: return "argument out of range";
+  case EVMC_INTERNAL_ERROR: return "internal error";
+  case EVMC_REJECTED: return "rejected";
+  default: return "other";
+  }
+}
+
+int usage(char const* name)
+{
+  cerr << "Usage: " << name << " [options] [<hera option>=<value>...] <contract.wasm>\n"
+       << "\n"
+       << "  --state <file.json>   pre-state fixture\n"
+       << "  --input <hex>         call data\n"
+       << "  --gas <n>             gas limit (default 1000000)\n"
+       << "  --value <hex>         call value\n"
+       << "  --address <hex>       address of the contract\n"
+       << "  --sender <hex>        address of the caller\n"
+       << "  --create              execute as deployment code\n"
+       << "  --rev <name>          byzantium (the only one supported)\n"
+       << "  --repeat <n>          execute n times, each on a fresh copy of the state\n"
+       << "\n"
+       << "Hera options are passed to set_option, e.g. engine=wabt.\n";
+  return 2;
+}
+
+// The phase times Hera reports, in the order they are printed.
+array<uint64_t, 4> phaseNanoseconds(evmc_instance* vm)
+{
+  hera_phase_times times;
+  hera_get_phase_times(vm, &times);
+  return {{times.parse_ns, times.validate_ns, times.instantiate_ns, times.run_ns}};
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  string contractPath;
+  string statePath;
+  string input;
+  string value;
+  string address = "0x0000000000000000000000000000000000001000";
+  string sender;
+  int64_t gas = 1000000;
+  bool create = false;
+  evmc_revision rev = EVMC_BYZANTIUM;
+  unsigned repeat = 1;
+  vector<pair<string, string>> options;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--state" && hasValue)
+      statePath = argv[++i];
+    else if (arg == "--input" && hasValue)
+      input = argv[++i];
+    else if (arg == "--gas" && hasValue)
+      gas = atoll(argv[++i]);
+    else if (arg == "--value" && hasValue)
+      value = argv[++i];
+    else if (arg == "--address" && hasValue)
+      address = argv[++i];
+    else if (arg == "--sender" && hasValue)
+      sender = argv[++i];
+    else if (arg == "--create")
+      create = true;
+    else if (arg == "--rev" && hasValue) {
+      string name = argv[++i];
+      if (name == "byzantium")
+        rev = EVMC_BYZANTIUM;
+      else
+        return usage(argv[0]);
+    } else if (arg == "--repeat" && hasValue)
+      repeat = static_cast<unsigned>(max(1, atoi(argv[++i])));
+    else if (arg.find('=') != string::npos && arg[0] != '-')
+      options.emplace_back(arg.substr(0, arg.find('=')), arg.substr(arg.find('=') + 1));
+    else if (contractPath.empty() && arg[0] != '-')
+      contractPath = arg;
+    else
+      return usage(argv[0]);
+  }
+  if (contractPath.empty())
+    return usage(argv[0]);
+
+  State preState;
+  vector<uint8_t> code;
+  vector<uint8_t> inputData;
+  evmc_message msg;
+  memset(&msg, 0, sizeof(msg));
+
+  try {
+    ifstream in(contractPath, ios::binary);
+    if (!in)
+      throw runtime_error("Cannot open " + contractPath);
+    code.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    if (!statePath.empty())
+      preState = loadState(statePath);
+
+    inputData = parseHex(input);
+    msg.destination = parseAddress(address);
+    if (!sender.empty())
+      msg.sender = parseAddress(sender);
+    if (!value.empty())
+      parseFixedHex(value, msg.value.bytes, sizeof(msg.value.bytes));
+  } catch (exception const& e) {
+    cerr << e.what() << "\n";
+    return 2;
+  }
+
+  msg.kind = create ? EVMC_CREATE : EVMC_CALL;
+  msg.gas = gas;
+  msg.input_data = inputData.data();
+  msg.input_size = inputData.size();
+  if (!create)
+    preState.accounts[msg.destination].code = code;
+
+  evmc_instance* vm = evmc_create_hera();
+  // Set first, so that it can be turned off again.
+  options.insert(options.begin(), make_pair(string("phase-times"), string("true")));
+  for (auto const& option: options) {
+    if (evmc_set_option(vm, option.first.c_str(), option.second.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+      cerr << "Invalid option: " << option.first << "=" << option.second << "\n";
+      vm->destroy(vm);
+      return 2;
+    }
+  }
+
+  // The time each run spent in each phase, nested executions included.
+  vector<array<double, 4>> times;
+  evmc_status_code status = EVMC_SUCCESS;
+  int64_t gasLeft = 0;
+  vector<uint8_t> output;
+  size_t logCount = 0;
+
+  for (unsigned run = 0; run < repeat; ++run) {
+    State state = preState;
+    MemoryHost host(state, vm, rev);
+
+    array<uint64_t, 4> before = phaseNanoseconds(vm);
+    evmc_result result = vm->execute(vm, &host, rev, &msg, code.data(), code.size());
+    array<uint64_t, 4> after = phaseNanoseconds(vm);
+    array<double, 4> phases;
+    for (size_t i = 0; i < phases.size(); ++i)
+      phases[i] = (after[i] - before[i]) / 1e6;
+    times.push_back(phases);
+
+    status = result.status_code;
+    gasLeft = result.gas_left;
+    output.assign(result.output_data, result.output_data + result.output_size);
+    logCount = host.logCount();
+    evmc_release_result(&result);
+  }
+
+  vm->destroy(vm);
+
+  cout << "status: " << statusName(status) << " (" << status << ")\n"
+       << "gas used: " << (gas - gasLeft) << "\n"
+       << "gas left: " << gasLeft << "\n"
+       << "output: " << toHex(output.data(), output.size()) << "\n"
+       << "logs: " << logCount << "\n"
+       << fixed << setprecision(3);
+
+  static char const* const phaseNames[] = {"parse", "validate", "instantiate", "run"};
+  for (size_t i = 0; i < 4; ++i) {
+    double best = times.front()[i];
+    double mean = 0;
+    for (auto const& run: times) {
+      best = min(best, run[i]);
+      mean += run[i] / times.size();
+    }
+    cout << phaseNames[i] << ": first " << times.front()[i] << " ms, min " << best << " ms, mean " << mean << " ms\n";
+  }
+  cout << "over " << repeat << " runs\n";
+
+  return status == EVMC_SUCCESS ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Converts a trace file written with the "evm-trace" option into one JSON
+// line per step, in the format printed by debug::evmTrace in debug builds.
+// Only the topmost EvmTraceRecord::stackItems stack items are available.
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <evmc/instructions.h>
+
+#include "evm-trace.h"
+#include "helpers.h"
+
+using namespace std;
+using namespace hera;
+
+int main(int argc, char** argv)
+{
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " <trace file>\n";
+    return 2;
+  }
+
+  ifstream in(argv[1], ios::binary);
+  EvmTraceFileHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      memcmp(header.magic, evmTraceMagic, sizeof(header.magic)) != 0 ||
+      header.version != evmTraceVersion ||
+      header.recordSize != sizeof(EvmTraceRecord) ||
+      header.capacity == 0) {
+    cerr << argv[1] << ": not a trace file\n";
+    return 2;
+  }
+
+  // Once the ring has wrapped around, only the last capacity records remain.
+  uint64_t end = header.next;
+  uint64_t begin = end > header.capacity ? end - header.capacity : 0;
+  uint64_t skipped = 0;
+
+  ostream& out = cout;
+  EvmTraceRecord record;
+  for (uint64_t sequence = begin; sequence < end; ++sequence) {
+    uint64_t offset = sizeof(header) + (sequence % header.capacity) * sizeof(record);
+    in.seekg(static_cast<streamoff>(offset));
+    if (!in.read(reinterpret_cast<char*>(&record), sizeof(record)) || record.sequence != sequence + 1) {
+      // Torn or overwritten while the trace was being written.
+      ++skipped;
+      continue;
+    }
+
+    const char* const* names = evmc_get_instruction_names_table(static_cast<evmc_revision>(record.revision));
+    const char* name = names ? names[record.opcode] : nullptr;
+
+    out << "{\"depth\":" << record.depth
+        << ",\"gas\":" << record.gas
+        << ",\"gasCost\":" << record.gasCost
+        << ",\"op\":" << (name ? name : "UNDEFINED")
+        << ",\"pc\":" << record.pc
+        << ",\"stack\":[";
+    unsigned items = record.stackSize < EvmTraceRecord::stackItems ? record.stackSize : EvmTraceRecord::stackItems;
+    for (unsigned i = items; i-- > 0;) {
+      out << '"' << toHex(record.stack[i]) << '"';
+      if (i != 0)
+        out << ',';
+    }
+    out << "]}\n";
+  }
+
+  if (begin > 0 || skipped > 0)
+    cerr << "Dropped " << begin << " overwritten and " << skipped << " incomplete records.\n";
+  return 0;
+}
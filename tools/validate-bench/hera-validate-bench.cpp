@@ -0,0 +1,295 @@
+/*
+ * Copyright 2016-2018 Alex Beregszaszi et al.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Compares the latency of deploying a large contract, which is dominated by
+// its validation, with validation on one thread against validation split
+// across threads.
+//
+// The deployed contract is generated with many functions, like the output
+// of evm2wasm, each with a chain of arithmetic and metering calls. It is
+// deployed once as it is and once with a type error in a function in its
+// middle, and both instances must agree on accepting the first and
+// rejecting the second.
+
+#include <hera/hera.h>
+#include <evmc/helpers.h>
+#include <evmc/helpers.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark-host.h"
+#include "contract-builder.h"
+
+using namespace std;
+using namespace hera;
+
+namespace {
+
+/*
+ * Contract generation
+ */
+
+// Builds a contract with the given number of functions besides main, each
+// of @steps arithmetic steps, calling the next. If @broken, the function in
+// the middle returns an i64 instead of an i32.
+Bytes buildContract(uint32_t functions, uint32_t steps, bool broken)
+{
+  Bytes module = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+
+  // Type 0 is main, type 1 is useGas(i64), type 2 is (i32) -> i32.
+  appendSection(module, 1, { 0x03, 0x60, 0x00, 0x00, 0x60, 0x01, I64, 0x00, 0x60, 0x01, I32, 0x01, I32 });
+
+  Bytes imports = { 0x01 };
+  appendName(imports, "ethereum");
+  appendName(imports, "useGas");
+  imports.insert(imports.end(), { 0x00, 0x01 });
+  appendSection(module, 2, imports);
+
+  // Function 0 is the import, 1 is main, 2.. are the generated ones.
+  Bytes declarations;
+  appendUnsigned(declarations, functions + 1);
+  declarations.push_back(0x00);
+  for (uint32_t i = 0; i < functions; ++i)
+    declarations.push_back(0x02);
+  appendSection(module, 3, declarations);
+
+  appendSection(module, 5, { 0x01, 0x00, 0x01 });
+
+  Bytes exports = { 0x02 };
+  appendName(exports, "main");
+  exports.insert(exports.end(), { 0x00, 0x01 });
+  appendName(exports, "memory");
+  exports.insert(exports.end(), { 0x02, 0x00 });
+  appendSection(module, 7, exports);
+
+  Bytes code;
+  appendUnsigned(code, functions + 1);
+
+  // main: drop(f2(0))
+  Bytes main = { 0x00, 0x41, 0x00, 0x10, 0x02, 0x1a, 0x0b };
+  appendUnsigned(code, main.size());
+  code.insert(code.end(), main.begin(), main.end());
+
+  for (uint32_t i = 0; i < functions; ++i) {
+    Bytes body = { 0x01, 0x01, I32 };
+    for (uint32_t step = 0; step < steps; ++step) {
+      // local1 = local0 * (step + 1); local0 = local1 + local0
+      body.insert(body.end(), { 0x20, 0x00, 0x41 });
+      appendSigned(body, step + 1);
+      body.insert(body.end(), { 0x6c, 0x21, 0x01, 0x20, 0x01, 0x20, 0x00, 0x6a, 0x21, 0x00 });
+      if (step % 8 == 7) {
+        body.push_back(0x42);
+        appendSigned(body, 8);
+        body.insert(body.end(), { 0x10, 0x00 });
+      }
+    }
+    if (broken && i == functions / 2)
+      body.insert(body.end(), { 0x42, 0x00 });
+    else
+      body.insert(body.end(), { 0x20, 0x00 });
+    if (i + 1 < functions) {
+      body.push_back(0x10);
+      appendUnsigned(body, i + 3);
+    }
+    body.push_back(0x0b);
+    appendUnsigned(code, body.size());
+    code.insert(code.end(), body.begin(), body.end());
+  }
+  appendSection(module, 10, code);
+
+  return module;
+}
+
+// Builds init code returning @contract.
+Bytes buildDeployer(Bytes const& contract)
+{
+  Bytes module = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+
+  // Type 0 is main, type 1 is finish(i32, i32).
+  appendSection(module, 1, { 0x02, 0x60, 0x00, 0x00, 0x60, 0x02, I32, I32, 0x00 });
+
+  Bytes imports = { 0x01 };
+  appendName(imports, "ethereum");
+  appendName(imports, "finish");
+  imports.insert(imports.end(), { 0x00, 0x01 });
+  appendSection(module, 2, imports);
+
+  appendSection(module, 3, { 0x01, 0x00 });
+
+  Bytes memory = { 0x01, 0x00 };
+  appendUnsigned(memory, contract.size() / 65536 + 1);
+  appendSection(module, 5, memory);
+
+  Bytes exports = { 0x02 };
+  appendName(exports, "main");
+  exports.insert(exports.end(), { 0x00, 0x01 });
+  appendName(exports, "memory");
+  exports.insert(exports.end(), { 0x02, 0x00 });
+  appendSection(module, 7, exports);
+
+  Bytes main = { 0x00, 0x41, 0x00, 0x41 };
+  appendSigned(main, static_cast<int32_t>(contract.size()));
+  main.insert(main.end(), { 0x10, 0x00, 0x0b });
+  Bytes code = { 0x01 };
+  appendUnsigned(code, main.size());
+  code.insert(code.end(), main.begin(), main.end());
+  appendSection(module, 10, code);
+
+  Bytes data = { 0x01, 0x00, 0x41, 0x00, 0x0b };
+  appendUnsigned(data, contract.size());
+  data.insert(data.end(), contract.begin(), contract.end());
+  appendSection(module, 11, data);
+
+  return module;
+}
+
+/*
+ * Measurement
+ */
+
+using Clock = chrono::steady_clock;
+
+// Deploys @deployer and returns the status and the seconds taken.
+pair<evmc_status_code, double> deploy(evmc_instance* vm, Bytes const& deployer)
+{
+  BenchmarkHost host;
+  evmc_message msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.kind = EVMC_CREATE;
+  msg.gas = gasLimit;
+
+  auto start = Clock::now();
+  evmc_result result = vm->execute(vm, &host, EVMC_BYZANTIUM, &msg, deployer.data(), deployer.size());
+  double seconds = chrono::duration<double>(Clock::now() - start).count();
+  evmc_status_code status = result.status_code;
+  evmc_release_result(&result);
+  return make_pair(status, seconds);
+}
+
+// The fastest of @repeat deployments, or a negative value if they did not
+// all end with @expected.
+double measure(evmc_instance* vm, Bytes const& deployer, unsigned repeat, evmc_status_code expected)
+{
+  double best = numeric_limits<double>::max();
+  for (unsigned i = 0; i < repeat; ++i) {
+    pair<evmc_status_code, double> result = deploy(vm, deployer);
+    if (result.first != expected)
+      return -1;
+    best = min(best, result.second);
+  }
+  return best;
+}
+
+int usage(char const* name)
+{
+  cerr << "Usage: " << name << " [options] [<hera option>=<value>...]\n"
+       << "\n"
+       << "  --functions <n>   functions of the deployed contract (default 5000)\n"
+       << "  --steps <n>       arithmetic steps per function (default 32)\n"
+       << "  --threads <n>     validation threads, 0 for one per core (default 0)\n"
+       << "  --repeat <n>      deployments timed, the fastest is reported (default 5)\n"
+       << "\n"
+       << "Hera options are passed to set_option of both instances.\n";
+  return 2;
+}
+
+evmc_instance* createVM(vector<pair<string, string>> const& options, string const& threads)
+{
+  evmc_instance* vm = evmc_create_hera();
+  for (auto const& option: options) {
+    if (evmc_set_option(vm, option.first.c_str(), option.second.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+      cerr << "Invalid option: " << option.first << "=" << option.second << "\n";
+      vm->destroy(vm);
+      return nullptr;
+    }
+  }
+  if (evmc_set_option(vm, "validation-threads", threads.c_str()) != EVMC_SET_OPTION_SUCCESS) {
+    cerr << "Invalid thread count: " << threads << "\n";
+    vm->destroy(vm);
+    return nullptr;
+  }
+  return vm;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t functions = 5000;
+  uint32_t steps = 32;
+  string threads = "0";
+  unsigned repeat = 5;
+  vector<pair<string, string>> options;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--functions" && hasValue)
+      functions = static_cast<uint32_t>(max(1, atoi(argv[++i])));
+    else if (arg == "--steps" && hasValue)
+      steps = static_cast<uint32_t>(max(1, atoi(argv[++i])));
+    else if (arg == "--threads" && hasValue)
+      threads = argv[++i];
+    else if (arg == "--repeat" && hasValue)
+      repeat = static_cast<unsigned>(max(1, atoi(argv[++i])));
+    else if (arg.find('=') != string::npos && arg[0] != '-')
+      options.emplace_back(arg.substr(0, arg.find('=')), arg.substr(arg.find('=') + 1));
+    else
+      return usage(argv[0]);
+  }
+
+  evmc_instance* sequential = createVM(options, "1");
+  evmc_instance* parallel = sequential ? createVM(options, threads) : nullptr;
+  if (!parallel) {
+    if (sequential)
+      sequential->destroy(sequential);
+    return 2;
+  }
+
+  Bytes contract = buildContract(functions, steps, false);
+  Bytes valid = buildDeployer(contract);
+  Bytes invalid = buildDeployer(buildContract(functions, steps, true));
+
+  // Both must accept the contract and reject the broken one alike.
+  evmc_status_code rejected = deploy(sequential, invalid).first;
+  bool agree = rejected != EVMC_SUCCESS && deploy(parallel, invalid).first == rejected;
+
+  double one = agree ? measure(sequential, valid, repeat, EVMC_SUCCESS) : -1;
+  double many = one < 0 ? -1 : measure(parallel, valid, repeat, EVMC_SUCCESS);
+  sequential->destroy(sequential);
+  parallel->destroy(parallel);
+  if (!agree || one < 0 || many < 0) {
+    cerr << "Validation results differ or deployment failed\n";
+    return 1;
+  }
+
+  cout << functions << " functions, " << contract.size() << " bytes\n"
+       << fixed << setprecision(2)
+       << left << setw(12) << "sequential" << right << setw(10) << one * 1000 << " ms\n"
+       << left << setw(12) << "parallel" << right << setw(10) << many * 1000 << " ms\n"
+       << "speedup " << one / many << "x\n";
+  return 0;
+}